@@ -0,0 +1,149 @@
+#include "auto_tune.h"
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "path_mtu.h"
+#include "video_chunking.h"
+
+namespace auto_tune {
+    static const double FPS_TOLERANCE = 0.02;   // Rates this close count as the same
+
+    static bool better(const video_load::Result& candidate, const video_load::Result& best) {
+        if (candidate.fps_per_stream > best.fps_per_stream * (1 + FPS_TOLERANCE)) {
+            return true;
+        }
+        return candidate.fps_per_stream >= best.fps_per_stream * (1 - FPS_TOLERANCE) &&
+               candidate.latency_p99_ms < best.latency_p99_ms;
+    }
+
+    static Trial run_trial(const std::string& setting, const std::string& value, const video_load::Options& load) {
+        Trial trial;
+        trial.setting = setting;
+        trial.value = value;
+        trial.result = video_load::run(load);
+        std::cout << setting << " " << value << ": " << std::fixed << std::setprecision(1)
+                  << trial.result.fps_per_stream << " fps, " << trial.result.completion_rate * 100
+                  << "% frames complete, p99 " << trial.result.latency_p99_ms << " ms\n";
+        return trial;
+    }
+
+    // One trial per value, through apply(index); the best value is left applied
+    static size_t sweep(const std::string& setting, const std::vector<std::string>& values,
+                        const std::function<void(size_t)>& apply, const video_load::Options& load,
+                        std::vector<Trial>& trials) {
+        size_t first = trials.size();
+        size_t best = first;
+        for (size_t i = 0; i < values.size(); i++) {
+            apply(i);
+            trials.push_back(run_trial(setting, values[i], load));
+            if (trials.size() - 1 != first && better(trials.back().result, trials[best].result)) {
+                best = trials.size() - 1;
+            }
+        }
+        trials[best].chosen = true;
+        apply(best - first);
+        return best - first;
+    }
+
+    template <typename T>
+    static std::vector<std::string> names(const std::vector<T>& values) {
+        std::vector<std::string> result;
+        for (const T& value : values) {
+            result.push_back(std::to_string(value));
+        }
+        return result;
+    }
+
+    static std::string rate_name(double bits_per_second) {
+        if (bits_per_second <= 0) {
+            return "off";
+        }
+        std::ostringstream name;
+        name << bits_per_second / 1e6 << "M";
+        return name.str();
+    }
+
+    std::vector<Trial> run(const Options& options, video_config::Settings& settings) {
+        video_load::Options load = options.load;
+        load.fps = settings.target_fps;
+        load.jpeg_quality = settings.max_quality;
+        load.send_buffer = settings.send_buffer;
+        load.receive_buffer = settings.receive_buffer;
+        load.pacing_rate = settings.pacing_rate;
+
+        std::vector<size_t> chunk_sizes = options.chunk_sizes;
+        if (chunk_sizes.empty()) {
+            chunk_sizes = { path_mtu::chunk_size(1500, video_chunking::HEADER_SIZE),
+                            path_mtu::chunk_size(9000, video_chunking::HEADER_SIZE), 58000 };
+        }
+
+        std::vector<Trial> trials;
+        sweep("max_chunk_size", names(chunk_sizes),
+            [&](size_t i) { load.max_chunk_size = chunk_sizes[i]; }, load, trials);
+        sweep("send_buffer", names(options.send_buffers),
+            [&](size_t i) { load.send_buffer = static_cast<int>(options.send_buffers[i]); }, load, trials);
+        sweep("receive_buffer", names(options.receive_buffers),
+            [&](size_t i) { load.receive_buffer = static_cast<int>(options.receive_buffers[i]); }, load, trials);
+        std::vector<std::string> rates;
+        for (double rate : options.pacing_rates) {
+            rates.push_back(rate_name(rate));
+        }
+        sweep("pacing_rate", rates, [&](size_t i) { load.pacing_rate = options.pacing_rates[i]; }, load, trials);
+
+        // Highest first; the first to keep up is the one
+        std::vector<int> qualities = options.qualities;
+        std::sort(qualities.rbegin(), qualities.rend());
+        for (int quality : qualities) {
+            load.jpeg_quality = quality;
+            trials.push_back(run_trial("max_quality", std::to_string(quality), load));
+            const video_load::Result& result = trials.back().result;
+            if (result.fps_per_stream >= options.min_ratio * load.fps && result.completion_rate >= options.min_ratio) {
+                break;
+            }
+        }
+        trials.back().chosen = true;
+
+        settings.max_chunk_size = load.max_chunk_size;
+        settings.send_buffer = load.send_buffer;
+        settings.receive_buffer = load.receive_buffer;
+        settings.pacing_rate = load.pacing_rate;
+        settings.max_quality = load.jpeg_quality;
+        settings.min_quality = std::min(settings.min_quality, settings.max_quality);
+        return trials;
+    }
+
+    std::string to_json(const std::vector<Trial>& trials) {
+        std::ostringstream json;
+        json << std::fixed << std::setprecision(3);
+        json << "{\n  \"trials\": [";
+        for (size_t i = 0; i < trials.size(); i++) {
+            const Trial& t = trials[i];
+            const video_load::Result& r = t.result;
+            json << (i ? ",\n" : "\n")
+                 << "    {\"setting\": \"" << t.setting << "\", \"value\": \"" << t.value << "\""
+                 << ", \"chosen\": " << (t.chosen ? "true" : "false")
+                 << ", \"fps_per_stream\": " << r.fps_per_stream << ", \"completion_rate\": " << r.completion_rate
+                 << ", \"chunk_loss\": " << r.chunk_loss
+                 << ", \"latency_ms\": {\"p50\": " << r.latency_p50_ms << ", \"p99\": " << r.latency_p99_ms << "}"
+                 << ", \"cpu_ms_per_frame\": " << r.cpu_ms_per_frame << "}";
+        }
+        json << "\n  ]\n}\n";
+        return json.str();
+    }
+
+    void print_table(const std::vector<Trial>& trials) {
+        std::cout << std::setw(16) << "setting" << std::setw(10) << "value" << std::setw(10) << "fps"
+                  << std::setw(11) << "complete%" << std::setw(13) << "chunk loss%" << std::setw(10) << "p50 ms"
+                  << std::setw(10) << "p99 ms" << std::setw(13) << "CPU ms/frame" << "\n";
+        std::cout << std::fixed << std::setprecision(2);
+        for (const Trial& t : trials) {
+            const video_load::Result& r = t.result;
+            std::cout << std::setw(16) << t.setting << std::setw(10) << t.value << std::setw(10) << r.fps_per_stream
+                      << std::setw(11) << r.completion_rate * 100 << std::setw(13) << r.chunk_loss * 100
+                      << std::setw(10) << r.latency_p50_ms << std::setw(10) << r.latency_p99_ms
+                      << std::setw(13) << r.cpu_ms_per_frame << (t.chosen ? "  *" : "") << "\n";
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#include "chunk_loss.h"
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include "path_mtu.h"
+#include "video_chunking.h"
+
+namespace chunk_loss {
+    size_t fragment_count(size_t udp_payload, size_t mtu) {
+        // Every fragment but the last carries a multiple of 8 bytes after its 20-byte IP header
+        size_t ip_payload = udp_payload + 8;
+        size_t per_fragment = (mtu - 20) / 8 * 8;
+        return (ip_payload + per_fragment - 1) / per_fragment;
+    }
+
+    static Result run_one(const Options& options, size_t chunk_size, double loss_rate) {
+        Result result;
+        result.chunk_size = chunk_size;
+        result.fragments_per_chunk = fragment_count(video_chunking::HEADER_SIZE + chunk_size, options.mtu);
+        result.loss_rate = loss_rate;
+
+        std::mt19937 rng(options.seed);
+        std::bernoulli_distribution lost(loss_rate);
+
+        std::vector<uint8_t> frame(options.frame_size, 0x5A);
+        std::vector<char> datagram(video_chunking::HEADER_SIZE + chunk_size);
+        video_chunking::Reassembler reassembler;
+        std::vector<uint8_t> assembled;
+
+        size_t chunks = video_chunking::chunk_count(options.frame_size, chunk_size);
+        for (uint32_t frame_id = 0; frame_id < options.frames; frame_id++) {
+            for (size_t chunk_id = 0; chunk_id < chunks; chunk_id++) {
+                size_t size = video_chunking::build_chunk(frame_id, frame.data(), frame.size(), chunk_id,
+                    chunk_size, datagram.data());
+                result.chunks_sent++;
+
+                bool arrived = true;
+                for (size_t fragment = 0; fragment < result.fragments_per_chunk; fragment++) {
+                    arrived = !lost(rng) && arrived;
+                }
+                if (!arrived) {
+                    continue;
+                }
+                result.chunks_received++;
+
+                video_chunking::ChunkHeader header;
+                video_chunking::read_header(datagram.data(), size, header);
+                auto status = reassembler.add(header,
+                    reinterpret_cast<const uint8_t*>(datagram.data()) + video_chunking::HEADER_SIZE,
+                    size - video_chunking::HEADER_SIZE);
+                if (status == video_chunking::Reassembler::Status::COMPLETE && reassembler.take(frame_id, assembled)) {
+                    result.frames_completed++;
+                }
+            }
+            result.frames_sent++;
+        }
+
+        result.chunk_loss = 1.0 - static_cast<double>(result.chunks_received) / result.chunks_sent;
+        result.completion_rate = static_cast<double>(result.frames_completed) / result.frames_sent;
+        return result;
+    }
+
+    std::vector<Result> run(const Options& options) {
+        std::vector<size_t> chunk_sizes = options.chunk_sizes;
+        if (chunk_sizes.empty()) {
+            chunk_sizes = { 58000, path_mtu::chunk_size(options.mtu, video_chunking::HEADER_SIZE) };
+        }
+
+        std::vector<Result> results;
+        for (double loss_rate : options.loss_rates) {
+            for (size_t chunk_size : chunk_sizes) {
+                results.push_back(run_one(options, chunk_size, loss_rate));
+            }
+        }
+        return results;
+    }
+
+    std::string to_json(const std::vector<Result>& results) {
+        std::ostringstream json;
+        json << std::fixed << std::setprecision(4);
+        json << "{\n  \"results\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            json << (i ? ",\n" : "\n")
+                 << "    {\"chunk_size\": " << r.chunk_size << ", \"fragments_per_chunk\": " << r.fragments_per_chunk
+                 << ", \"loss_rate\": " << r.loss_rate
+                 << ", \"chunks_sent\": " << r.chunks_sent << ", \"chunks_received\": " << r.chunks_received
+                 << ", \"frames_sent\": " << r.frames_sent << ", \"frames_completed\": " << r.frames_completed
+                 << ", \"chunk_loss\": " << r.chunk_loss << ", \"completion_rate\": " << r.completion_rate << "}";
+        }
+        json << "\n  ]\n}\n";
+        return json.str();
+    }
+
+    void print_table(const std::vector<Result>& results) {
+        std::cout << std::setw(8) << "loss%" << std::setw(12) << "chunk size" << std::setw(11) << "fragments"
+                  << std::setw(13) << "chunk loss%" << std::setw(11) << "complete%" << "\n";
+        std::cout << std::fixed;
+        for (const Result& r : results) {
+            std::cout << std::setprecision(1) << std::setw(8) << r.loss_rate * 100
+                      << std::setw(12) << r.chunk_size << std::setw(11) << r.fragments_per_chunk
+                      << std::setprecision(2) << std::setw(13) << r.chunk_loss * 100
+                      << std::setw(11) << r.completion_rate * 100 << "\n";
+        }
+    }
+}
@@ -0,0 +1,516 @@
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#ifdef _WIN32
+#include <winsock2.h>
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#include "../include/net_bench.h"
+#include "../include/video_bench.h"
+#include "../include/video_load.h"
+#include "../include/chunk_loss.h"
+#include "../include/auto_tune.h"
+#include "../include/packet_fuzz.h"
+#include "../../Client/include/tcp_client.h"
+#include "../../Shared/include/frame_trace.h"
+
+static void print_usage() {
+    std::cout << "Usage:\n";
+    std::cout << "  Bench server [--port N] [--shards N]\n";
+    std::cout << "  Bench client [--host IP] [--port N] [--protocol tcp|udp|both]\n";
+    std::cout << "               [--sizes 64,1024,...] [--streams 1,4,...] [--duration SECONDS]\n";
+    std::cout << "               [--json FILE|-]\n";
+    std::cout << "  Bench video [--min-time SECONDS] [--json FILE|-]\n";
+    std::cout << "  Bench video-alloc [--frames N]\n";
+    std::cout << "  Bench video-fuzz [--iterations N] [--seed N]\n";
+    std::cout << "  Bench video-load [--streams N | --max-streams N] [--duration SECONDS] [--fps F]\n";
+    std::cout << "                   [--resolution WxH] [--encode 0|1] [--decode 0|1] [--transport udp|shm]\n";
+    std::cout << "                   [--payload jpeg|raw|raw-lz4] [--source FILE.mjpeg] [--json FILE|-]\n";
+    std::cout << "  Bench video-loss [--mtu N] [--frame-size BYTES] [--frames N] [--loss 0.001,0.01,...]\n";
+    std::cout << "                   [--chunk-sizes 58000,1428,...] [--json FILE|-]\n";
+    std::cout << "  Bench autotune [--config FILE] [--output FILE] [--duration SECONDS] [--fps F] [--resolution WxH]\n";
+    std::cout << "                 [--streams N] [--loss RATE] [--mtu N] [--json FILE|-]\n";
+    std::cout << "  Bench trace-merge OUTPUT INPUT...\n";
+}
+
+static bool parse_list(const std::string& text, std::vector<size_t>& values) {
+    values.clear();
+    std::istringstream input(text);
+    std::string item;
+    while (std::getline(input, item, ',')) {
+        char* end = nullptr;
+        unsigned long value = std::strtoul(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || value == 0) {
+            return false;
+        }
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+static bool parse_rates(const std::string& text, std::vector<double>& values) {
+    values.clear();
+    std::istringstream input(text);
+    std::string item;
+    while (std::getline(input, item, ',')) {
+        char* end = nullptr;
+        double value = std::strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || value < 0 || value >= 1) {
+            return false;
+        }
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+// Print to stdout for "-", write the file otherwise; nothing when no path was given
+static bool save_json(const std::string& json, const std::string& path) {
+    if (path == "-") {
+        std::cout << "\n" << json;
+    }
+    else if (!path.empty()) {
+        std::ofstream file(path, std::ios::trunc);
+        file << json;
+        if (!file) {
+            std::cerr << "Could not write " << path << "\n";
+            return false;
+        }
+        std::cout << "Results saved to " << path << "\n";
+    }
+    return true;
+}
+
+static int run_server(int argc, char* argv[]) {
+    net_bench::ServerOptions options;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--port") {
+            options.port = static_cast<uint16_t>(std::atoi(argv[i + 1]));
+        }
+        else if (flag == "--shards") {
+            options.udp_shards = static_cast<size_t>(std::atoi(argv[i + 1]));
+        }
+        else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    std::atomic<bool> running{true};
+    bool ok = true;
+    std::thread server([&] { ok = net_bench::run_server(options, running); });
+
+    std::cout << "Press Enter to stop\n";
+    std::string line;
+    std::getline(std::cin, line);
+    running = false;
+    server.join();
+    return ok ? 0 : 1;
+}
+
+static int run_client(int argc, char* argv[]) {
+    net_bench::ClientOptions options;
+    std::string json_path;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        bool valid = true;
+        if (flag == "--host") {
+            options.host = value;
+        }
+        else if (flag == "--port") {
+            options.port = static_cast<uint16_t>(std::atoi(value.c_str()));
+        }
+        else if (flag == "--protocol") {
+            options.tcp = value == "tcp" || value == "both";
+            options.udp = value == "udp" || value == "both";
+            valid = options.tcp || options.udp;
+        }
+        else if (flag == "--sizes") {
+            valid = parse_list(value, options.message_sizes);
+        }
+        else if (flag == "--streams") {
+            valid = parse_list(value, options.stream_counts);
+        }
+        else if (flag == "--duration") {
+            options.duration_s = std::atof(value.c_str());
+            valid = options.duration_s > 0;
+        }
+        else if (flag == "--json") {
+            json_path = value;
+        }
+        else {
+            valid = false;
+        }
+
+        if (!valid) {
+            std::cerr << "Invalid option: " << flag << " " << value << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+
+    std::vector<net_bench::Result> results = net_bench::run_client(options);
+    std::cout << "\n";
+    net_bench::print_table(results);
+    return save_json(net_bench::to_json(results), json_path) ? 0 : 1;
+}
+
+static int run_video(int argc, char* argv[]) {
+    video_bench::Options options;
+    std::string json_path;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        if (flag == "--min-time" && std::atof(value.c_str()) > 0) {
+            options.min_time_s = std::atof(value.c_str());
+        }
+        else if (flag == "--json") {
+            json_path = value;
+        }
+        else {
+            std::cerr << "Invalid option: " << flag << " " << value << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+
+    std::vector<video_bench::Result> results = video_bench::run(options);
+    video_bench::print_table(results);
+    return save_json(video_bench::to_json(results), json_path) ? 0 : 1;
+}
+
+// Fails when the chunking and reassembly path still allocates once warmed up
+static int run_video_alloc(int argc, char* argv[]) {
+    size_t frames = 10000;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--frames" && std::atoi(argv[i + 1]) > 0) {
+            frames = static_cast<size_t>(std::atoi(argv[i + 1]));
+        }
+        else {
+            std::cerr << "Invalid option: " << flag << " " << argv[i + 1] << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+
+    uint64_t allocations = video_bench::steady_state_allocations(video_bench::Options(), frames);
+    std::cout << "Heap allocations over " << frames << " frames after warm-up: " << allocations << "\n";
+    if (allocations > 0) {
+        std::cout << "FAILED: the video buffers are not fully recycled\n";
+        return 1;
+    }
+    std::cout << "OK\n";
+    return 0;
+}
+
+static int run_video_fuzz(int argc, char* argv[]) {
+    packet_fuzz::Options options;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        bool valid = true;
+        if (flag == "--iterations") {
+            options.iterations = std::strtoull(value.c_str(), nullptr, 10);
+            valid = options.iterations > 0;
+        }
+        else if (flag == "--seed") {
+            options.seed = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else {
+            valid = false;
+        }
+
+        if (!valid) {
+            std::cerr << "Invalid option: " << flag << " " << value << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+
+    packet_fuzz::Result result = packet_fuzz::run(options);
+    std::cout << "Fed " << result.datagrams << " datagrams: " << result.headers_accepted << " headers accepted, "
+              << result.chunks_verified << " chunks verified, " << result.frames_completed << " frames completed, "
+              << result.frames_checked << " checked against what was sent\n";
+    if (result.failures > 0) {
+        std::cout << "FAILED " << result.failures << " times, first: " << result.first_failure << "\n";
+        return 1;
+    }
+    std::cout << "OK\n";
+    return 0;
+}
+
+static int run_video_load(int argc, char* argv[]) {
+    video_load::Options options;
+    size_t max_streams = 0;
+    std::string json_path;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        bool valid = true;
+        if (flag == "--streams") {
+            options.streams = static_cast<size_t>(std::atoi(value.c_str()));
+            valid = options.streams > 0;
+        }
+        else if (flag == "--max-streams") {
+            max_streams = static_cast<size_t>(std::atoi(value.c_str()));
+            valid = max_streams > 0;
+        }
+        else if (flag == "--duration") {
+            options.duration_s = std::atof(value.c_str());
+            valid = options.duration_s > 0;
+        }
+        else if (flag == "--fps") {
+            options.fps = std::atof(value.c_str());
+            valid = options.fps > 0;
+        }
+        else if (flag == "--resolution") {
+            char separator = 0;
+            std::istringstream(value) >> options.width >> separator >> options.height;
+            valid = separator == 'x' && options.width > 0 && options.height > 0;
+        }
+        else if (flag == "--encode") {
+            options.encode = value != "0";
+        }
+        else if (flag == "--decode") {
+            options.decode = value != "0";
+        }
+        else if (flag == "--transport") {
+            options.shared_memory = value == "shm";
+            valid = value == "shm" || value == "udp";
+        }
+        else if (flag == "--source") {
+            options.source_file = value;
+        }
+        else if (flag == "--payload") {
+            valid = raw_video::parse_mode(value, options.payload);
+        }
+        else if (flag == "--json") {
+            json_path = value;
+        }
+        else {
+            valid = false;
+        }
+
+        if (!valid) {
+            std::cerr << "Invalid option: " << flag << " " << value << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+    if (options.shared_memory && !options.source_file.empty()) {
+        std::cerr << "--source applies to the udp transport only\n";
+        return 1;
+    }
+    if (options.payload != raw_video::Mode::JPEG && (options.shared_memory || !options.source_file.empty())) {
+        std::cerr << "--payload applies to synthetic frames over udp only\n";
+        return 1;
+    }
+
+    std::vector<video_load::Result> results;
+    if (max_streams > 0) {
+        results = video_load::find_limit(options, max_streams);
+    }
+    else {
+        results.push_back(video_load::run(options));
+    }
+    std::cout << "\n";
+    video_load::print_table(results);
+    return save_json(video_load::to_json(results), json_path) ? 0 : 1;
+}
+
+static int run_video_loss(int argc, char* argv[]) {
+    chunk_loss::Options options;
+    std::string json_path;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        bool valid = true;
+        if (flag == "--mtu") {
+            options.mtu = static_cast<size_t>(std::atoi(value.c_str()));
+            valid = options.mtu >= 576 && options.mtu <= 65535;
+        }
+        else if (flag == "--frame-size") {
+            options.frame_size = static_cast<size_t>(std::atoi(value.c_str()));
+            valid = options.frame_size > 0;
+        }
+        else if (flag == "--frames") {
+            options.frames = static_cast<size_t>(std::atoi(value.c_str()));
+            valid = options.frames > 0;
+        }
+        else if (flag == "--loss") {
+            valid = parse_rates(value, options.loss_rates);
+        }
+        else if (flag == "--chunk-sizes") {
+            valid = parse_list(value, options.chunk_sizes);
+        }
+        else if (flag == "--json") {
+            json_path = value;
+        }
+        else {
+            valid = false;
+        }
+
+        if (!valid) {
+            std::cerr << "Invalid option: " << flag << " " << value << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+
+    std::vector<chunk_loss::Result> results = chunk_loss::run(options);
+    chunk_loss::print_table(results);
+    return save_json(chunk_loss::to_json(results), json_path) ? 0 : 1;
+}
+
+// Sweep the video settings on loopback and write the best ones as a config file for the demos
+static int run_autotune(int argc, char* argv[]) {
+    auto_tune::Options options;
+    options.load.duration_s = 2.0;
+    video_config::Settings settings;
+    std::string config_path;
+    std::string output_path = video_config::DEFAULT_FILE;
+    std::string json_path;
+    double fps = 0;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        bool valid = true;
+        if (flag == "--config") {
+            config_path = value;
+        }
+        else if (flag == "--output") {
+            output_path = value;
+        }
+        else if (flag == "--duration") {
+            options.load.duration_s = std::atof(value.c_str());
+            valid = options.load.duration_s > 0;
+        }
+        else if (flag == "--fps") {
+            fps = std::atof(value.c_str());
+            valid = fps > 0;
+        }
+        else if (flag == "--resolution") {
+            char separator = 0;
+            std::istringstream(value) >> options.load.width >> separator >> options.load.height;
+            valid = separator == 'x' && options.load.width > 0 && options.load.height > 0;
+        }
+        else if (flag == "--streams") {
+            options.load.streams = static_cast<size_t>(std::atoi(value.c_str()));
+            valid = options.load.streams > 0;
+        }
+        else if (flag == "--loss") {
+            options.load.link_loss = std::atof(value.c_str());
+            valid = options.load.link_loss >= 0 && options.load.link_loss < 1;
+        }
+        else if (flag == "--mtu") {
+            options.load.link_mtu = static_cast<size_t>(std::atoi(value.c_str()));
+            valid = options.load.link_mtu >= 576 && options.load.link_mtu <= 65535;
+        }
+        else if (flag == "--json") {
+            json_path = value;
+        }
+        else {
+            valid = false;
+        }
+
+        if (!valid) {
+            std::cerr << "Invalid option: " << flag << " " << value << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+
+    // Tuning starts from the settings in use, so the ones it does not sweep carry over
+    if (config_path.empty() && std::ifstream(video_config::DEFAULT_FILE)) {
+        config_path = video_config::DEFAULT_FILE;
+    }
+    if (!config_path.empty() && !video_config::load(config_path, settings)) {
+        return 1;
+    }
+    if (fps > 0) {
+        settings.target_fps = fps;
+    }
+
+    std::vector<auto_tune::Trial> trials = auto_tune::run(options, settings);
+    std::cout << "\n";
+    auto_tune::print_table(trials);
+    if (!save_json(auto_tune::to_json(trials), json_path)) {
+        return 1;
+    }
+
+    std::cout << "\n";
+    video_config::write(std::cout, settings);
+    if (!video_config::save(output_path, settings)) {
+        return 1;
+    }
+    std::cout << "Settings saved to " << output_path << "\n";
+    return 0;
+}
+
+// Combine the frame traces of the server and client into one timeline
+static int run_trace_merge(int argc, char* argv[]) {
+    if (argc < 4) {
+        print_usage();
+        return 1;
+    }
+
+    std::vector<std::string> inputs(argv + 3, argv + argc);
+    if (!frame_trace::merge(inputs, argv[2])) {
+        return 1;
+    }
+    std::cout << "Trace saved to " << argv[2] << "\n";
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+
+    if (!tcp_client::initialize_winsock()) {
+        return 1;
+    }
+
+    std::string mode = argv[1];
+    int status = 1;
+    if (mode == "server") {
+        status = run_server(argc, argv);
+    }
+    else if (mode == "client") {
+        status = run_client(argc, argv);
+    }
+    else if (mode == "video") {
+        status = run_video(argc, argv);
+    }
+    else if (mode == "video-alloc") {
+        status = run_video_alloc(argc, argv);
+    }
+    else if (mode == "video-fuzz") {
+        status = run_video_fuzz(argc, argv);
+    }
+    else if (mode == "video-load") {
+        status = run_video_load(argc, argv);
+    }
+    else if (mode == "video-loss") {
+        status = run_video_loss(argc, argv);
+    }
+    else if (mode == "autotune") {
+        status = run_autotune(argc, argv);
+    }
+    else if (mode == "trace-merge") {
+        status = run_trace_merge(argc, argv);
+    }
+    else {
+        print_usage();
+    }
+
+    tcp_client::cleanup_winsock();
+    return status;
+}
@@ -0,0 +1,450 @@
+#include "net_bench.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include "tcp_client.h"
+#include "tcp_server.h"
+#include "udp_client.h"
+#include "udp_sharded_server.h"
+
+namespace net_bench {
+    using Clock = std::chrono::steady_clock;
+
+    // First message on a TCP connection selects how the server treats it
+    static const char ECHO_MODE[] = "bench:echo";
+    static const char SINK_MODE[] = "bench:sink";
+    // First byte of every benchmark payload
+    static const char DATA = 'D';
+    static const char SYNC = 'S';   // TCP sink: report what arrived so far
+    static const char ECHO = 'E';   // UDP: send it back
+    static const char BEGIN = 'B';  // UDP: start counting a run
+    static const char REPORT = 'R'; // UDP: report a run's counts
+
+    // UDP datagrams: type, 8-byte run ID, then filler
+    static const size_t UDP_HEADER_SIZE = 1 + 8;
+    static const size_t UDP_MAX_PAYLOAD = 65507;
+    static const size_t UDP_RUN_SLOTS = 64;
+
+    struct UdpRun {
+        std::atomic<uint64_t> id{0};
+        std::atomic<uint64_t> messages{0};
+        std::atomic<uint64_t> bytes{0};
+    };
+
+    static void put_u64(char* out, uint64_t value) {
+        memcpy(out, &value, sizeof(value)); // Both ends run this code: host order is fine
+    }
+
+    static uint64_t get_u64(const char* in) {
+        uint64_t value;
+        memcpy(&value, in, sizeof(value));
+        return value;
+    }
+
+    static double percentile(const std::vector<double>& sorted, double fraction) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    static void serve_tcp(tcp_server::Connection connection) {
+        std::string_view message;
+        if (!connection.receive_message(message)) {
+            return;
+        }
+        bool echo = message == ECHO_MODE;
+
+        uint64_t messages = 0;
+        uint64_t bytes = 0;
+        while (connection.receive_message(message)) {
+            if (echo) {
+                connection.queue_message(message);
+                if (!connection.flush_messages()) break;
+            }
+            else if (!message.empty() && message[0] == SYNC) {
+                std::string reply = std::to_string(messages) + " " + std::to_string(bytes);
+                connection.queue_message(reply);
+                if (!connection.flush_messages()) break;
+            }
+            else {
+                messages++;
+                bytes += message.size();
+            }
+        }
+    }
+
+    static size_t handle_udp(std::array<UdpRun, UDP_RUN_SLOTS>& runs, const char* request, size_t size,
+                             char* reply, size_t capacity) {
+        if (size < UDP_HEADER_SIZE) {
+            return 0;
+        }
+        uint64_t run_id = get_u64(request + 1);
+        UdpRun& run = runs[run_id % UDP_RUN_SLOTS];
+
+        switch (request[0]) {
+            case DATA:
+                if (run.id.load(std::memory_order_relaxed) == run_id) {
+                    run.messages.fetch_add(1, std::memory_order_relaxed);
+                    run.bytes.fetch_add(size, std::memory_order_relaxed);
+                }
+                return 0;
+            case ECHO:
+                memcpy(reply, request, std::min(size, capacity));
+                return std::min(size, capacity);
+            case BEGIN:
+                run.messages = 0;
+                run.bytes = 0;
+                run.id = run_id;
+                memcpy(reply, request, UDP_HEADER_SIZE);
+                return UDP_HEADER_SIZE;
+            case REPORT:
+                memcpy(reply, request, UDP_HEADER_SIZE);
+                put_u64(reply + UDP_HEADER_SIZE, run.messages.load());
+                put_u64(reply + UDP_HEADER_SIZE + 8, run.bytes.load());
+                return UDP_HEADER_SIZE + 16;
+            default:
+                return 0;
+        }
+    }
+
+    bool run_server(const ServerOptions& options, const std::atomic<bool>& running) {
+        tcp_server::Listener listener;
+        if (!listener.start_server(options.port)) {
+            return false;
+        }
+
+        std::array<UdpRun, UDP_RUN_SLOTS> runs;
+        udp_sharded_server::Options udp_options;
+        udp_options.port = options.port;
+        udp_options.shards = options.udp_shards;
+        udp_sharded_server::Server udp;
+        bool started = udp.start(udp_options,
+            [&runs](const char* request, size_t size, const sockaddr_in&, char* reply, size_t capacity) {
+                return handle_udp(runs, request, size, reply, capacity);
+            });
+        if (!started) {
+            return false;
+        }
+
+        std::cout << "Benchmark server ready on port " << options.port << " (TCP and UDP)\n";
+        while (running.load()) {
+            // Short timeout so a stop request is noticed promptly
+            if (!message_framing::wait_readable(listener.handle(), std::chrono::milliseconds(100))) {
+                continue;
+            }
+            tcp_server::Connection connection;
+            if (listener.accept_client(connection)) {
+                // Connection threads only touch their own connection, so they can outlive this loop
+                std::thread(serve_tcp, std::move(connection)).detach();
+            }
+        }
+
+        udp.stop();
+        listener.stop_server();
+        return true;
+    }
+
+    // Runs `streams` copies of `body` in parallel, all released at the same instant.
+    template <typename Body>
+    static void run_streams(size_t streams, Body body) {
+        std::vector<std::thread> threads;
+        Clock::time_point start = Clock::now() + std::chrono::milliseconds(50);
+        for (size_t i = 0; i < streams; i++) {
+            threads.emplace_back([&body, i, start] {
+                std::this_thread::sleep_until(start);
+                body(i, start);
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    static void finish_rates(Result& result) {
+        if (result.duration_s > 0) {
+            result.throughput_mbps = result.bytes * 8.0 / result.duration_s / 1e6;
+            result.messages_per_s = result.messages / result.duration_s;
+        }
+    }
+
+    static void finish_latency(Result& result, std::vector<double>& samples) {
+        std::sort(samples.begin(), samples.end());
+        result.messages = samples.size();
+        result.bytes = samples.size() * result.message_size;
+        result.rtt_p50_us = percentile(samples, 0.50);
+        result.rtt_p90_us = percentile(samples, 0.90);
+        result.rtt_p99_us = percentile(samples, 0.99);
+        result.rtt_p999_us = percentile(samples, 0.999);
+        result.rtt_max_us = samples.empty() ? 0 : samples.back();
+        finish_rates(result);
+    }
+
+    static Result tcp_throughput(const ClientOptions& options, size_t size, size_t streams) {
+        Result result{ "tcp", "throughput", size, streams };
+        std::mutex mutex;
+        Clock::time_point last_end{};
+        auto duration = std::chrono::duration<double>(options.duration_s);
+
+        run_streams(streams, [&](size_t, Clock::time_point start) {
+            tcp_client::Connection connection;
+            if (!connection.connect_to_server(options.host.c_str(), options.port)) {
+                return;
+            }
+            connection.queue_message(SINK_MODE);
+
+            std::string payload(size, 'x');
+            payload[0] = DATA;
+            auto deadline = start + std::chrono::duration_cast<Clock::duration>(duration);
+            bool ok = connection.flush_messages();
+            while (ok && Clock::now() < deadline) {
+                for (size_t i = 0; i < options.tcp_batch; i++) {
+                    connection.queue_message(payload);
+                }
+                ok = connection.flush_messages();
+            }
+
+            // The sync reply arrives after every earlier message was processed by the server
+            std::string_view reply;
+            connection.queue_message(std::string_view(&SYNC, 1));
+            if (!ok || !connection.flush_messages() || !connection.receive_message(reply)) {
+                return;
+            }
+            uint64_t messages = 0;
+            uint64_t bytes = 0;
+            std::istringstream(std::string(reply)) >> messages >> bytes;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            result.messages += messages;
+            result.bytes += bytes;
+            last_end = std::max(last_end, Clock::now());
+            result.duration_s = std::chrono::duration<double>(last_end - start).count();
+        });
+
+        finish_rates(result);
+        return result;
+    }
+
+    static Result tcp_latency(const ClientOptions& options, size_t size, size_t streams) {
+        Result result{ "tcp", "latency", size, streams, options.duration_s };
+        std::mutex mutex;
+        std::vector<double> samples;
+        auto duration = std::chrono::duration<double>(options.duration_s);
+
+        run_streams(streams, [&](size_t, Clock::time_point start) {
+            tcp_client::Connection connection;
+            if (!connection.connect_to_server(options.host.c_str(), options.port)) {
+                return;
+            }
+            connection.queue_message(ECHO_MODE);
+            if (!connection.flush_messages()) {
+                return;
+            }
+
+            std::string payload(size, 'x');
+            std::vector<double> local;
+            auto deadline = start + std::chrono::duration_cast<Clock::duration>(duration);
+            std::string_view reply;
+            while (Clock::now() < deadline) {
+                auto sent = Clock::now();
+                connection.queue_message(payload);
+                if (!connection.flush_messages() || !connection.receive_message(reply)) {
+                    break;
+                }
+                local.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            samples.insert(samples.end(), local.begin(), local.end());
+        });
+
+        finish_latency(result, samples);
+        return result;
+    }
+
+    static uint64_t new_run_id() {
+        static std::mutex mutex;
+        static std::mt19937_64 generator(std::random_device{}());
+        std::lock_guard<std::mutex> lock(mutex);
+        return generator() | 1; // Never 0, which marks a free slot
+    }
+
+    // Send a control datagram until the server answers it (UDP may drop either side)
+    static int udp_request(udp_client::Socket& socket, char type, uint64_t run_id, char* reply, size_t capacity) {
+        char request[UDP_HEADER_SIZE];
+        request[0] = type;
+        put_u64(request + 1, run_id);
+        for (int attempt = 0; attempt < 10; attempt++) {
+            socket.send_datagram(request, sizeof(request));
+            auto deadline = Clock::now() + std::chrono::milliseconds(200);
+            while (Clock::now() < deadline) {
+                int size = socket.receive_datagram(reply, capacity, 50);
+                if (size >= static_cast<int>(UDP_HEADER_SIZE) && reply[0] == type && get_u64(reply + 1) == run_id) {
+                    return size;
+                }
+            }
+        }
+        return -1;
+    }
+
+    static Result udp_throughput(const ClientOptions& options, size_t size, size_t streams) {
+        size = std::min(std::max(size, UDP_HEADER_SIZE), UDP_MAX_PAYLOAD);
+        Result result{ "udp", "throughput", size, streams, options.duration_s };
+        std::mutex mutex;
+        auto duration = std::chrono::duration<double>(options.duration_s);
+
+        run_streams(streams, [&](size_t, Clock::time_point start) {
+            udp_client::Socket socket;
+            if (!socket.create_socket(options.host.c_str(), options.port)) {
+                return;
+            }
+
+            char reply[64];
+            uint64_t run_id = new_run_id();
+            if (udp_request(socket, BEGIN, run_id, reply, sizeof(reply)) < 0) {
+                std::cerr << "UDP benchmark server not answering\n";
+                return;
+            }
+
+            std::string payload(size, 'x');
+            payload[0] = DATA;
+            put_u64(&payload[1], run_id);
+            uint64_t sent = 0;
+            auto deadline = start + std::chrono::duration_cast<Clock::duration>(duration);
+            while (Clock::now() < deadline) {
+                for (int i = 0; i < 64; i++) {
+                    if (socket.send_datagram(payload.data(), payload.size())) {
+                        sent++;
+                    }
+                }
+            }
+
+            // Let queued datagrams drain before asking what arrived
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (udp_request(socket, REPORT, run_id, reply, sizeof(reply)) < static_cast<int>(UDP_HEADER_SIZE + 16)) {
+                return;
+            }
+            uint64_t messages = get_u64(reply + UDP_HEADER_SIZE);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            result.messages += messages;
+            result.bytes += get_u64(reply + UDP_HEADER_SIZE + 8);
+            result.lost += sent > messages ? sent - messages : 0;
+        });
+
+        finish_rates(result);
+        return result;
+    }
+
+    static Result udp_latency(const ClientOptions& options, size_t size, size_t streams) {
+        size = std::min(std::max(size, UDP_HEADER_SIZE), UDP_MAX_PAYLOAD);
+        Result result{ "udp", "latency", size, streams, options.duration_s };
+        std::mutex mutex;
+        std::vector<double> samples;
+        auto duration = std::chrono::duration<double>(options.duration_s);
+
+        run_streams(streams, [&](size_t, Clock::time_point start) {
+            udp_client::Socket socket;
+            if (!socket.create_socket(options.host.c_str(), options.port)) {
+                return;
+            }
+
+            // The run ID field carries a sequence number, so late replies are not mistaken
+            std::string payload(size, 'x');
+            std::vector<char> reply(UDP_MAX_PAYLOAD);
+            payload[0] = ECHO;
+            std::vector<double> local;
+            uint64_t lost = 0;
+            auto deadline = start + std::chrono::duration_cast<Clock::duration>(duration);
+            for (uint64_t sequence = 1; Clock::now() < deadline; sequence++) {
+                put_u64(&payload[1], sequence);
+                auto sent = Clock::now();
+                auto timeout = sent + std::chrono::milliseconds(options.udp_timeout_ms);
+                socket.send_datagram(payload.data(), payload.size());
+
+                bool answered = false;
+                while (!answered && Clock::now() < timeout) {
+                    int wait_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(timeout - Clock::now()).count());
+                    int received = socket.receive_datagram(reply.data(), reply.size(), std::max(wait_ms, 1));
+                    answered = received >= static_cast<int>(UDP_HEADER_SIZE) && get_u64(reply.data() + 1) == sequence;
+                }
+                if (answered) {
+                    local.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+                }
+                else {
+                    lost++;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            samples.insert(samples.end(), local.begin(), local.end());
+            result.lost += lost;
+        });
+
+        finish_latency(result, samples);
+        return result;
+    }
+
+    std::vector<Result> run_client(const ClientOptions& options) {
+        std::vector<Result> results;
+        for (size_t size : options.message_sizes) {
+            for (size_t streams : options.stream_counts) {
+                if (options.tcp) {
+                    results.push_back(tcp_throughput(options, size, streams));
+                    results.push_back(tcp_latency(options, size, streams));
+                }
+                if (options.udp) {
+                    results.push_back(udp_throughput(options, size, streams));
+                    results.push_back(udp_latency(options, size, streams));
+                }
+            }
+        }
+        return results;
+    }
+
+    std::string to_json(const std::vector<Result>& results) {
+        std::ostringstream json;
+        json << std::fixed << std::setprecision(3);
+        json << "{\n  \"results\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            json << (i ? ",\n" : "\n")
+                 << "    {\"protocol\": \"" << r.protocol << "\", \"test\": \"" << r.test << "\""
+                 << ", \"message_size\": " << r.message_size << ", \"streams\": " << r.streams
+                 << ", \"duration_s\": " << r.duration_s << ", \"messages\": " << r.messages
+                 << ", \"bytes\": " << r.bytes << ", \"lost\": " << r.lost
+                 << ", \"throughput_mbps\": " << r.throughput_mbps << ", \"messages_per_s\": " << r.messages_per_s
+                 << ", \"rtt_us\": {\"p50\": " << r.rtt_p50_us << ", \"p90\": " << r.rtt_p90_us
+                 << ", \"p99\": " << r.rtt_p99_us << ", \"p999\": " << r.rtt_p999_us
+                 << ", \"max\": " << r.rtt_max_us << "}}";
+        }
+        json << "\n  ]\n}\n";
+        return json.str();
+    }
+
+    void print_table(const std::vector<Result>& results) {
+        std::cout << std::left << std::setw(6) << "proto" << std::setw(12) << "test"
+                  << std::right << std::setw(8) << "size" << std::setw(8) << "streams"
+                  << std::setw(12) << "Mbit/s" << std::setw(12) << "msg/s" << std::setw(10) << "lost"
+                  << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(10) << "max us" << "\n";
+        std::cout << std::fixed << std::setprecision(1);
+        for (const Result& r : results) {
+            std::cout << std::left << std::setw(6) << r.protocol << std::setw(12) << r.test
+                      << std::right << std::setw(8) << r.message_size << std::setw(8) << r.streams
+                      << std::setw(12) << r.throughput_mbps << std::setw(12) << r.messages_per_s
+                      << std::setw(10) << r.lost;
+            if (r.test == "latency") {
+                std::cout << std::setw(10) << r.rtt_p50_us << std::setw(10) << r.rtt_p99_us << std::setw(10) << r.rtt_max_us;
+            }
+            std::cout << "\n";
+        }
+    }
+}
@@ -0,0 +1,201 @@
+#include "packet_fuzz.h"
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <vector>
+#include "crc32c.h"
+#include "video_chunking.h"
+
+namespace packet_fuzz {
+    enum class Kind { RANDOM, GENUINE, TRUNCATED, CORRUPTED, FORGED, COUNT };
+
+    // Genuine frames are made up from their ID, so a completed one can be checked without
+    // keeping what was sent
+    static void genuine_frame(uint32_t frame_id, size_t max_chunk_size, std::vector<uint8_t>& frame) {
+        frame.resize(1 + (frame_id * 7919u) % (max_chunk_size * 6));
+        for (size_t i = 0; i < frame.size(); i++) {
+            frame[i] = static_cast<uint8_t>(frame_id * 31u + i * 131u);
+        }
+    }
+
+    class Fuzzer {
+    public:
+        Fuzzer(const Options& options)
+            : options(options), rng(options.seed),
+              datagram(video_chunking::HEADER_SIZE + options.max_chunk_size) {
+            for (auto& reassembler : reassemblers) {
+                reassembler = std::make_unique<video_chunking::Reassembler>();
+            }
+            genuine_frame(frame_id, options.max_chunk_size, frame);
+        }
+
+        Result run() {
+            std::uniform_int_distribution<int> kinds(0, static_cast<int>(Kind::COUNT) - 1);
+            for (uint64_t i = 0; i < options.iterations; i++) {
+                Kind kind = static_cast<Kind>(kinds(rng));
+                size_t size = make_datagram(kind);
+                feed(kind, size);
+            }
+            return result;
+        }
+
+    private:
+        uint32_t random(uint32_t max) {
+            return std::uniform_int_distribution<uint32_t>(0, max)(rng);
+        }
+
+        // The next chunk of the current genuine frame, which moves on once all are built
+        size_t next_genuine() {
+            size_t size = video_chunking::build_chunk(frame_id, frame.data(), frame.size(), chunk_id,
+                options.max_chunk_size, datagram.data(), 0, 0, 0, 0, crc32c::value(frame.data(), frame.size()));
+            if (++chunk_id == video_chunking::chunk_count(frame.size(), options.max_chunk_size)) {
+                chunk_id = 0;
+                genuine_frame(++frame_id, options.max_chunk_size, frame);
+            }
+            return size;
+        }
+
+        size_t make_datagram(Kind kind) {
+            switch (kind) {
+                case Kind::RANDOM: {
+                    size_t size = random(static_cast<uint32_t>(datagram.size()));
+                    for (size_t i = 0; i < size; i++) {
+                        datagram[i] = static_cast<char>(random(0xFF));
+                    }
+                    // Mostly with a version and type the parser accepts, to get past them
+                    if (size >= 2 && random(3) != 0) {
+                        datagram[0] = static_cast<char>(video_chunking::VERSION);
+                        datagram[1] = static_cast<char>(video_chunking::PacketType::VIDEO_CHUNK);
+                    }
+                    return size;
+                }
+
+                case Kind::TRUNCATED:
+                    return random(static_cast<uint32_t>(next_genuine() - 1));
+
+                case Kind::CORRUPTED: {
+                    // A burst of up to 32 bits, which CRC-32C always detects
+                    size_t size = next_genuine();
+                    uint32_t length = 1 + random(3);
+                    size_t start = random(static_cast<uint32_t>(size - length));
+                    for (size_t i = start; i < start + length; i++) {
+                        datagram[i] ^= static_cast<char>(1 + random(0xFE));
+                    }
+                    return size;
+                }
+
+                case Kind::FORGED: {
+                    // Near the genuine frames, so forged chunks land in frames being reassembled
+                    size_t size = next_genuine();
+                    namespace wire = video_chunking::wire;
+                    packet_codec::MutableView<wire::Header> header(datagram.data());
+                    header.set<wire::FrameId>(frame_id - 2 + random(4));
+                    if (random(1)) {
+                        header.set<wire::ChunkId>(random(8));
+                    }
+                    if (random(1)) {
+                        header.set<wire::TotalChunks>(random(1) ? random(8) : random(video_chunking::MAX_CHUNKS + 1));
+                    }
+                    if (random(3) == 0) {
+                        header.set<wire::StreamId>(static_cast<uint16_t>(random(video_chunking::MAX_STREAMS)));
+                    }
+                    size = std::max<size_t>(video_chunking::HEADER_SIZE, size - random(8));
+                    uint32_t crc = crc32c::value(reinterpret_cast<const uint8_t*>(datagram.data()), wire::ChunkCrc::offset);
+                    header.set<wire::ChunkCrc>(crc32c::extend(crc, header.payload(), size - video_chunking::HEADER_SIZE));
+                    return size;
+                }
+
+                default:
+                    return next_genuine();
+            }
+        }
+
+        void fail(const std::string& what) {
+            if (result.failures++ == 0) {
+                result.first_failure = what;
+            }
+        }
+
+        // As the client's receive loop
+        void feed(Kind kind, size_t size) {
+            result.datagrams++;
+            video_chunking::ChunkHeader header;
+            if (!video_chunking::read_header(datagram.data(), size, header)) {
+                if (kind == Kind::GENUINE) {
+                    fail("a genuine chunk header was rejected");
+                }
+                return;
+            }
+            result.headers_accepted++;
+            if (size <= video_chunking::HEADER_SIZE || header.total_chunks == 0 ||
+                header.total_chunks > video_chunking::MAX_CHUNKS ||
+                header.stream_id >= video_chunking::MAX_STREAMS || header.layer >= video_chunking::MAX_LAYERS) {
+                std::ostringstream what;
+                what << "a header outside the sanity bounds was accepted: " << size << " bytes, "
+                     << header.total_chunks << " chunks, stream " << header.stream_id << ", layer " << header.layer;
+                fail(what.str());
+                return;
+            }
+
+            bool verified = video_chunking::verify_chunk(datagram.data(), size);
+            if (verified != (kind != Kind::TRUNCATED && kind != Kind::CORRUPTED) && kind != Kind::RANDOM) {
+                fail(verified ? "a damaged chunk passed its CRC check" : "an intact chunk failed its CRC check");
+                return;
+            }
+            if (!verified) {
+                return;
+            }
+            result.chunks_verified++;
+
+            // Frames with a chunk that was not sent as part of them are only checked for not crashing
+            if (kind != Kind::GENUINE && header.stream_id == 0) {
+                tainted.insert(header.frame_id);
+                while (*tainted.begin() + 64 < frame_id) {
+                    tainted.erase(tainted.begin());
+                }
+            }
+
+            video_chunking::Reassembler& reassembler = *reassemblers[header.stream_id];
+            auto status = reassembler.add(header,
+                reinterpret_cast<const uint8_t*>(datagram.data()) + video_chunking::HEADER_SIZE,
+                size - video_chunking::HEADER_SIZE);
+            if (status != video_chunking::Reassembler::Status::COMPLETE) {
+                return;
+            }
+            if (!reassembler.take(header.frame_id, assembled)) {
+                fail("a complete frame could not be taken");
+                return;
+            }
+            result.frames_completed++;
+
+            if (header.stream_id == 0 && !tainted.count(header.frame_id)) {
+                genuine_frame(header.frame_id, options.max_chunk_size, expected);
+                if (!video_chunking::verify_frame(header, assembled.data(), assembled.size()) || assembled != expected) {
+                    std::ostringstream what;
+                    what << "frame " << header.frame_id << " was not reassembled as sent";
+                    fail(what.str());
+                }
+                result.frames_checked++;
+            }
+        }
+
+        const Options& options;
+        std::mt19937 rng;
+        std::vector<char> datagram;
+        std::unique_ptr<video_chunking::Reassembler> reassemblers[video_chunking::MAX_STREAMS];
+        std::vector<uint8_t> assembled;
+        std::vector<uint8_t> expected;
+        std::set<uint32_t> tainted;
+
+        uint32_t frame_id = 1;
+        size_t chunk_id = 0;
+        std::vector<uint8_t> frame;
+        Result result;
+    };
+
+    Result run(const Options& options) {
+        return Fuzzer(options).run();
+    }
+}
@@ -0,0 +1,253 @@
+#include "video_bench.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <opencv2/opencv.hpp>
+#include "video_chunking.h"
+#include "crc32c.h"
+#include "raw_video.h"
+#include "../include/alloc_counter.h"
+
+namespace video_bench {
+    using Clock = std::chrono::steady_clock;
+
+    // Results are folded in here so the compiler cannot drop the measured work
+    static volatile size_t sink = 0;
+
+    template <typename Op>
+    static Result measure(const std::string& stage, const std::string& resolution, size_t bytes_per_op,
+                          double min_time_s, Op op) {
+        op(); // Warm-up: first-touch allocations and caches
+
+        Result result;
+        result.stage = stage;
+        result.resolution = resolution;
+        result.bytes_per_op = bytes_per_op;
+
+        uint64_t batch = 1;
+        double elapsed = 0;
+        auto start = Clock::now();
+        while (elapsed < min_time_s) {
+            for (uint64_t i = 0; i < batch; i++) {
+                op();
+            }
+            result.iterations += batch;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            batch = batch < (1u << 20) ? batch * 2 : batch;
+        }
+
+        result.ns_per_op = elapsed * 1e9 / result.iterations;
+        result.bytes_per_s = bytes_per_op * result.iterations / elapsed;
+        return result;
+    }
+
+    // Smooth gradients with a few hard edges: compresses roughly like a camera frame
+    static cv::Mat synthetic_frame(int width, int height) {
+        cv::Mat frame(height, width, CV_8UC3);
+        for (int y = 0; y < height; y++) {
+            uchar* row = frame.ptr<uchar>(y);
+            for (int x = 0; x < width; x++) {
+                row[3 * x] = static_cast<uchar>(x * 255 / width);
+                row[3 * x + 1] = static_cast<uchar>(y * 255 / height);
+                row[3 * x + 2] = static_cast<uchar>((x ^ y) & 0x3F);
+            }
+        }
+        cv::rectangle(frame, cv::Point(width / 8, height / 8), cv::Point(width / 3, height / 2), cv::Scalar(40, 200, 90), -1);
+        cv::circle(frame, cv::Point(width * 2 / 3, height / 2), height / 4, cv::Scalar(230, 230, 230), 3);
+        return frame;
+    }
+
+    static void run_resolution(const Options& options, const Resolution& size, std::vector<Result>& results) {
+        std::string name = std::to_string(size.width) + "x" + std::to_string(size.height);
+        double min_time = options.min_time_s;
+        cv::Mat frame = synthetic_frame(size.width, size.height);
+        size_t raw_size = frame.total() * frame.elemSize();
+
+        std::vector<int> params = { cv::IMWRITE_JPEG_QUALITY, options.jpeg_quality, cv::IMWRITE_JPEG_OPTIMIZE, 1 };
+        std::vector<uchar> jpeg;
+        cv::imencode(".jpg", frame, jpeg, params);
+
+        results.push_back(measure("imencode", name, raw_size, min_time, [&] {
+            std::vector<uchar> encoded;
+            cv::imencode(".jpg", frame, encoded, params);
+            sink = sink + encoded.size();
+        }));
+
+        results.push_back(measure("imdecode", name, jpeg.size(), min_time, [&] {
+            cv::Mat decoded = cv::imdecode(jpeg, cv::IMREAD_COLOR);
+            sink = sink + static_cast<size_t>(decoded.rows);
+        }));
+
+        // The raw payload path instead of JPEG: YUV420 conversion, and LZ4 in builds that have it
+        std::vector<raw_video::Compression> compressions = { raw_video::Compression::NONE };
+#ifdef HAVE_LZ4
+        compressions.push_back(raw_video::Compression::LZ4);
+#endif
+        for (raw_video::Compression compression : compressions) {
+            std::string suffix = compression == raw_video::Compression::LZ4 ? "_lz4" : "";
+            raw_video::Encoder raw_encoder;
+            raw_video::Decoder raw_decoder;
+            std::vector<uint8_t> payload;
+            raw_encoder.encode(frame, compression, payload);
+            cv::Mat decoded;
+
+            results.push_back(measure("raw_encode" + suffix, name, raw_size, min_time, [&] {
+                raw_encoder.encode(frame, compression, payload);
+                sink = sink + payload.size();
+            }));
+            results.push_back(measure("raw_decode" + suffix, name, payload.size(), min_time, [&] {
+                raw_decoder.decode(payload.data(), payload.size(), decoded);
+                sink = sink + static_cast<size_t>(decoded.rows);
+            }));
+        }
+
+        // Same overlay as the server preview: copy the frame, then draw the stats line
+        cv::Mat display_frame;
+        results.push_back(measure("overlay", name, raw_size, min_time, [&] {
+            frame.copyTo(display_frame);
+            cv::putText(display_frame, "Resolution: 1920x1080 | FPS: 29.9 | Target: 30 | Quality: 85",
+                cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 0), 2);
+            sink = sink + display_frame.data[0];
+        }));
+
+        // Frame integrity: what a sender adds per frame, with and without the crc32 instruction
+        results.push_back(measure("crc32c", name, raw_size, min_time, [&] {
+            sink = sink + crc32c::value(frame.data, raw_size);
+        }));
+        results.push_back(measure("crc32c_portable", name, raw_size, min_time, [&] {
+            sink = sink + crc32c::extend_portable(0, frame.data, raw_size);
+        }));
+
+        size_t chunks = video_chunking::chunk_count(jpeg.size(), options.max_chunk_size);
+        std::vector<char> datagram(video_chunking::HEADER_SIZE + options.max_chunk_size);
+        uint32_t frame_id = 0;
+
+        results.push_back(measure("chunk_header", name, video_chunking::HEADER_SIZE, min_time, [&] {
+            video_chunking::ChunkHeader header;
+            header.frame_id = frame_id++;
+            header.total_chunks = 1;
+            video_chunking::write_header(datagram.data(), header);
+            video_chunking::read_header(datagram.data(), datagram.size(), header);
+            sink = sink + header.frame_id;
+        }));
+
+        // What a receiver needs to route a chunk, read in place instead of into a ChunkHeader
+        results.push_back(measure("header_view", name, video_chunking::HEADER_SIZE, min_time, [&] {
+            packet_codec::MutableView<video_chunking::wire::Header>(datagram.data()).set<video_chunking::wire::FrameId>(frame_id++);
+            packet_codec::View<video_chunking::wire::Header> view(datagram.data());
+            sink = sink + view.get<video_chunking::wire::FrameId>() + view.get<video_chunking::wire::ChunkId>() +
+                   view.get<video_chunking::wire::StreamId>();
+        }));
+
+        results.push_back(measure("chunking", name, jpeg.size(), min_time, [&] {
+            for (size_t chunk_id = 0; chunk_id < chunks; chunk_id++) {
+                sink = sink + video_chunking::build_chunk(frame_id, jpeg.data(), jpeg.size(), chunk_id,
+                    options.max_chunk_size, datagram.data());
+            }
+            frame_id++;
+        }));
+
+        // All datagrams of one frame prepared up front; only insert + scan + concatenate is timed
+        std::vector<std::vector<char>> datagrams(chunks, std::vector<char>(datagram.size()));
+        std::vector<size_t> datagram_sizes(chunks);
+        for (size_t chunk_id = 0; chunk_id < chunks; chunk_id++) {
+            datagram_sizes[chunk_id] = video_chunking::build_chunk(0, jpeg.data(), jpeg.size(), chunk_id,
+                options.max_chunk_size, datagrams[chunk_id].data());
+        }
+        video_chunking::Reassembler reassembler;
+        std::vector<uchar> assembled;
+
+        results.push_back(measure("reassembly", name, jpeg.size(), min_time, [&] {
+            for (size_t chunk_id = 0; chunk_id < chunks; chunk_id++) {
+                video_chunking::ChunkHeader header;
+                video_chunking::read_header(datagrams[chunk_id].data(), datagram_sizes[chunk_id], header);
+                const uchar* data = reinterpret_cast<const uchar*>(datagrams[chunk_id].data()) + video_chunking::HEADER_SIZE;
+                reassembler.add(header, data, datagram_sizes[chunk_id] - video_chunking::HEADER_SIZE);
+            }
+            reassembler.take(0, assembled);
+            sink = sink + assembled.size();
+        }));
+
+        results.push_back(measure("jpeg_end_marker", name, jpeg.size(), min_time, [&] {
+            sink = sink + video_chunking::has_jpeg_end_marker(jpeg.data(), jpeg.size());
+        }));
+    }
+
+    std::vector<Result> run(const Options& options) {
+        std::vector<Result> results;
+        for (const Resolution& resolution : options.resolutions) {
+            run_resolution(options, resolution, results);
+        }
+        return results;
+    }
+
+    uint64_t steady_state_allocations(const Options& options, size_t frames) {
+        // Synthetic payloads stand in for JPEG data: only the buffer handling matters here
+        const size_t MAX_FRAME_SIZE = 400 * 1024;
+        std::vector<uint8_t> frame(MAX_FRAME_SIZE, 0x5A);
+        std::vector<char> datagram(video_chunking::HEADER_SIZE + options.max_chunk_size);
+        std::vector<uchar> assembled;
+        video_chunking::Reassembler reassembler;
+
+        auto stream = [&](uint32_t first_frame_id, size_t count) {
+            for (uint32_t frame_id = first_frame_id; frame_id < first_frame_id + count; frame_id++) {
+                // Sizes cycle between half and full size, so the warm-up sees the largest frame
+                size_t frame_size = MAX_FRAME_SIZE - (frame_id % 64) * (MAX_FRAME_SIZE / 128);
+                size_t chunks = video_chunking::chunk_count(frame_size, options.max_chunk_size);
+                for (size_t chunk_id = 0; chunk_id < chunks; chunk_id++) {
+                    // Lose the last chunk of every seventh frame, leaving it to be evicted
+                    if (frame_id % 7 == 3 && chunk_id == chunks - 1) {
+                        continue;
+                    }
+                    size_t size = video_chunking::build_chunk(frame_id, frame.data(), frame_size, chunk_id,
+                        options.max_chunk_size, datagram.data());
+                    video_chunking::ChunkHeader header;
+                    video_chunking::read_header(datagram.data(), size, header);
+                    auto status = reassembler.add(header,
+                        reinterpret_cast<const uchar*>(datagram.data()) + video_chunking::HEADER_SIZE,
+                        size - video_chunking::HEADER_SIZE);
+                    if (status == video_chunking::Reassembler::Status::COMPLETE) {
+                        reassembler.take(frame_id, assembled);
+                        sink = sink + assembled.size();
+                    }
+                }
+            }
+        };
+
+        // Warm-up until every pooled buffer has grown to its largest size
+        const size_t WARM_UP_FRAMES = 1000;
+        stream(0, WARM_UP_FRAMES);
+
+        uint64_t before = alloc_counter::allocations();
+        stream(WARM_UP_FRAMES, frames);
+        return alloc_counter::allocations() - before;
+    }
+
+    std::string to_json(const std::vector<Result>& results) {
+        std::ostringstream json;
+        json << std::fixed << std::setprecision(1);
+        json << "{\n  \"results\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            json << (i ? ",\n" : "\n")
+                 << "    {\"stage\": \"" << r.stage << "\", \"resolution\": \"" << r.resolution << "\""
+                 << ", \"iterations\": " << r.iterations << ", \"bytes_per_op\": " << r.bytes_per_op
+                 << ", \"ns_per_op\": " << r.ns_per_op << ", \"bytes_per_s\": " << r.bytes_per_s << "}";
+        }
+        json << "\n  ]\n}\n";
+        return json.str();
+    }
+
+    void print_table(const std::vector<Result>& results) {
+        std::cout << std::left << std::setw(17) << "stage" << std::setw(11) << "resolution"
+                  << std::right << std::setw(12) << "iterations" << std::setw(12) << "bytes/op"
+                  << std::setw(14) << "ns/op" << std::setw(12) << "MB/s" << "\n";
+        std::cout << std::fixed << std::setprecision(1);
+        for (const Result& r : results) {
+            std::cout << std::left << std::setw(17) << r.stage << std::setw(11) << r.resolution
+                      << std::right << std::setw(12) << r.iterations << std::setw(12) << r.bytes_per_op
+                      << std::setw(14) << r.ns_per_op << std::setw(12) << r.bytes_per_s / 1e6 << "\n";
+        }
+    }
+}
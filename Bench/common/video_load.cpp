@@ -0,0 +1,483 @@
+#include "video_load.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "udp_client.h"
+#include "udp_server.h"
+#include "video_chunking.h"
+#include "crc32c.h"
+#include "shm_transport.h"
+#include "mjpeg_file.h"
+#include "chunk_loss.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/select.h>
+#endif
+
+namespace video_load {
+    using Clock = std::chrono::steady_clock;
+
+    // Frame production times, indexed by frame_id % SENT_SLOTS: several seconds of frames
+    static const size_t SENT_SLOTS = 1024;
+    static const size_t RECEIVE_BUFFER_SIZE = 262144; // As in the client demo
+
+    struct Stream {
+        std::atomic<int64_t> produced_at[SENT_SLOTS]; // Nanoseconds since the run started
+        std::atomic<bool> sending{true};
+        uint64_t frames_sent = 0;
+        uint64_t chunks_sent = 0;
+        uint64_t frames_completed = 0;
+        uint64_t chunks_received = 0;
+        std::vector<double> latencies_ms;
+    };
+
+    static double process_cpu_seconds() {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+            return 0;
+        }
+        auto to_seconds = [](const FILETIME& time) {
+            return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+        };
+        return to_seconds(kernel) + to_seconds(user);
+#else
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+    }
+
+    static double percentile(const std::vector<double>& sorted, double fraction) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    // Smooth background; senders add a moving bar, so consecutive frames differ
+    static cv::Mat make_background(const Options& options) {
+        cv::Mat base(options.height, options.width, CV_8UC3);
+        for (int y = 0; y < base.rows; y++) {
+            uchar* row = base.ptr<uchar>(y);
+            for (int x = 0; x < base.cols; x++) {
+                row[3 * x] = static_cast<uchar>(x * 255 / base.cols);
+                row[3 * x + 1] = static_cast<uchar>(y * 255 / base.rows);
+                row[3 * x + 2] = 128;
+            }
+        }
+        return base;
+    }
+
+    static std::string ring_name(uint16_t port) {
+        return "networktools_load_" + std::to_string(port);
+    }
+
+    static bool open_sender(const Options& options, uint16_t port, udp_client::Socket& socket) {
+        if (!socket.create_socket("127.0.0.1", port)) {
+            return false;
+        }
+        if (options.send_buffer > 0) {
+            setsockopt(socket.handle(), SOL_SOCKET, SO_SNDBUF, (const char*)&options.send_buffer, sizeof(options.send_buffer));
+        }
+        return true;
+    }
+
+    static void send_stream(const Options& options, uint16_t port, Stream& stream, Clock::time_point start) {
+        udp_client::Socket socket;
+        if (!open_sender(options, port, socket)) {
+            return;
+        }
+
+        cv::Mat base = make_background(options);
+
+        std::vector<int> params = { cv::IMWRITE_JPEG_QUALITY, options.jpeg_quality, cv::IMWRITE_JPEG_OPTIMIZE, 1 };
+        raw_video::Encoder raw_encoder;
+        raw_video::Compression compression = options.payload == raw_video::Mode::RAW_LZ4 ?
+            raw_video::Compression::LZ4 : raw_video::Compression::NONE;
+        std::vector<uchar> buffer;
+        auto encode = [&](const cv::Mat& frame) {
+            if (options.payload == raw_video::Mode::JPEG) {
+                cv::imencode(".jpg", frame, buffer, params);
+            }
+            else {
+                raw_encoder.encode(frame, compression, buffer);
+            }
+        };
+        encode(base);
+        std::vector<char> chunk_buffer(options.max_chunk_size + video_chunking::HEADER_SIZE);
+        video_chunking::Pacer pacer(options.pacing_rate);
+
+        auto frame_time = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / options.fps));
+        auto deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration_s));
+        auto next_frame = start;
+
+        for (uint32_t frame_id = 0; Clock::now() < deadline; frame_id++) {
+            std::this_thread::sleep_until(next_frame);
+            next_frame += frame_time;
+
+            auto produced = Clock::now();
+            stream.produced_at[frame_id % SENT_SLOTS].store((produced - start).count(), std::memory_order_relaxed);
+
+            if (options.encode) {
+                cv::Mat frame = base.clone();
+                int x = static_cast<int>(frame_id * 8 % static_cast<uint32_t>(options.width));
+                cv::rectangle(frame, cv::Point(x, 0), cv::Point(x + 32, options.height - 1), cv::Scalar(255, 255, 255), -1);
+                encode(frame);
+            }
+
+            size_t num_chunks = video_chunking::chunk_count(buffer.size(), options.max_chunk_size);
+            uint32_t frame_crc = crc32c::value(buffer.data(), buffer.size());
+            for (size_t chunk_id = 0; chunk_id < num_chunks; chunk_id++) {
+                size_t datagram_size = video_chunking::build_chunk(frame_id, buffer.data(), buffer.size(),
+                    chunk_id, options.max_chunk_size, chunk_buffer.data(), 0, 0, 0, 0, frame_crc);
+                pacer.wait();
+                if (socket.send_datagram(chunk_buffer.data(), datagram_size)) {
+                    pacer.sent(datagram_size);
+                    stream.chunks_sent++;
+                }
+            }
+            stream.frames_sent++;
+
+            // A sender that cannot keep up skips frames rather than bursting to catch up
+            if (Clock::now() > next_frame) {
+                next_frame = Clock::now();
+            }
+        }
+    }
+
+    // Same pacing as send_stream(), with the recording's frames in turn, each chunk gathered
+    // straight from the file mapping
+    static void send_file_stream(const Options& options, uint16_t port, const mjpeg_file::Recording& recording,
+                                 Stream& stream, Clock::time_point start) {
+        udp_client::Socket socket;
+        if (!open_sender(options, port, socket)) {
+            return;
+        }
+        video_chunking::Pacer pacer(options.pacing_rate);
+
+        const std::vector<mjpeg_file::Frame>& frames = recording.frames();
+        auto frame_time = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / options.fps));
+        auto deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration_s));
+        auto next_frame = start;
+
+        for (uint32_t frame_id = 0; Clock::now() < deadline; frame_id++) {
+            std::this_thread::sleep_until(next_frame);
+            next_frame += frame_time;
+
+            auto produced = Clock::now();
+            stream.produced_at[frame_id % SENT_SLOTS].store((produced - start).count(), std::memory_order_relaxed);
+
+            const mjpeg_file::Frame& frame = frames[frame_id % frames.size()];
+            const uint8_t* data = recording.frame_data(frame);
+            size_t num_chunks = video_chunking::chunk_count(frame.size, options.max_chunk_size);
+            uint32_t frame_crc = crc32c::value(data, frame.size);
+            for (size_t chunk_id = 0; chunk_id < num_chunks; chunk_id++) {
+                pacer.wait();
+                int sent = video_chunking::send_chunk(socket.handle(), socket.server_address(), frame_id, data,
+                    frame.size, chunk_id, options.max_chunk_size, 0, 0, 0, 0, frame_crc);
+                if (sent > 0) {
+                    pacer.sent(static_cast<size_t>(sent));
+                    stream.chunks_sent++;
+                }
+            }
+            stream.frames_sent++;
+
+            if (Clock::now() > next_frame) {
+                next_frame = Clock::now();
+            }
+        }
+    }
+
+    static void receive_stream(const Options& options, udp_server::Socket& socket, Stream& stream, Clock::time_point start) {
+        std::vector<char> buffer(RECEIVE_BUFFER_SIZE);
+        video_chunking::Reassembler reassembler;
+        raw_video::Decoder raw_decoder;
+        std::vector<uchar> frame;
+        cv::Mat decoded;
+        auto drain_until = Clock::time_point::max();
+        std::mt19937 rng(1);
+        std::bernoulli_distribution fragment_lost(options.link_loss);
+
+        while (Clock::now() < drain_until) {
+            if (!stream.sending.load() && drain_until == Clock::time_point::max()) {
+                drain_until = Clock::now() + std::chrono::milliseconds(200); // Chunks still in flight
+            }
+
+            fd_set readfds;
+            FD_ZERO(&readfds);
+            FD_SET(socket.handle(), &readfds);
+            timeval tv;
+            tv.tv_sec = 0;
+            tv.tv_usec = 10000; // 10ms timeout
+            if (select(static_cast<int>(socket.handle()) + 1, &readfds, nullptr, nullptr, &tv) <= 0) {
+                continue;
+            }
+
+            sockaddr_in sender_addr{};
+            socklen_t sender_len = sizeof(sender_addr);
+            int received = recvfrom(socket.handle(), buffer.data(), static_cast<int>(buffer.size()), 0,
+                reinterpret_cast<sockaddr*>(&sender_addr), &sender_len);
+
+            video_chunking::ChunkHeader header;
+            if (received <= 0 || !video_chunking::read_header(buffer.data(), static_cast<size_t>(received), header) ||
+                !video_chunking::verify_chunk(buffer.data(), static_cast<size_t>(received))) {
+                continue;
+            }
+            if (options.link_loss > 0) {
+                bool arrived = true;
+                size_t fragments = chunk_loss::fragment_count(static_cast<size_t>(received), options.link_mtu);
+                for (size_t fragment = 0; fragment < fragments; fragment++) {
+                    arrived = !fragment_lost(rng) && arrived;
+                }
+                if (!arrived) {
+                    continue;
+                }
+            }
+            stream.chunks_received++;
+
+            auto status = reassembler.add(header, reinterpret_cast<const uchar*>(buffer.data()) + video_chunking::HEADER_SIZE,
+                static_cast<size_t>(received) - video_chunking::HEADER_SIZE);
+            if (status != video_chunking::Reassembler::Status::COMPLETE || !reassembler.take(header.frame_id, frame) ||
+                !video_chunking::verify_frame(header, frame.data(), frame.size())) {
+                continue;
+            }
+            if (options.decode) {
+                bool ok = raw_video::is_raw(frame.data(), frame.size()) ?
+                    raw_decoder.decode(frame.data(), frame.size(), decoded) :
+                    !cv::imdecode(frame, cv::IMREAD_COLOR, &decoded).empty();
+                if (!ok) {
+                    continue;
+                }
+            }
+
+            int64_t produced = stream.produced_at[header.frame_id % SENT_SLOTS].load(std::memory_order_relaxed);
+            int64_t now = (Clock::now() - start).count();
+            stream.latencies_ms.push_back(std::chrono::duration<double, std::milli>(Clock::duration(now - produced)).count());
+            stream.frames_completed++;
+        }
+    }
+
+    // Same pacing as send_stream(), but each frame is drawn straight into a ring slot
+    static void publish_stream(const Options& options, shm_transport::Producer& producer, Stream& stream,
+                               Clock::time_point start) {
+        cv::Mat base = make_background(options);
+        size_t frame_bytes = base.total() * base.elemSize();
+
+        auto frame_time = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / options.fps));
+        auto deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration_s));
+        auto next_frame = start;
+
+        for (uint32_t frame_id = 0; Clock::now() < deadline; frame_id++) {
+            std::this_thread::sleep_until(next_frame);
+            next_frame += frame_time;
+
+            auto produced = Clock::now();
+            stream.produced_at[frame_id % SENT_SLOTS].store((produced - start).count(), std::memory_order_relaxed);
+
+            uint8_t* slot = producer.begin_write(frame_bytes);
+            if (slot) {
+                cv::Mat frame(options.height, options.width, CV_8UC3, slot);
+                base.copyTo(frame);
+                int x = static_cast<int>(frame_id * 8 % static_cast<uint32_t>(options.width));
+                cv::rectangle(frame, cv::Point(x, 0), cv::Point(x + 32, options.height - 1), cv::Scalar(255, 255, 255), -1);
+
+                shm_transport::FrameInfo info;
+                info.frame_id = frame_id;
+                info.width = options.width;
+                info.height = options.height;
+                info.stride = static_cast<uint32_t>(frame.step);
+                producer.publish(info);
+            }
+            stream.frames_sent++;
+
+            if (Clock::now() > next_frame) {
+                next_frame = Clock::now();
+            }
+        }
+    }
+
+    static void consume_stream(shm_transport::Consumer& consumer, Stream& stream, Clock::time_point start) {
+        shm_transport::FrameView view;
+        auto drain_until = Clock::time_point::max();
+
+        while (Clock::now() < drain_until) {
+            if (!stream.sending.load() && drain_until == Clock::time_point::max()) {
+                drain_until = Clock::now() + std::chrono::milliseconds(200);
+            }
+            if (!consumer.next(view, std::chrono::milliseconds(10))) {
+                continue;
+            }
+
+            int64_t produced = stream.produced_at[view.info.frame_id % SENT_SLOTS].load(std::memory_order_relaxed);
+            int64_t now = (Clock::now() - start).count();
+            stream.latencies_ms.push_back(std::chrono::duration<double, std::milli>(Clock::duration(now - produced)).count());
+            stream.frames_completed++;
+        }
+    }
+
+    Result run(const Options& options) {
+        std::vector<std::unique_ptr<Stream>> streams;
+        for (size_t i = 0; i < options.streams; i++) {
+            streams.push_back(std::make_unique<Stream>());
+        }
+
+        std::vector<udp_server::Socket> sockets(options.shared_memory ? 0 : options.streams);
+        for (size_t i = 0; i < sockets.size(); i++) {
+            if (!sockets[i].start_server(static_cast<uint16_t>(options.base_port + i))) {
+                return Result{};
+            }
+            setsockopt(sockets[i].handle(), SOL_SOCKET, SO_RCVBUF, (const char*)&options.receive_buffer,
+                sizeof(options.receive_buffer));
+        }
+
+        // Mapped and indexed once, then read by every sender
+        mjpeg_file::Recording recording;
+        if (!options.source_file.empty() && !recording.open(options.source_file, options.fps)) {
+            return Result{};
+        }
+
+        // One ring per stream, each slot holding a raw frame
+        std::vector<std::unique_ptr<shm_transport::Producer>> producers;
+        std::vector<std::unique_ptr<shm_transport::Consumer>> consumers;
+        for (size_t i = 0; options.shared_memory && i < options.streams; i++) {
+            std::string name = ring_name(static_cast<uint16_t>(options.base_port + i));
+            producers.push_back(std::make_unique<shm_transport::Producer>());
+            consumers.push_back(std::make_unique<shm_transport::Consumer>());
+            if (!producers[i]->create(name, static_cast<size_t>(options.width) * options.height * 3) ||
+                !consumers[i]->open(name)) {
+                return Result{};
+            }
+        }
+
+        // Release every thread at the same instant
+        auto start = Clock::now() + std::chrono::milliseconds(100);
+        double cpu_start = process_cpu_seconds();
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < options.streams; i++) {
+            threads.emplace_back([&, i] {
+                std::this_thread::sleep_until(start);
+                if (options.shared_memory) {
+                    consume_stream(*consumers[i], *streams[i], start);
+                }
+                else {
+                    receive_stream(options, sockets[i], *streams[i], start);
+                }
+            });
+            threads.emplace_back([&, i] {
+                if (options.shared_memory) {
+                    publish_stream(options, *producers[i], *streams[i], start);
+                }
+                else if (recording.is_open()) {
+                    send_file_stream(options, static_cast<uint16_t>(options.base_port + i), recording, *streams[i], start);
+                }
+                else {
+                    send_stream(options, static_cast<uint16_t>(options.base_port + i), *streams[i], start);
+                }
+                streams[i]->sending = false;
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        double cpu_seconds = process_cpu_seconds() - cpu_start;
+
+        Result result;
+        result.shared_memory = options.shared_memory;
+        result.file_source = recording.is_open();
+        result.payload = options.payload;
+        result.streams = options.streams;
+        result.duration_s = options.duration_s;
+        std::vector<double> latencies;
+        for (const auto& stream : streams) {
+            result.frames_sent += stream->frames_sent;
+            result.frames_completed += stream->frames_completed;
+            result.chunks_sent += stream->chunks_sent;
+            result.chunks_received += stream->chunks_received;
+            latencies.insert(latencies.end(), stream->latencies_ms.begin(), stream->latencies_ms.end());
+        }
+        std::sort(latencies.begin(), latencies.end());
+
+        result.fps_per_stream = result.frames_completed / options.duration_s / options.streams;
+        if (result.chunks_sent > 0) {
+            result.chunk_loss = 1.0 - static_cast<double>(result.chunks_received) / result.chunks_sent;
+        }
+        if (result.frames_sent > 0) {
+            result.completion_rate = static_cast<double>(result.frames_completed) / result.frames_sent;
+        }
+        if (result.frames_completed > 0) {
+            result.cpu_ms_per_frame = cpu_seconds * 1000.0 / result.frames_completed;
+        }
+        result.latency_p50_ms = percentile(latencies, 0.50);
+        result.latency_p99_ms = percentile(latencies, 0.99);
+        result.latency_p999_ms = percentile(latencies, 0.999);
+        result.latency_max_ms = latencies.empty() ? 0 : latencies.back();
+        return result;
+    }
+
+    std::vector<Result> find_limit(Options options, size_t max_streams, double min_ratio) {
+        std::vector<Result> results;
+        for (size_t streams = 1; streams <= max_streams; streams *= 2) {
+            options.streams = streams;
+            results.push_back(run(options));
+
+            const Result& last = results.back();
+            std::cout << streams << " streams: " << std::fixed << std::setprecision(1)
+                      << last.fps_per_stream << " fps, " << last.completion_rate * 100 << "% frames complete\n";
+            if (last.completion_rate < min_ratio || last.fps_per_stream < options.fps * min_ratio) {
+                break;
+            }
+        }
+        return results;
+    }
+
+    std::string to_json(const std::vector<Result>& results) {
+        std::ostringstream json;
+        json << std::fixed << std::setprecision(3);
+        json << "{\n  \"results\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            json << (i ? ",\n" : "\n")
+                 << "    {\"transport\": \"" << (r.shared_memory ? "shm" : "udp") << "\""
+                 << ", \"source\": \"" << (r.file_source ? "file" : "synthetic") << "\""
+                 << ", \"payload\": \"" << raw_video::mode_name(r.payload) << "\""
+                 << ", \"streams\": " << r.streams << ", \"duration_s\": " << r.duration_s
+                 << ", \"frames_sent\": " << r.frames_sent << ", \"frames_completed\": " << r.frames_completed
+                 << ", \"chunks_sent\": " << r.chunks_sent << ", \"chunks_received\": " << r.chunks_received
+                 << ", \"fps_per_stream\": " << r.fps_per_stream << ", \"chunk_loss\": " << r.chunk_loss
+                 << ", \"completion_rate\": " << r.completion_rate
+                 << ", \"latency_ms\": {\"p50\": " << r.latency_p50_ms << ", \"p99\": " << r.latency_p99_ms
+                 << ", \"p999\": " << r.latency_p999_ms << ", \"max\": " << r.latency_max_ms << "}"
+                 << ", \"cpu_ms_per_frame\": " << r.cpu_ms_per_frame << "}";
+        }
+        json << "\n  ]\n}\n";
+        return json.str();
+    }
+
+    void print_table(const std::vector<Result>& results) {
+        std::cout << std::setw(10) << "transport" << std::setw(9) << "payload" << std::setw(8) << "streams" << std::setw(10) << "fps"
+                  << std::setw(11) << "complete%" << std::setw(13) << "chunk loss%" << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms"
+                  << std::setw(10) << "p999 ms" << std::setw(10) << "max ms" << std::setw(13) << "CPU ms/frame" << "\n";
+        std::cout << std::fixed << std::setprecision(2);
+        for (const Result& r : results) {
+            std::cout << std::setw(10) << (r.shared_memory ? "shm" : "udp")
+                      << std::setw(9) << (r.file_source ? "file" : raw_video::mode_name(r.payload)) << std::setw(8) << r.streams
+                      << std::setw(10) << r.fps_per_stream
+                      << std::setw(11) << r.completion_rate * 100 << std::setw(13) << r.chunk_loss * 100
+                      << std::setw(10) << r.latency_p50_ms << std::setw(10) << r.latency_p99_ms
+                      << std::setw(10) << r.latency_p999_ms << std::setw(10) << r.latency_max_ms
+                      << std::setw(13) << r.cpu_ms_per_frame << "\n";
+        }
+    }
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <cstdint>
+
+// Counts heap allocations made through the global operator new, which this module
+// replaces for the whole Bench executable. Reading the counter before and after a
+// piece of code shows whether it allocates.
+namespace alloc_counter {
+    uint64_t allocations();
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "video_load.h"
+#include "video_config.h"
+
+// Automatic tuning of the UDP video settings with video_load runs on loopback, optionally
+// through its emulated lossy link. One setting is swept at a time with the others held at the
+// best values so far: chunk size, send buffer, receive buffer and pacing rate, which decide
+// whether frames arrive in time, then the JPEG quality, which decides what they cost.
+// A trial beats the best so far with more complete frames per second, or with a lower p99
+// latency at about the same rate. The quality sweep keeps the highest quality that still
+// reaches min_ratio of the target fps, as the rate controller's upper bound.
+namespace auto_tune {
+    struct Options {
+        video_load::Options load;       // Resolution, duration and link of every trial
+        double min_ratio = 0.95;
+        std::vector<size_t> chunk_sizes;    // Empty: one packet of a 1500-byte and a 9000-byte MTU, and 58000
+        std::vector<size_t> send_buffers = { 256 * 1024, 1024 * 1024, 4 * 1024 * 1024 };
+        std::vector<size_t> receive_buffers = { 256 * 1024, 1024 * 1024, 8 * 1024 * 1024 };
+        std::vector<double> pacing_rates = { 0, 50e6, 200e6, 1e9 };
+        std::vector<int> qualities = { 95, 90, 85, 75, 60, 45, 30 };    // Tried in this order
+    };
+
+    struct Trial {
+        std::string setting;
+        std::string value;
+        video_load::Result result;
+        bool chosen = false;
+    };
+
+    // Start from `settings`, at its target fps, and leave the best values found in it.
+    // Returns every trial in the order run.
+    std::vector<Trial> run(const Options& options, video_config::Settings& settings);
+
+    std::string to_json(const std::vector<Trial>& trials);
+    void print_table(const std::vector<Trial>& trials);
+}
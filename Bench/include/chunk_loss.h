@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Loss emulation for UDP video chunking, without sockets. Each chunk datagram is split
+// into the IP fragments an IPv4 link of the given MTU would carry; every fragment is
+// lost independently at the given rate, and a chunk arrives only if all its fragments
+// do. Surviving chunks go through the real reassembler, so the frame completion rate
+// shows how much chunks larger than the MTU amplify packet loss.
+namespace chunk_loss {
+    struct Options {
+        size_t mtu = 1500;
+        size_t frame_size = 150000;   // Bytes per encoded frame, about a 720p JPEG
+        size_t frames = 2000;         // Per chunk size and loss rate
+        std::vector<double> loss_rates = { 0.001, 0.005, 0.01, 0.02, 0.05 };
+        std::vector<size_t> chunk_sizes; // Empty: 58000 (the old fixed size) and the MTU-sized chunk
+        uint32_t seed = 1;
+    };
+
+    struct Result {
+        size_t chunk_size = 0;
+        size_t fragments_per_chunk = 0;
+        double loss_rate = 0;           // Per IP fragment
+        uint64_t chunks_sent = 0;
+        uint64_t chunks_received = 0;
+        uint64_t frames_sent = 0;
+        uint64_t frames_completed = 0;
+        double chunk_loss = 0;          // Fraction of chunks with at least one fragment lost
+        double completion_rate = 0;     // Completed / sent frames
+    };
+
+    // IP fragments needed for a UDP datagram with `udp_payload` bytes over an IPv4 link.
+    size_t fragment_count(size_t udp_payload, size_t mtu);
+
+    std::vector<Result> run(const Options& options);
+
+    std::string to_json(const std::vector<Result>& results);
+    void print_table(const std::vector<Result>& results);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// iperf-style benchmark of the socket modules.
+// The server side runs on tcp_server (one thread per connection) and udp_sharded_server;
+// the client side drives tcp_client and udp_client. For every protocol, message size and
+// stream count the client runs two tests:
+//   throughput  messages are sent back to back; the server counts what actually arrived
+//   latency     one message in flight per stream, echoed back; RTT percentiles are reported
+namespace net_bench {
+    struct ServerOptions {
+        uint16_t port = 5201;
+        size_t udp_shards = 0; // 0 = one per hardware thread
+    };
+
+    struct ClientOptions {
+        std::string host = "127.0.0.1";
+        uint16_t port = 5201;
+        bool tcp = true;
+        bool udp = true;
+        std::vector<size_t> message_sizes = { 64, 1024, 16384, 65536 };
+        std::vector<size_t> stream_counts = { 1, 4 };
+        double duration_s = 3.0;    // Per test
+        size_t tcp_batch = 32;      // Messages per gathered write in the TCP throughput test
+        int udp_timeout_ms = 200;   // A UDP ping without reply by then counts as lost
+    };
+
+    struct Result {
+        std::string protocol;       // "tcp" or "udp"
+        std::string test;           // "throughput" or "latency"
+        size_t message_size = 0;
+        size_t streams = 0;
+        double duration_s = 0;
+        uint64_t messages = 0;      // Delivered (throughput) or answered (latency)
+        uint64_t bytes = 0;
+        uint64_t lost = 0;          // UDP only
+        double throughput_mbps = 0; // Payload megabits per second
+        double messages_per_s = 0;
+        double rtt_p50_us = 0;      // Latency tests only
+        double rtt_p90_us = 0;
+        double rtt_p99_us = 0;
+        double rtt_p999_us = 0;
+        double rtt_max_us = 0;
+    };
+
+    // Serve benchmark clients until `running` becomes false.
+    bool run_server(const ServerOptions& options, const std::atomic<bool>& running);
+
+    // Run the whole test matrix against a server; results come back in run order.
+    std::vector<Result> run_client(const ClientOptions& options);
+
+    std::string to_json(const std::vector<Result>& results);
+    void print_table(const std::vector<Result>& results);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Fuzzing of the UDP video receive path, without sockets: datagrams go through
+// video_chunking::read_header, verify_chunk and a Reassembler per stream exactly as the
+// client handles them. They are a mix of random bytes, genuine chunks, genuine chunks cut
+// short or with bytes flipped, and chunks with random header fields and a CRC that matches,
+// so that hostile headers get past the CRC check into reassembly.
+// Besides not crashing (run it under a sanitizer to catch memory errors), the receive path
+// must reject every damaged chunk, keep accepted headers within the sanity bounds, and hand
+// out every frame made only of genuine chunks as it was sent.
+namespace packet_fuzz {
+    struct Options {
+        uint64_t iterations = 1000000;
+        size_t max_chunk_size = 1428;
+        uint32_t seed = 1;
+    };
+
+    struct Result {
+        uint64_t datagrams = 0;
+        uint64_t headers_accepted = 0;
+        uint64_t chunks_verified = 0;
+        uint64_t frames_completed = 0;
+        uint64_t frames_checked = 0;    // Completed frames of genuine chunks compared with what was sent
+        uint64_t failures = 0;
+        std::string first_failure;
+    };
+
+    Result run(const Options& options);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Microbenchmarks of the UDP video pipeline stages, on synthetic frames and without any
+// socket or window: JPEG encode/decode, raw YUV420 (and LZ4) conversion both ways, the FPS
+// overlay, CRC-32C, chunk header serialization and in-place field access, chunking,
+// reassembly and the JPEG end-marker scan.
+// Each stage runs in doubling batches until min_time_s has elapsed, then reports the time
+// per operation and the throughput over the bytes that stage processes per operation.
+namespace video_bench {
+    struct Resolution {
+        int width;
+        int height;
+    };
+
+    struct Options {
+        std::vector<Resolution> resolutions = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 } };
+        double min_time_s = 0.5;     // Per stage and resolution
+        int jpeg_quality = 85;
+        size_t max_chunk_size = 1428;  // As sent by the server over a 1500-byte MTU path
+    };
+
+    struct Result {
+        std::string stage;
+        std::string resolution;
+        uint64_t iterations = 0;
+        size_t bytes_per_op = 0;
+        double ns_per_op = 0;
+        double bytes_per_s = 0;
+    };
+
+    std::vector<Result> run(const Options& options);
+
+    // Heap allocations made by chunking and reassembly over `frames` frames of varying
+    // size with some chunks lost, after a warm-up. Zero when buffers are recycled as intended.
+    uint64_t steady_state_allocations(const Options& options, size_t frames);
+
+    std::string to_json(const std::vector<Result>& results);
+    void print_table(const std::vector<Result>& results);
+}
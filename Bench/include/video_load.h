@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "raw_video.h"
+
+// Headless end-to-end load test of the UDP video path on loopback.
+// Every stream gets a sender thread (synthetic frames, JPEG encode, chunking, paced at the
+// target fps, like the server demo) and a receiver thread (reassembly and decode, like the
+// client demo) on its own port, all in one process. Senders record when each frame was
+// produced, so receivers can measure frame-to-decode latency on the same clock.
+// With shared_memory, senders publish raw frames into a shared-memory ring per stream
+// instead, and receivers take them in place, for comparison with the UDP path.
+// With a source_file, UDP senders cycle through the frames of an MJPEG recording (see
+// mjpeg_file.h), sent from its mapping at the target fps, so no sender CPU goes to encoding.
+// The payload can also be raw YUV420 (see raw_video.h), to compare against JPEG.
+// Senders can pace their chunks (see video_chunking::Pacer), and receivers can drop chunks
+// as a lossy link would, each IP fragment independently (see chunk_loss.h).
+namespace video_load {
+    struct Options {
+        size_t streams = 1;
+        double duration_s = 5.0;
+        int width = 1280;
+        int height = 720;
+        double fps = 30.0;
+        int jpeg_quality = 85;
+        size_t max_chunk_size = 58000;
+        uint16_t base_port = 23000;   // Stream i uses base_port + i
+        bool encode = true;           // Encode every frame; otherwise resend one pre-encoded frame
+        bool decode = true;           // Decode every completed frame
+        bool shared_memory = false;   // Raw frames through shm_transport; encode and decode do not apply
+        std::string source_file;      // MJPEG recording to send instead of synthetic frames (UDP only)
+        raw_video::Mode payload = raw_video::Mode::JPEG;  // For synthetic UDP frames
+        int send_buffer = 0;                    // SO_SNDBUF of the senders; 0 keeps the system's
+        int receive_buffer = 8 * 1024 * 1024;   // SO_RCVBUF of the receivers, as in the client demo
+        double pacing_rate = 0;                 // Bits per second per UDP stream; 0 is unpaced
+        double link_loss = 0;                   // Emulated loss rate per IP fragment
+        size_t link_mtu = 1500;                 // MTU the emulated link fragments chunks at
+    };
+
+    struct Result {
+        bool shared_memory = false;
+        bool file_source = false;
+        raw_video::Mode payload = raw_video::Mode::JPEG;
+        size_t streams = 0;
+        double duration_s = 0;
+        uint64_t frames_sent = 0;
+        uint64_t frames_completed = 0;  // All chunks reassembled (and decoded, when enabled)
+        uint64_t chunks_sent = 0;
+        uint64_t chunks_received = 0;
+        double fps_per_stream = 0;      // Completed frames per second, averaged over streams
+        double chunk_loss = 0;          // Fraction of sent chunks never received
+        double completion_rate = 0;     // Completed / sent frames
+        double latency_p50_ms = 0;      // Frame produced to frame reassembled/decoded
+        double latency_p99_ms = 0;
+        double latency_p999_ms = 0;
+        double latency_max_ms = 0;
+        double cpu_ms_per_frame = 0;    // Process CPU time (all threads) per completed frame
+    };
+
+    Result run(const Options& options);
+
+    // Run 1, 2, 4, ... streams up to max_streams, stopping after the first step whose
+    // completion rate or per-stream fps falls below min_ratio of the target.
+    std::vector<Result> find_limit(Options options, size_t max_streams, double min_ratio = 0.95);
+
+    std::string to_json(const std::vector<Result>& results);
+    void print_table(const std::vector<Result>& results);
+}
@@ -0,0 +1,377 @@
+#include "file_receiver.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#define SOCK_ERR   SOCKET_ERROR
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#define SOCK_ERR   -1
+#endif
+
+namespace file_receiver {
+    FileSink::~FileSink() {
+        close();
+    }
+
+    bool FileSink::open(const std::string& path, uint64_t size) {
+        close();
+
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            std::cerr << "Could not create " << path << "\n";
+            return false;
+        }
+
+        // Reserve the clusters up front so parallel writes do not fragment the file
+        FILE_ALLOCATION_INFO allocation{};
+        allocation.AllocationSize.QuadPart = static_cast<long long>(size);
+        SetFileInformationByHandle(file, FileAllocationInfo, &allocation, sizeof(allocation));
+
+        LARGE_INTEGER end;
+        end.QuadPart = static_cast<long long>(size);
+        if (!SetFilePointerEx(file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) {
+            std::cerr << "Could not allocate " << size << " bytes for " << path << "\n";
+            close();
+            return false;
+        }
+#else
+        file = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (file == -1) {
+            std::cerr << "Could not create " << path << "\n";
+            return false;
+        }
+
+        // Reserve the blocks up front so parallel writes do not fragment the file
+        bool allocated = false;
+#ifdef __linux__
+        allocated = size == 0 || posix_fallocate(file, 0, static_cast<off_t>(size)) == 0;
+#endif
+        if (!allocated && ftruncate(file, static_cast<off_t>(size)) != 0) {
+            std::cerr << "Could not allocate " << size << " bytes for " << path << "\n";
+            close();
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    void FileSink::close() {
+#ifdef _WIN32
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (file != -1) {
+            ::close(file);
+            file = -1;
+        }
+#endif
+    }
+
+    bool FileSink::write_at(uint64_t offset, const char* data, size_t size) {
+        while (size > 0) {
+#ifdef _WIN32
+            OVERLAPPED overlapped{};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD written = 0;
+            if (!WriteFile(file, data, static_cast<DWORD>(size), &written, &overlapped) || written == 0) {
+                std::cerr << "WriteFile() failed\n";
+                return false;
+            }
+#else
+            ssize_t written = pwrite(file, data, size, static_cast<off_t>(offset));
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                std::cerr << "pwrite() failed\n";
+                return false;
+            }
+#endif
+            offset += static_cast<uint64_t>(written);
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    bool FileSink::sync() {
+#ifdef _WIN32
+        bool synced = FlushFileBuffers(file) != 0;
+#elif defined(__linux__)
+        bool synced = fdatasync(file) == 0;
+#else
+        bool synced = fsync(file) == 0;
+#endif
+        if (!synced) {
+            std::cerr << "Could not flush the file to disk\n";
+        }
+        return synced;
+    }
+
+    // Replace `path` with `text` so that a crash leaves either the old or the new contents,
+    // both on disk: written to a temporary file, flushed, then renamed over the old one
+    static bool write_durably(const std::string& path, const std::string& text) {
+        std::string temporary = path + ".tmp";
+#ifdef _WIN32
+        HANDLE file = CreateFileA(temporary.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        DWORD written = 0;
+        bool saved = WriteFile(file, text.data(), static_cast<DWORD>(text.size()), &written, nullptr) &&
+                     written == text.size() && FlushFileBuffers(file);
+        CloseHandle(file);
+        return saved && MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+        int file = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (file == -1) {
+            return false;
+        }
+        bool saved = write(file, text.data(), text.size()) == static_cast<ssize_t>(text.size()) && fsync(file) == 0;
+        saved = ::close(file) == 0 && saved;
+        if (!saved || rename(temporary.c_str(), path.c_str()) != 0) {
+            return false;
+        }
+
+        // The rename itself is only durable once the directory is flushed too
+        std::string directory = std::filesystem::path(path).parent_path().string();
+        int dir = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+        if (dir != -1) {
+            fsync(dir);
+            ::close(dir);
+        }
+        return true;
+#endif
+    }
+
+    Transfer::~Transfer() {
+        cancel();
+        finish();
+    }
+
+    bool Transfer::start(const char* ip, uint16_t port, std::string output, size_t stream_count) {
+        finish();
+        server_ip = ip;
+        server_port = port;
+        cancelled = false;
+        streams.clear();
+
+        // Ask what the server has to offer
+        tcp_client::Connection control;
+        if (!control.connect_to_server(server_ip.c_str(), server_port)) {
+            return false;
+        }
+        std::string request = file_transfer::encode_request({ file_transfer::RequestType::OFFER, 0, 0 });
+        control.queue_message(request);
+        std::string_view reply;
+        if (!control.flush_messages() || !control.receive_message(reply) || !file_transfer::decode_offer(reply, offer)) {
+            return false;
+        }
+        control.disconnect();
+
+        // Never let the server pick a directory
+        output_path = output.empty() ? std::filesystem::path(offer.name).filename().string() : output;
+        if (output_path.empty()) {
+            std::cerr << "No output file name\n";
+            return false;
+        }
+        std::cout << "Receiving " << offer.name << " (" << offer.size << " bytes) into " << output_path << "\n";
+
+        if (load_progress()) {
+            std::cout << "Resuming: " << bytes_received() << " bytes already received\n";
+        }
+        else {
+            for (const auto& range : file_transfer::split(offer.size, stream_count)) {
+                auto stream = std::make_unique<Stream>();
+                stream->range = range;
+                streams.push_back(std::move(stream));
+            }
+        }
+
+        if (!sink.open(output_path + ".part", offer.size)) {
+            return false;
+        }
+
+        for (auto& stream : streams) {
+            if (stream->written.load() < stream->range.length) {
+                active_streams.fetch_add(1);
+                workers.emplace_back(&Transfer::receive, this, std::ref(*stream));
+            }
+        }
+        return true;
+    }
+
+    bool Transfer::finish() {
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+        if (streams.empty() && output_path.empty()) {
+            return false;
+        }
+
+        bool complete = true;
+        for (const auto& stream : streams) {
+            complete = complete && stream->written.load() == stream->range.length;
+        }
+        // Progress is saved while the file is still open, to flush it first
+        bool saved = !complete && save_progress();
+        sink.close();
+
+        std::string part_path = output_path + ".part";
+        std::string progress_path = part_path + ".progress";
+        std::error_code error;
+        if (!complete) {
+            if (saved) {
+                std::cout << "Transfer incomplete, run it again to resume\n";
+            }
+            else {
+                std::cerr << "Transfer incomplete, and its progress could not be saved\n";
+            }
+        }
+        else if (std::filesystem::exists(part_path, error)) {
+            std::filesystem::rename(part_path, output_path, error);
+            if (error) {
+                std::cerr << "Could not rename " << part_path << ": " << error.message() << "\n";
+                complete = false;
+            }
+            else {
+                std::filesystem::remove(progress_path, error);
+                std::cout << "Saved " << output_path << "\n";
+            }
+        }
+
+        streams.clear();
+        output_path.clear();
+        return complete;
+    }
+
+    void Transfer::cancel() {
+        cancelled = true;
+    }
+
+    uint64_t Transfer::bytes_received() const {
+        uint64_t total = 0;
+        for (const auto& stream : streams) {
+            total += stream->written.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    void Transfer::receive(Stream& stream) {
+        tcp_client::Connection connection;
+        uint64_t position = stream.range.offset + stream.written.load();
+        uint64_t end = stream.range.offset + stream.range.length;
+
+        if (connection.connect_to_server(server_ip.c_str(), server_port)) {
+            std::string request = file_transfer::encode_request({ file_transfer::RequestType::RANGE, position, end - position });
+            connection.queue_message(request);
+            connection.flush_messages();
+
+            // Aligned buffer: data is written to disk in whole blocks
+            std::vector<char> storage(WRITE_BUFFER_SIZE + WRITE_ALIGNMENT);
+            char* buffer = storage.data() + (WRITE_ALIGNMENT - reinterpret_cast<uintptr_t>(storage.data()) % WRITE_ALIGNMENT);
+            uint64_t last_saved = stream.written.load();
+            bool failed = false;
+
+            while (position < end && !failed && !cancelled.load(std::memory_order_relaxed)) {
+                // A resumed range may start mid-block: end the first write on a block boundary
+                size_t capacity = WRITE_BUFFER_SIZE - static_cast<size_t>(position % WRITE_ALIGNMENT);
+                capacity = static_cast<size_t>(std::min<uint64_t>(capacity, end - position));
+
+                size_t filled = 0;
+                while (filled < capacity) {
+                    int recvd = recv(connection.handle(), buffer + filled, static_cast<int>(capacity - filled), 0);
+                    if (recvd == SOCK_ERR || recvd == 0) {
+                        std::cerr << "Stream at offset " << position << " interrupted\n";
+                        failed = true;
+                        break;
+                    }
+                    filled += static_cast<size_t>(recvd);
+                }
+
+                if (filled > 0) {
+                    if (!sink.write_at(position, buffer, filled)) {
+                        break;
+                    }
+                    position += filled;
+                    stream.written.fetch_add(filled);
+                }
+
+                if (stream.written.load() - last_saved >= PROGRESS_INTERVAL) {
+                    save_progress();
+                    last_saved = stream.written.load();
+                }
+            }
+        }
+
+        connection.disconnect();
+        active_streams.fetch_sub(1);
+    }
+
+    bool Transfer::load_progress() {
+        std::error_code error;
+        std::string part_path = output_path + ".part";
+        if (!std::filesystem::exists(part_path, error) || std::filesystem::file_size(part_path, error) != offer.size) {
+            return false;
+        }
+
+        std::ifstream file(part_path + ".progress");
+        std::string keyword;
+        uint64_t size = 0;
+        if (!(file >> keyword >> size) || keyword != "size" || size != offer.size) {
+            return false;
+        }
+
+        std::vector<std::unique_ptr<Stream>> loaded;
+        file_transfer::Range range;
+        uint64_t written = 0;
+        while (file >> keyword >> range.offset >> range.length >> written) {
+            if (keyword != "range" || written > range.length || range.offset + range.length > size) {
+                return false;
+            }
+            auto stream = std::make_unique<Stream>();
+            stream->range = range;
+            stream->written = written;
+            loaded.push_back(std::move(stream));
+        }
+        if (loaded.empty() && size > 0) {
+            return false;
+        }
+
+        streams = std::move(loaded);
+        return true;
+    }
+
+    bool Transfer::save_progress() {
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        std::string progress_path = output_path + ".part.progress";
+        std::ostringstream record;
+        record << "size " << offer.size << "\n";
+        for (const auto& stream : streams) {
+            record << "range " << stream->range.offset << " " << stream->range.length << " "
+                   << stream->written.load() << "\n";
+        }
+
+        // Counts are read before the flush, so the record never claims data still in the cache
+        if (!sink.sync()) {
+            return false;
+        }
+        if (!write_durably(progress_path, record.str())) {
+            std::cerr << "Could not save " << progress_path << "\n";
+            return false;
+        }
+        return true;
+    }
+}
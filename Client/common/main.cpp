@@ -1,3 +1,4 @@
+#include <cstdio>
 #include <iostream>
 #include <string>
 #include <limits>
@@ -7,6 +8,7 @@
 #include <iomanip>
 #include <opencv2/opencv.hpp>
 #include <map>
+#include <cmath>
 #include <fstream>
 // Fix for Windows max macro conflict
 #define NOMINMAX
@@ -19,15 +21,30 @@
 #endif
 #include "../include/tcp_client.h"
 #include "../include/udp_client.h"
+#include "../include/file_receiver.h"
+#include "../../Shared/include/video_chunking.h"
+#include "../../Shared/include/frame_trace.h"
+#include "../../Shared/include/simulcast.h"
+#include "../../Shared/include/shm_transport.h"
+#include "../../Shared/include/raw_video.h"
+#include "../../Shared/include/clock_sync.h"
+#include "../../Shared/include/metrics.h"
+#include "../../Shared/include/video_config.h"
+#include "../../Shared/include/stream_control.h"
 
-#define VIDEO_PORT 12345
-#define BUFFER_SIZE 262144  // Increased to 256KB
+// Server address, video port and receive buffer sizes, from video.conf and the command line
+// (see video_config.h)
+static video_config::Settings settings;
 
 enum class Demo {
     TCP_TEXT = 1,
     UDP_TEXT = 2,
     UDP_VIDEO = 3,
-    EXIT = 4
+    TCP_VIDEO = 4,
+    FILE_TRANSFER = 5,
+    UDP_SIMULCAST_VIDEO = 6,
+    STREAM_CONTROL = 7,
+    EXIT = 8
 };
 
 Demo show_menu() {
@@ -36,8 +53,12 @@ Demo show_menu() {
         std::cout << "1. TCP Text Message\n";
         std::cout << "2. UDP Text Message\n";
         std::cout << "3. UDP Video Stream\n";
-        std::cout << "4. Exit\n";
-        std::cout << "Choice (1-4): ";
+        std::cout << "4. TCP Video Stream\n";
+        std::cout << "5. File Transfer (receive)\n";
+        std::cout << "6. UDP Simulcast Video Stream\n";
+        std::cout << "7. Stream Control (while a UDP video stream runs)\n";
+        std::cout << "8. Exit\n";
+        std::cout << "Choice (1-8): ";
         
         char choice;
         std::cin >> choice;
@@ -51,6 +72,14 @@ Demo show_menu() {
             case '3':
                 return Demo::UDP_VIDEO;
             case '4':
+                return Demo::TCP_VIDEO;
+            case '5':
+                return Demo::FILE_TRANSFER;
+            case '6':
+                return Demo::UDP_SIMULCAST_VIDEO;
+            case '7':
+                return Demo::STREAM_CONTROL;
+            case '8':
                 return Demo::EXIT;
             default:
                 std::cout << "Invalid choice. Please try again.\n";
@@ -59,63 +88,73 @@ Demo show_menu() {
 }
 
 bool run_tcp_text_demo(const char* server_ip, uint16_t server_port) {
+    tcp_client::Connection connection;
+
     // Initialize TCP client
     if (!tcp_client::initialize_winsock()) {
         return false;
     }
 
     // Connect to server
-    if (!tcp_client::connect_to_server(server_ip, server_port)) {
+    if (!connection.connect_to_server(server_ip, server_port)) {
         tcp_client::cleanup_winsock();
         return false;
     }
 
+    // Compress messages if the server agrees; otherwise they go out as plain text
+    connection.negotiate_compression();
+
     // Send message
-    if (!tcp_client::send_message("Hello from TCP client!")) {
-        tcp_client::disconnect();
+    if (!connection.send_message("Hello from TCP client!")) {
+        connection.disconnect();
         tcp_client::cleanup_winsock();
         return false;
     }
 
     // Receive response
-    std::string response = tcp_client::receive_message();
+    std::string response = connection.receive_message();
     if (!response.empty()) {
         std::cout << "Server response: " << response << "\n";
     }
 
     // Cleanup
-    tcp_client::disconnect();
+    connection.disconnect();
     tcp_client::cleanup_winsock();
     return true;
 }
 
 bool run_udp_text_demo(const char* server_ip, uint16_t server_port) {
+    udp_client::Socket client;
+
     // Initialize UDP client
     if (!udp_client::initialize_winsock()) {
         return false;
     }
 
     // Create socket and set server address
-    if (!udp_client::create_socket(server_ip, server_port)) {
+    if (!client.create_socket(server_ip, server_port)) {
         udp_client::cleanup_winsock();
         return false;
     }
 
+    // Compress datagrams if the server agrees; otherwise they go out as plain text
+    client.negotiate_compression();
+
     // Send message
-    if (!udp_client::send_message("Hello from UDP client!")) {
-        udp_client::close_socket();
+    if (!client.send_message("Hello from UDP client!")) {
+        client.close_socket();
         udp_client::cleanup_winsock();
         return false;
     }
 
     // Receive response
-    std::string response = udp_client::receive_message();
+    std::string response = client.receive_message();
     if (!response.empty()) {
         std::cout << "Server response: " << response << "\n";
     }
 
     // Cleanup
-    udp_client::close_socket();
+    client.close_socket();
     udp_client::cleanup_winsock();
     return true;
 }
@@ -132,7 +171,90 @@ struct Frame {
     std::chrono::steady_clock::time_point timestamp;
 };
 
-bool run_udp_video_demo(const char* server_ip) noexcept {
+// Scale a stream's frame into its cell of the mosaic, a near-square grid of stream_count
+// cells. The mosaic is cleared whenever the grid grows.
+static void draw_tile(cv::Mat& mosaic, size_t stream_count, uint32_t stream_id, const cv::Mat& frame) {
+    const int TILE_WIDTH = 640;
+    const int TILE_HEIGHT = 360;
+    int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(stream_count))));
+    int rows = (static_cast<int>(stream_count) + columns - 1) / columns;
+
+    if (mosaic.rows != rows * TILE_HEIGHT || mosaic.cols != columns * TILE_WIDTH) {
+        mosaic.create(rows * TILE_HEIGHT, columns * TILE_WIDTH, CV_8UC3);
+        mosaic.setTo(cv::Scalar(0, 0, 0));
+    }
+
+    cv::Rect cell(static_cast<int>(stream_id) % columns * TILE_WIDTH, static_cast<int>(stream_id) / columns * TILE_HEIGHT,
+                  TILE_WIDTH, TILE_HEIGHT);
+    cv::Mat tile = mosaic(cell);
+    cv::resize(frame, tile, tile.size(), 0, 0, cv::INTER_AREA);
+}
+
+// Glass-to-glass latency of the frames shown, split where the chunk headers and the clock
+// sync let it be measured: capture to the send of the frame's last chunk (sender clock), that
+// chunk's network transit, and its arrival to display (receiver clock). In seconds.
+struct LatencyReport {
+    metrics::Histogram capture_to_send{ metrics::latency_buckets() };
+    metrics::Histogram network{ metrics::latency_buckets() };
+    metrics::Histogram receive_to_display{ metrics::latency_buckets() };
+    metrics::Histogram glass_to_glass{ metrics::latency_buckets() };
+
+    void add(int64_t capture_us, int64_t send_us, int64_t arrival_us, int64_t displayed_us,
+             const clock_sync::Tracker& clock) {
+        capture_to_send.observe((send_us - capture_us) / 1e6);
+        network.observe((arrival_us - clock.to_local(send_us)) / 1e6);
+        receive_to_display.observe((displayed_us - arrival_us) / 1e6);
+        glass_to_glass.observe((displayed_us - clock.to_local(capture_us)) / 1e6);
+    }
+
+    void print(const clock_sync::Tracker& clock) const {
+        if (glass_to_glass.count() == 0) {
+            return;
+        }
+        std::cout << "Latency over " << glass_to_glass.count() << " frames";
+        if (clock.synchronized()) {
+            std::cout << " (server clock " << std::showpos << std::fixed << std::setprecision(1)
+                      << clock.offset_us() / 1000.0 << std::noshowpos << " ms, round trip "
+                      << clock.round_trip_us() / 1000.0 << " ms)";
+        }
+        else {
+            std::cout << " (server clock not synchronized yet, assumed equal)";
+        }
+        std::cout << ":\n";
+        print_histogram("capture to send", capture_to_send);
+        print_histogram("network", network);
+        print_histogram("receive to display", receive_to_display);
+        print_histogram("glass to glass", glass_to_glass);
+    }
+
+    // Percentiles, then the share of frames in each non-empty bucket
+    static void print_histogram(const char* name, const metrics::Histogram& histogram) {
+        uint64_t total = histogram.count();
+        std::cout << "  " << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1)
+                  << "p50 " << std::setw(7) << histogram.quantile(0.5) * 1000 << " ms  p99 "
+                  << std::setw(7) << histogram.quantile(0.99) * 1000 << " ms |";
+        const std::vector<double>& bounds = histogram.bounds();
+        for (size_t i = 0; i <= bounds.size(); i++) {
+            uint64_t in_bucket = histogram.bucket_count(i);
+            if (in_bucket == 0) {
+                continue;
+            }
+            std::cout << std::setprecision(1);
+            if (i < bounds.size()) {
+                std::cout << " <=" << bounds[i] * 1000 << "ms ";
+            }
+            else {
+                std::cout << " >" << bounds.back() * 1000 << "ms ";
+            }
+            std::cout << std::setprecision(0) << 100.0 * in_bucket / total << "%";
+        }
+        std::cout << std::endl;
+    }
+};
+
+// With simulcast, subscribe to the server's layers instead of waiting for a stream, and move
+// between layers as the share of complete frames changes.
+bool run_udp_video_demo(const char* server_ip, bool simulcast) noexcept {
     try {
         // Init Winsock
         WSADATA wsa;
@@ -151,7 +273,7 @@ bool run_udp_video_demo(const char* server_ip) noexcept {
 
         sockaddr_in serverAddr;
         serverAddr.sin_family = AF_INET;
-        serverAddr.sin_port = htons(VIDEO_PORT);
+        serverAddr.sin_port = htons(settings.video_port);
         serverAddr.sin_addr.s_addr = INADDR_ANY;  // Listen on all interfaces
 
         if (bind(sock, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) == SOCKET_ERROR) {
@@ -173,13 +295,13 @@ bool run_udp_video_demo(const char* server_ip) noexcept {
                 char ipstr[INET_ADDRSTRLEN];
                 struct sockaddr_in *addr = (struct sockaddr_in *)res->ai_addr;
                 inet_ntop(AF_INET, &(addr->sin_addr), ipstr, INET_ADDRSTRLEN);
-                std::cout << "Client listening on " << ipstr << ":" << VIDEO_PORT << std::endl;
+                std::cout << "Client listening on " << ipstr << ":" << settings.video_port << std::endl;
                 freeaddrinfo(res);
             }
         }
 
-        // Increase receive buffer size
-        int rcvbuf = 262144;  // 256KB buffer
+        // Increase receive buffer size; the default has room for a raw frame (see raw_video.h) in flight
+        int rcvbuf = settings.receive_buffer;
         if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char*)&rcvbuf, sizeof(rcvbuf)) < 0) {
             std::cerr << "Failed to set receive buffer size\n";
         }
@@ -188,22 +310,57 @@ bool run_udp_video_demo(const char* server_ip) noexcept {
         u_long mode = 1;
         ioctlsocket(sock, FIONBIO, &mode);
 
+        // Subscriptions go out from this socket, so the server sends video back to it
+        sockaddr_in subscribeAddr = {};
+        subscribeAddr.sin_family = AF_INET;
+        subscribeAddr.sin_port = htons(simulcast::PORT);
+        if (simulcast && inet_pton(AF_INET, server_ip, &subscribeAddr.sin_addr) != 1) {
+            std::cerr << "Invalid server IP " << server_ip << std::endl;
+            closesocket(sock);
+            WSACleanup();
+            return false;
+        }
+        simulcast::LayerSelector layer_selector;
+        char subscribe[simulcast::SUBSCRIBE_SIZE];
+        uint64_t subscribe_cookie = 0;  // From the server's last challenge
+        std::chrono::steady_clock::time_point last_subscribe;  // Never: subscribe right away
+        uint32_t next_simulcast_frame = 0;  // Older frames were shown already, from another layer
+
         std::cout << "Receiving video stream. Press ESC to stop.\n";
 
-        std::vector<char> buffer(BUFFER_SIZE);
+        std::vector<char> buffer(settings.buffer_size);
         sockaddr_in senderAddr;
         int senderLen = sizeof(senderAddr);
 
         // Frame management
-        std::map<uint32_t, std::vector<std::vector<uchar>>> frame_chunks;
-        const size_t HEADER_SIZE = 12;  // 12 bytes: 4 for frame_id + 4 for chunk_id + 4 for total_chunks
         const auto FRAME_TIMEOUT = std::chrono::milliseconds(100); // Reduced timeout
         const size_t MAX_FRAME_QUEUE = 30; // Maximum frames to keep in memory
+        // Streams share the socket and are told apart by the stream ID in each chunk header
+        std::vector<video_chunking::Reassembler> reassemblers(video_chunking::MAX_STREAMS,
+            video_chunking::Reassembler(MAX_FRAME_QUEUE));
+        size_t stream_count = 1;  // Highest stream ID seen + 1; more than one shows a mosaic
+        cv::Mat mosaic;
+        bool mosaic_changed = false;
+        std::map<uint64_t, int64_t> first_chunk_us; // Reassembly span starts by stream and frame, while tracing
 
-        // FPS calculation variables
+        // Reused for every frame, so a steady stream does not allocate
+        std::vector<uchar> frameData;
+        cv::Mat img;
+        char overlay_text[128];
+        std::string overlay;
+        raw_video::Decoder raw_decoder;   // For senders with VIDEO_PAYLOAD=raw or raw-lz4
+
+        // Server timestamps in the chunk headers, brought onto this clock, give the latency
+        const auto LATENCY_REPORT_INTERVAL = std::chrono::seconds(5);
+        clock_sync::Tracker server_clock;
+        server_clock.start(server_ip, clock_sync::PORT);
+        LatencyReport latency;
+        auto last_latency_report = std::chrono::steady_clock::now();
+
+        // FPS calculation variables, per stream
         const int FPS_WINDOW_SIZE = 30;
-        std::queue<std::chrono::steady_clock::time_point> frame_times;
-        double current_fps = 0.0;
+        std::vector<std::queue<std::chrono::steady_clock::time_point>> frame_times(video_chunking::MAX_STREAMS);
+        std::vector<double> current_fps(video_chunking::MAX_STREAMS, 0.0);
 
         // Debug variables
         size_t total_bytes_received = 0;
@@ -212,6 +369,11 @@ bool run_udp_video_demo(const char* server_ip) noexcept {
         uint32_t last_frame_id = 0;
         size_t received_chunks = 0;
         size_t completed_frames = 0;
+        // Data rejected since the start, by reason
+        size_t bad_headers = 0;
+        size_t corrupt_chunks = 0;      // Chunk CRC mismatch
+        size_t corrupt_frames = 0;      // Frame CRC mismatch after reassembly
+        size_t undecodable_frames = 0;  // Intact, yet the decoder refused them
         uint32_t last_displayed_frame = 0;
         bool test_frame_saved = false;  // Flag to ensure we only save one frame
         bool failed_frame_saved = false; // <--- Add this flag
@@ -232,6 +394,11 @@ bool run_udp_video_demo(const char* server_ip) noexcept {
                          << "Completed frames: " << completed_frames << ", "
                          << "Current frame: " << last_frame_id 
                          << ", Last displayed: " << last_displayed_frame << std::endl;
+                if (bad_headers + corrupt_chunks + corrupt_frames + undecodable_frames > 0) {
+                    std::cout << "Rejected - Bad headers: " << bad_headers << ", Corrupt chunks: " << corrupt_chunks
+                              << ", Corrupt frames: " << corrupt_frames << ", Undecodable frames: " << undecodable_frames
+                              << std::endl;
+                }
                 
                 // Reset counters
                 total_bytes_received = 0;
@@ -239,6 +406,24 @@ bool run_udp_video_demo(const char* server_ip) noexcept {
                 received_chunks = 0;
                 completed_frames = 0;
                 last_debug = now;
+
+                if (simulcast && layer_selector.update()) {
+                    std::cout << "Switching to layer " << layer_selector.layer() << " after "
+                              << std::fixed << std::setprecision(0) << layer_selector.completion() * 100
+                              << "% complete frames" << std::endl;
+                    last_subscribe = std::chrono::steady_clock::time_point();
+                }
+            }
+
+            if (now - last_latency_report >= LATENCY_REPORT_INTERVAL) {
+                latency.print(server_clock);
+                last_latency_report = now;
+            }
+
+            if (simulcast && now - last_subscribe >= simulcast::RESUBSCRIBE_INTERVAL) {
+                simulcast::write_subscribe(subscribe, layer_selector.layer(), subscribe_cookie);
+                sendto(sock, subscribe, sizeof(subscribe), 0, reinterpret_cast<sockaddr*>(&subscribeAddr), sizeof(subscribeAddr));
+                last_subscribe = now;
             }
 
             // Receive chunks with timeout
@@ -253,111 +438,128 @@ bool run_udp_video_demo(const char* server_ip) noexcept {
             int ready = select(0, &readfds, nullptr, nullptr, &tv);
             
             if (ready > 0) {
+                frame_trace::Span receive_span(frame_trace::Stage::RECEIVE, 0);
                 int bytesReceived = recvfrom(sock, buffer.data(), static_cast<int>(buffer.size()), 0,
                     reinterpret_cast<sockaddr*>(&senderAddr), &senderLen);
+                int64_t arrival_us = frame_trace::now_us();
+
+                // The server's challenge to a subscribe: answer with its cookie at once
+                uint64_t cookie;
+                if (simulcast && bytesReceived > 0 &&
+                    senderAddr.sin_addr.s_addr == subscribeAddr.sin_addr.s_addr &&
+                    simulcast::read_challenge(buffer.data(), static_cast<size_t>(bytesReceived), cookie)) {
+                    subscribe_cookie = cookie;
+                    last_subscribe = std::chrono::steady_clock::time_point();
+                    continue;
+                }
 
-                if (bytesReceived > static_cast<int>(HEADER_SIZE)) {
+                if (bytesReceived > static_cast<int>(video_chunking::HEADER_SIZE)) {
                     total_bytes_received += static_cast<size_t>(bytesReceived);
                     packets_received++;
                     received_chunks++;
 
                     // Extract header information
-                    uint32_t frame_id = ntohl(*reinterpret_cast<uint32_t*>(buffer.data()));
-                    uint32_t chunk_id = ntohl(*reinterpret_cast<uint32_t*>(buffer.data() + 4));
-                    uint32_t total_chunks = ntohl(*reinterpret_cast<uint32_t*>(buffer.data() + 8)); // New: total_chunks from header
+                    video_chunking::ChunkHeader header;
+                    if (!video_chunking::read_header(buffer.data(), static_cast<size_t>(bytesReceived), header)) {
+                        std::cerr << "Invalid chunk header, " << bytesReceived << " bytes" << std::endl;
+                        bad_headers++;
+                        continue;
+                    }
+                    // Dropped before it can misplace or spoil a frame
+                    if (!video_chunking::verify_chunk(buffer.data(), static_cast<size_t>(bytesReceived))) {
+                        std::cerr << "Corrupt chunk " << header.chunk_id << " of frame " << header.frame_id << std::endl;
+                        corrupt_chunks++;
+                        continue;
+                    }
+                    uint32_t frame_id = header.frame_id;
+                    uint32_t chunk_id = header.chunk_id;
+                    uint32_t stream_id = header.stream_id;
+                    // Simulcast layers carry the same frame IDs, so each needs its own reassembler
+                    size_t source = simulcast ? header.layer : stream_id;
+                    video_chunking::Reassembler& reassembler = reassemblers[source];
+                    stream_count = std::max<size_t>(stream_count, stream_id + 1);
+                    receive_span.set_frame(frame_id);
+                    receive_span.end();
+                    if (simulcast) {
+                        layer_selector.chunk_received(header.layer, frame_id);
+                    }
                     // Calculate chunk size from received data
-                    size_t chunk_size = bytesReceived - HEADER_SIZE;
+                    size_t chunk_size = bytesReceived - video_chunking::HEADER_SIZE;
 
-                    // Add bounds checking and debug output
+#ifdef DEBUG_VIDEO_PACKETS
                     std::cout << "Received packet - Frame: " << frame_id 
                             << ", Chunk: " << chunk_id 
-                            << "/" << total_chunks
+                            << "/" << header.total_chunks
                             << ", Size: " << chunk_size << " bytes" << std::endl;
+#endif
 
-                    // Sanity check the values
-                    const uint32_t MAX_CHUNKS = 100;  // Reasonable maximum number of chunks
-                    const uint32_t MAX_CHUNK_SIZE = 1024 * 1024;  // 1MB max chunk size
-
-                    if (chunk_size == 0 || chunk_size > MAX_CHUNK_SIZE || total_chunks == 0 || total_chunks > MAX_CHUNKS) {
-                        std::cerr << "Invalid chunk_size or total_chunks value: " << chunk_size << ", " << total_chunks << std::endl;
-                        continue;
-                    }
-
-                    // Create or get frame buffer
-                    if (frame_chunks.find(frame_id) == frame_chunks.end()) {
-                        if (chunk_id == 0) {
-                            frame_chunks[frame_id] = std::vector<std::vector<uchar>>(total_chunks);
-                            std::cout << "Created new frame buffer for frame " << frame_id 
-                                    << " with " << total_chunks << " chunks" << std::endl;
-                        } else {
-                            std::cerr << "Received chunk " << chunk_id << " before chunk 0 for frame " << frame_id << std::endl;
-                            continue;
+                    // Store this chunk; a frame is only started by its chunk 0
+                    auto status = reassembler.add(header,
+                        reinterpret_cast<const uchar*>(buffer.data()) + video_chunking::HEADER_SIZE, chunk_size);
+                    if (frame_trace::enabled() && status != video_chunking::Reassembler::Status::REJECTED) {
+                        // Reassembly spans the first chunk's arrival to the frame's completion
+                        int64_t now_us = frame_trace::now_us();
+                        uint64_t key = (static_cast<uint64_t>(source) << 32) | frame_id;
+                        first_chunk_us.emplace(key, now_us);
+                        if (status == video_chunking::Reassembler::Status::COMPLETE) {
+                            frame_trace::record(frame_trace::Stage::REASSEMBLY, frame_id, first_chunk_us[key], now_us);
+                            first_chunk_us.erase(key);
+                        }
+                        while (first_chunk_us.size() > MAX_FRAME_QUEUE) {
+                            first_chunk_us.erase(first_chunk_us.begin());
                         }
                     }
-
-                    // Store this chunk if within bounds
-                    if (chunk_id < frame_chunks[frame_id].size()) {
-                        frame_chunks[frame_id][chunk_id] = std::vector<uchar>(
-                            buffer.begin() + HEADER_SIZE,
-                            buffer.begin() + bytesReceived
-                        );
+                    if (status == video_chunking::Reassembler::Status::REJECTED) {
+                        std::cerr << "Dropped chunk " << chunk_id << " of frame " << frame_id << std::endl;
+                    }
+                    else {
+#ifdef DEBUG_VIDEO_PACKETS
                         std::cout << "Stored chunk " << chunk_id << " of frame " << frame_id 
                                 << " (size: " << chunk_size << " bytes)" << std::endl;
+#endif
 
-                        // Check if we have all chunks for this frame
-                        bool frame_complete = true;
-                        size_t total_size = 0;
-                        size_t received_chunks = 0;
-
-                        // Count received chunks and calculate total size
-                        for (size_t i = 0; i < frame_chunks[frame_id].size(); i++) {
-                            if (!frame_chunks[frame_id][i].empty()) {
-                                received_chunks++;
-                                total_size += frame_chunks[frame_id][i].size();
-                            } else {
-                                frame_complete = false;
-                            }
+                        if (simulcast && status == video_chunking::Reassembler::Status::COMPLETE) {
+                            layer_selector.frame_completed(header.layer);
                         }
 
-                        std::cout << "Frame " << frame_id << " status: " 
-                                << received_chunks << "/" << frame_chunks[frame_id].size() 
-                                << " chunks received" << std::endl;
-
-                        // Only decode if all chunks are present
-                        if (frame_complete && received_chunks > 0) {
-                            // Combine all chunks into one frame
-                            std::vector<uchar> frameData;
-                            frameData.reserve(total_size);
-                            for (const auto& chunk : frame_chunks[frame_id]) {
-                                if (!chunk.empty()) {
-                                    frameData.insert(frameData.end(), chunk.begin(), chunk.end());
-                                }
-                            }
+                        bool complete = status == video_chunking::Reassembler::Status::COMPLETE &&
+                                        reassembler.take(frame_id, frameData);
+                        if (complete && !video_chunking::verify_frame(header, frameData.data(), frameData.size())) {
+                            std::cerr << "Frame " << frame_id << " failed its CRC check, not decoding it" << std::endl;
+                            corrupt_frames++;
+                            complete = false;
+                        }
+
+                        // Only decode if all chunks are present and intact, and after a layer switch
+                        // only frames newer than the last one shown
+                        if (complete && !(simulcast && frame_id < next_simulcast_frame)) {
                             try {
+#ifdef DEBUG_VIDEO_PACKETS
                                 std::cout << "Attempting to decode frame " << frame_id 
                                         << " (total size: " << frameData.size() << " bytes from " 
-                                        << frame_chunks[frame_id].size() << " chunks)" << std::endl;
-                                // Debug: Check first few bytes of the data
-                                std::cout << "First bytes: ";
-                                for (size_t i = 0; i < std::min(size_t(16), frameData.size()); i++) {
-                                    printf("%02X ", frameData[i]);
+                                        << header.total_chunks << " chunks)" << std::endl;
+#endif
+                                // Raw YUV420 frames are told apart by their header
+                                bool raw = raw_video::is_raw(frameData.data(), frameData.size());
+                                // Without a frame CRC, a missing JPEG end marker is the best hint of damage
+                                if (!raw && !(header.flags & video_chunking::FLAG_FRAME_CRC) &&
+                                    !video_chunking::has_jpeg_end_marker(frameData.data(), frameData.size())) {
+                                    std::cerr << "Warning: Frame " << frame_id << " is missing JPEG end marker" << std::endl;
                                 }
-                                std::cout << std::endl;
-                                // Check for JPEG end marker
-                                bool hasEndMarker = false;
-                                for (size_t i = frameData.size() - 2; i > 0; --i) {
-                                    if (frameData[i] == 0xFF && frameData[i + 1] == 0xD9) {
-                                        hasEndMarker = true;
-                                        break;
+                                // Try to decode the frame
+                                frame_trace::Span decode_span(frame_trace::Stage::DECODE, frame_id);
+                                if (raw) {
+                                    if (!raw_decoder.decode(frameData.data(), frameData.size(), img)) {
+                                        img.release();
                                     }
                                 }
-                                if (!hasEndMarker) {
-                                    std::cerr << "Warning: Frame " << frame_id << " is missing JPEG end marker" << std::endl;
+                                else {
+                                    cv::imdecode(frameData, cv::IMREAD_COLOR, &img);
                                 }
-                                // Try to decode the frame
-                                cv::Mat img = cv::imdecode(frameData, cv::IMREAD_COLOR);
+                                decode_span.end();
                                 if (img.empty()) {
                                     std::cerr << "Failed to decode frame " << frame_id << std::endl;
+                                    undecodable_frames++;
                                     // Save the failed frame data for debugging, but only once per session
                                     if (!failed_frame_saved) {
                                         std::string debug_filename = "failed_frame_" + std::to_string(frame_id) + ".jpg";
@@ -370,25 +572,37 @@ bool run_udp_video_demo(const char* server_ip) noexcept {
                                     }
                                 } else {
                                     // --- FPS calculation ---
-                                    frame_times.push(std::chrono::steady_clock::now());
-                                    while (frame_times.size() > FPS_WINDOW_SIZE) {
-                                        frame_times.pop();
+                                    auto& times = frame_times[stream_id];
+                                    times.push(std::chrono::steady_clock::now());
+                                    while (times.size() > FPS_WINDOW_SIZE) {
+                                        times.pop();
                                     }
-                                    if (frame_times.size() >= 2) {
+                                    if (times.size() >= 2) {
                                         auto time_diff = std::chrono::duration_cast<std::chrono::milliseconds>(
-                                            frame_times.back() - frame_times.front()).count();
+                                            times.back() - times.front()).count();
                                         if (time_diff > 0) {
-                                            current_fps = (frame_times.size() - 1) * 1000.0 / time_diff;
+                                            current_fps[stream_id] = (times.size() - 1) * 1000.0 / time_diff;
                                         }
                                     }
-                                    // Overlay resolution and FPS
-                                    std::stringstream info;
-                                    info << "Resolution: " << img.cols << "x" << img.rows
-                                         << " | FPS: " << std::fixed << std::setprecision(1) << current_fps;
-                                    cv::putText(img, info.str(), cv::Point(10, 30),
+                                    // Overlay resolution and FPS, formatted into the reused buffers
+                                    int length = 0;
+                                    if (stream_count > 1) {
+                                        length += std::snprintf(overlay_text + length, sizeof(overlay_text) - length,
+                                            "Stream %u | ", stream_id);
+                                    }
+                                    if (simulcast) {
+                                        length += std::snprintf(overlay_text + length, sizeof(overlay_text) - length,
+                                            "Layer %u | ", static_cast<unsigned>(header.layer));
+                                    }
+                                    std::snprintf(overlay_text + length, sizeof(overlay_text) - length,
+                                        "Resolution: %dx%d | FPS: %.1f", img.cols, img.rows, current_fps[stream_id]);
+                                    overlay.assign(overlay_text);
+                                    cv::putText(img, overlay, cv::Point(10, 30),
                                         cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 0), 2);
+#ifdef DEBUG_VIDEO_PACKETS
                                     std::cout << "Successfully decoded frame " << frame_id 
                                             << " (" << img.cols << "x" << img.rows << ")" << std::endl;
+#endif
                                     
                                     // Save one test frame after 3 seconds of streaming
                                     auto now = std::chrono::steady_clock::now();
@@ -442,26 +656,35 @@ bool run_udp_video_demo(const char* server_ip) noexcept {
                                     }
                                     #endif
 
-                                    // Display the frame
-                                    cv::imshow("Video Stream", img);
+                                    // Display the frame, or place it in the mosaic shown once per loop
+                                    frame_trace::Span display_span(frame_trace::Stage::DISPLAY, frame_id);
+                                    if (stream_count > 1) {
+                                        draw_tile(mosaic, stream_count, stream_id, img);
+                                        mosaic_changed = true;
+                                    } else {
+                                        cv::imshow("Video Stream", img);
+                                    }
+                                    display_span.end();
+                                    // Timed by the chunk that completed the frame; older servers send no timestamps
+                                    if (header.capture_us != 0) {
+                                        latency.add(header.capture_us, header.send_us, arrival_us, frame_trace::now_us(), server_clock);
+                                    }
                                     last_displayed_frame = frame_id;
+                                    next_simulcast_frame = frame_id + 1;
                                 }
                             } catch (const cv::Exception& e) {
                                 std::cerr << "OpenCV exception while processing frame: " << e.what() << std::endl;
                             } catch (const std::exception& e) {
                                 std::cerr << "Standard exception while processing frame: " << e.what() << std::endl;
                             }
-
-                            // Clean up the chunks for this frame
-                            frame_chunks.erase(frame_id);
                         }
                     }
                 }
             }
 
-            // Limit frame queue size
-            while (frame_chunks.size() > MAX_FRAME_QUEUE) {
-                frame_chunks.erase(frame_chunks.begin());
+            if (mosaic_changed) {
+                cv::imshow("Video Stream", mosaic);
+                mosaic_changed = false;
             }
 
             // Process window events and check for ESC key
@@ -472,9 +695,18 @@ bool run_udp_video_demo(const char* server_ip) noexcept {
             Sleep(1);
         }
 
+        if (simulcast) {
+            // Stop the server sending now rather than at the subscription timeout
+            simulcast::write_subscribe(subscribe, simulcast::UNSUBSCRIBE, subscribe_cookie);
+            sendto(sock, subscribe, sizeof(subscribe), 0, reinterpret_cast<sockaddr*>(&subscribeAddr), sizeof(subscribeAddr));
+        }
+
+        latency.print(server_clock);
+        server_clock.stop();
         cv::destroyAllWindows();
         closesocket(sock);
         WSACleanup();
+        frame_trace::flush();
         return true;
     }
     catch (const std::exception& e) {
@@ -483,14 +715,355 @@ bool run_udp_video_demo(const char* server_ip) noexcept {
     }
 }
 
+// Same-host receiver: frames are read in place from the server's shared-memory ring, with
+// no sockets, chunking or decoding
+bool run_shm_video_demo() noexcept {
+    try {
+        shm_transport::Consumer consumer;
+        std::cout << "Server is on this host: receiving through shared memory (set VIDEO_TRANSPORT=udp to use UDP). "
+                  << "Press ESC to stop.\n";
+
+        const int FPS_WINDOW_SIZE = 30;
+        std::queue<std::chrono::steady_clock::time_point> frame_times;
+        double current_fps = 0.0;
+
+        size_t frames_received = 0;
+        int64_t total_latency_us = 0;
+        uint64_t last_skipped = 0;
+        auto last_debug = std::chrono::steady_clock::now();
+        shm_transport::FrameInfo last_info;
+        cv::Mat img; // JPEG frames only; raw ones are shown straight from shared memory
+
+        cv::namedWindow("Video Stream", cv::WINDOW_AUTOSIZE | cv::WINDOW_GUI_NORMAL);
+
+        bool running = true;
+        while (running) {
+            // Follow the server across restarts: its ring is recreated each time
+            if (!consumer.is_open() || consumer.producer_closed()) {
+                if (consumer.open(shm_transport::DEFAULT_NAME)) {
+                    std::cout << "Connected to shared memory \"" << shm_transport::DEFAULT_NAME << "\"\n";
+                    last_skipped = 0;
+                }
+                else {
+                    char c = static_cast<char>(cv::waitKey(100));
+                    if (c == 27) running = false;  // ESC key
+                    continue;
+                }
+            }
+
+            shm_transport::FrameView view;
+            if (consumer.next(view, std::chrono::milliseconds(100))) {
+                cv::Mat frame;
+                if (view.info.format == shm_transport::Format::BGR24) {
+                    // Wraps the slot, which stays leased until the next frame is taken
+                    frame = cv::Mat(view.info.height, view.info.width, CV_8UC3, const_cast<uint8_t*>(view.data), view.info.stride);
+                }
+                else {
+                    frame_trace::Span decode_span(frame_trace::Stage::DECODE, view.info.frame_id);
+                    cv::imdecode(cv::Mat(1, static_cast<int>(view.size), CV_8UC1, const_cast<uint8_t*>(view.data)),
+                        cv::IMREAD_COLOR, &img);
+                    frame = img;
+                }
+
+                if (!frame.empty()) {
+                    frame_trace::Span display_span(frame_trace::Stage::DISPLAY, view.info.frame_id);
+                    cv::imshow("Video Stream", frame);
+                    display_span.end();
+                    last_info = view.info;
+                    // JPEG frames carry no size: it is known once decoded
+                    last_info.width = frame.cols;
+                    last_info.height = frame.rows;
+
+                    total_latency_us += frame_trace::now_us() - view.info.capture_us;
+                    frames_received++;
+                    frame_times.push(std::chrono::steady_clock::now());
+                    while (frame_times.size() > FPS_WINDOW_SIZE) {
+                        frame_times.pop();
+                    }
+                    if (frame_times.size() >= 2) {
+                        auto time_diff = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            frame_times.back() - frame_times.front()).count();
+                        if (time_diff > 0) {
+                            current_fps = (frame_times.size() - 1) * 1000.0 / time_diff;
+                        }
+                    }
+                }
+            }
+
+            // Stats every second; the overlay goes in the title, since drawing on a
+            // raw frame would draw into the server's memory
+            auto now = std::chrono::steady_clock::now();
+            if (std::chrono::duration_cast<std::chrono::seconds>(now - last_debug).count() >= 1) {
+                std::cout << "Client stats - Frames: " << frames_received
+                          << ", Skipped: " << consumer.skipped() - last_skipped
+                          << ", Capture to display: " << std::fixed << std::setprecision(2)
+                          << (frames_received ? total_latency_us / 1000.0 / frames_received : 0.0) << " ms" << std::endl;
+                std::stringstream title;
+                title << "Video Stream | Resolution: " << last_info.width << "x" << last_info.height
+                      << " | FPS: " << std::fixed << std::setprecision(1) << current_fps << " | Shared memory";
+                cv::setWindowTitle("Video Stream", title.str());
+
+                frames_received = 0;
+                total_latency_us = 0;
+                last_skipped = consumer.skipped();
+                last_debug = now;
+            }
+
+            char c = static_cast<char>(cv::waitKey(1));
+            if (c == 27) running = false;  // ESC key
+        }
+
+        consumer.close();
+        cv::destroyAllWindows();
+        frame_trace::flush();
+        return true;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error in shared-memory video demo: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool run_tcp_video_demo(const char* server_ip) noexcept {
+    try {
+        tcp_client::Connection connection;
+
+        // Initialize TCP client
+        if (!tcp_client::initialize_winsock()) {
+            return false;
+        }
+
+        // Connect to the server's video port
+        if (!connection.connect_to_server(server_ip, settings.video_port)) {
+            tcp_client::cleanup_winsock();
+            return false;
+        }
+
+        std::cout << "Receiving video stream over TCP. Press ESC to stop.\n";
+
+        const size_t FRAME_ID_SIZE = 4;  // 4 bytes frame ID in front of the JPEG data
+
+        // FPS calculation variables
+        const int FPS_WINDOW_SIZE = 30;
+        std::queue<std::chrono::steady_clock::time_point> frame_times;
+        double current_fps = 0.0;
+
+        // Debug variables
+        size_t total_bytes_received = 0;
+        size_t frames_received = 0;
+        size_t skipped_frames = 0;
+        uint32_t last_frame_id = 0;
+        bool first_frame = true;
+        auto last_debug = std::chrono::steady_clock::now();
+        cv::Mat img; // Decoded into the same pixels every frame
+        char overlay_text[128];
+        std::string overlay;
+
+        cv::namedWindow("Video Stream", cv::WINDOW_AUTOSIZE | cv::WINDOW_GUI_NORMAL);
+
+        bool running = true;
+        while (running) {
+            auto now = std::chrono::steady_clock::now();
+
+            // Debug output every second
+            if (std::chrono::duration_cast<std::chrono::seconds>(now - last_debug).count() >= 1) {
+                std::cout << "Client stats - Received: " << total_bytes_received / 1024 << " KB, "
+                         << "Frames: " << frames_received << ", "
+                         << "Skipped by server: " << skipped_frames << ", "
+                         << "Current frame: " << last_frame_id << std::endl;
+
+                // Reset counters
+                total_bytes_received = 0;
+                frames_received = 0;
+                skipped_frames = 0;
+                last_debug = now;
+            }
+
+            if (connection.wait_for_message(10)) {
+                frame_trace::Span receive_span(frame_trace::Stage::RECEIVE, 0);
+                std::string_view message;
+                if (!connection.receive_message(message)) {
+                    break;
+                }
+
+                if (message.size() > FRAME_ID_SIZE) {
+                    uint32_t frame_id_net;
+                    memcpy(&frame_id_net, message.data(), FRAME_ID_SIZE);
+                    uint32_t frame_id = ntohl(frame_id_net);
+                    receive_span.set_frame(frame_id);
+                    receive_span.end();
+
+                    // Gaps in frame IDs are frames the server dropped to bound latency
+                    if (!first_frame && frame_id > last_frame_id + 1) {
+                        skipped_frames += frame_id - last_frame_id - 1;
+                    }
+                    first_frame = false;
+                    last_frame_id = frame_id;
+                    total_bytes_received += message.size();
+                    frames_received++;
+
+                    // Decode straight from the receive buffer
+                    cv::Mat encoded(1, static_cast<int>(message.size() - FRAME_ID_SIZE), CV_8UC1,
+                        const_cast<char*>(message.data() + FRAME_ID_SIZE));
+                    frame_trace::Span decode_span(frame_trace::Stage::DECODE, frame_id);
+                    cv::imdecode(encoded, cv::IMREAD_COLOR, &img);
+                    decode_span.end();
+                    if (img.empty()) {
+                        std::cerr << "Failed to decode frame " << frame_id << std::endl;
+                    } else {
+                        frame_times.push(std::chrono::steady_clock::now());
+                        while (frame_times.size() > FPS_WINDOW_SIZE) {
+                            frame_times.pop();
+                        }
+                        if (frame_times.size() >= 2) {
+                            auto time_diff = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                frame_times.back() - frame_times.front()).count();
+                            if (time_diff > 0) {
+                                current_fps = (frame_times.size() - 1) * 1000.0 / time_diff;
+                            }
+                        }
+
+                        // Overlay resolution and FPS, formatted into the reused buffers
+                        std::snprintf(overlay_text, sizeof(overlay_text), "Resolution: %dx%d | FPS: %.1f | TCP",
+                            img.cols, img.rows, current_fps);
+                        overlay.assign(overlay_text);
+                        cv::putText(img, overlay, cv::Point(10, 30),
+                            cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 0), 2);
+                        frame_trace::Span display_span(frame_trace::Stage::DISPLAY, frame_id);
+                        cv::imshow("Video Stream", img);
+                    }
+                }
+            }
+
+            // Process window events and check for ESC key
+            char c = static_cast<char>(cv::waitKey(1));
+            if (c == 27) running = false;  // ESC key
+        }
+
+        cv::destroyAllWindows();
+        connection.disconnect();
+        tcp_client::cleanup_winsock();
+        frame_trace::flush();
+        return true;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error in TCP video demo: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool run_file_transfer_demo(const char* server_ip, uint16_t server_port) {
+    // Initialize Winsock
+    if (!tcp_client::initialize_winsock()) {
+        return false;
+    }
+
+    std::cout << "Parallel streams (1-16): ";
+    size_t stream_count = 4;
+    std::cin >> stream_count;
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    stream_count = std::min<size_t>(std::max<size_t>(stream_count, 1), 16);
+
+    file_receiver::Transfer transfer;
+    if (!transfer.start(server_ip, server_port, "", stream_count)) {
+        tcp_client::cleanup_winsock();
+        return false;
+    }
+
+    std::cout << "Press ESC to stop (the transfer can be resumed later).\n";
+
+    uint64_t last_received = transfer.bytes_received();
+    auto last_stats = std::chrono::steady_clock::now();
+    while (!transfer.done()) {
+        Sleep(100);
+
+        // Print progress every second
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_stats).count();
+        if (elapsed >= 1.0) {
+            uint64_t received = transfer.bytes_received();
+            std::cout << "Received " << received / (1024 * 1024) << " / " << transfer.total_size() / (1024 * 1024)
+                      << " MB (" << std::fixed << std::setprecision(1)
+                      << (received - last_received) / elapsed / (1024 * 1024) << " MB/s)" << std::endl;
+            last_received = received;
+            last_stats = now;
+        }
+
+        if (_kbhit()) {
+            char c = static_cast<char>(_getch());
+            if (c == 27) transfer.cancel();  // ESC key
+        }
+    }
+
+    bool complete = transfer.finish();
+    tcp_client::cleanup_winsock();
+    return complete;
+}
+
+// Send commands typed on the console to a server streaming UDP video, typically from a second
+// client next to the one showing the video
+bool run_stream_control_demo(const char* server_ip) {
+    if (!tcp_client::initialize_winsock()) {
+        return false;
+    }
+
+    tcp_client::Connection connection;
+    if (!connection.connect_to_server(server_ip, stream_control::PORT)) {
+        tcp_client::cleanup_winsock();
+        return false;
+    }
+
+    std::cout << "Commands:\n" << stream_control::usage() << "  quit\n";
+    bool connected = true;
+    std::string line;
+    while (connected && std::cout << "> " && std::getline(std::cin, line) && line != "quit") {
+        // Checked here too, so typing mistakes never reach the server
+        stream_control::Command command;
+        std::string error;
+        if (!stream_control::parse_command(line, command, error)) {
+            std::cout << "Invalid command: " << error << "\n";
+            continue;
+        }
+
+        connection.queue_message(line);
+        std::string_view reply;
+        if (!connection.flush_messages() || !connection.wait_for_message(2000) ||
+            !connection.receive_message(reply)) {
+            std::cerr << "No reply from the server\n";
+            connected = false;
+            break;
+        }
+        std::cout << reply << "\n";
+    }
+
+    connection.disconnect();
+    tcp_client::cleanup_winsock();
+    return connected;
+}
+
 int main(int argc, char* argv[]) {
-    // Allow optional server IP as first argument (default = localhost)
-    const char* SERVER_IP = (argc > 1 ? argv[1] : "127.0.0.1");
+    // The server IP can also come first on its own, as before options existed
+    std::vector<std::string> positional;
+    if (!video_config::from_command_line(argc, argv, settings, positional)) {
+        return 1;
+    }
+    if (positional.size() > 1) {
+        std::cerr << "Unexpected argument: " << positional[1] << "\n";
+        video_config::print_usage(argv[0]);
+        return 1;
+    }
+    if (!positional.empty()) {
+        settings.server_ip = positional[0];
+    }
+    const char* SERVER_IP = settings.server_ip.c_str();
     const uint16_t SERVER_PORT = 8080;
 
     // Silence INFO?level plugin?loader messages
     cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_WARNING);
 
+    // Set FRAME_TRACE to record where each frame's time goes in the video demos
+    frame_trace::start_from_environment("client");
+
     while (true) {
         Demo choice = show_menu();
         bool success = false;
@@ -505,7 +1078,29 @@ int main(int argc, char* argv[]) {
                 break;
 
             case Demo::UDP_VIDEO:
-                success = run_udp_video_demo(SERVER_IP);
+                // With the server on this host, frames come through shared memory instead
+                if (shm_transport::use_for_peer(SERVER_IP)) {
+                    success = run_shm_video_demo();
+                }
+                else {
+                    success = run_udp_video_demo(SERVER_IP, false);
+                }
+                break;
+
+            case Demo::UDP_SIMULCAST_VIDEO:
+                success = run_udp_video_demo(SERVER_IP, true);
+                break;
+
+            case Demo::TCP_VIDEO:
+                success = run_tcp_video_demo(SERVER_IP);
+                break;
+
+            case Demo::FILE_TRANSFER:
+                success = run_file_transfer_demo(SERVER_IP, SERVER_PORT);
+                break;
+
+            case Demo::STREAM_CONTROL:
+                success = run_stream_control_demo(SERVER_IP);
                 break;
 
             case Demo::EXIT:
@@ -1,5 +1,6 @@
 #include "tcp_client.h"
 #include <iostream>
+#include <utility>
 
 #ifdef _WIN32
 #pragma comment(lib, "ws2_32.lib")
@@ -7,6 +8,7 @@
 #define SOCK_ERR   SOCKET_ERROR
 #define SOCK_INV   INVALID_SOCKET
 #else
+#include <sys/select.h>
 #include <unistd.h>
 #define CLOSESOCK(s) close(s)
 #define SOCK_ERR   -1
@@ -14,8 +16,6 @@
 #endif
 
 namespace tcp_client {
-    static sock_t client_socket = SOCK_INV;
-
     bool initialize_winsock() {
 #ifdef _WIN32
         WSADATA wsaData;
@@ -33,7 +33,40 @@ namespace tcp_client {
 #endif
     }
 
-    bool connect_to_server(const char* server_ip, uint16_t server_port) {
+    Connection::Connection() : client_socket(SOCK_INV) {
+    }
+
+    Connection::~Connection() {
+        disconnect();
+    }
+
+    Connection::Connection(Connection&& other) noexcept
+        : client_socket(std::exchange(other.client_socket, SOCK_INV)),
+          reader(std::move(other.reader)),
+          writer(std::move(other.writer)),
+          compressing(std::exchange(other.compressing, false)),
+          encoder(std::move(other.encoder)),
+          decoder(std::move(other.decoder)),
+          encoded_queue(std::move(other.encoded_queue)) {
+    }
+
+    Connection& Connection::operator=(Connection&& other) noexcept {
+        if (this != &other) {
+            disconnect();
+            client_socket = std::exchange(other.client_socket, SOCK_INV);
+            reader = std::move(other.reader);
+            writer = std::move(other.writer);
+            compressing = std::exchange(other.compressing, false);
+            encoder = std::move(other.encoder);
+            decoder = std::move(other.decoder);
+            encoded_queue = std::move(other.encoded_queue);
+        }
+        return *this;
+    }
+
+    bool Connection::connect_to_server(const char* server_ip, uint16_t server_port) {
+        disconnect();
+
         // Create socket
         client_socket = socket(AF_INET, SOCK_STREAM, 0);
         if (client_socket == SOCK_INV) {
@@ -48,6 +81,7 @@ namespace tcp_client {
         if (inet_pton(AF_INET, server_ip, &serverAddr.sin_addr) != 1) {
             std::cerr << "Invalid address: " << server_ip << "\n";
             CLOSESOCK(client_socket);
+            client_socket = SOCK_INV;
             return false;
         }
 
@@ -55,39 +89,81 @@ namespace tcp_client {
         if (connect(client_socket, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCK_ERR) {
             std::cerr << "connect() failed\n";
             CLOSESOCK(client_socket);
+            client_socket = SOCK_INV;
             return false;
         }
 
+        reader.reset();
+        writer.clear();
         std::cout << "Connected to " << server_ip << ":" << server_port << "\n";
         return true;
     }
 
-    bool send_message(const std::string& message) {
-        int sent = send(client_socket, message.c_str(), static_cast<int>(message.length()), 0);
-        if (sent == SOCK_ERR) {
-            std::cerr << "send() failed\n";
+    bool Connection::send_message(const std::string& message) {
+        writer.queue(compressing ? encoder.encode(message) : std::string_view(message));
+        if (!writer.flush(client_socket)) {
             return false;
         }
         std::cout << "Sent message: " << message << "\n";
         return true;
     }
 
-    std::string receive_message() {
-        char buffer[1024];
-        int recvd = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-        if (recvd == SOCK_ERR) {
-            std::cerr << "recv() failed\n";
-            return "";
+    void Connection::queue_message(std::string_view message) {
+        if (compressing) {
+            encoded_queue.emplace_back(encoder.encode(message));
+            writer.queue(encoded_queue.back());
         }
-        else if (recvd == 0) {
-            std::cout << "Server closed connection\n";
+        else {
+            writer.queue(message);
+        }
+    }
+
+    bool Connection::flush_messages() {
+        bool flushed = writer.flush(client_socket);
+        encoded_queue.clear();
+        return flushed;
+    }
+
+    bool Connection::receive_message(std::string_view& message) {
+        std::string_view frame;
+        if (!reader.next_frame(client_socket, frame)) {
+            if (reader.closed()) {
+                std::cout << "Server closed connection\n";
+            }
+            return false;
+        }
+        if (compressing) {
+            return decoder.decode(frame, message);
+        }
+        message = frame;
+        return true;
+    }
+
+    bool Connection::wait_for_message(int timeout_ms) {
+        if (reader.has_frame()) {
+            return true;
+        }
+
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(client_socket, &readfds);
+
+        timeval tv;
+        tv.tv_sec = timeout_ms / 1000;
+        tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+        return select(static_cast<int>(client_socket) + 1, &readfds, nullptr, nullptr, &tv) > 0;
+    }
+
+    std::string Connection::receive_message() {
+        std::string_view message;
+        if (!receive_message(message)) {
             return "";
         }
-        buffer[recvd] = '\0';
-        return std::string(buffer);
+        return std::string(message);
     }
 
-    void disconnect() {
+    void Connection::disconnect() {
         if (client_socket != SOCK_INV) {
 #ifdef _WIN32
             shutdown(client_socket, SD_BOTH);
@@ -97,5 +173,72 @@ namespace tcp_client {
             CLOSESOCK(client_socket);
             client_socket = SOCK_INV;
         }
+        reader.reset();
+        writer.clear();
+        compressing = false;
+        encoded_queue.clear();
+    }
+
+    bool Connection::negotiate_compression(std::string_view dictionary) {
+        if (!payload_codec::available() || client_socket == SOCK_INV) {
+            return false;
+        }
+
+        // The handshake itself always goes out uncompressed
+        compressing = false;
+        std::string hello = payload_codec::hello(dictionary);
+        writer.queue(hello);
+        std::string_view answer;
+        if (!writer.flush(client_socket) || !receive_message(answer)) {
+            return false;
+        }
+
+        compressing = payload_codec::is_accepted(answer);
+        if (compressing) {
+            encoder = payload_codec::Encoder(dictionary);
+            decoder = payload_codec::Decoder(dictionary);
+        }
+        std::cout << "Compression " << (compressing ? "enabled" : "declined by server") << "\n";
+        return compressing;
+    }
+
+    bool Connection::is_connected() const {
+        return client_socket != SOCK_INV && !reader.closed();
+    }
+
+    ConnectionPool::ConnectionPool(const std::string& server_ip, uint16_t server_port, size_t max_idle)
+        : server_ip(server_ip), server_port(server_port), max_idle(max_idle) {
+    }
+
+    Connection ConnectionPool::acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!idle.empty()) {
+                Connection connection = std::move(idle.back());
+                idle.pop_back();
+                return connection;
+            }
+        }
+
+        // Connect outside the lock so other workers are not held up
+        Connection connection;
+        connection.connect_to_server(server_ip.c_str(), server_port);
+        return connection;
+    }
+
+    void ConnectionPool::release(Connection connection) {
+        if (!connection.is_connected()) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (idle.size() < max_idle) {
+            idle.push_back(std::move(connection));
+        }
+    }
+
+    size_t ConnectionPool::idle_connections() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return idle.size();
     }
-} 
\ No newline at end of file
+}
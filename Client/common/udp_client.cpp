@@ -1,5 +1,6 @@
 #include "udp_client.h"
 #include <iostream>
+#include <utility>
 
 #ifdef _WIN32
 #pragma comment(lib, "ws2_32.lib")
@@ -7,6 +8,7 @@
 #define SOCK_ERR   SOCKET_ERROR
 #define SOCK_INV   INVALID_SOCKET
 #else
+#include <sys/select.h>
 #include <unistd.h>
 #define CLOSESOCK(s) close(s)
 #define SOCK_ERR   -1
@@ -14,9 +16,6 @@
 #endif
 
 namespace udp_client {
-    static sock_t client_socket = SOCK_INV;
-    static sockaddr_in server_addr{};
-
     bool initialize_winsock() {
 #ifdef _WIN32
         WSADATA wsaData;
@@ -34,7 +33,36 @@ namespace udp_client {
 #endif
     }
 
-    bool create_socket(const char* server_ip, uint16_t server_port) {
+    Socket::Socket() : client_socket(SOCK_INV) {
+    }
+
+    Socket::~Socket() {
+        close_socket();
+    }
+
+    Socket::Socket(Socket&& other) noexcept
+        : client_socket(std::exchange(other.client_socket, SOCK_INV)),
+          server_addr(other.server_addr),
+          compressing(std::exchange(other.compressing, false)),
+          encoder(std::move(other.encoder)),
+          decoder(std::move(other.decoder)) {
+    }
+
+    Socket& Socket::operator=(Socket&& other) noexcept {
+        if (this != &other) {
+            close_socket();
+            client_socket = std::exchange(other.client_socket, SOCK_INV);
+            server_addr = other.server_addr;
+            compressing = std::exchange(other.compressing, false);
+            encoder = std::move(other.encoder);
+            decoder = std::move(other.decoder);
+        }
+        return *this;
+    }
+
+    bool Socket::create_socket(const char* server_ip, uint16_t server_port) {
+        close_socket();
+
         // Create UDP socket
         client_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
         if (client_socket == SOCK_INV) {
@@ -48,6 +76,7 @@ namespace udp_client {
         if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) != 1) {
             std::cerr << "Invalid address: " << server_ip << "\n";
             CLOSESOCK(client_socket);
+            client_socket = SOCK_INV;
             return false;
         }
 
@@ -55,8 +84,9 @@ namespace udp_client {
         return true;
     }
 
-    bool send_message(const std::string& message) {
-        int sent = sendto(client_socket, message.c_str(), static_cast<int>(message.length()), 0,
+    bool Socket::send_message(const std::string& message) {
+        std::string_view payload = compressing ? encoder.encode_datagram(message) : std::string_view(message);
+        int sent = sendto(client_socket, payload.data(), static_cast<int>(payload.size()), 0,
             (sockaddr*)&server_addr, sizeof(server_addr));
         if (sent == SOCK_ERR) {
             std::cerr << "sendto() failed\n";
@@ -66,7 +96,7 @@ namespace udp_client {
         return true;
     }
 
-    std::string receive_message() {
+    std::string Socket::receive_message() {
         char buffer[1024];
         sockaddr_in from_addr{};
         socklen_t from_len = sizeof(from_addr);
@@ -85,13 +115,83 @@ namespace udp_client {
         inet_ntop(AF_INET, &from_addr.sin_addr, sender_ip, INET_ADDRSTRLEN);
         std::cout << "Received from " << sender_ip << ":" << ntohs(from_addr.sin_port) << "\n";
         
+        if (compressing) {
+            std::string_view message;
+            if (!decoder.decode_datagram(std::string_view(buffer, recvd), message)) {
+                return "";
+            }
+            return std::string(message);
+        }
         return std::string(buffer);
     }
 
-    void close_socket() {
+    bool Socket::send_datagram(const char* data, size_t size) {
+        return sendto(client_socket, data, static_cast<int>(size), 0,
+            (sockaddr*)&server_addr, sizeof(server_addr)) != SOCK_ERR;
+    }
+
+    int Socket::receive_datagram(char* buffer, size_t capacity, int timeout_ms) {
+        if (timeout_ms >= 0) {
+            fd_set readfds;
+            FD_ZERO(&readfds);
+            FD_SET(client_socket, &readfds);
+            timeval tv;
+            tv.tv_sec = timeout_ms / 1000;
+            tv.tv_usec = (timeout_ms % 1000) * 1000;
+            if (select(static_cast<int>(client_socket) + 1, &readfds, nullptr, nullptr, &tv) <= 0) {
+                return 0;
+            }
+        }
+
+        sockaddr_in from_addr{};
+        socklen_t from_len = sizeof(from_addr);
+        int recvd = recvfrom(client_socket, buffer, static_cast<int>(capacity), 0, (sockaddr*)&from_addr, &from_len);
+        return recvd == SOCK_ERR ? -1 : recvd;
+    }
+
+    bool Socket::negotiate_compression(std::string_view dictionary) {
+        if (!payload_codec::available() || client_socket == SOCK_INV) {
+            return false;
+        }
+
+        compressing = false;
+        std::string hello = payload_codec::hello(dictionary);
+        if (sendto(client_socket, hello.data(), static_cast<int>(hello.size()), 0,
+            (sockaddr*)&server_addr, sizeof(server_addr)) == SOCK_ERR) {
+            std::cerr << "sendto() failed\n";
+            return false;
+        }
+
+        // Wait up to 1 s for the answer, so a lost datagram does not block the caller
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(client_socket, &readfds);
+        timeval tv;
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        if (select(static_cast<int>(client_socket) + 1, &readfds, nullptr, nullptr, &tv) <= 0) {
+            std::cout << "No answer to compression request\n";
+            return false;
+        }
+
+        char answer[64];
+        sockaddr_in from_addr{};
+        socklen_t from_len = sizeof(from_addr);
+        int recvd = recvfrom(client_socket, answer, sizeof(answer), 0, (sockaddr*)&from_addr, &from_len);
+        compressing = recvd != SOCK_ERR && payload_codec::is_accepted(std::string_view(answer, recvd));
+        if (compressing) {
+            encoder = payload_codec::Encoder(dictionary);
+            decoder = payload_codec::Decoder(dictionary);
+        }
+        std::cout << "Compression " << (compressing ? "enabled" : "declined by server") << "\n";
+        return compressing;
+    }
+
+    void Socket::close_socket() {
         if (client_socket != SOCK_INV) {
             CLOSESOCK(client_socket);
             client_socket = SOCK_INV;
         }
+        compressing = false;
     }
 } 
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "file_transfer.h"
+#include "tcp_client.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Downloads a file served by file_sender over several parallel TCP connections, one per
+// range (see file_transfer). Data goes to "<output>.part", preallocated to the full size
+// and written in large aligned blocks; progress is kept in "<output>.part.progress" so an
+// interrupted transfer resumes where it stopped. The .part file is renamed when complete.
+namespace file_receiver {
+    constexpr size_t WRITE_BUFFER_SIZE = 4 * 1024 * 1024;
+    constexpr size_t WRITE_ALIGNMENT = 4096;
+    constexpr uint64_t PROGRESS_INTERVAL = 64 * 1024 * 1024; // Bytes per stream between progress saves
+
+    // Writable file preallocated to its final size.
+    class FileSink {
+    public:
+        FileSink() = default;
+        ~FileSink();
+        FileSink(const FileSink&) = delete;
+        FileSink& operator=(const FileSink&) = delete;
+
+        // Open (keeping existing contents, for resume) and reserve `size` bytes on disk.
+        bool open(const std::string& path, uint64_t size);
+        void close();
+        // Thread-safe: concurrent writes to different offsets do not interfere.
+        bool write_at(uint64_t offset, const char* data, size_t size);
+        // Wait until everything written so far is on disk.
+        bool sync();
+
+    private:
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+#else
+        int file = -1;
+#endif
+    };
+
+    class Transfer {
+    public:
+        Transfer() = default;
+        ~Transfer();
+        Transfer(const Transfer&) = delete;
+        Transfer& operator=(const Transfer&) = delete;
+
+        // Ask the server for its file and start fetching it over `streams` connections.
+        // With an empty output path the file is saved under the name the server offers.
+        bool start(const char* server_ip, uint16_t server_port, std::string output_path, size_t streams);
+        // Wait for all streams; renames the file and returns true if it is complete.
+        bool finish();
+        // Stop early, keeping progress for a later resume.
+        void cancel();
+
+        bool done() const { return active_streams.load() == 0; }
+        uint64_t total_size() const { return offer.size; }
+        uint64_t bytes_received() const;
+        const std::string& output() const { return output_path; }
+
+    private:
+        struct Stream {
+            file_transfer::Range range;
+            std::atomic<uint64_t> written{0}; // Bytes of the range on disk
+        };
+
+        void receive(Stream& stream);
+        bool load_progress();
+        // Returns true once both the data and the record of it are on disk.
+        bool save_progress();
+
+        std::string server_ip;
+        uint16_t server_port = 0;
+        std::string output_path;
+        file_transfer::Offer offer;
+        FileSink sink;
+        std::vector<std::unique_ptr<Stream>> streams;
+        std::vector<std::thread> workers;
+        std::atomic<size_t> active_streams{0};
+        std::atomic<bool> cancelled{false};
+        std::mutex progress_mutex;
+    };
+}
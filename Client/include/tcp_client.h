@@ -1,5 +1,11 @@
 #pragma once
+#include <deque>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <vector>
+#include "message_framing.h"
+#include "payload_codec.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -15,8 +21,71 @@ using sock_t = int;
 namespace tcp_client {
     bool initialize_winsock();
     void cleanup_winsock();
-    bool connect_to_server(const char* server_ip, uint16_t server_port);
-    bool send_message(const std::string& message);
-    std::string receive_message();
-    void disconnect();
-} 
\ No newline at end of file
+
+    // One TCP connection to a server. Instances are independent, so a process can hold
+    // any number of them; a connection is move-only and may be handed to another thread,
+    // but must only be used by one thread at a time.
+    class Connection {
+    public:
+        Connection();
+        ~Connection();
+        Connection(Connection&& other) noexcept;
+        Connection& operator=(Connection&& other) noexcept;
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+        bool connect_to_server(const char* server_ip, uint16_t server_port);
+        bool send_message(const std::string& message);
+        std::string receive_message();
+
+        // Pipelined messaging: queued messages go out in one gathered write on flush.
+        // Queued payloads must stay alive until flush_messages() returns.
+        void queue_message(std::string_view message);
+        bool flush_messages();
+        // Zero-copy receive: the view is valid until the next receive call.
+        bool receive_message(std::string_view& message);
+        // Wait up to timeout_ms for a message to become available; false on timeout.
+        bool wait_for_message(int timeout_ms);
+        void disconnect();
+
+        // Ask the server to compress messages in both directions (see payload_codec).
+        // Returns true if it agreed; otherwise messages keep going out uncompressed.
+        bool negotiate_compression(std::string_view dictionary = payload_codec::default_dictionary());
+        bool compression_enabled() const { return compressing; }
+        const payload_codec::Encoder& compression_stats() const { return encoder; }
+
+        bool is_connected() const;
+        sock_t handle() const { return client_socket; }
+
+    private:
+        sock_t client_socket;
+        message_framing::StreamReader reader;
+        message_framing::BatchWriter writer;
+        bool compressing = false;
+        payload_codec::Encoder encoder;
+        payload_codec::Decoder decoder;
+        std::deque<std::string> encoded_queue; // Compressed copies of queued messages
+    };
+
+    // Thread-safe pool of connections to one server, so that parallel workers can
+    // reuse established connections instead of reconnecting for every exchange.
+    class ConnectionPool {
+    public:
+        ConnectionPool(const std::string& server_ip, uint16_t server_port, size_t max_idle = 8);
+        ConnectionPool(const ConnectionPool&) = delete;
+        ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+        // Reuse an idle connection or open a new one; check is_connected() on the result.
+        Connection acquire();
+        // Hand a connection back; closed connections and surplus ones are dropped.
+        void release(Connection connection);
+        size_t idle_connections() const;
+
+    private:
+        std::string server_ip;
+        uint16_t server_port;
+        size_t max_idle;
+        mutable std::mutex mutex;
+        std::vector<Connection> idle;
+    };
+}
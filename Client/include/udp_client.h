@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include "payload_codec.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -15,8 +16,41 @@ using sock_t = int;
 namespace udp_client {
     bool initialize_winsock();
     void cleanup_winsock();
-    bool create_socket(const char* server_ip, uint16_t server_port);
-    bool send_message(const std::string& message);
-    std::string receive_message();
-    void close_socket();
-} 
\ No newline at end of file
+
+    // UDP socket bound to one server address. Move-only; may be handed to another
+    // thread, but must only be used by one thread at a time.
+    class Socket {
+    public:
+        Socket();
+        ~Socket();
+        Socket(Socket&& other) noexcept;
+        Socket& operator=(Socket&& other) noexcept;
+        Socket(const Socket&) = delete;
+        Socket& operator=(const Socket&) = delete;
+
+        bool create_socket(const char* server_ip, uint16_t server_port);
+        bool send_message(const std::string& message);
+        std::string receive_message();
+        void close_socket();
+
+        // Raw datagram I/O without logging, e.g. for benchmarks. receive_datagram waits up to
+        // timeout_ms (-1 = forever) and returns the datagram size, 0 on timeout or -1 on error.
+        bool send_datagram(const char* data, size_t size);
+        int receive_datagram(char* buffer, size_t capacity, int timeout_ms);
+
+        // Ask the server to compress datagrams in both directions. Each datagram is
+        // compressed on its own against the dictionary, since datagrams can be lost.
+        bool negotiate_compression(std::string_view dictionary = payload_codec::default_dictionary());
+        bool compression_enabled() const { return compressing; }
+
+        sock_t handle() const { return client_socket; }
+        const sockaddr_in& server_address() const { return server_addr; }
+
+    private:
+        sock_t client_socket;
+        sockaddr_in server_addr{};
+        bool compressing = false;
+        payload_codec::Encoder encoder;
+        payload_codec::Decoder decoder;
+    };
+}
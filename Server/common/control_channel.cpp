@@ -0,0 +1,174 @@
+#include "control_channel.h"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace control_channel {
+    const char* address_from_environment() {
+        const char* address = std::getenv("CONTROL_ADDRESS");
+        return address && *address ? address : DEFAULT_ADDRESS;
+    }
+
+    static bool is_loopback(const sockaddr_in& address) {
+        return (ntohl(address.sin_addr.s_addr) >> 24) == 127;
+    }
+
+    Channel::~Channel() {
+        stop();
+    }
+
+    bool Channel::start(const sockaddr_in& current_destination, uint16_t port, const char* address) {
+        stop();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            destination = current_destination;
+            pending = Changes();
+            has_pending = false;
+        }
+
+        if (!listener.start_server(port, address)) {
+            return false;
+        }
+
+        stopping = false;
+        worker = std::thread(&Channel::serve_loop, this);
+        std::cout << "Stream control on " << address << ":" << port << "\n";
+        return true;
+    }
+
+    void Channel::stop() {
+        stopping = true;
+        if (worker.joinable()) {
+            worker.join();
+        }
+
+        sessions.stop();
+        listener.stop_server();
+    }
+
+    bool Channel::take(Changes& changes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!has_pending) {
+            return false;
+        }
+        changes = pending;
+        pending = Changes();
+        has_pending = false;
+        return true;
+    }
+
+    void Channel::publish(const Stats& snapshot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats = snapshot;
+    }
+
+    void Channel::serve_loop() {
+        while (!stopping.load(std::memory_order_relaxed)) {
+            // Short timeout so stop() is noticed promptly
+            if (!message_framing::wait_readable(listener.handle(), std::chrono::milliseconds(100))) {
+                continue;
+            }
+
+            tcp_server::Connection connection;
+            sockaddr_in peer{};
+            if (!listener.accept_client(connection, &peer)) {
+                continue;
+            }
+            if (sessions.active() >= MAX_SESSIONS) {
+                std::cerr << "Stream control: " << MAX_SESSIONS << " sessions already open, closing the new one\n";
+                continue;
+            }
+            sessions.start(std::move(connection),
+                [this, peer](tcp_server::Connection& client) { serve(client, peer); });
+        }
+    }
+
+    void Channel::serve(tcp_server::Connection& connection, const sockaddr_in& peer) {
+        std::string_view request;
+        auto last_request = std::chrono::steady_clock::now();
+        while (!stopping.load(std::memory_order_relaxed)) {
+            // Requests pipelined behind the last one are already buffered, and poll() does not
+            // report them. Nothing ever waits for a whole message, so a peer cannot stall here
+            if (!connection.has_frame() &&
+                message_framing::wait_readable(connection.handle(), std::chrono::milliseconds(100)) &&
+                !connection.read_available()) {
+                break;
+            }
+            bool received = false;
+            if (!connection.poll_message(request, received)) {
+                break;
+            }
+            if (!received) {
+                // Only whole requests count, so half a message left hanging times out as well
+                if (std::chrono::steady_clock::now() - last_request > IDLE_TIMEOUT) {
+                    break;
+                }
+                continue;
+            }
+            last_request = std::chrono::steady_clock::now();
+            std::string reply = handle(request, peer);
+            connection.queue_message(reply);
+            if (!connection.flush_messages()) {
+                break;
+            }
+        }
+    }
+
+    std::string Channel::handle(std::string_view request, const sockaddr_in& peer) {
+        stream_control::Command command;
+        std::string error;
+        if (!stream_control::parse_command(request, command, error)) {
+            return "ERROR " + error;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (command.type == stream_control::Type::STATS) {
+            std::ostringstream reply;
+            reply << std::fixed << std::setprecision(1)
+                  << "OK frame=" << stats.frame_id << " sent=" << stats.frames_sent
+                  << " dropped=" << stats.frames_dropped << " bytes=" << stats.bytes_sent
+                  << " fps=" << stats.fps << " target_fps=" << stats.target_fps
+                  << " quality=" << stats.quality << " resolution=" << stats.width << "x" << stats.height
+                  << " paused=" << (stats.paused ? 1 : 0) << " destination=" << stats.destination;
+            return reply.str();
+        }
+
+        switch (command.type) {
+            case stream_control::Type::REFRESH:
+                pending.refresh = true;
+                break;
+            case stream_control::Type::RESOLUTION:
+                pending.resolution = std::make_pair(command.width, command.height);
+                break;
+            case stream_control::Type::FPS:
+                pending.fps = command.fps;
+                break;
+            case stream_control::Type::QUALITY:
+                pending.max_quality = command.quality;
+                break;
+            case stream_control::Type::DESTINATION: {
+                in_addr address{};
+                inet_pton(AF_INET, command.address.c_str(), &address);
+                // Only local clients may send the video to another host
+                if (!is_loopback(peer) && address.s_addr != peer.sin_addr.s_addr) {
+                    return "ERROR destination must be this client's own address";
+                }
+                destination.sin_addr = address;
+                if (command.port != 0) {
+                    destination.sin_port = htons(command.port);
+                }
+                pending.destination = destination;
+                break;
+            }
+            case stream_control::Type::PAUSE:
+            case stream_control::Type::RESUME:
+                pending.paused = command.type == stream_control::Type::PAUSE;
+                break;
+            case stream_control::Type::STATS:
+                break;
+        }
+        has_pending = true;
+        return "OK applied from the next frame";
+    }
+}
@@ -0,0 +1,217 @@
+#include "file_sender.h"
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+
+#ifdef _WIN32
+#include <mswsock.h>
+#pragma comment(lib, "mswsock.lib")
+#define SOCK_ERR   SOCKET_ERROR
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SOCK_ERR   -1
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#endif
+
+namespace file_sender {
+    // Bytes per sendfile/TransmitFile call, so cancellation is noticed promptly
+    static const uint64_t SEND_CHUNK = 16 * 1024 * 1024;
+
+    FileSource::~FileSource() {
+        close();
+    }
+
+    bool FileSource::open(const std::string& path) {
+        close();
+
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER size;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+            std::cerr << "Could not open " << path << "\n";
+            close();
+            return false;
+        }
+        file_size = static_cast<uint64_t>(size.QuadPart);
+#else
+        file = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (file == -1 || fstat(file, &info) != 0) {
+            std::cerr << "Could not open " << path << "\n";
+            close();
+            return false;
+        }
+        file_size = static_cast<uint64_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    void FileSource::close() {
+#ifdef _WIN32
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (file != -1) {
+            ::close(file);
+            file = -1;
+        }
+#endif
+        file_size = 0;
+    }
+
+    bool FileSource::send_range(sock_t sock, uint64_t offset, uint64_t length,
+                                std::atomic<uint64_t>& sent, const std::atomic<bool>& cancel) {
+        uint64_t end = offset + length;
+        if (end > file_size || end < offset) {
+            std::cerr << "Requested range is outside the file\n";
+            return false;
+        }
+
+        while (offset < end) {
+            if (cancel.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            uint64_t chunk = std::min(SEND_CHUNK, end - offset);
+
+#ifdef _WIN32
+            // The offset comes from the OVERLAPPED structure; wait for completion if the
+            // socket runs the transfer asynchronously
+            OVERLAPPED overlapped{};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+            BOOL done = TransmitFile(sock, file, static_cast<DWORD>(chunk), 0, &overlapped, nullptr, 0);
+            DWORD transferred = static_cast<DWORD>(chunk);
+            if (!done) {
+                DWORD flags = 0;
+                if (WSAGetLastError() != WSA_IO_PENDING ||
+                    !WSAGetOverlappedResult(sock, &overlapped, &transferred, TRUE, &flags)) {
+                    std::cerr << "TransmitFile() failed\n";
+                    CloseHandle(overlapped.hEvent);
+                    return false;
+                }
+            }
+            CloseHandle(overlapped.hEvent);
+            offset += transferred;
+            sent.fetch_add(transferred, std::memory_order_relaxed);
+#elif defined(__linux__)
+            off_t position = static_cast<off_t>(offset);
+            ssize_t written = sendfile(sock, file, &position, static_cast<size_t>(chunk));
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                std::cerr << "sendfile() failed\n";
+                return false;
+            }
+            offset += static_cast<uint64_t>(written);
+            sent.fetch_add(static_cast<uint64_t>(written), std::memory_order_relaxed);
+#else
+            // No zero-copy path: read into a buffer and send it
+            static thread_local std::vector<char> buffer(1024 * 1024);
+            size_t wanted = static_cast<size_t>(std::min<uint64_t>(chunk, buffer.size()));
+            ssize_t got = pread(file, buffer.data(), wanted, static_cast<off_t>(offset));
+            if (got <= 0) {
+                std::cerr << "pread() failed\n";
+                return false;
+            }
+            std::string_view data(buffer.data(), static_cast<size_t>(got));
+            if (!message_framing::send_buffers(sock, &data, 1)) {
+                return false;
+            }
+            offset += static_cast<uint64_t>(got);
+            sent.fetch_add(static_cast<uint64_t>(got), std::memory_order_relaxed);
+#endif
+        }
+        return true;
+    }
+
+    Server::~Server() {
+        stop();
+    }
+
+    bool Server::start(uint16_t port, const std::string& file_path) {
+        stop();
+
+        FileSource source;
+        if (!source.open(file_path)) {
+            return false;
+        }
+        path = file_path;
+        offer.size = source.size();
+        offer.name = std::filesystem::path(file_path).filename().string();
+
+        if (!listener.start_server(port)) {
+            return false;
+        }
+
+#ifndef _WIN32
+        // sendfile() has no MSG_NOSIGNAL: a receiver that hangs up must not kill the process
+        signal(SIGPIPE, SIG_IGN);
+#endif
+
+        stopping = false;
+        acceptor = std::thread(&Server::accept_loop, this);
+        std::cout << "Serving " << offer.name << " (" << offer.size << " bytes)\n";
+        return true;
+    }
+
+    void Server::stop() {
+        stopping = true;
+        if (acceptor.joinable()) {
+            acceptor.join();
+        }
+
+        // Threads blocked in recv() or sendfile() on a stalled peer are woken by the shutdown
+        sessions.stop();
+        listener.stop_server();
+    }
+
+    void Server::accept_loop() {
+        while (!stopping.load(std::memory_order_relaxed)) {
+            // Short timeout so stop() is noticed promptly
+            if (!message_framing::wait_readable(listener.handle(), std::chrono::milliseconds(100))) {
+                continue;
+            }
+
+            tcp_server::Connection connection;
+            if (!listener.accept_client(connection)) {
+                continue;
+            }
+
+            totals.active_streams.fetch_add(1);
+            sessions.start(std::move(connection), [this](tcp_server::Connection& client) { serve(client); });
+        }
+    }
+
+    void Server::serve(tcp_server::Connection& connection) {
+        std::string_view message;
+        file_transfer::Request request;
+        if (connection.receive_message(message) && file_transfer::decode_request(message, request)) {
+            if (request.type == file_transfer::RequestType::OFFER) {
+                std::string reply = file_transfer::encode_offer(offer);
+                connection.queue_message(reply);
+                connection.flush_messages();
+            }
+            else {
+                // Every connection reads through its own handle, so offsets never interfere
+                FileSource source;
+                if (source.open(path) &&
+                    source.send_range(connection.handle(), request.offset, request.length, totals.bytes_sent, stopping)) {
+                    totals.ranges_sent.fetch_add(1);
+                }
+            }
+        }
+        totals.active_streams.fetch_sub(1);
+    }
+}
@@ -1,11 +1,14 @@
 #include <iostream>
 #include <string>
+#include <algorithm>
 #include <limits>
 #include <opencv2/opencv.hpp>
 #include <queue>
 #include <chrono>
 #include <iomanip>
 #include <sstream>
+#include <atomic>
+#include <thread>
 // Fix for Windows max macro conflict
 #define NOMINMAX
 #ifdef _WIN32
@@ -17,16 +20,58 @@
 #endif
 #include "../include/tcp_server.h"
 #include "../include/udp_server.h"
+#include "../include/tcp_video_sender.h"
+#include "../include/udp_sharded_server.h"
+#include "../include/udp_stream_mux.h"
+#include "../include/simulcast_sender.h"
+#include "../include/file_sender.h"
+#include "../include/metrics_exporter.h"
+#include "../include/rate_control.h"
+#include "../include/control_channel.h"
+#include "../../Shared/include/video_chunking.h"
+#include "../../Shared/include/frame_trace.h"
+#include "../../Shared/include/path_mtu.h"
+#include "../../Shared/include/simulcast.h"
+#include "../../Shared/include/shm_transport.h"
+#include "../../Shared/include/mjpeg_file.h"
+#include "../../Shared/include/raw_video.h"
+#include "../../Shared/include/clock_sync.h"
+#include "../../Shared/include/crc32c.h"
+#include "../../Shared/include/async_io.h"
+#include "../../Shared/include/video_config.h"
 
-#define VIDEO_PORT 12345
-#define CLIENT_IP "127.0.0.1"
+#define METRICS_PORT 9100
+
+// Video port, client address, frame rate, chunk and buffer sizes, quality bounds and pacing,
+// from video.conf and the command line (see video_config.h)
+static video_config::Settings settings;
+
+// Largest chunk one packet of the path carries, or the configured size if that is smaller
+static size_t chunk_size_for(size_t path_mtu_size) {
+    size_t size = path_mtu::chunk_size(path_mtu_size, video_chunking::HEADER_SIZE);
+    return settings.max_chunk_size > 0 ? std::min(size, settings.max_chunk_size) : size;
+}
+
+static std::string address_text(const sockaddr_in& address) {
+    char ip[INET_ADDRSTRLEN] = {};
+    inet_ntop(AF_INET, &address.sin_addr, ip, INET_ADDRSTRLEN);
+    return std::string(ip) + ":" + std::to_string(ntohs(address.sin_port));
+}
 
 enum class Demo {
     TCP_TEXT = 1,
     UDP_TEXT = 2,
     UDP_VIDEO = 3,
     UDP_VIDEO_PREVIEW = 4,
-    EXIT = 5
+    TCP_VIDEO = 5,
+    TCP_VIDEO_PREVIEW = 6,
+    UDP_ECHO_SHARDED = 7,
+    ASYNC_TCP_ECHO = 8,
+    FILE_TRANSFER = 9,
+    UDP_MULTI_VIDEO = 10,
+    UDP_SIMULCAST_VIDEO = 11,
+    UDP_FILE_VIDEO = 12,
+    EXIT = 13
 };
 
 Demo show_menu() {
@@ -36,7 +81,15 @@ Demo show_menu() {
         std::cout << "2. UDP Text Message\n";
         std::cout << "3. UDP Video Stream\n";
         std::cout << "4. UDP Video Stream with Preview\n";
-        std::cout << "5. Exit\n";
+        std::cout << "5. TCP Video Stream\n";
+        std::cout << "6. TCP Video Stream with Preview\n";
+        std::cout << "7. UDP Echo Server (multi-core)\n";
+        std::cout << "8. Async TCP Echo Server (coroutines)\n";
+        std::cout << "9. File Transfer (send)\n";
+        std::cout << "10. UDP Multi-Camera Video Stream\n";
+        std::cout << "11. UDP Simulcast Video Stream\n";
+        std::cout << "12. UDP Video from MJPEG File\n";
+        std::cout << "13. Exit\n";
         std::cout << "Enter your choice: ";
 
         int choice;
@@ -52,6 +105,22 @@ Demo show_menu() {
             case 4:
                 return Demo::UDP_VIDEO_PREVIEW;
             case 5:
+                return Demo::TCP_VIDEO;
+            case 6:
+                return Demo::TCP_VIDEO_PREVIEW;
+            case 7:
+                return Demo::UDP_ECHO_SHARDED;
+            case 8:
+                return Demo::ASYNC_TCP_ECHO;
+            case 9:
+                return Demo::FILE_TRANSFER;
+            case 10:
+                return Demo::UDP_MULTI_VIDEO;
+            case 11:
+                return Demo::UDP_SIMULCAST_VIDEO;
+            case 12:
+                return Demo::UDP_FILE_VIDEO;
+            case 13:
                 return Demo::EXIT;
             default:
                 std::cout << "Invalid choice. Please try again.\n";
@@ -60,13 +129,16 @@ Demo show_menu() {
 }
 
 bool run_tcp_text_demo(uint16_t port) {
+    tcp_server::Listener listener;
+    tcp_server::Connection client;
+
     // Initialize TCP server
     if (!tcp_server::initialize_winsock()) {
         return false;
     }
 
     // Start server
-    if (!tcp_server::start_server(port)) {
+    if (!listener.start_server(port)) {
         tcp_server::cleanup_winsock();
         return false;
     }
@@ -74,39 +146,43 @@ bool run_tcp_text_demo(uint16_t port) {
     std::cout << "TCP Server started. Waiting for client...\n";
 
     // Accept client
-    if (!tcp_server::accept_client()) {
-        tcp_server::stop_server();
+    if (!listener.accept_client(client)) {
+        listener.stop_server();
         tcp_server::cleanup_winsock();
         return false;
     }
 
     // Receive message
-    std::string message = tcp_server::receive_message();
+    std::string message = client.receive_message();
     if (!message.empty()) {
         std::cout << "Received message: " << message << "\n";
         
         // Send response
-        if (!tcp_server::send_message("Hello from TCP server!")) {
-            tcp_server::stop_server();
+        if (!client.send_message("Hello from TCP server!")) {
+            client.disconnect();
+            listener.stop_server();
             tcp_server::cleanup_winsock();
             return false;
         }
     }
 
     // Cleanup
-    tcp_server::stop_server();
+    client.disconnect();
+    listener.stop_server();
     tcp_server::cleanup_winsock();
     return true;
 }
 
 bool run_udp_text_demo(uint16_t port) {
+    udp_server::Socket server;
+
     // Initialize UDP server
     if (!udp_server::initialize_winsock()) {
         return false;
     }
 
     // Start server
-    if (!udp_server::start_server(port)) {
+    if (!server.start_server(port)) {
         udp_server::cleanup_winsock();
         return false;
     }
@@ -114,24 +190,298 @@ bool run_udp_text_demo(uint16_t port) {
     std::cout << "UDP Server started. Waiting for client...\n";
 
     // Receive message
-    auto [message, client_addr] = udp_server::receive_message();
+    auto [message, client_addr] = server.receive_message();
     if (!message.empty()) {
         std::cout << "Received message: " << message << "\n";
         
         // Send response
-        if (!udp_server::send_message("Hello from UDP server!", client_addr)) {
-            udp_server::stop_server();
+        if (!server.send_message("Hello from UDP server!", client_addr)) {
+            server.stop_server();
             udp_server::cleanup_winsock();
             return false;
         }
     }
 
     // Cleanup
-    udp_server::stop_server();
+    server.stop_server();
+    udp_server::cleanup_winsock();
+    return true;
+}
+
+bool run_udp_sharded_echo_demo(uint16_t port) {
+    // Initialize Winsock
+    if (!udp_server::initialize_winsock()) {
+        return false;
+    }
+
+    // One SO_REUSEPORT socket and pinned thread per core, each echoing requests back
+    udp_sharded_server::Options options;
+    options.port = port;
+    udp_sharded_server::Server server;
+    bool started = server.start(options,
+        [](const char* request, size_t size, const sockaddr_in&, char* reply, size_t capacity) {
+            size_t reply_size = std::min(size, capacity);
+            memcpy(reply, request, reply_size);
+            return reply_size;
+        });
+    if (!started) {
+        udp_server::cleanup_winsock();
+        return false;
+    }
+
+    // The server keeps its own atomic counters; the metrics read them at scrape time
+    metrics::Registry& registry = metrics::default_registry();
+    registry.gauge_function("udp_echo_requests", "Requests received by the running echo server",
+        [&server] { return static_cast<double>(server.total_requests()); });
+    registry.gauge_function("udp_echo_replies", "Replies sent by the running echo server",
+        [&server] { return static_cast<double>(server.total_replies()); });
+
+    std::cout << "Echoing UDP requests. Press ESC to stop.\n";
+
+    uint64_t last_requests = 0;
+    auto last_stats = std::chrono::steady_clock::now();
+    bool running = true;
+    while (running) {
+        Sleep(100);
+
+        // Print request rate every second
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::seconds>(now - last_stats).count() >= 1) {
+            uint64_t requests = server.total_requests();
+            std::cout << "Echo stats - Requests: " << requests - last_requests
+                      << ", Total replies: " << server.total_replies() << ", Per shard:";
+            for (size_t i = 0; i < server.shard_count(); i++) {
+                std::cout << " " << server.shard_stats(i).requests.load();
+            }
+            std::cout << std::endl;
+            last_requests = requests;
+            last_stats = now;
+        }
+
+        if (_kbhit()) {
+            char c = static_cast<char>(_getch());
+            if (c == 27) running = false;  // ESC key
+        }
+    }
+
+    registry.remove_function("udp_echo_requests");
+    registry.remove_function("udp_echo_replies");
+    server.stop();
     udp_server::cleanup_winsock();
     return true;
 }
 
+async_io::Task<void> serve_echo_client(async_io::Reactor& reactor, sock_t sock, std::atomic<uint64_t>& echoed) {
+    async_io::TcpConnection connection(reactor, sock);
+    std::string_view message;
+    while (co_await connection.receive(message)) {
+        if (!co_await connection.send(message)) {
+            break;
+        }
+        echoed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+async_io::Task<void> accept_echo_clients(async_io::TcpListener& listener, async_io::ReactorPool& workers,
+                                         std::atomic<uint64_t>& echoed) {
+    while (true) {
+        sock_t sock = co_await listener.accept();
+        if (sock == async_io::INVALID_SOCK) {
+            if (!listener.is_open()) {
+                co_return;
+            }
+            // Out of descriptors (EMFILE / ENFILE) or an aborted handshake: the backlog stays
+            // readable, so back off instead of spinning. This reactor does nothing but accept.
+            Sleep(10);
+            continue;
+        }
+        // Each client lives on one worker reactor for its whole lifetime
+        async_io::Reactor& reactor = workers.next();
+        reactor.spawn(serve_echo_client(reactor, sock, echoed));
+    }
+}
+
+bool run_async_tcp_echo_demo(uint16_t port) {
+    // Initialize Winsock
+    if (!tcp_server::initialize_winsock()) {
+        return false;
+    }
+
+    // One reactor accepts, the others serve clients (thousands per thread)
+    async_io::ReactorPool workers;
+    workers.start(std::max(1u, std::thread::hardware_concurrency()));
+
+    async_io::Reactor acceptor;
+    async_io::TcpListener listener(acceptor);
+    if (!listener.listen(port)) {
+        workers.stop();
+        tcp_server::cleanup_winsock();
+        return false;
+    }
+
+    std::atomic<uint64_t> echoed{0};
+    acceptor.spawn(accept_echo_clients(listener, workers, echoed));
+    std::thread acceptor_thread(&async_io::Reactor::run, &acceptor);
+
+    std::cout << "Echoing framed TCP messages on " << workers.size()
+              << " reactor threads. Press ESC to stop.\n";
+
+    uint64_t last_echoed = 0;
+    auto last_stats = std::chrono::steady_clock::now();
+    bool running = true;
+    while (running) {
+        Sleep(100);
+
+        // Print message rate every second
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::seconds>(now - last_stats).count() >= 1) {
+            size_t clients = 0;
+            for (size_t i = 0; i < workers.size(); i++) {
+                clients += workers.at(i).active_tasks();
+            }
+            uint64_t total = echoed.load();
+            std::cout << "Echo stats - Messages: " << total - last_echoed
+                      << ", Clients: " << clients << std::endl;
+            last_echoed = total;
+            last_stats = now;
+        }
+
+        if (_kbhit()) {
+            char c = static_cast<char>(_getch());
+            if (c == 27) running = false;  // ESC key
+        }
+    }
+
+    // Stopping a reactor destroys its remaining coroutines, which closes their sockets
+    acceptor.stop();
+    acceptor_thread.join();
+    workers.stop();
+    tcp_server::cleanup_winsock();
+    return true;
+}
+
+bool run_file_transfer_demo(uint16_t port) {
+    std::cout << "File to serve: ";
+    std::string path;
+    std::cin >> std::ws;
+    std::getline(std::cin, path);
+
+    // Initialize Winsock
+    if (!tcp_server::initialize_winsock()) {
+        return false;
+    }
+
+    file_sender::Server server;
+    if (!server.start(port, path)) {
+        tcp_server::cleanup_winsock();
+        return false;
+    }
+
+    metrics::Registry& registry = metrics::default_registry();
+    registry.gauge_function("file_transfer_bytes_sent", "Bytes sent by the running file server",
+        [&server] { return static_cast<double>(server.stats().bytes_sent.load()); });
+    registry.gauge_function("file_transfer_active_streams", "Ranges being sent right now",
+        [&server] { return static_cast<double>(server.stats().active_streams.load()); });
+
+    std::cout << "Waiting for receivers. Press ESC to stop.\n";
+
+    uint64_t last_sent = 0;
+    auto last_stats = std::chrono::steady_clock::now();
+    bool running = true;
+    while (running) {
+        Sleep(100);
+
+        // Print throughput every second
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_stats).count();
+        if (elapsed >= 1.0) {
+            const file_sender::Stats& stats = server.stats();
+            uint64_t sent = stats.bytes_sent.load();
+            if (sent != last_sent || stats.active_streams.load() > 0) {
+                std::cout << "Transfer stats - Streams: " << stats.active_streams.load()
+                          << ", Ranges done: " << stats.ranges_sent.load()
+                          << ", Rate: " << std::fixed << std::setprecision(1)
+                          << (sent - last_sent) / elapsed / (1024 * 1024) << " MB/s" << std::endl;
+            }
+            last_sent = sent;
+            last_stats = now;
+        }
+
+        if (_kbhit()) {
+            char c = static_cast<char>(_getch());
+            if (c == 27) running = false;  // ESC key
+        }
+    }
+
+    registry.remove_function("file_transfer_bytes_sent");
+    registry.remove_function("file_transfer_active_streams");
+    server.stop();
+    tcp_server::cleanup_winsock();
+    return true;
+}
+
+bool open_camera(cv::VideoCapture& cap, double& actualFPS) {
+    // Open webcam with DirectShow backend
+    cap.open(0, cv::CAP_DSHOW);
+    if (!cap.isOpened()) {
+        std::cerr << "Could not open webcam.\n";
+        return false;
+    }
+
+    // Configure camera for high performance
+    cap.set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'));
+    cap.set(cv::CAP_PROP_FRAME_WIDTH, 1920);
+    cap.set(cv::CAP_PROP_FRAME_HEIGHT, 1080);
+    cap.set(cv::CAP_PROP_FPS, 30);
+
+    // Read back actual camera settings
+    double actualWidth = cap.get(cv::CAP_PROP_FRAME_WIDTH);
+    double actualHeight = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
+    actualFPS = cap.get(cv::CAP_PROP_FPS);
+
+    std::cout << "Camera initialized with settings:\n"
+              << "Resolution: " << actualWidth << "x" << actualHeight << "\n"
+              << "FPS: " << actualFPS << "\n"
+              << "Streaming video. Press ESC to stop.\n";
+    return true;
+}
+
+// Cumulative video statistics for the metrics endpoint, named "<prefix>_..."
+struct VideoMetrics {
+    explicit VideoMetrics(const std::string& prefix)
+        : bytes_sent(registry().counter(prefix + "_bytes_sent_total", "Video bytes handed to the socket")),
+          chunks_sent(registry().counter(prefix + "_chunks_sent_total", "Video chunks or frame messages sent")),
+          frames_sent(registry().counter(prefix + "_frames_sent_total", "Frames sent completely")),
+          frames_dropped(registry().counter(prefix + "_frames_dropped_total", "Frames dropped before being sent completely")),
+          send_errors(registry().counter(prefix + "_send_errors_total", "Failed sends, not counting would-block")),
+          quality(registry().gauge(prefix + "_jpeg_quality", "Current JPEG quality")),
+          fps(registry().gauge(prefix + "_fps", "Captured frames per second")),
+          frame_bytes(registry().histogram(prefix + "_frame_bytes", "Encoded frame size in bytes", metrics::size_buckets())),
+          frame_seconds(registry().histogram(prefix + "_frame_seconds", "Capture to frame handed to the socket, in seconds",
+              metrics::latency_buckets())) {
+    }
+
+    static metrics::Registry& registry() { return metrics::default_registry(); }
+
+    metrics::Counter& bytes_sent;
+    metrics::Counter& chunks_sent;
+    metrics::Counter& frames_sent;
+    metrics::Counter& frames_dropped;
+    metrics::Counter& send_errors;
+    metrics::Gauge& quality;
+    metrics::Gauge& fps;
+    metrics::Histogram& frame_bytes;
+    metrics::Histogram& frame_seconds;
+};
+
+// ESC in the preview window, or on the console without one
+static bool escape_pressed(bool preview) {
+    if (preview) {
+        return static_cast<char>(cv::waitKey(1)) == 27;
+    }
+    return _kbhit() && static_cast<char>(_getch()) == 27;
+}
+
 bool run_udp_video_demo(bool preview) {
     // Init Winsock
     WSADATA wsa;
@@ -150,8 +500,8 @@ bool run_udp_video_demo(bool preview) {
 
     sockaddr_in clientAddr;
     clientAddr.sin_family = AF_INET;
-    clientAddr.sin_port = htons(VIDEO_PORT);
-    if (inet_pton(AF_INET, CLIENT_IP, &clientAddr.sin_addr) != 1) {
+    clientAddr.sin_port = htons(settings.video_port);
+    if (inet_pton(AF_INET, settings.client_ip.c_str(), &clientAddr.sin_addr) != 1) {
         std::cerr << "Failed to set client IP\n";
         closesocket(sock);
         WSACleanup();
@@ -159,9 +509,7 @@ bool run_udp_video_demo(bool preview) {
     }
 
     // Print client address info
-    char client_ip_str[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &clientAddr.sin_addr, client_ip_str, INET_ADDRSTRLEN);
-    std::cout << "Sending video to client at " << client_ip_str << ":" << ntohs(clientAddr.sin_port) << std::endl;
+    std::cout << "Sending video to client at " << address_text(clientAddr) << std::endl;
 
     // Enable broadcast (in case client is on broadcast address)
     int broadcast = 1;
@@ -169,8 +517,13 @@ bool run_udp_video_demo(bool preview) {
         std::cerr << "Failed to set broadcast option\n";
     }
 
-    // Increase send buffer size
-    int sendbuf = 262144; // 256KB buffer
+    // Set VIDEO_PAYLOAD=raw or raw-lz4 to skip JPEG on fast links
+    raw_video::Mode payload_mode = raw_video::mode_from_environment();
+    bool raw = payload_mode != raw_video::Mode::JPEG;
+    std::cout << "Payload: " << raw_video::mode_name(payload_mode) << "\n";
+
+    // Increase send buffer size; a raw frame is several MB
+    int sendbuf = raw ? std::max(settings.send_buffer, 8 * 1024 * 1024) : settings.send_buffer;
     if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char*)&sendbuf, sizeof(sendbuf)) < 0) {
         std::cerr << "Failed to set send buffer size\n";
     }
@@ -181,31 +534,20 @@ bool run_udp_video_demo(bool preview) {
         std::cerr << "Failed to set non-blocking mode\n";
     }
 
-    // Open webcam with DirectShow backend
-    cv::VideoCapture cap(0, cv::CAP_DSHOW);
-    if (!cap.isOpened()) {
-        std::cerr << "Could not open webcam.\n";
+    // One chunk per IP packet: a lost fragment would lose its whole chunk
+    path_mtu::disable_fragmentation(sock);
+    size_t path_mtu_size = path_mtu::discover(clientAddr);
+    size_t max_chunk_size = chunk_size_for(path_mtu_size);
+    std::cout << "Path MTU: " << path_mtu_size << " bytes, chunks of up to " << max_chunk_size << " bytes\n";
+
+    cv::VideoCapture cap;
+    double actualFPS = 0.0;
+    if (!open_camera(cap, actualFPS)) {
         closesocket(sock);
         WSACleanup();
         return false;
     }
 
-    // Configure camera for high performance
-    cap.set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'));
-    cap.set(cv::CAP_PROP_FRAME_WIDTH, 1920);
-    cap.set(cv::CAP_PROP_FRAME_HEIGHT, 1080);
-    cap.set(cv::CAP_PROP_FPS, 30);
-
-    // Read back actual camera settings
-    double actualWidth = cap.get(cv::CAP_PROP_FRAME_WIDTH);
-    double actualHeight = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
-    double actualFPS = cap.get(cv::CAP_PROP_FPS);
-
-    std::cout << "Camera initialized with settings:\n"
-              << "Resolution: " << actualWidth << "x" << actualHeight << "\n"
-              << "FPS: " << actualFPS << "\n"
-              << "Streaming video. Press ESC to stop.\n";
-
     if (preview) {
         cv::namedWindow("Server Preview", cv::WINDOW_AUTOSIZE | cv::WINDOW_GUI_NORMAL);
     }
@@ -216,38 +558,114 @@ bool run_udp_video_demo(bool preview) {
     params.push_back(85);
     params.push_back(cv::IMWRITE_JPEG_OPTIMIZE);
     params.push_back(1);
+    raw_video::Encoder raw_encoder;
 
     cv::Mat frame, display_frame;
     bool running = true;
 
-    // FPS and rate control variables
-    const int TARGET_FPS = 30;
+    // FPS and rate control variables; the frame rate can change from the control channel
+    double target_fps = settings.target_fps;
     const int FPS_WINDOW_SIZE = 30;
-    const double FRAME_TIME = 1000.0 / TARGET_FPS;
-    const size_t MAX_CHUNK_SIZE = 58000; // Reduced to avoid fragmentation
+    double frame_time = 1000.0 / target_fps;
     const size_t MAX_PENDING_FRAMES = 2;
+    // Reused for every chunk; with buffer, the loop stops allocating once both have grown.
+    // Chunks only ever shrink when the path MTU drops, and grow only for a new destination
+    std::vector<char> chunk_buffer(max_chunk_size + video_chunking::HEADER_SIZE);
     std::queue<std::chrono::steady_clock::time_point> frame_times;
     double current_fps = 0.0;
 
-    // Network congestion control
+    // Network congestion control: send errors shrink the rate controller's budget
     size_t consecutive_errors = 0;
     const size_t ERROR_THRESHOLD = 5;
-    int current_quality = 85;
+    int current_quality = settings.max_quality;
+    size_t reencoded_frames = 0;
+
+    // Set VIDEO_BITRATE (e.g. 8M) to change the budget each JPEG frame is sized to
+    rate_control::Controller rate(rate_control::bitrate_from_environment(), target_fps,
+        settings.min_quality, settings.max_quality);
+    if (!raw) {
+        std::cout << "Rate control: " << static_cast<size_t>(rate.budget_bytes()) << " bytes per frame\n";
+    }
+    video_chunking::Pacer pacer(settings.pacing_rate);
+    if (settings.pacing_rate > 0) {
+        std::cout << "Pacing chunks at " << settings.pacing_rate / 1e6 << " Mbit/s\n";
+    }
     
-    // Debug variables for network statistics
+    // Debug variables for network statistics; the metrics keep cumulative totals
+    VideoMetrics video_metrics("video_udp");
     size_t total_bytes_sent = 0;
     size_t total_chunks_sent = 0;
     size_t dropped_frames = 0;
     auto last_stats = std::chrono::steady_clock::now();
+    static uint32_t frame_id = 0;
+
+    // Live changes from clients over TCP (see stream_control.h), applied between frames
+    control_channel::Channel control;
+    control.start(clientAddr, stream_control::PORT, control_channel::address_from_environment());
+    control_channel::Stats control_stats;
+    control_stats.destination = address_text(clientAddr);
+    cv::Size output_size;           // Empty: the camera's own
+    cv::Mat scaled;
+    bool paused = false;
+    bool refresh = false;
+    // Below the camera's rate, frames that come too early are captured but not sent
+    auto next_due = std::chrono::steady_clock::now();
 
     while (running) {
+        control_channel::Changes changes;
+        if (control.take(changes)) {
+            if (changes.fps) {
+                target_fps = *changes.fps;
+                frame_time = 1000.0 / target_fps;
+                rate.set_frame_rate(target_fps);
+            }
+            if (changes.resolution) {
+                output_size = cv::Size(changes.resolution->first, changes.resolution->second);
+            }
+            if (changes.max_quality) {
+                rate.set_quality_range(settings.min_quality, *changes.max_quality);
+            }
+            if (changes.paused) {
+                paused = *changes.paused;
+            }
+            if (changes.destination) {
+                clientAddr = *changes.destination;
+                path_mtu_size = path_mtu::discover(clientAddr);
+                max_chunk_size = chunk_size_for(path_mtu_size);
+                chunk_buffer.resize(max_chunk_size + video_chunking::HEADER_SIZE);
+                control_stats.destination = address_text(clientAddr);
+            }
+            refresh = refresh || changes.refresh;
+            std::cout << "Control: " << target_fps << " fps, "
+                      << (output_size.empty() ? std::string("camera resolution") :
+                          std::to_string(output_size.width) + "x" + std::to_string(output_size.height))
+                      << ", quality up to " << rate.highest_quality() << ", to " << control_stats.destination
+                      << (paused ? ", paused" : "") << std::endl;
+        }
+
         auto frame_start = std::chrono::steady_clock::now();
 
+        frame_trace::Span capture_span(frame_trace::Stage::CAPTURE, frame_id);
         cap >> frame;
+        capture_span.end();
         if (frame.empty()) {
             std::cerr << "Failed to capture frame\n";
             continue;
         }
+        int64_t capture_us = frame_trace::now_us();
+
+        // A quarter of a frame early still counts, for the camera's jitter
+        auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(frame_time));
+        if (frame_start + interval / 4 < next_due) {
+            continue;
+        }
+        next_due = std::max(next_due + interval, frame_start);
+
+        if (!output_size.empty() && frame.size() != output_size) {
+            cv::resize(frame, scaled, output_size, 0, 0, cv::INTER_AREA);
+        }
+        const cv::Mat& outgoing = !output_size.empty() && frame.size() != output_size ? scaled : frame;
 
         // Calculate FPS
         frame_times.push(frame_start);
@@ -263,27 +681,67 @@ bool run_udp_video_demo(bool preview) {
 
         // If preview is enabled, create a copy for display
         if (preview) {
-            display_frame = frame.clone();
+            outgoing.copyTo(display_frame);
             // Add resolution and FPS overlay
             std::stringstream info;
-            info << "Resolution: " << frame.cols << "x" << frame.rows 
+            info << "Resolution: " << outgoing.cols << "x" << outgoing.rows
                  << " | FPS: " << std::fixed << std::setprecision(1) << current_fps
-                 << " | Target: " << actualFPS
-                 << " | Quality: " << current_quality;
+                 << " | Target: " << actualFPS;
+            if (paused) {
+                info << " | Paused";
+            }
+            else if (raw) {
+                info << " | Payload: " << raw_video::mode_name(payload_mode);
+            }
+            else {
+                info << " | Quality: " << current_quality;
+            }
             cv::putText(display_frame, info.str(), cv::Point(10, 30),
                 cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 0), 2);
             cv::imshow("Server Preview", display_frame);
         }
 
-        // Compress frame to JPEG with dynamic quality
-        params[1] = current_quality;
-        cv::imencode(".jpg", frame, buffer, params);
+        // Paused: capture goes on, so resuming is immediate, but nothing is encoded or sent
+        if (paused) {
+            control_stats.paused = true;
+            control_stats.fps = current_fps;
+            control.publish(control_stats);
+            if (escape_pressed(preview)) {
+                running = false;
+            }
+            continue;
+        }
+
+        // Compress frame to JPEG at the quality expected to fit the budget, or convert it to YUV420
+        frame_trace::Span encode_span(frame_trace::Stage::ENCODE, frame_id);
+        if (raw) {
+            raw_encoder.encode(outgoing, payload_mode == raw_video::Mode::RAW_LZ4 ?
+                raw_video::Compression::LZ4 : raw_video::Compression::NONE, buffer);
+        }
+        else {
+            // A refresh asked for over the control channel goes out at the top quality, whatever the budget
+            double complexity = rate.measure_complexity(outgoing);
+            current_quality = refresh ? rate.highest_quality() : rate.choose_quality(complexity);
+            params[1] = current_quality;
+            cv::imencode(".jpg", outgoing, buffer, params);
+            // A far miss, typically at a scene change, costs a second encode rather than a burst
+            if (rate.observe(current_quality, complexity, buffer.size()) && !refresh) {
+                current_quality = rate.choose_quality(complexity);
+                params[1] = current_quality;
+                cv::imencode(".jpg", outgoing, buffer, params);
+                rate.observe(current_quality, complexity, buffer.size());
+                reencoded_frames++;
+            }
+        }
+        encode_span.end();
+        video_metrics.frame_bytes.observe(static_cast<double>(buffer.size()));
+        video_metrics.quality.set(current_quality);
+        video_metrics.fps.set(current_fps);
 
-        // Split frame into chunks with headers
-        const size_t HEADER_SIZE = 12; // 4 bytes frame ID, 4 bytes chunk ID, 4 bytes total_chunks
+        // Split frame into chunks with headers, each carrying the frame's CRC
         size_t total_size = buffer.size();
-        size_t num_chunks = (total_size + MAX_CHUNK_SIZE - 1) / MAX_CHUNK_SIZE;
-        static uint32_t frame_id = 0;
+        size_t num_chunks = video_chunking::chunk_count(total_size, max_chunk_size);
+        uint32_t frame_crc = crc32c::value(buffer.data(), total_size);
 
         // Debug output
         static auto last_debug = std::chrono::steady_clock::now();
@@ -291,7 +749,12 @@ bool run_udp_video_demo(bool preview) {
         if (std::chrono::duration_cast<std::chrono::seconds>(now - last_debug).count() >= 1) {
             std::cout << "Server: Frame " << frame_id << " size: " << total_size 
                       << " bytes, chunks: " << num_chunks 
-                      << ", quality: " << current_quality << std::endl;
+                      << ", quality: " << current_quality;
+            if (!raw) {
+                std::cout << ", target: " << rate.target_bytes() << " bytes, re-encoded: " << reencoded_frames;
+                reencoded_frames = 0;
+            }
+            std::cout << std::endl;
             last_debug = now;
         }
 
@@ -307,26 +770,13 @@ bool run_udp_video_demo(bool preview) {
             last_stats = now;
         }
 
-        // Prepare header buffer
-        std::vector<char> chunk_buffer(MAX_CHUNK_SIZE + HEADER_SIZE);
-        
         // Send all chunks for this frame
-        size_t offset = 0;
+        frame_trace::Span send_span(frame_trace::Stage::SEND, frame_id);
         bool frame_sent = true;
+        size_t frame_bytes_sent = 0;
         for (size_t chunk_id = 0; chunk_id < num_chunks; chunk_id++) {
-            size_t chunk_size = std::min(MAX_CHUNK_SIZE, total_size - offset);
-            
-            // Write header (frame_id, chunk_id, total_chunks)
-            uint32_t frame_id_net = htonl(frame_id);
-            uint32_t chunk_id_net = htonl(static_cast<uint32_t>(chunk_id));
-            uint32_t total_chunks_net = htonl(static_cast<uint32_t>(num_chunks));
-            memcpy(chunk_buffer.data(), &frame_id_net, 4);
-            memcpy(chunk_buffer.data() + 4, &chunk_id_net, 4);
-            memcpy(chunk_buffer.data() + 8, &total_chunks_net, 4);
-            
-            // Copy chunk data
-            memcpy(chunk_buffer.data() + HEADER_SIZE, buffer.data() + offset, chunk_size);
-            
+            pacer.wait();
+
             // Send chunk with timeout using select
             fd_set writefds;
             FD_ZERO(&writefds);
@@ -337,100 +787,1114 @@ bool run_udp_video_demo(bool preview) {
             tv.tv_usec = 5000; // 5ms timeout
             
             if (select(0, nullptr, &writefds, nullptr, &tv) > 0) {
-                int sent = sendto(sock, chunk_buffer.data(), static_cast<int>(chunk_size + HEADER_SIZE), 0,
+                // Header (frame_id, chunk_id, total_chunks, stream 0, capture and send times)
+                // followed by the chunk data, built once the socket can take it
+                size_t datagram_size = video_chunking::build_chunk(frame_id, buffer.data(), total_size,
+                    chunk_id, max_chunk_size, chunk_buffer.data(), 0, 0, capture_us, frame_trace::now_us(), frame_crc);
+                int sent = sendto(sock, chunk_buffer.data(), static_cast<int>(datagram_size), 0,
                     reinterpret_cast<sockaddr*>(&clientAddr), sizeof(clientAddr));
                     
                 if (sent == SOCKET_ERROR) {
                     int error = WSAGetLastError();
+                    if (path_mtu::is_too_big(error)) {
+                        // The path narrowed (ICMP fragmentation needed): re-chunk from the next frame
+                        path_mtu_size = path_mtu::after_too_big(clientAddr, datagram_size);
+                        max_chunk_size = std::min(max_chunk_size,
+                            path_mtu::chunk_size(path_mtu_size, video_chunking::HEADER_SIZE));
+                        std::cout << "Path MTU dropped to " << path_mtu_size << " bytes\n";
+                        frame_sent = false;
+                        break;
+                    }
                     if (error != WSAEWOULDBLOCK) {
+                        video_metrics.send_errors.add();
                         consecutive_errors++;
                         frame_sent = false;
-                        if (consecutive_errors >= ERROR_THRESHOLD && current_quality > 60) {
-                            current_quality = std::max(60, static_cast<int>(current_quality - 5));
+                        if (consecutive_errors >= ERROR_THRESHOLD) {
+                            rate.congestion();
                             consecutive_errors = 0;
                         }
                     }
                 } else {
                     consecutive_errors = 0;
+                    pacer.sent(static_cast<size_t>(sent));
+                    frame_bytes_sent += static_cast<size_t>(sent);
                     total_bytes_sent += sent;
                     total_chunks_sent++;
+                    video_metrics.bytes_sent.add(static_cast<uint64_t>(sent));
+                    video_metrics.chunks_sent.add();
                 }
             } else {
                 frame_sent = false;
                 break;
             }
-            
-            offset += chunk_size;
         }
+        send_span.end();
         
+        video_metrics.frame_seconds.observe(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - frame_start).count());
+        (frame_sent ? video_metrics.frames_sent : video_metrics.frames_dropped).add();
         if (!frame_sent) {
             dropped_frames++;
-        } else if (consecutive_errors == 0 && current_quality < 85) {
-            // Gradually increase quality if network is stable
-            current_quality = std::min(85, static_cast<int>(current_quality + 1));
         }
+        if (!raw) {
+            // Headers included: the budget is what goes on the wire
+            rate.sent(frame_bytes_sent);
+        }
+        refresh = false;
+
+        control_stats.frame_id = frame_id;
+        (frame_sent ? control_stats.frames_sent : control_stats.frames_dropped)++;
+        control_stats.bytes_sent += frame_bytes_sent;
+        control_stats.fps = current_fps;
+        control_stats.target_fps = target_fps;
+        control_stats.quality = raw ? 0 : current_quality;
+        control_stats.width = outgoing.cols;
+        control_stats.height = outgoing.rows;
+        control_stats.paused = false;
+        control.publish(control_stats);
         
         frame_id++;
 
         // Check for ESC key and handle input
-        if (preview) {
-            char c = static_cast<char>(cv::waitKey(1));
-            if (c == 27) running = false;  // ESC key
-        } else if (_kbhit()) {
-            char c = static_cast<char>(_getch());
-            if (c == 27) running = false;  // ESC key
+        if (escape_pressed(preview)) {
+            running = false;
         }
 
         // Calculate processing time and add delay if needed
         auto frame_end = std::chrono::steady_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(frame_end - frame_start).count();
         
-        if (duration < FRAME_TIME) {
-            auto sleep_time = static_cast<DWORD>((FRAME_TIME - duration) / 2);
+        if (duration < frame_time) {
+            auto sleep_time = static_cast<DWORD>((frame_time - duration) / 2);
             if (sleep_time > 0) {
                 Sleep(sleep_time); // Use half the available time for better timing
             }
         }
     }
 
+    control.stop();
     if (preview) {
         cv::destroyWindow("Server Preview");
     }
     cap.release();
     closesocket(sock);
     WSACleanup();
+    frame_trace::flush();
     return true;
 }
 
-int main(int argc, char* argv[]) {
-    const uint16_t SERVER_PORT = 8080;
+// Same-host variant of the UDP video demo: raw frames go into a shared-memory ring instead
+// of being encoded and chunked, and the client reads them in place
+bool run_shm_video_demo(bool preview) {
+    cv::VideoCapture cap;
+    double actualFPS = 0.0;
+    if (!open_camera(cap, actualFPS)) {
+        return false;
+    }
 
-    // Silence INFO-level plugin-loader messages
-    cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_WARNING);
+    if (preview) {
+        cv::namedWindow("Server Preview", cv::WINDOW_AUTOSIZE | cv::WINDOW_GUI_NORMAL);
+    }
 
-    while (true) {
-        Demo choice = show_menu();
-        bool success = false;
+    shm_transport::Producer producer;
+    VideoMetrics video_metrics("video_shm");
+    const int FPS_WINDOW_SIZE = 30;
+    std::queue<std::chrono::steady_clock::time_point> frame_times;
+    double current_fps = 0.0;
+    size_t published_frames = 0;
+    size_t dropped_frames = 0;
+    auto last_stats = std::chrono::steady_clock::now();
+    cv::Mat frame, display_frame;
+    uint32_t frame_id = 0;
+    bool running = true;
 
-        switch (choice) {
-            case Demo::TCP_TEXT:
-                success = run_tcp_text_demo(SERVER_PORT);
-                break;
+    // The control channel works as in the UDP demo. Frames are raw and stay on this host,
+    // so quality and destination requests have nothing to apply to
+    double target_fps = actualFPS > 0 ? actualFPS : settings.target_fps;
+    double frame_time = 1000.0 / target_fps;
+    sockaddr_in clientAddr{};
+    clientAddr.sin_family = AF_INET;
+    clientAddr.sin_port = htons(settings.video_port);
+    inet_pton(AF_INET, settings.client_ip.c_str(), &clientAddr.sin_addr);
+    control_channel::Channel control;
+    control.start(clientAddr, stream_control::PORT, control_channel::address_from_environment());
+    control_channel::Stats control_stats;
+    control_stats.destination = std::string("shm:") + shm_transport::DEFAULT_NAME;
+    cv::Size output_size;           // Empty: the camera's own
+    cv::Mat scaled;
+    bool paused = false;
+    auto next_due = std::chrono::steady_clock::now();
 
-            case Demo::UDP_TEXT:
-                success = run_udp_text_demo(SERVER_PORT);
-                break;
+    while (running) {
+        control_channel::Changes changes;
+        if (control.take(changes)) {
+            if (changes.fps) {
+                target_fps = *changes.fps;
+                frame_time = 1000.0 / target_fps;
+            }
+            if (changes.resolution) {
+                output_size = cv::Size(changes.resolution->first, changes.resolution->second);
+            }
+            if (changes.paused) {
+                paused = *changes.paused;
+            }
+            if (changes.max_quality || changes.destination) {
+                std::cout << "Control: quality and destination do not apply to shared memory\n";
+            }
+            std::cout << "Control: " << target_fps << " fps, "
+                      << (output_size.empty() ? std::string("camera resolution") :
+                          std::to_string(output_size.width) + "x" + std::to_string(output_size.height))
+                      << (paused ? ", paused" : "") << std::endl;
+        }
 
-            case Demo::UDP_VIDEO:
-                success = run_udp_video_demo(false);
-                break;
+        auto frame_start = std::chrono::steady_clock::now();
 
-            case Demo::UDP_VIDEO_PREVIEW:
-                success = run_udp_video_demo(true);
+        frame_trace::Span capture_span(frame_trace::Stage::CAPTURE, frame_id);
+        cap >> frame;
+        capture_span.end();
+        if (frame.empty()) {
+            std::cerr << "Failed to capture frame\n";
+            continue;
+        }
+        int64_t capture_us = frame_trace::now_us();
+
+        // A quarter of a frame early still counts, for the camera's jitter
+        auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(frame_time));
+        if (frame_start + interval / 4 < next_due) {
+            continue;
+        }
+        next_due = std::max(next_due + interval, frame_start);
+
+        if (!output_size.empty() && frame.size() != output_size) {
+            cv::resize(frame, scaled, output_size, 0, 0, cv::INTER_AREA);
+        }
+        const cv::Mat& outgoing = !output_size.empty() && frame.size() != output_size ? scaled : frame;
+
+        frame_times.push(frame_start);
+        while (frame_times.size() > FPS_WINDOW_SIZE) {
+            frame_times.pop();
+        }
+        if (frame_times.size() >= 2) {
+            auto time_diff = std::chrono::duration_cast<std::chrono::milliseconds>(
+                frame_times.back() - frame_times.front()).count();
+            current_fps = (frame_times.size() - 1) * 1000.0 / time_diff;
+        }
+
+        if (paused) {
+            control_stats.paused = true;
+            control_stats.fps = current_fps;
+            control.publish(control_stats);
+            if (escape_pressed(preview)) {
+                running = false;
+            }
+            continue;
+        }
+
+        // A slot holds one raw frame, so the ring is sized from the actual output
+        size_t frame_bytes = outgoing.total() * outgoing.elemSize();
+        if (producer.slot_size() < frame_bytes) {
+            if (!producer.create(shm_transport::DEFAULT_NAME, frame_bytes)) {
+                control.stop();
+                cap.release();
+                return false;
+            }
+            std::cout << "Publishing " << outgoing.cols << "x" << outgoing.rows << " frames to shared memory \""
+                      << shm_transport::DEFAULT_NAME << "\"\n";
+        }
+
+        // Straight from the capture buffer into the ring: the only copy between camera and window
+        frame_trace::Span send_span(frame_trace::Stage::SEND, frame_id);
+        uint8_t* slot = producer.begin_write(frame_bytes);
+        if (slot) {
+            cv::Mat shared(outgoing.rows, outgoing.cols, outgoing.type(), slot);
+            outgoing.copyTo(shared);
+
+            shm_transport::FrameInfo info;
+            info.frame_id = frame_id;
+            info.format = shm_transport::Format::BGR24;
+            info.width = outgoing.cols;
+            info.height = outgoing.rows;
+            info.stride = static_cast<uint32_t>(shared.step);
+            info.capture_us = capture_us;
+            producer.publish(info);
+
+            published_frames++;
+            video_metrics.frames_sent.add();
+            video_metrics.bytes_sent.add(frame_bytes);
+            control_stats.frames_sent++;
+            control_stats.bytes_sent += frame_bytes;
+        } else {
+            // Every other slot is still being read
+            dropped_frames++;
+            video_metrics.frames_dropped.add();
+            control_stats.frames_dropped++;
+        }
+        send_span.end();
+        video_metrics.fps.set(current_fps);
+        video_metrics.frame_seconds.observe(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - frame_start).count());
+
+        if (preview) {
+            outgoing.copyTo(display_frame);
+            std::stringstream info;
+            info << "Resolution: " << outgoing.cols << "x" << outgoing.rows
+                 << " | FPS: " << std::fixed << std::setprecision(1) << current_fps
+                 << " | Target: " << actualFPS
+                 << " | Shared memory";
+            cv::putText(display_frame, info.str(), cv::Point(10, 30),
+                cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 0), 2);
+            cv::imshow("Server Preview", display_frame);
+        }
+
+        control_stats.frame_id = frame_id;
+        control_stats.fps = current_fps;
+        control_stats.target_fps = target_fps;
+        control_stats.width = outgoing.cols;
+        control_stats.height = outgoing.rows;
+        control_stats.paused = false;
+        control.publish(control_stats);
+
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::seconds>(now - last_stats).count() >= 1) {
+            std::cout << "Shared memory stats - Published: " << published_frames << " frames, "
+                      << "Dropped (all slots being read): " << dropped_frames << std::endl;
+            published_frames = 0;
+            dropped_frames = 0;
+            last_stats = now;
+        }
+
+        frame_id++;
+
+        if (preview) {
+            char c = static_cast<char>(cv::waitKey(1));
+            if (c == 27) running = false;  // ESC key
+        } else if (_kbhit()) {
+            char c = static_cast<char>(_getch());
+            if (c == 27) running = false;  // ESC key
+        }
+    }
+
+    if (preview) {
+        cv::destroyWindow("Server Preview");
+    }
+    control.stop();
+    producer.close();
+    cap.release();
+    frame_trace::flush();
+    return true;
+}
+
+bool run_tcp_video_demo(bool preview) {
+    tcp_server::Listener listener;
+    tcp_server::Connection client;
+
+    // Initialize TCP server
+    if (!tcp_server::initialize_winsock()) {
+        return false;
+    }
+
+    // Start server on the video port
+    if (!listener.start_server(settings.video_port)) {
+        tcp_server::cleanup_winsock();
+        return false;
+    }
+
+    std::cout << "TCP video server started. Waiting for client...\n";
+
+    // Accept client
+    if (!listener.accept_client(client)) {
+        listener.stop_server();
+        tcp_server::cleanup_winsock();
+        return false;
+    }
+
+    cv::VideoCapture cap;
+    double actualFPS = 0.0;
+    if (!open_camera(cap, actualFPS)) {
+        client.disconnect();
+        listener.stop_server();
+        tcp_server::cleanup_winsock();
+        return false;
+    }
+
+    // Keep at most two frames queued behind the socket; older unsent frames are dropped
+    // so that latency stays bounded when the link cannot keep up
+    const size_t MAX_PENDING_FRAMES = 2;
+    tcp_video_sender::FrameSender sender(client.handle(), MAX_PENDING_FRAMES);
+    if (!sender.configure(static_cast<size_t>(settings.send_buffer), true)) {
+        cap.release();
+        client.disconnect();
+        listener.stop_server();
+        tcp_server::cleanup_winsock();
+        return false;
+    }
+
+    if (preview) {
+        cv::namedWindow("Server Preview", cv::WINDOW_AUTOSIZE | cv::WINDOW_GUI_NORMAL);
+    }
+
+    std::vector<uchar> buffer;
+    std::vector<int> params;
+    params.push_back(cv::IMWRITE_JPEG_QUALITY);
+    params.push_back(85);
+    params.push_back(cv::IMWRITE_JPEG_OPTIMIZE);
+    params.push_back(1);
+
+    cv::Mat frame, display_frame;
+    bool running = true;
+
+    // FPS and rate control variables
+    const double TARGET_FPS = settings.target_fps;
+    const int FPS_WINDOW_SIZE = 30;
+    const double FRAME_TIME = 1000.0 / TARGET_FPS;
+    std::queue<std::chrono::steady_clock::time_point> frame_times;
+    double current_fps = 0.0;
+    int current_quality = 85;
+    uint32_t frame_id = 0;
+
+    // Statistics are cumulative in the sender; print the difference every second
+    // and forward it to the metrics after every frame
+    VideoMetrics video_metrics("video_tcp");
+    tcp_video_sender::Stats exported_stats;
+    tcp_video_sender::Stats last_stats_snapshot;
+    size_t last_dropped = 0;
+    auto last_stats = std::chrono::steady_clock::now();
+
+    while (running) {
+        auto frame_start = std::chrono::steady_clock::now();
+
+        frame_trace::Span capture_span(frame_trace::Stage::CAPTURE, frame_id);
+        cap >> frame;
+        capture_span.end();
+        if (frame.empty()) {
+            std::cerr << "Failed to capture frame\n";
+            continue;
+        }
+
+        // Calculate FPS
+        frame_times.push(frame_start);
+        while (frame_times.size() > FPS_WINDOW_SIZE) {
+            frame_times.pop();
+        }
+
+        if (frame_times.size() >= 2) {
+            auto time_diff = std::chrono::duration_cast<std::chrono::milliseconds>(
+                frame_times.back() - frame_times.front()).count();
+            if (time_diff > 0) {
+                current_fps = (frame_times.size() - 1) * 1000.0 / time_diff;
+            }
+        }
+
+        if (preview) {
+            frame.copyTo(display_frame);
+            std::stringstream info;
+            info << "Resolution: " << frame.cols << "x" << frame.rows
+                 << " | FPS: " << std::fixed << std::setprecision(1) << current_fps
+                 << " | Target: " << actualFPS
+                 << " | Quality: " << current_quality << " | TCP";
+            cv::putText(display_frame, info.str(), cv::Point(10, 30),
+                cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 0), 2);
+            cv::imshow("Server Preview", display_frame);
+        }
+
+        // Encode and hand the buffer to the sender without copying
+        params[1] = current_quality;
+        frame_trace::Span encode_span(frame_trace::Stage::ENCODE, frame_id);
+        cv::imencode(".jpg", frame, buffer, params);
+        encode_span.end();
+        video_metrics.frame_bytes.observe(static_cast<double>(buffer.size()));
+        video_metrics.quality.set(current_quality);
+        video_metrics.fps.set(current_fps);
+
+        // The send span covers queueing plus pumping, which may also finish earlier frames
+        frame_trace::Span send_span(frame_trace::Stage::SEND, frame_id);
+        sender.submit(frame_id++, buffer);
+
+        // Spend the rest of the frame interval pushing queued data
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - frame_start).count();
+        auto budget = std::chrono::milliseconds(std::max(1LL, static_cast<long long>(FRAME_TIME) - elapsed));
+        if (!sender.pump(budget)) {
+            std::cout << "Client disconnected\n";
+            break;
+        }
+        send_span.end();
+        video_metrics.frame_seconds.observe(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - frame_start).count());
+
+        // Lower quality while frames are being dropped, recover slowly otherwise
+        const tcp_video_sender::Stats& stats = sender.stats();
+        if (stats.frames_dropped > last_dropped) {
+            current_quality = std::max(60, current_quality - 5);
+            last_dropped = stats.frames_dropped;
+        } else if (current_quality < 85) {
+            current_quality = std::min(85, current_quality + 1);
+        }
+
+        video_metrics.bytes_sent.add(stats.bytes_sent - exported_stats.bytes_sent);
+        video_metrics.chunks_sent.add(stats.frames_sent - exported_stats.frames_sent);
+        video_metrics.frames_sent.add(stats.frames_sent - exported_stats.frames_sent);
+        video_metrics.frames_dropped.add(stats.frames_dropped - exported_stats.frames_dropped);
+        exported_stats = stats;
+
+        // Print network statistics every second
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::seconds>(now - last_stats).count() >= 1) {
+            std::cout << "Network stats - Sent: " << (stats.bytes_sent - last_stats_snapshot.bytes_sent) / 1024 << " KB, "
+                      << "Frames: " << stats.frames_sent - last_stats_snapshot.frames_sent << ", "
+                      << "Dropped frames: " << stats.frames_dropped - last_stats_snapshot.frames_dropped << ", "
+                      << "Queued: " << sender.queued_frames() << ", "
+                      << "Zero-copy: " << (sender.zero_copy_enabled() ? "on" : "off")
+                      << ", quality: " << current_quality << std::endl;
+            last_stats_snapshot = stats;
+            last_stats = now;
+        }
+
+        // Check for ESC key and handle input
+        if (preview) {
+            char c = static_cast<char>(cv::waitKey(1));
+            if (c == 27) running = false;  // ESC key
+        } else if (_kbhit()) {
+            char c = static_cast<char>(_getch());
+            if (c == 27) running = false;  // ESC key
+        }
+
+        // Add delay if the frame finished early
+        auto frame_end = std::chrono::steady_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(frame_end - frame_start).count();
+
+        if (duration < FRAME_TIME) {
+            auto sleep_time = static_cast<DWORD>((FRAME_TIME - duration) / 2);
+            if (sleep_time > 0) {
+                Sleep(sleep_time);
+            }
+        }
+    }
+
+    if (preview) {
+        cv::destroyWindow("Server Preview");
+    }
+    cap.release();
+    client.disconnect();
+    listener.stop_server();
+    tcp_server::cleanup_winsock();
+    frame_trace::flush();
+    return true;
+}
+
+// Test pattern for sources without a camera: a bar sweeping across a background tinted per stream
+static void draw_test_pattern(cv::Mat& frame, uint32_t stream_id, uint32_t frame_id) {
+    frame.create(720, 1280, CV_8UC3);
+    frame.setTo(cv::Scalar(40 + 50 * (stream_id % 4), 60, 40 + 30 * (stream_id / 4)));
+    int x = static_cast<int>(frame_id * 8 % 1280);
+    cv::rectangle(frame, cv::Point(x, 0), cv::Point(x + 40, 720), cv::Scalar(230, 230, 230), -1);
+    cv::putText(frame, "Stream " + std::to_string(stream_id) + " frame " + std::to_string(frame_id),
+        cv::Point(40, 80), cv::FONT_HERSHEY_SIMPLEX, 1.5, cv::Scalar(255, 255, 255), 3);
+}
+
+// Capture (or draw) and encode one source, handing every frame to the multiplexer
+static void encode_source(cv::VideoCapture& camera, uint32_t stream_id, udp_stream_mux::Multiplexer& mux,
+                          const std::atomic<bool>& running) {
+    const auto FRAME_INTERVAL = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / settings.target_fps));
+    std::vector<int> params = { cv::IMWRITE_JPEG_QUALITY, 80 };
+    std::vector<uchar> buffer;
+    cv::Mat frame;
+    uint32_t frame_id = 0;
+    auto next_frame = std::chrono::steady_clock::now();
+
+    while (running) {
+        if (camera.isOpened()) {
+            camera >> frame;
+            if (frame.empty()) {
+                continue;
+            }
+        }
+        else {
+            draw_test_pattern(frame, stream_id, frame_id);
+            next_frame += FRAME_INTERVAL;
+            std::this_thread::sleep_until(next_frame);
+        }
+        int64_t capture_us = frame_trace::now_us();
+
+        cv::imencode(".jpg", frame, buffer, params);
+        mux.submit(stream_id, frame_id++, buffer, capture_us);
+    }
+}
+
+bool run_udp_multi_video_demo() {
+    std::cout << "Number of sources (1-" << video_chunking::MAX_STREAMS << "): ";
+    size_t source_count = 4;
+    std::cin >> source_count;
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    source_count = std::min<size_t>(std::max<size_t>(source_count, 1), video_chunking::MAX_STREAMS);
+
+    if (!udp_server::initialize_winsock()) {
+        return false;
+    }
+
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock == INVALID_SOCKET) {
+        std::cerr << "Failed to create socket\n";
+        udp_server::cleanup_winsock();
+        return false;
+    }
+
+    sockaddr_in clientAddr = {};
+    clientAddr.sin_family = AF_INET;
+    clientAddr.sin_port = htons(settings.video_port);
+    inet_pton(AF_INET, settings.client_ip.c_str(), &clientAddr.sin_addr);
+
+    // Room for a few frames of every stream, then non-blocking sends
+    int sendbuf = static_cast<int>(256 * 1024 * source_count);
+    if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char*)&sendbuf, sizeof(sendbuf)) < 0) {
+        std::cerr << "Failed to set send buffer size\n";
+    }
+    u_long mode = 1;
+    ioctlsocket(sock, FIONBIO, &mode);
+
+    path_mtu::disable_fragmentation(sock);
+    size_t max_chunk_size = chunk_size_for(path_mtu::discover(clientAddr));
+
+    // Cameras 0 .. N-1; sources without a camera send a test pattern instead
+    std::vector<cv::VideoCapture> cameras(source_count);
+    for (size_t i = 0; i < source_count; i++) {
+        cameras[i].open(static_cast<int>(i), cv::CAP_DSHOW);
+        if (cameras[i].isOpened()) {
+            cameras[i].set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'));
+            cameras[i].set(cv::CAP_PROP_FRAME_WIDTH, 1280);
+            cameras[i].set(cv::CAP_PROP_FRAME_HEIGHT, 720);
+            cameras[i].set(cv::CAP_PROP_FPS, 30);
+        }
+        else {
+            std::cout << "No camera " << i << ", stream " << i << " sends a test pattern\n";
+        }
+    }
+
+    udp_stream_mux::Multiplexer mux(sock, clientAddr, source_count, max_chunk_size);
+    std::atomic<bool> running{true};
+    std::vector<std::thread> encoders;
+    for (size_t i = 0; i < source_count; i++) {
+        encoders.emplace_back(encode_source, std::ref(cameras[i]), static_cast<uint32_t>(i), std::ref(mux), std::cref(running));
+    }
+
+    std::cout << "Sending " << source_count << " streams to " << settings.client_ip << ":" << settings.video_port
+              << " in chunks of up to " << max_chunk_size << " bytes. Press ESC to stop.\n";
+
+    // This thread sends for all encoders, interleaving their chunks fairly
+    std::vector<udp_stream_mux::StreamStats> last_stats(source_count);
+    auto last_print = std::chrono::steady_clock::now();
+    bool ok = true;
+    while (running) {
+        if (!mux.pump(std::chrono::milliseconds(50))) {
+            ok = false;
+            running = false;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::seconds>(now - last_print).count() >= 1) {
+            for (uint32_t i = 0; i < source_count; i++) {
+                udp_stream_mux::StreamStats stats = mux.stats(i);
+                std::cout << "Stream " << i << ": " << stats.frames_sent - last_stats[i].frames_sent << " frames, "
+                          << (stats.bytes_sent - last_stats[i].bytes_sent) / 1024 << " KB, "
+                          << stats.frames_dropped - last_stats[i].frames_dropped << " dropped\n";
+                last_stats[i] = stats;
+            }
+            last_print = now;
+        }
+
+        if (_kbhit()) {
+            char c = static_cast<char>(_getch());
+            if (c == 27) running = false;  // ESC key
+        }
+    }
+
+    for (auto& encoder : encoders) {
+        encoder.join();
+    }
+    for (auto& camera : cameras) {
+        camera.release();
+    }
+    closesocket(sock);
+    udp_server::cleanup_winsock();
+    return ok;
+}
+
+// Send to each subscriber the layer it asked for. Every captured frame is encoded once per
+// subscribed layer, under one frame ID, and subscriptions are applied between frames.
+bool run_udp_simulcast_video_demo() {
+    if (!udp_server::initialize_winsock()) {
+        return false;
+    }
+
+    // Subscriptions arrive on this socket, and video leaves from it
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock == INVALID_SOCKET) {
+        std::cerr << "Failed to create socket\n";
+        udp_server::cleanup_winsock();
+        return false;
+    }
+
+    sockaddr_in serverAddr = {};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(simulcast::PORT);
+    serverAddr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(sock, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) == SOCKET_ERROR) {
+        std::cerr << "Failed to bind socket: " << WSAGetLastError() << std::endl;
+        closesocket(sock);
+        udp_server::cleanup_winsock();
+        return false;
+    }
+
+    int sendbuf = 1024 * 1024; // Room for a frame of every layer
+    if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char*)&sendbuf, sizeof(sendbuf)) < 0) {
+        std::cerr << "Failed to set send buffer size\n";
+    }
+    u_long mode = 1;
+    ioctlsocket(sock, FIONBIO, &mode);
+    path_mtu::disable_fragmentation(sock);
+
+    // Without a camera, a test pattern stands in
+    cv::VideoCapture cap;
+    double actualFPS = 0.0;
+    if (!open_camera(cap, actualFPS)) {
+        std::cout << "Sending a test pattern instead\n";
+    }
+
+    std::vector<simulcast::Layer> layers(std::begin(simulcast::LAYERS), std::end(simulcast::LAYERS));
+    simulcast_sender::LayerEncoder encoder(layers);
+    simulcast_sender::Subscriptions subscriptions(encoder.layer_count());
+
+    std::cout << "Simulcasting " << layers.size() << " layers:";
+    for (size_t i = 0; i < layers.size(); i++) {
+        std::cout << " " << i << "=" << layers[i].width << "x" << layers[i].height << "/q" << layers[i].quality;
+    }
+    std::cout << "\nWaiting for subscriptions on port " << simulcast::PORT << ". Press ESC to stop.\n";
+
+    const auto FRAME_INTERVAL = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / settings.target_fps));
+    VideoMetrics video_metrics("video_simulcast");
+    std::vector<char> request(64);
+    char challenge[simulcast::CHALLENGE_SIZE];
+    std::vector<char> chunk_buffer(video_chunking::HEADER_SIZE + path_mtu::chunk_size(path_mtu::MAX_MTU, 0));
+    std::vector<size_t> layer_frames(layers.size(), 0);
+    std::vector<size_t> layer_bytes(layers.size(), 0);
+    cv::Mat frame;
+    uint32_t frame_id = 0;
+    auto next_frame = std::chrono::steady_clock::now();
+    auto last_stats = next_frame;
+    bool running = true;
+
+    while (running) {
+        auto frame_start = std::chrono::steady_clock::now();
+
+        frame_trace::Span capture_span(frame_trace::Stage::CAPTURE, frame_id);
+        if (cap.isOpened()) {
+            cap >> frame;
+            if (frame.empty()) {
+                continue;
+            }
+        }
+        else {
+            draw_test_pattern(frame, 0, frame_id);
+            next_frame += FRAME_INTERVAL;
+            std::this_thread::sleep_until(next_frame);
+        }
+        capture_span.end();
+        int64_t capture_us = frame_trace::now_us();
+
+        // Apply the subscriptions received since the last frame
+        sockaddr_in from;
+        int from_len = sizeof(from);
+        int received;
+        while ((received = recvfrom(sock, request.data(), static_cast<int>(request.size()), 0,
+                reinterpret_cast<sockaddr*>(&from), &from_len)) > 0) {
+            if (subscriptions.handle(request.data(), static_cast<size_t>(received), from, frame_start, challenge) ==
+                simulcast_sender::Subscriptions::Result::CHALLENGE) {
+                sendto(sock, challenge, sizeof(challenge), 0, reinterpret_cast<sockaddr*>(&from), from_len);
+            }
+            from_len = sizeof(from);
+        }
+        subscriptions.expire(frame_start);
+
+        // Encode only what someone receives; the frame ID advances regardless, so receivers
+        // see frames captured while nobody listened as lost
+        std::vector<bool> wanted = subscriptions.wanted_layers();
+        if (std::find(wanted.begin(), wanted.end(), true) != wanted.end()) {
+            frame_trace::Span encode_span(frame_trace::Stage::ENCODE, frame_id);
+            encoder.encode(frame, wanted);
+            encode_span.end();
+
+            frame_trace::Span send_span(frame_trace::Stage::SEND, frame_id);
+            for (uint16_t layer = 0; layer < encoder.layer_count(); layer++) {
+                const std::vector<uchar>& encoded = encoder.encoded(layer);
+                if (encoded.empty()) {
+                    continue;
+                }
+                video_metrics.frame_bytes.observe(static_cast<double>(encoded.size()));
+                layer_frames[layer]++;
+                uint32_t frame_crc = crc32c::value(encoded.data(), encoded.size());
+
+                for (auto& subscriber : subscriptions.subscribers()) {
+                    if (subscriber.layer != layer) {
+                        continue;
+                    }
+
+                    size_t num_chunks = video_chunking::chunk_count(encoded.size(), subscriber.max_chunk_size);
+                    bool frame_sent = true;
+                    for (size_t chunk_id = 0; chunk_id < num_chunks; chunk_id++) {
+                        fd_set writefds;
+                        FD_ZERO(&writefds);
+                        FD_SET(sock, &writefds);
+                        timeval tv;
+                        tv.tv_sec = 0;
+                        tv.tv_usec = 5000; // 5ms timeout
+                        if (select(0, nullptr, &writefds, nullptr, &tv) <= 0) {
+                            frame_sent = false;
+                            break;
+                        }
+
+                        size_t datagram_size = video_chunking::build_chunk(frame_id, encoded.data(), encoded.size(),
+                            chunk_id, subscriber.max_chunk_size, chunk_buffer.data(), 0, layer, capture_us, frame_trace::now_us(),
+                            frame_crc);
+
+                        int sent = sendto(sock, chunk_buffer.data(), static_cast<int>(datagram_size), 0,
+                            reinterpret_cast<sockaddr*>(&subscriber.address), sizeof(subscriber.address));
+                        if (sent == SOCKET_ERROR) {
+                            int error = WSAGetLastError();
+                            if (path_mtu::is_too_big(error)) {
+                                // Re-chunk this subscriber's frames from the next one
+                                subscriber.max_chunk_size = std::min(subscriber.max_chunk_size, path_mtu::chunk_size(
+                                    path_mtu::after_too_big(subscriber.address, datagram_size), video_chunking::HEADER_SIZE));
+                            }
+                            if (error != WSAEWOULDBLOCK) {
+                                video_metrics.send_errors.add();
+                            }
+                            frame_sent = false;
+                            break;
+                        }
+                        layer_bytes[layer] += static_cast<size_t>(sent);
+                        video_metrics.bytes_sent.add(static_cast<uint64_t>(sent));
+                        video_metrics.chunks_sent.add();
+                    }
+                    (frame_sent ? video_metrics.frames_sent : video_metrics.frames_dropped).add();
+                }
+            }
+            send_span.end();
+        }
+        video_metrics.frame_seconds.observe(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - frame_start).count());
+        frame_id++;
+
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::seconds>(now - last_stats).count() >= 1) {
+            std::cout << "Simulcast stats - Subscribers: " << subscriptions.subscribers().size();
+            for (size_t i = 0; i < layers.size(); i++) {
+                std::cout << ", layer " << i << ": " << layer_frames[i] << " frames, " << layer_bytes[i] / 1024 << " KB";
+                layer_frames[i] = 0;
+                layer_bytes[i] = 0;
+            }
+            std::cout << std::endl;
+            last_stats = now;
+        }
+
+        if (_kbhit()) {
+            char c = static_cast<char>(_getch());
+            if (c == 27) running = false;  // ESC key
+        }
+    }
+
+    cap.release();
+    closesocket(sock);
+    udp_server::cleanup_winsock();
+    frame_trace::flush();
+    return true;
+}
+
+// Video on demand: stream a recorded MJPEG file at its recorded pace. Frames go out straight
+// from the file mapping, already encoded, so no CPU is spent on decoding or encoding
+bool run_mjpeg_file_demo() {
+    std::cout << "MJPEG file to stream: ";
+    std::string path;
+    std::cin >> std::ws;
+    std::getline(std::cin, path);
+
+    mjpeg_file::Recording recording;
+    if (!recording.open(path)) {
+        return false;
+    }
+    const std::vector<mjpeg_file::Frame>& frames = recording.frames();
+    std::cout << "Indexed " << frames.size() << " frames, " << std::fixed << std::setprecision(1)
+              << recording.duration_us() / 1000000.0 << " s\n";
+
+    // A client on this host gets the JPEGs through shared memory, one frame per slot
+    bool shared_memory = shm_transport::use_for_peer(settings.client_ip.c_str());
+    shm_transport::Producer producer;
+    SOCKET sock = INVALID_SOCKET;
+    sockaddr_in clientAddr = {};
+    size_t max_chunk_size = 0;
+
+    if (shared_memory) {
+        if (!producer.create(shm_transport::DEFAULT_NAME, recording.largest_frame())) {
+            return false;
+        }
+        std::cout << "Client is on this host: publishing to shared memory \"" << shm_transport::DEFAULT_NAME
+                  << "\" (set VIDEO_TRANSPORT=udp to use UDP)\n";
+    }
+    else {
+        if (!udp_server::initialize_winsock()) {
+            return false;
+        }
+        sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == INVALID_SOCKET) {
+            std::cerr << "Failed to create socket\n";
+            udp_server::cleanup_winsock();
+            return false;
+        }
+
+        clientAddr.sin_family = AF_INET;
+        clientAddr.sin_port = htons(settings.video_port);
+        if (inet_pton(AF_INET, settings.client_ip.c_str(), &clientAddr.sin_addr) != 1) {
+            std::cerr << "Failed to set client IP\n";
+            closesocket(sock);
+            udp_server::cleanup_winsock();
+            return false;
+        }
+
+        int sendbuf = settings.send_buffer;
+        if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char*)&sendbuf, sizeof(sendbuf)) < 0) {
+            std::cerr << "Failed to set send buffer size\n";
+        }
+        u_long mode = 1;
+        ioctlsocket(sock, FIONBIO, &mode);
+
+        path_mtu::disable_fragmentation(sock);
+        size_t path_mtu_size = path_mtu::discover(clientAddr);
+        max_chunk_size = chunk_size_for(path_mtu_size);
+        std::cout << "Sending video to client at " << settings.client_ip << ":" << settings.video_port
+                  << ", chunks of up to " << max_chunk_size << " bytes\n";
+    }
+    std::cout << "Press ESC to stop.\n";
+
+    VideoMetrics video_metrics("video_file");
+    size_t total_bytes_sent = 0;
+    size_t sent_frames = 0;
+    size_t dropped_frames = 0;
+    size_t position = 0;
+    uint32_t frame_id = 0;
+    int64_t loop_offset_us = 0;     // Recording time already played in earlier loops
+    auto start = std::chrono::steady_clock::now();
+    auto last_stats = start;
+    bool running = true;
+
+    while (running) {
+        const mjpeg_file::Frame& file_frame = frames[position];
+        const uint8_t* data = recording.frame_data(file_frame);
+
+        // Wait for the frame's time in the recording, still answering ESC during long gaps
+        auto due = start + std::chrono::microseconds(loop_offset_us + file_frame.timestamp_us);
+        auto now = std::chrono::steady_clock::now();
+        while (running && now < due) {
+            std::this_thread::sleep_until(std::min(due, now + std::chrono::milliseconds(50)));
+            if (_kbhit()) {
+                char c = static_cast<char>(_getch());
+                if (c == 27) running = false;  // ESC key
+            }
+            now = std::chrono::steady_clock::now();
+        }
+        if (!running) {
+            break;
+        }
+        if (now - due > std::chrono::seconds(1)) {
+            // After a stall, carry on from this frame instead of bursting to catch up
+            start = now - std::chrono::microseconds(loop_offset_us + file_frame.timestamp_us);
+            std::cout << "Fell behind the recording, resynchronising\n";
+        }
+
+        // Frames count as captured when their presentation time comes
+        int64_t capture_us = frame_trace::now_us();
+        frame_trace::Span send_span(frame_trace::Stage::SEND, frame_id);
+        bool frame_sent = true;
+        if (shared_memory) {
+            shm_transport::FrameInfo info;
+            info.frame_id = frame_id;
+            info.format = shm_transport::Format::JPEG;
+            info.capture_us = capture_us;
+            frame_sent = producer.publish(info, data, file_frame.size);
+            if (frame_sent) {
+                total_bytes_sent += file_frame.size;
+                video_metrics.bytes_sent.add(file_frame.size);
+            }
+        }
+        else {
+            size_t num_chunks = video_chunking::chunk_count(file_frame.size, max_chunk_size);
+            uint32_t frame_crc = crc32c::value(data, file_frame.size);
+            for (size_t chunk_id = 0; chunk_id < num_chunks; chunk_id++) {
+                fd_set writefds;
+                FD_ZERO(&writefds);
+                FD_SET(sock, &writefds);
+                timeval tv;
+                tv.tv_sec = 0;
+                tv.tv_usec = 5000; // 5ms timeout
+                if (select(0, nullptr, &writefds, nullptr, &tv) <= 0) {
+                    frame_sent = false;
+                    break;
+                }
+
+                // Header and chunk gathered from the mapping by the kernel, without a copy here
+                int sent = video_chunking::send_chunk(sock, clientAddr, frame_id, data, file_frame.size,
+                    chunk_id, max_chunk_size, 0, 0, capture_us, frame_trace::now_us(), frame_crc);
+                if (sent == SOCKET_ERROR) {
+                    int error = WSAGetLastError();
+                    if (path_mtu::is_too_big(error)) {
+                        // Re-chunk from the next frame
+                        size_t datagram_size = video_chunking::HEADER_SIZE +
+                            std::min(max_chunk_size, file_frame.size - chunk_id * max_chunk_size);
+                        size_t path_mtu_size = path_mtu::after_too_big(clientAddr, datagram_size);
+                        max_chunk_size = std::min(max_chunk_size,
+                            path_mtu::chunk_size(path_mtu_size, video_chunking::HEADER_SIZE));
+                        std::cout << "Path MTU dropped to " << path_mtu_size << " bytes\n";
+                    }
+                    if (error != WSAEWOULDBLOCK) {
+                        video_metrics.send_errors.add();
+                    }
+                    frame_sent = false;
+                    break;
+                }
+                total_bytes_sent += static_cast<size_t>(sent);
+                video_metrics.bytes_sent.add(static_cast<uint64_t>(sent));
+                video_metrics.chunks_sent.add();
+            }
+        }
+        send_span.end();
+
+        video_metrics.frame_bytes.observe(static_cast<double>(file_frame.size));
+        video_metrics.frame_seconds.observe(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - now).count());
+        (frame_sent ? video_metrics.frames_sent : video_metrics.frames_dropped).add();
+        (frame_sent ? sent_frames : dropped_frames)++;
+        frame_id++;
+
+        if (++position == frames.size()) {
+            position = 0;
+            loop_offset_us += recording.duration_us();
+            std::cout << "End of recording, starting over\n";
+        }
+
+        if (std::chrono::duration_cast<std::chrono::seconds>(now - last_stats).count() >= 1) {
+            std::cout << "File stats - Sent: " << total_bytes_sent / 1024 << " KB, "
+                      << "Frames: " << sent_frames << ", Dropped frames: " << dropped_frames
+                      << ", Position: " << std::fixed << std::setprecision(1)
+                      << frames[position].timestamp_us / 1000000.0 << " s" << std::endl;
+            total_bytes_sent = 0;
+            sent_frames = 0;
+            dropped_frames = 0;
+            last_stats = now;
+        }
+    }
+
+    if (shared_memory) {
+        producer.close();
+    }
+    else {
+        closesocket(sock);
+        udp_server::cleanup_winsock();
+    }
+    frame_trace::flush();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    const uint16_t SERVER_PORT = 8080;
+
+    std::vector<std::string> positional;
+    if (!video_config::from_command_line(argc, argv, settings, positional)) {
+        return 1;
+    }
+    if (!positional.empty()) {
+        std::cerr << "Unexpected argument: " << positional[0] << "\n";
+        video_config::print_usage(argv[0]);
+        return 1;
+    }
+
+    // Silence INFO-level plugin-loader messages
+    cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_WARNING);
+
+    // Set FRAME_TRACE to record where each frame's time goes in the video demos
+    frame_trace::start_from_environment("server");
+
+    // Metrics, and the clock receivers measure glass-to-glass latency against, stay
+    // available across demos, for as long as the menu runs
+    metrics_exporter::Exporter exporter;
+    clock_sync::Responder clock_responder;
+    if (tcp_server::initialize_winsock()) {
+        exporter.start(METRICS_PORT);
+        clock_responder.start(clock_sync::PORT);
+    }
+
+    while (true) {
+        Demo choice = show_menu();
+        bool success = false;
+
+        switch (choice) {
+            case Demo::TCP_TEXT:
+                success = run_tcp_text_demo(SERVER_PORT);
+                break;
+
+            case Demo::UDP_TEXT:
+                success = run_udp_text_demo(SERVER_PORT);
+                break;
+
+            case Demo::UDP_VIDEO:
+            case Demo::UDP_VIDEO_PREVIEW:
+                // A client on this host reads raw frames from shared memory instead
+                if (shm_transport::use_for_peer(settings.client_ip.c_str())) {
+                    std::cout << "Client is on this host: sending through shared memory (set VIDEO_TRANSPORT=udp to use UDP)\n";
+                    success = run_shm_video_demo(choice == Demo::UDP_VIDEO_PREVIEW);
+                }
+                else {
+                    success = run_udp_video_demo(choice == Demo::UDP_VIDEO_PREVIEW);
+                }
+                break;
+
+            case Demo::TCP_VIDEO:
+                success = run_tcp_video_demo(false);
+                break;
+
+            case Demo::TCP_VIDEO_PREVIEW:
+                success = run_tcp_video_demo(true);
+                break;
+
+            case Demo::UDP_ECHO_SHARDED:
+                success = run_udp_sharded_echo_demo(SERVER_PORT);
+                break;
+
+            case Demo::ASYNC_TCP_ECHO:
+                success = run_async_tcp_echo_demo(SERVER_PORT);
+                break;
+
+            case Demo::FILE_TRANSFER:
+                success = run_file_transfer_demo(SERVER_PORT);
+                break;
+
+            case Demo::UDP_MULTI_VIDEO:
+                success = run_udp_multi_video_demo();
+                break;
+
+            case Demo::UDP_SIMULCAST_VIDEO:
+                success = run_udp_simulcast_video_demo();
+                break;
+
+            case Demo::UDP_FILE_VIDEO:
+                success = run_mjpeg_file_demo();
                 break;
 
             case Demo::EXIT:
                 std::cout << "Exiting...\n";
+                exporter.stop();
+                clock_responder.stop();
+                tcp_server::cleanup_winsock();
                 return 0;
         }
 
@@ -0,0 +1,84 @@
+#include "metrics_exporter.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#define SOCK_ERR   SOCKET_ERROR
+#else
+#define SOCK_ERR   -1
+#endif
+
+namespace metrics_exporter {
+    static const size_t MAX_REQUEST_SIZE = 8192;
+
+    Exporter::~Exporter() {
+        stop();
+    }
+
+    bool Exporter::start(uint16_t port, metrics::Registry& metrics_registry) {
+        stop();
+        registry = &metrics_registry;
+
+        if (!listener.start_server(port)) {
+            return false;
+        }
+
+        stopping = false;
+        worker = std::thread(&Exporter::serve_loop, this);
+        std::cout << "Metrics available at http://localhost:" << port << "/metrics\n";
+        return true;
+    }
+
+    void Exporter::stop() {
+        stopping = true;
+        if (worker.joinable()) {
+            worker.join();
+        }
+        listener.stop_server();
+    }
+
+    void Exporter::serve_loop() {
+        while (!stopping.load(std::memory_order_relaxed)) {
+            // Short timeout so stop() is noticed promptly
+            if (!message_framing::wait_readable(listener.handle(), std::chrono::milliseconds(100))) {
+                continue;
+            }
+
+            tcp_server::Connection connection;
+            if (listener.accept_client(connection)) {
+                serve(connection);
+                connection.disconnect();
+            }
+        }
+    }
+
+    void Exporter::serve(tcp_server::Connection& connection) {
+        // Read the request head; the body of a GET is empty
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST_SIZE) {
+            if (!message_framing::wait_readable(connection.handle(), std::chrono::seconds(1))) {
+                return;
+            }
+            int recvd = recv(connection.handle(), buffer, sizeof(buffer), 0);
+            if (recvd == SOCK_ERR || recvd == 0) {
+                return;
+            }
+            request.append(buffer, recvd);
+        }
+
+        std::string_view line(request.data(), std::min(request.find("\r\n"), request.size()));
+        bool found = line.rfind("GET /metrics ", 0) == 0 || line.rfind("GET / ", 0) == 0;
+
+        std::string body = found ? registry->render() : "Not found\n";
+        std::string head = std::string(found ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n")
+            + "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            + "Content-Length: " + std::to_string(body.size()) + "\r\n"
+            + "Connection: close\r\n\r\n";
+
+        std::string_view response[] = { head, body };
+        message_framing::send_buffers(connection.handle(), response, 2);
+    }
+}
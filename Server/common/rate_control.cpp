@@ -0,0 +1,140 @@
+#include "rate_control.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "video_config.h"
+
+namespace rate_control {
+    static const int COMPLEXITY_WIDTH = 160;
+    static const int COMPLEXITY_HEIGHT = 90;
+    static const double REFERENCE_AREA = 1280.0 * 720.0;
+    static const double HISTORY_WEIGHT = 0.9;       // Per frame of age
+    static const double MIN_QUALITY_SPREAD = 4.0;   // Standard deviation needed to fit the slope
+    static const double MIN_SLOPE = 0.01;
+    static const double MAX_SLOPE = 0.1;
+    static const double DEBT_FRAMES = 8.0;          // Frames a miss is paid back over
+    static const double MIN_TARGET = 0.25;          // Target bounds, as fractions of the budget
+    static const double MAX_TARGET = 1.5;
+    static const double MIN_BUDGET_SCALE = 0.25;
+    static const double CONGESTION_SCALE = 0.8;
+    static const double RECOVERY_SCALE = 1.02;
+
+    double bitrate_from_environment() {
+        const char* text = std::getenv("VIDEO_BITRATE");
+        if (!text) {
+            return DEFAULT_BITRATE;
+        }
+        double bitrate = 0;
+        if (!video_config::parse_rate(text, bitrate) || bitrate <= 0) {
+            std::cerr << "Invalid VIDEO_BITRATE \"" << text << "\", using " << DEFAULT_BITRATE / 1e6 << " Mbit/s\n";
+            return DEFAULT_BITRATE;
+        }
+        return bitrate;
+    }
+
+    Controller::Controller(double bits_per_second, double fps, int lowest, int highest)
+        : bitrate(bits_per_second) {
+        set_frame_rate(fps);
+        set_quality_range(lowest, highest);
+    }
+
+    void Controller::set_frame_rate(double fps) {
+        frame_budget = bitrate / 8.0 / (fps > 0 ? fps : 30.0);
+    }
+
+    void Controller::set_quality_range(int lowest, int highest) {
+        min_quality = std::min(lowest, highest);
+        max_quality = highest;
+    }
+
+    double Controller::measure_complexity(const cv::Mat& frame) {
+        cv::resize(frame, small, cv::Size(COMPLEXITY_WIDTH, COMPLEXITY_HEIGHT), 0, 0, cv::INTER_AREA);
+        if (small.channels() == 3) {
+            cv::cvtColor(small, grey, cv::COLOR_BGR2GRAY);
+        }
+        else {
+            small.copyTo(grey);
+        }
+
+        uint64_t total = 0;
+        for (int y = 0; y + 1 < grey.rows; y++) {
+            const uchar* row = grey.ptr<uchar>(y);
+            const uchar* below = grey.ptr<uchar>(y + 1);
+            for (int x = 0; x + 1 < grey.cols; x++) {
+                total += std::abs(row[x] - row[x + 1]) + std::abs(row[x] - below[x]);
+            }
+        }
+        size_t pairs = 2 * static_cast<size_t>(std::max(grey.rows - 1, 1)) * std::max(grey.cols - 1, 1);
+        // Offset so that a blank frame still has a size to predict
+        return (1.0 + static_cast<double>(total) / pairs) * (frame.total() / REFERENCE_AREA);
+    }
+
+    size_t Controller::target_bytes() const {
+        double budget = budget_bytes();
+        double target = std::clamp(budget - debt / DEBT_FRAMES, MIN_TARGET * budget, MAX_TARGET * budget);
+        return static_cast<size_t>(target);
+    }
+
+    double Controller::predict_bytes(int quality, double complexity) const {
+        return complexity * std::exp(intercept + slope * quality);
+    }
+
+    int Controller::choose_quality(double complexity) const {
+        if (!fitted) {
+            return max_quality;     // The first frame calibrates the model
+        }
+        double quality = (std::log(static_cast<double>(target_bytes()) / complexity) - intercept) / slope;
+        return static_cast<int>(std::clamp(std::floor(quality), double(min_quality), double(max_quality)));
+    }
+
+    bool Controller::observe(int quality, double complexity, size_t bytes) {
+        if (bytes == 0) {
+            return false;
+        }
+        history.push_back({ quality, std::log(static_cast<double>(bytes) / complexity) });
+        if (history.size() > HISTORY) {
+            history.pop_front();
+        }
+        fit();
+
+        return bytes > RE_ENCODE_OVERSHOOT * target_bytes() && choose_quality(complexity) < quality;
+    }
+
+    void Controller::sent(size_t bytes) {
+        double budget = budget_bytes();
+        // Capped both ways: a quiet stretch cannot pay for a burst later, and a scene the
+        // budget cannot hold even at MIN_QUALITY does not starve the frames after it
+        debt = std::clamp(debt + static_cast<double>(bytes) - budget, -DEBT_FRAMES * budget, DEBT_FRAMES * budget);
+        budget_scale = std::min(1.0, budget_scale * RECOVERY_SCALE);
+    }
+
+    void Controller::congestion() {
+        budget_scale = std::max(MIN_BUDGET_SCALE, budget_scale * CONGESTION_SCALE);
+    }
+
+    // Weighted least squares of log_size against quality; with too little spread in quality
+    // to tell the slope, only the intercept is updated
+    void Controller::fit() {
+        double weight = 1.0;
+        double sum_w = 0, sum_q = 0, sum_y = 0, sum_qq = 0, sum_qy = 0;
+        for (auto it = history.rbegin(); it != history.rend(); ++it) {
+            sum_w += weight;
+            sum_q += weight * it->quality;
+            sum_y += weight * it->log_size;
+            sum_qq += weight * it->quality * it->quality;
+            sum_qy += weight * it->quality * it->log_size;
+            weight *= HISTORY_WEIGHT;
+        }
+        double mean_q = sum_q / sum_w;
+        double mean_y = sum_y / sum_w;
+        double variance = sum_qq / sum_w - mean_q * mean_q;
+        if (variance >= MIN_QUALITY_SPREAD * MIN_QUALITY_SPREAD) {
+            double covariance = sum_qy / sum_w - mean_q * mean_y;
+            slope = std::clamp(covariance / variance, MIN_SLOPE, MAX_SLOPE);
+        }
+        intercept = mean_y - slope * mean_q;
+        fitted = true;
+    }
+}
@@ -0,0 +1,213 @@
+#include "simulcast_sender.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include "path_mtu.h"
+#include "video_chunking.h"
+
+namespace simulcast_sender {
+    LayerEncoder::LayerEncoder(const std::vector<simulcast::Layer>& layers)
+        : workers(std::min<size_t>(layers.size(), video_chunking::MAX_LAYERS)) {
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].layer = layers[i];
+            workers[i].params = { cv::IMWRITE_JPEG_QUALITY, layers[i].quality };
+        }
+        // Started once the vector is final, since each thread refers to its own element
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].thread = std::thread(&LayerEncoder::run, this, i);
+        }
+    }
+
+    LayerEncoder::~LayerEncoder() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        work_ready.notify_all();
+        for (auto& worker : workers) {
+            worker.thread.join();
+        }
+    }
+
+    void LayerEncoder::encode(const cv::Mat& frame, const std::vector<bool>& wanted_layers) {
+        std::unique_lock<std::mutex> lock(mutex);
+        source = &frame;
+        wanted = wanted_layers;
+        wanted.resize(workers.size(), false);
+        remaining = workers.size();
+        generation++;
+        work_ready.notify_all();
+        work_done.wait(lock, [this] { return remaining == 0; });
+        source = nullptr;
+    }
+
+    void LayerEncoder::run(size_t index) {
+        Worker& worker = workers[index];
+        uint64_t done = 0;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            work_ready.wait(lock, [&] { return stopping || generation != done; });
+            if (stopping) {
+                return;
+            }
+            done = generation;
+
+            if (!wanted[index]) {
+                worker.output.clear();
+            }
+            else {
+                // The source frame stays untouched until every layer reports back
+                const cv::Mat& frame = *source;
+                lock.unlock();
+
+                const cv::Mat* input = &frame;
+                double scale = std::min(static_cast<double>(worker.layer.width) / frame.cols,
+                                        static_cast<double>(worker.layer.height) / frame.rows);
+                if (scale < 1.0) {
+                    cv::resize(frame, worker.scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+                    input = &worker.scaled;
+                }
+                cv::imencode(".jpg", *input, worker.output, worker.params);
+
+                lock.lock();
+            }
+
+            if (--remaining == 0) {
+                work_done.notify_one();
+            }
+        }
+    }
+
+    static uint64_t rotate_left(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    // SipHash-2-4 of `size` bytes under a 128-bit key
+    static uint64_t siphash(const uint64_t key[2], const uint8_t* data, size_t size) {
+        uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+        uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+        uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+        uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+        auto round = [&] {
+            v0 += v1; v1 = rotate_left(v1, 13); v1 ^= v0; v0 = rotate_left(v0, 32);
+            v2 += v3; v3 = rotate_left(v3, 16); v3 ^= v2;
+            v0 += v3; v3 = rotate_left(v3, 21); v3 ^= v0;
+            v2 += v1; v1 = rotate_left(v1, 17); v1 ^= v2; v2 = rotate_left(v2, 32);
+        };
+        auto compress = [&](uint64_t word) {
+            v3 ^= word;
+            round();
+            round();
+            v0 ^= word;
+        };
+
+        // Little-endian 8-byte words, then the tail with the length in the top byte
+        size_t whole = size - size % 8;
+        for (size_t i = 0; i < whole; i += 8) {
+            uint64_t word = 0;
+            for (size_t j = 8; j-- > 0;) {
+                word = (word << 8) | data[i + j];
+            }
+            compress(word);
+        }
+        uint64_t last = static_cast<uint64_t>(size) << 56;
+        for (size_t j = 0; j < size % 8; j++) {
+            last |= static_cast<uint64_t>(data[whole + j]) << (8 * j);
+        }
+        compress(last);
+
+        v2 ^= 0xff;
+        round();
+        round();
+        round();
+        round();
+        return v0 ^ v1 ^ v2 ^ v3;
+    }
+
+    Subscriptions::Subscriptions(size_t layer_count) : layer_count(layer_count) {
+        std::random_device random;
+        for (uint64_t& word : key) {
+            word = (static_cast<uint64_t>(random()) << 32) | random();
+        }
+    }
+
+    uint64_t Subscriptions::cookie_for(const sockaddr_in& address, int64_t period) const {
+        // Address and port as they are in memory, then the period
+        uint8_t input[sizeof(address.sin_addr.s_addr) + sizeof(address.sin_port) + sizeof(period)];
+        memcpy(input, &address.sin_addr.s_addr, 4);
+        memcpy(input + 4, &address.sin_port, 2);
+        memcpy(input + 6, &period, sizeof(period));
+        // Never 0, which stands for no cookie
+        return siphash(key, input, sizeof(input)) | 1;
+    }
+
+    static bool same_address(const sockaddr_in& a, const sockaddr_in& b) {
+        return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+    }
+
+    Subscriptions::Result Subscriptions::handle(const char* data, size_t size, const sockaddr_in& from,
+                                                std::chrono::steady_clock::time_point now, char* challenge) {
+        uint16_t layer;
+        uint64_t cookie;
+        if (!simulcast::read_subscribe(data, size, layer, cookie)) {
+            return Result::IGNORED;
+        }
+
+        // Nothing is sent to, or kept for, an address that has not shown it reads its datagrams
+        int64_t period = now.time_since_epoch() / COOKIE_PERIOD;
+        if (cookie != cookie_for(from, period) && cookie != cookie_for(from, period - 1)) {
+            simulcast::write_challenge(challenge, cookie_for(from, period));
+            return Result::CHALLENGE;
+        }
+
+        auto existing = std::find_if(list.begin(), list.end(),
+            [&](const Subscriber& subscriber) { return same_address(subscriber.address, from); });
+
+        if (layer == simulcast::UNSUBSCRIBE) {
+            if (existing != list.end()) {
+                list.erase(existing);
+            }
+            return Result::APPLIED;
+        }
+        if (layer >= layer_count) {
+            return Result::IGNORED;
+        }
+
+        if (existing == list.end()) {
+            if (list.size() >= MAX_SUBSCRIBERS) {
+                return Result::IGNORED;
+            }
+            size_t max_chunk_size = path_mtu::chunk_size(path_mtu::discover(from), video_chunking::HEADER_SIZE);
+            char address[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &from.sin_addr, address, sizeof(address));
+            std::cout << "Simulcast subscriber " << address << ":" << ntohs(from.sin_port)
+                      << " joined on layer " << layer << ", chunks of up to " << max_chunk_size << " bytes\n";
+            list.push_back({ from, layer, max_chunk_size, now });
+            return Result::APPLIED;
+        }
+
+        if (existing->layer != layer) {
+            std::cout << "Simulcast subscriber on port " << ntohs(from.sin_port) << " switched from layer "
+                      << existing->layer << " to " << layer << "\n";
+        }
+        existing->layer = layer;
+        existing->last_seen = now;
+        return Result::APPLIED;
+    }
+
+    void Subscriptions::expire(std::chrono::steady_clock::time_point now) {
+        list.erase(std::remove_if(list.begin(), list.end(), [&](const Subscriber& subscriber) {
+            return now - subscriber.last_seen > simulcast::SUBSCRIPTION_TIMEOUT;
+        }), list.end());
+    }
+
+    std::vector<bool> Subscriptions::wanted_layers() const {
+        std::vector<bool> wanted(layer_count, false);
+        for (const auto& subscriber : list) {
+            wanted[subscriber.layer] = true;
+        }
+        return wanted;
+    }
+}
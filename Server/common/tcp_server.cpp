@@ -1,5 +1,6 @@
 #include "tcp_server.h"
 #include <iostream>
+#include <utility>
 
 #ifdef _WIN32
 #pragma comment(lib, "ws2_32.lib")
@@ -14,9 +15,6 @@
 #endif
 
 namespace tcp_server {
-    static sock_t server_socket = SOCK_INV;
-    static sock_t client_socket = SOCK_INV;
-
     bool initialize_winsock() {
 #ifdef _WIN32
         WSADATA wsaData;
@@ -34,7 +32,188 @@ namespace tcp_server {
 #endif
     }
 
-    bool start_server(uint16_t port) {
+    Connection::Connection() : client_socket(SOCK_INV) {
+    }
+
+    Connection::~Connection() {
+        disconnect();
+    }
+
+    Connection::Connection(Connection&& other) noexcept
+        : client_socket(std::exchange(other.client_socket, SOCK_INV)),
+          reader(std::move(other.reader)),
+          writer(std::move(other.writer)),
+          compressing(std::exchange(other.compressing, false)),
+          encoder(std::move(other.encoder)),
+          decoder(std::move(other.decoder)),
+          encoded_queue(std::move(other.encoded_queue)) {
+    }
+
+    Connection& Connection::operator=(Connection&& other) noexcept {
+        if (this != &other) {
+            disconnect();
+            client_socket = std::exchange(other.client_socket, SOCK_INV);
+            reader = std::move(other.reader);
+            writer = std::move(other.writer);
+            compressing = std::exchange(other.compressing, false);
+            encoder = std::move(other.encoder);
+            decoder = std::move(other.decoder);
+            encoded_queue = std::move(other.encoded_queue);
+        }
+        return *this;
+    }
+
+    bool Connection::send_message(const std::string& message) {
+        writer.queue(compressing ? encoder.encode(message) : std::string_view(message));
+        if (!writer.flush(client_socket)) {
+            return false;
+        }
+        std::cout << "Sent message: " << message << "\n";
+        return true;
+    }
+
+    void Connection::queue_message(std::string_view message) {
+        if (compressing) {
+            encoded_queue.emplace_back(encoder.encode(message));
+            writer.queue(encoded_queue.back());
+        }
+        else {
+            writer.queue(message);
+        }
+    }
+
+    bool Connection::flush_messages() {
+        bool flushed = writer.flush(client_socket);
+        encoded_queue.clear();
+        return flushed;
+    }
+
+    bool Connection::receive_message(std::string_view& message) {
+        std::string_view frame;
+        bool received = false;
+        while (!received) {
+            if (!reader.next_frame(client_socket, frame)) {
+                if (reader.closed()) {
+                    std::cout << "Client disconnected\n";
+                }
+                return false;
+            }
+            if (!accept_frame(frame, message, received)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Connection::poll_message(std::string_view& message, bool& received) {
+        std::string_view frame;
+        received = false;
+        while (!received && reader.poll_frame(frame)) {
+            if (!accept_frame(frame, message, received)) {
+                return false;
+            }
+        }
+        return !reader.corrupted();
+    }
+
+    bool Connection::read_available() {
+        bool would_block = false;
+        if (!reader.read_some(client_socket, would_block)) {
+            if (reader.closed()) {
+                std::cout << "Client disconnected\n";
+            }
+            return false;
+        }
+        return true;
+    }
+
+    bool Connection::accept_frame(std::string_view frame, std::string_view& message, bool& received) {
+        if (compressing) {
+            received = true;
+            return decoder.decode(frame, message);
+        }
+        if (!payload_codec::is_hello(frame)) {
+            message = frame;
+            received = true;
+            return true;
+        }
+
+        // Compression request: answer it, the real message follows
+        std::string_view dictionary = payload_codec::default_dictionary();
+        bool accepted = false;
+        std::string answer = payload_codec::answer(frame, dictionary, accepted);
+        writer.queue(answer);
+        if (!writer.flush(client_socket)) {
+            return false;
+        }
+        if (accepted) {
+            compressing = true;
+            encoder = payload_codec::Encoder(dictionary);
+            decoder = payload_codec::Decoder(dictionary);
+        }
+        std::cout << "Compression " << (accepted ? "enabled" : "declined") << " for client\n";
+        return true;
+    }
+
+    std::string Connection::receive_message() {
+        std::string_view message;
+        if (!receive_message(message)) {
+            return "";
+        }
+        return std::string(message);
+    }
+
+    void Connection::disconnect() {
+        if (client_socket != SOCK_INV) {
+#ifdef _WIN32
+            shutdown(client_socket, SD_BOTH);
+#else
+            shutdown(client_socket, SHUT_RDWR);
+#endif
+            CLOSESOCK(client_socket);
+            client_socket = SOCK_INV;
+        }
+        reader.reset();
+        writer.clear();
+        compressing = false;
+        encoded_queue.clear();
+    }
+
+    bool Connection::is_connected() const {
+        return client_socket != SOCK_INV && !reader.closed();
+    }
+
+    Listener::Listener() : server_socket(SOCK_INV) {
+    }
+
+    Listener::~Listener() {
+        stop_server();
+    }
+
+    Listener::Listener(Listener&& other) noexcept
+        : server_socket(std::exchange(other.server_socket, SOCK_INV)) {
+    }
+
+    Listener& Listener::operator=(Listener&& other) noexcept {
+        if (this != &other) {
+            stop_server();
+            server_socket = std::exchange(other.server_socket, SOCK_INV);
+        }
+        return *this;
+    }
+
+    bool Listener::start_server(uint16_t port, const char* address) {
+        stop_server();
+
+        sockaddr_in server_addr{};
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        server_addr.sin_port = htons(port);
+        if (address && inet_pton(AF_INET, address, &server_addr.sin_addr) != 1) {
+            std::cerr << "Invalid listen address " << address << "\n";
+            return false;
+        }
+
         // Create socket
         server_socket = socket(AF_INET, SOCK_STREAM, 0);
         if (server_socket == SOCK_INV) {
@@ -48,14 +227,10 @@ namespace tcp_server {
             reinterpret_cast<char*>(&opt), sizeof(opt));
 
         // Bind
-        sockaddr_in server_addr{};
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-        server_addr.sin_port = htons(port);
-
         if (bind(server_socket, (sockaddr*)&server_addr, sizeof(server_addr)) == SOCK_ERR) {
             std::cerr << "bind() failed\n";
             CLOSESOCK(server_socket);
+            server_socket = SOCK_INV;
             return false;
         }
 
@@ -63,6 +238,7 @@ namespace tcp_server {
         if (listen(server_socket, 5) == SOCK_ERR) {
             std::cerr << "listen() failed\n";
             CLOSESOCK(server_socket);
+            server_socket = SOCK_INV;
             return false;
         }
 
@@ -70,61 +246,92 @@ namespace tcp_server {
         return true;
     }
 
-    bool accept_client() {
+    bool Listener::accept_client(Connection& client, sockaddr_in* peer) {
         sockaddr_in client_addr{};
         socklen_t addr_len = sizeof(client_addr);
-        
-        client_socket = accept(server_socket, (sockaddr*)&client_addr, &addr_len);
+
+        sock_t client_socket = accept(server_socket, (sockaddr*)&client_addr, &addr_len);
         if (client_socket == SOCK_INV) {
             std::cerr << "accept() failed\n";
             return false;
         }
+        client.disconnect();
+        client.client_socket = client_socket;
+        if (peer) {
+            *peer = client_addr;
+        }
 
         char client_ip[INET_ADDRSTRLEN];
         inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-        std::cout << "Accepted TCP connection from " << client_ip 
+        std::cout << "Accepted TCP connection from " << client_ip
                   << ":" << ntohs(client_addr.sin_port) << "\n";
         return true;
     }
 
-    bool send_message(const std::string& message) {
-        int sent = send(client_socket, message.c_str(), static_cast<int>(message.length()), 0);
-        if (sent == SOCK_ERR) {
-            std::cerr << "send() failed\n";
-            return false;
-        }
-        std::cout << "Sent message: " << message << "\n";
-        return true;
+    Sessions::~Sessions() {
+        stop();
     }
 
-    std::string receive_message() {
-        char buffer[1024];
-        int recvd = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-        if (recvd == SOCK_ERR) {
-            std::cerr << "recv() failed\n";
-            return "";
-        }
-        else if (recvd == 0) {
-            std::cout << "Client disconnected\n";
-            return "";
-        }
-        buffer[recvd] = '\0';
-        return std::string(buffer);
+    void Sessions::start(Connection connection, std::function<void(Connection&)> serve) {
+        join(false);
+        std::lock_guard<std::mutex> lock(mutex);
+        Session& session = sessions.emplace_back();
+        session.sock = connection.handle();
+        session.thread = std::thread([this, &session, serve = std::move(serve),
+                                      connection = std::move(connection)]() mutable {
+            serve(connection);
+            // Marked done before closing, so stop() never shuts down a socket number already reused
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                session.done = true;
+            }
+            connection.disconnect();
+        });
     }
 
-    void stop_server() {
-        if (client_socket != SOCK_INV) {
+    size_t Sessions::active() {
+        join(false);
+        std::lock_guard<std::mutex> lock(mutex);
+        return sessions.size();
+    }
+
+    void Sessions::stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& session : sessions) {
+                if (!session.done) {
 #ifdef _WIN32
-            shutdown(client_socket, SD_BOTH);
+                    shutdown(session.sock, SD_BOTH);
 #else
-            shutdown(client_socket, SHUT_RDWR);
+                    shutdown(session.sock, SHUT_RDWR);
 #endif
-            CLOSESOCK(client_socket);
-            client_socket = SOCK_INV;
+                }
+            }
         }
+        join(true);
+    }
+
+    void Sessions::join(bool all) {
+        std::list<Session> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto it = sessions.begin(); it != sessions.end();) {
+                auto next = std::next(it);
+                if (all || it->done) {
+                    finished.splice(finished.end(), sessions, it);
+                }
+                it = next;
+            }
+        }
+        for (auto& session : finished) {
+            session.thread.join();
+        }
+    }
+
+    void Listener::stop_server() {
         if (server_socket != SOCK_INV) {
             CLOSESOCK(server_socket);
             server_socket = SOCK_INV;
         }
     }
-} 
\ No newline at end of file
+}
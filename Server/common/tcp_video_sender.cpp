@@ -0,0 +1,273 @@
+#include "tcp_video_sender.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define SOCK_ERR   SOCKET_ERROR
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/uio.h>
+#define SOCK_ERR   -1
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#define ZERO_COPY_SUPPORTED
+#endif
+#endif
+
+namespace tcp_video_sender {
+    // Below this size pinning pages costs more than copying them
+    static const size_t ZERO_COPY_MIN_SIZE = 16 * 1024;
+
+    FrameSender::FrameSender(sock_t sock, size_t max_queued_frames)
+        : sock(sock), max_queued_frames(std::max<size_t>(1, max_queued_frames)) {
+    }
+
+    bool FrameSender::configure(size_t send_buffer_size, bool zero_copy_requested) {
+        int nodelay = 1;
+        if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char*>(&nodelay), sizeof(nodelay)) == SOCK_ERR) {
+            std::cerr << "Failed to set TCP_NODELAY\n";
+        }
+
+        int sendbuf = static_cast<int>(send_buffer_size);
+        if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<char*>(&sendbuf), sizeof(sendbuf)) == SOCK_ERR) {
+            std::cerr << "Failed to set send buffer size\n";
+        }
+
+#ifdef _WIN32
+        u_long mode = 1;
+        if (ioctlsocket(sock, FIONBIO, &mode) == SOCK_ERR) {
+            std::cerr << "Failed to set non-blocking mode\n";
+            return false;
+        }
+#else
+        int flags = fcntl(sock, F_GETFL, 0);
+        if (flags == -1 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1) {
+            std::cerr << "Failed to set non-blocking mode\n";
+            return false;
+        }
+#endif
+
+        zero_copy = false;
+        if (zero_copy_requested) {
+#ifdef ZERO_COPY_SUPPORTED
+            int one = 1;
+            if (setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0) {
+                zero_copy = true;
+            } else {
+                std::cerr << "MSG_ZEROCOPY not available, using regular sends\n";
+            }
+#else
+            std::cerr << "MSG_ZEROCOPY not supported on this platform, using regular sends\n";
+#endif
+        }
+        return true;
+    }
+
+    void FrameSender::submit(uint32_t frame_id, std::vector<unsigned char>& encoded) {
+        PendingFrame frame;
+        uint32_t length_net = htonl(static_cast<uint32_t>(FRAME_ID_SIZE + encoded.size()));
+        uint32_t frame_id_net = htonl(frame_id);
+        memcpy(frame.header, &length_net, message_framing::PREFIX_SIZE);
+        memcpy(frame.header + message_framing::PREFIX_SIZE, &frame_id_net, FRAME_ID_SIZE);
+
+        // Take the encoder's buffer and hand it back a recycled one
+        frame.data.swap(encoded);
+        encoded = frame_pool.acquire(frame.data.size());
+        queue.push_back(std::move(frame));
+
+        // Drop the oldest frames that have not started; a partially sent frame must be finished
+        // to keep the stream framing intact
+        while (queue.size() > max_queued_frames) {
+            auto oldest = queue.begin();
+            if (oldest->sent > 0) {
+                ++oldest;
+            }
+            if (oldest == queue.end() - 1) {
+                break;
+            }
+            frame_pool.release(std::move(oldest->data));
+            queue.erase(oldest);
+            totals.frames_dropped++;
+        }
+    }
+
+    bool FrameSender::pump(std::chrono::milliseconds budget) {
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        while (true) {
+            reap_zero_copy_completions();
+            if (queue.empty()) {
+                return true;
+            }
+
+            SendResult result = send_some();
+            if (result == SendResult::FAILED) {
+                return false;
+            }
+            if (result == SendResult::WOULD_BLOCK) {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now());
+                if (remaining.count() <= 0 || !wait_writable(remaining)) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    FrameSender::SendResult FrameSender::send_some() {
+        PendingFrame& frame = queue.front();
+        const size_t header_size = sizeof(frame.header);
+
+        // Gather the rest of the header and the payload straight from the encode buffer
+        const unsigned char* parts[2];
+        size_t sizes[2];
+        size_t count = 0;
+        if (frame.sent < header_size) {
+            parts[count] = frame.header + frame.sent;
+            sizes[count++] = header_size - frame.sent;
+        }
+        size_t data_offset = frame.sent > header_size ? frame.sent - header_size : 0;
+        if (data_offset < frame.data.size()) {
+            parts[count] = frame.data.data() + data_offset;
+            sizes[count++] = frame.data.size() - data_offset;
+        }
+
+        size_t sent = 0;
+#ifdef _WIN32
+        WSABUF buffers[2];
+        for (size_t i = 0; i < count; i++) {
+            buffers[i].buf = reinterpret_cast<char*>(const_cast<unsigned char*>(parts[i]));
+            buffers[i].len = static_cast<ULONG>(sizes[i]);
+        }
+        DWORD bytes = 0;
+        if (WSASend(sock, buffers, static_cast<DWORD>(count), &bytes, 0, nullptr, nullptr) == SOCK_ERR) {
+            if (WSAGetLastError() == WSAEWOULDBLOCK) {
+                return SendResult::WOULD_BLOCK;
+            }
+            std::cerr << "WSASend() failed\n";
+            return SendResult::FAILED;
+        }
+        sent = bytes;
+#else
+        iovec buffers[2];
+        for (size_t i = 0; i < count; i++) {
+            buffers[i].iov_base = const_cast<unsigned char*>(parts[i]);
+            buffers[i].iov_len = sizes[i];
+        }
+        msghdr msg{};
+        msg.msg_iov = buffers;
+        msg.msg_iovlen = count;
+
+        int flags = MSG_DONTWAIT;
+#ifdef MSG_NOSIGNAL
+        flags |= MSG_NOSIGNAL;
+#endif
+        bool use_zero_copy = false;
+#ifdef ZERO_COPY_SUPPORTED
+        use_zero_copy = zero_copy && frame.data.size() - data_offset >= ZERO_COPY_MIN_SIZE;
+        if (use_zero_copy && frame.sent < header_size) {
+            // The header lives in the queue entry, which moves before the completion arrives,
+            // so it is copied on its own; MSG_MORE holds it back until the payload follows
+            msg.msg_iovlen = 1;
+            flags |= MSG_MORE;
+            use_zero_copy = false;
+        }
+        if (use_zero_copy) {
+            flags |= MSG_ZEROCOPY;
+        }
+#endif
+
+        ssize_t result = sendmsg(sock, &msg, flags);
+        if (result < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return SendResult::WOULD_BLOCK;
+            }
+            if (errno == EINTR) {
+                return SendResult::PROGRESS;
+            }
+            if (errno == ENOBUFS && use_zero_copy) {
+                // Out of pinned-page budget (optmem_max): fall back to copying sends
+                std::cerr << "MSG_ZEROCOPY send rejected, using regular sends\n";
+                zero_copy = false;
+                return SendResult::PROGRESS;
+            }
+            std::cerr << "sendmsg() failed\n";
+            return SendResult::FAILED;
+        }
+        sent = static_cast<size_t>(result);
+        if (use_zero_copy) {
+            frame.zero_copy = true;
+            frame.last_zc_id = next_zc_id++;
+        }
+#endif
+
+        frame.sent += sent;
+        totals.bytes_sent += sent;
+        if (frame.sent == frame.total_size()) {
+            totals.frames_sent++;
+            if (frame.zero_copy) {
+                awaiting_completion.push_back(std::move(frame));
+            } else {
+                frame_pool.release(std::move(frame.data));
+            }
+            queue.pop_front();
+        }
+        return SendResult::PROGRESS;
+    }
+
+    void FrameSender::reap_zero_copy_completions() {
+#ifdef ZERO_COPY_SUPPORTED
+        if (awaiting_completion.empty()) {
+            return;
+        }
+
+        while (true) {
+            char control[128];
+            msghdr msg{};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                break;
+            }
+
+            for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+                if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                      (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                    continue;
+                }
+                auto* err = reinterpret_cast<sock_extended_err*>(CMSG_DATA(cm));
+                if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                    continue;
+                }
+                // Completions cover the inclusive range [ee_info, ee_data] and arrive in order for TCP
+                completed_zc_id = err->ee_data + 1;
+                if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                    // The kernel copied anyway (e.g. loopback), so pinning only adds overhead
+                    zero_copy = false;
+                }
+            }
+        }
+
+        while (!awaiting_completion.empty() &&
+               static_cast<int32_t>(awaiting_completion.front().last_zc_id - completed_zc_id) < 0) {
+            frame_pool.release(std::move(awaiting_completion.front().data));
+            awaiting_completion.pop_front();
+        }
+#endif
+    }
+
+    bool FrameSender::wait_writable(std::chrono::milliseconds timeout) {
+        fd_set writefds;
+        FD_ZERO(&writefds);
+        FD_SET(sock, &writefds);
+
+        timeval tv;
+        tv.tv_sec = static_cast<long>(timeout.count() / 1000);
+        tv.tv_usec = static_cast<long>((timeout.count() % 1000) * 1000);
+
+        return select(static_cast<int>(sock) + 1, nullptr, &writefds, nullptr, &tv) > 0;
+    }
+}
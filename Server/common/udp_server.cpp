@@ -1,5 +1,6 @@
 #include "udp_server.h"
 #include <iostream>
+#include <utility>
 
 #ifdef _WIN32
 #pragma comment(lib, "ws2_32.lib")
@@ -13,9 +14,11 @@
 #define SOCK_INV   -1
 #endif
 
-namespace udp_server {
-    static sock_t server_socket = SOCK_INV;
+static uint64_t peer_key(const sockaddr_in& addr) {
+    return (static_cast<uint64_t>(addr.sin_addr.s_addr) << 16) | addr.sin_port;
+}
 
+namespace udp_server {
     bool initialize_winsock() {
 #ifdef _WIN32
         WSADATA wsaData;
@@ -33,7 +36,37 @@ namespace udp_server {
 #endif
     }
 
-    bool start_server(uint16_t port) {
+    Socket::Socket()
+        : server_socket(SOCK_INV),
+          encoder(payload_codec::default_dictionary()),
+          decoder(payload_codec::default_dictionary()) {
+    }
+
+    Socket::~Socket() {
+        stop_server();
+    }
+
+    Socket::Socket(Socket&& other) noexcept
+        : server_socket(std::exchange(other.server_socket, SOCK_INV)),
+          compressed_peers(std::move(other.compressed_peers)),
+          encoder(std::move(other.encoder)),
+          decoder(std::move(other.decoder)) {
+    }
+
+    Socket& Socket::operator=(Socket&& other) noexcept {
+        if (this != &other) {
+            stop_server();
+            server_socket = std::exchange(other.server_socket, SOCK_INV);
+            compressed_peers = std::move(other.compressed_peers);
+            encoder = std::move(other.encoder);
+            decoder = std::move(other.decoder);
+        }
+        return *this;
+    }
+
+    bool Socket::start_server(uint16_t port) {
+        stop_server();
+
         // Create UDP socket
         server_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
         if (server_socket == SOCK_INV) {
@@ -50,6 +83,7 @@ namespace udp_server {
         if (bind(server_socket, (sockaddr*)&server_addr, sizeof(server_addr)) == SOCK_ERR) {
             std::cerr << "bind() failed\n";
             CLOSESOCK(server_socket);
+            server_socket = SOCK_INV;
             return false;
         }
 
@@ -57,8 +91,10 @@ namespace udp_server {
         return true;
     }
 
-    bool send_message(const std::string& message, const sockaddr_in& client_addr) {
-        int sent = sendto(server_socket, message.c_str(), static_cast<int>(message.length()), 0,
+    bool Socket::send_message(const std::string& message, const sockaddr_in& client_addr) {
+        std::string_view payload = compressed_peers.count(peer_key(client_addr))
+            ? encoder.encode_datagram(message) : std::string_view(message);
+        int sent = sendto(server_socket, payload.data(), static_cast<int>(payload.size()), 0,
             (sockaddr*)&client_addr, sizeof(client_addr));
         if (sent == SOCK_ERR) {
             std::cerr << "sendto() failed\n";
@@ -72,17 +108,34 @@ namespace udp_server {
         return true;
     }
 
-    std::pair<std::string, sockaddr_in> receive_message() {
+    std::pair<std::string, sockaddr_in> Socket::receive_message() {
         char buffer[1024];
         sockaddr_in client_addr{};
-        socklen_t addr_len = sizeof(client_addr);
-        
-        int recvd = recvfrom(server_socket, buffer, sizeof(buffer) - 1, 0,
-            (sockaddr*)&client_addr, &addr_len);
-        
-        if (recvd == SOCK_ERR) {
-            std::cerr << "recvfrom() failed\n";
-            return {"", sockaddr_in{}};
+        int recvd;
+
+        while (true) {
+            socklen_t addr_len = sizeof(client_addr);
+            recvd = recvfrom(server_socket, buffer, sizeof(buffer) - 1, 0,
+                (sockaddr*)&client_addr, &addr_len);
+
+            if (recvd == SOCK_ERR) {
+                std::cerr << "recvfrom() failed\n";
+                return {"", sockaddr_in{}};
+            }
+
+            std::string_view datagram(buffer, recvd);
+            if (!payload_codec::is_hello(datagram)) {
+                break;
+            }
+
+            // Compression request: answer it and wait for the next real message
+            bool accepted = false;
+            std::string answer = payload_codec::answer(datagram, payload_codec::default_dictionary(), accepted);
+            sendto(server_socket, answer.data(), static_cast<int>(answer.size()), 0,
+                (sockaddr*)&client_addr, sizeof(client_addr));
+            if (accepted) {
+                compressed_peers.insert(peer_key(client_addr));
+            }
         }
         
         buffer[recvd] = '\0';
@@ -90,15 +143,25 @@ namespace udp_server {
         char client_ip[INET_ADDRSTRLEN];
         inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
         std::cout << "Received from " << client_ip << ":" << ntohs(client_addr.sin_port) << "\n";
-        std::cout << "Message: " << buffer << "\n";
+
+        std::string message(buffer);
+        if (compressed_peers.count(peer_key(client_addr))) {
+            std::string_view decoded;
+            if (!decoder.decode_datagram(std::string_view(buffer, recvd), decoded)) {
+                return {"", client_addr};
+            }
+            message.assign(decoded);
+        }
+        std::cout << "Message: " << message << "\n";
         
-        return {std::string(buffer), client_addr};
+        return {message, client_addr};
     }
 
-    void stop_server() {
+    void Socket::stop_server() {
         if (server_socket != SOCK_INV) {
             CLOSESOCK(server_socket);
             server_socket = SOCK_INV;
         }
+        compressed_peers.clear();
     }
 } 
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include "udp_sharded_server.h"
+#include <algorithm>
+#include <iostream>
+#include "message_framing.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#define CLOSESOCK(s) closesocket(s)
+#define SOCK_ERR   SOCKET_ERROR
+#define SOCK_INV   INVALID_SOCKET
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#define CLOSESOCK(s) close(s)
+#define SOCK_ERR   -1
+#define SOCK_INV   -1
+#ifdef __linux__
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+namespace udp_sharded_server {
+    static void pin_to_core(size_t core) {
+        size_t cores = std::max(1u, std::thread::hardware_concurrency());
+#ifdef _WIN32
+        SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << (core % cores % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core % cores % CPU_SETSIZE, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            std::cerr << "Failed to pin shard thread to core " << core << "\n";
+        }
+#else
+        (void)core;
+        (void)cores;
+#endif
+    }
+
+    Server::~Server() {
+        stop();
+    }
+
+    bool Server::start(const Options& requested, Handler request_handler) {
+        stop();
+
+        options = requested;
+        options.batch_size = std::max<size_t>(1, options.batch_size);
+        handler = std::move(request_handler);
+        size_t shards = options.shards ? options.shards : std::max(1u, std::thread::hardware_concurrency());
+
+#if defined(__linux__) && defined(SO_REUSEPORT)
+        // One socket per shard; the kernel spreads incoming flows across the group
+        for (size_t i = 0; i < shards; i++) {
+            if (!open_socket(true)) {
+                close_sockets();
+                return false;
+            }
+        }
+
+        if (options.steer_by_flow_hash) {
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+            // socket index = flow hash % shards (uses the NIC/RSS hash stored in the packet)
+            sock_filter code[] = {
+                { BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_RXHASH) },
+                { BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(shards) },
+                { BPF_RET | BPF_A, 0, 0, 0 },
+            };
+            sock_fprog program{};
+            program.len = sizeof(code) / sizeof(code[0]);
+            program.filter = code;
+            if (setsockopt(sockets[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == SOCK_ERR) {
+                std::cerr << "Failed to attach flow-hash steering program, using kernel default\n";
+            }
+#else
+            std::cerr << "Flow-hash steering not supported by this kernel, using kernel default\n";
+#endif
+        }
+#else
+        // Without SO_REUSEPORT load balancing the shards share one non-blocking socket
+        if (!open_socket(false)) {
+            return false;
+        }
+#endif
+
+        // Counters start over; they stay readable after stop() until the next start()
+        stats.clear();
+        for (size_t i = 0; i < shards; i++) {
+            stats.push_back(std::make_unique<ShardStats>());
+        }
+        running = true;
+        for (size_t i = 0; i < shards; i++) {
+            workers.emplace_back(&Server::run_shard, this, i, sockets[i % sockets.size()]);
+        }
+
+        std::cout << "UDP sharded server listening on port " << options.port
+                  << " with " << shards << " shards (" << sockets.size() << " sockets)\n";
+        return true;
+    }
+
+    void Server::stop() {
+        running = false;
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+        close_sockets();
+    }
+
+    uint64_t Server::total_requests() const {
+        uint64_t total = 0;
+        for (const auto& shard : stats) {
+            total += shard->requests.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    uint64_t Server::total_replies() const {
+        uint64_t total = 0;
+        for (const auto& shard : stats) {
+            total += shard->replies.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    bool Server::open_socket(bool reuse_port) {
+        sock_t sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == SOCK_INV) {
+            std::cerr << "socket() failed\n";
+            return false;
+        }
+
+#ifdef SO_REUSEPORT
+        if (reuse_port) {
+            int opt = 1;
+            if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<char*>(&opt), sizeof(opt)) == SOCK_ERR) {
+                std::cerr << "Failed to set SO_REUSEPORT\n";
+                CLOSESOCK(sock);
+                return false;
+            }
+        }
+#else
+        (void)reuse_port;
+#endif
+
+        int rcvbuf = options.receive_buffer_size;
+        if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<char*>(&rcvbuf), sizeof(rcvbuf)) == SOCK_ERR) {
+            std::cerr << "Failed to set receive buffer size\n";
+        }
+
+        // Non-blocking, so that shards sharing a socket never block in recvfrom
+#ifdef _WIN32
+        u_long mode = 1;
+        ioctlsocket(sock, FIONBIO, &mode);
+#else
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+        sockaddr_in server_addr{};
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        server_addr.sin_port = htons(options.port);
+
+        if (bind(sock, (sockaddr*)&server_addr, sizeof(server_addr)) == SOCK_ERR) {
+            std::cerr << "bind() failed\n";
+            CLOSESOCK(sock);
+            return false;
+        }
+
+        sockets.push_back(sock);
+        return true;
+    }
+
+    void Server::close_sockets() {
+        for (sock_t sock : sockets) {
+            CLOSESOCK(sock);
+        }
+        sockets.clear();
+    }
+
+    void Server::run_shard(size_t shard, sock_t sock) {
+        if (options.pin_threads) {
+            pin_to_core(shard);
+        }
+
+        ShardStats& shard_stats = *stats[shard];
+        const size_t batch = options.batch_size;
+        const size_t slot_size = options.max_datagram_size;
+
+        // All buffers are allocated once per shard and reused for every batch
+        std::vector<char> requests(batch * slot_size);
+        std::vector<char> replies(batch * slot_size);
+        std::vector<sockaddr_in> addresses(batch);
+
+#ifdef __linux__
+        std::vector<mmsghdr> in_msgs(batch);
+        std::vector<mmsghdr> out_msgs(batch);
+        std::vector<iovec> in_iov(batch);
+        std::vector<iovec> out_iov(batch);
+        for (size_t i = 0; i < batch; i++) {
+            in_iov[i].iov_base = requests.data() + i * slot_size;
+            in_iov[i].iov_len = slot_size;
+        }
+#endif
+
+        while (running.load(std::memory_order_relaxed)) {
+            // Short timeout so stop() is noticed promptly
+            if (!message_framing::wait_readable(sock, std::chrono::milliseconds(100))) {
+                continue;
+            }
+
+#ifdef __linux__
+            for (size_t i = 0; i < batch; i++) {
+                in_msgs[i].msg_hdr = msghdr{};
+                in_msgs[i].msg_hdr.msg_name = &addresses[i];
+                in_msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+                in_msgs[i].msg_hdr.msg_iov = &in_iov[i];
+                in_msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+
+            int count = recvmmsg(sock, in_msgs.data(), static_cast<unsigned int>(batch), MSG_DONTWAIT, nullptr);
+            if (count <= 0) {
+                continue;
+            }
+
+            unsigned int reply_count = 0;
+            uint64_t bytes = 0;
+            for (int i = 0; i < count; i++) {
+                size_t size = in_msgs[i].msg_len;
+                bytes += size;
+                char* reply = replies.data() + reply_count * slot_size;
+                size_t reply_size = handler(requests.data() + i * slot_size, size, addresses[i], reply, slot_size);
+                if (reply_size == 0) {
+                    continue;
+                }
+                out_iov[reply_count].iov_base = reply;
+                out_iov[reply_count].iov_len = reply_size;
+                out_msgs[reply_count].msg_hdr = msghdr{};
+                out_msgs[reply_count].msg_hdr.msg_name = &addresses[i];
+                out_msgs[reply_count].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+                out_msgs[reply_count].msg_hdr.msg_iov = &out_iov[reply_count];
+                out_msgs[reply_count].msg_hdr.msg_iovlen = 1;
+                reply_count++;
+            }
+
+            unsigned int sent_total = 0;
+            while (sent_total < reply_count) {
+                int sent = sendmmsg(sock, out_msgs.data() + sent_total, reply_count - sent_total, 0);
+                if (sent <= 0) {
+                    break;
+                }
+                sent_total += static_cast<unsigned int>(sent);
+            }
+
+            shard_stats.requests.fetch_add(static_cast<uint64_t>(count), std::memory_order_relaxed);
+            shard_stats.replies.fetch_add(sent_total, std::memory_order_relaxed);
+            shard_stats.bytes_received.fetch_add(bytes, std::memory_order_relaxed);
+#else
+            // Portable path: drain what is queued one datagram at a time
+            for (size_t i = 0; i < batch; i++) {
+                socklen_t addr_len = sizeof(addresses[0]);
+                int recvd = recvfrom(sock, requests.data(), static_cast<int>(slot_size), 0,
+                    (sockaddr*)&addresses[0], &addr_len);
+                if (recvd == SOCK_ERR || recvd == 0) {
+                    break;
+                }
+
+                shard_stats.requests.fetch_add(1, std::memory_order_relaxed);
+                shard_stats.bytes_received.fetch_add(static_cast<uint64_t>(recvd), std::memory_order_relaxed);
+
+                size_t reply_size = handler(requests.data(), static_cast<size_t>(recvd), addresses[0], replies.data(), slot_size);
+                if (reply_size > 0 &&
+                    sendto(sock, replies.data(), static_cast<int>(reply_size), 0,
+                        (sockaddr*)&addresses[0], sizeof(addresses[0])) != SOCK_ERR) {
+                    shard_stats.replies.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+#endif
+        }
+    }
+}
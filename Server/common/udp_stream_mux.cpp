@@ -0,0 +1,194 @@
+#include "udp_stream_mux.h"
+#include <algorithm>
+#include <iostream>
+#include "crc32c.h"
+#include "frame_trace.h"
+#include "path_mtu.h"
+#include "video_chunking.h"
+
+#ifdef _WIN32
+#define SOCK_ERR   SOCKET_ERROR
+#else
+#include <cerrno>
+#include <sys/select.h>
+#define SOCK_ERR   -1
+#endif
+
+namespace udp_stream_mux {
+    Multiplexer::Multiplexer(sock_t sock, const sockaddr_in& destination, size_t stream_count, size_t max_chunk_size)
+        : sock(sock), destination(destination), chunk_size(max_chunk_size),
+          streams(std::clamp<size_t>(stream_count, 1, video_chunking::MAX_STREAMS)),
+          datagram(video_chunking::HEADER_SIZE + max_chunk_size),
+          frame_pool(2 * streams.size() + 2) {
+    }
+
+    void Multiplexer::submit(uint32_t stream_id, uint32_t frame_id, std::vector<uint8_t>& encoded, int64_t capture_us) {
+        if (stream_id >= streams.size() || encoded.empty()) {
+            return;
+        }
+
+        // On the encoder's thread, outside the lock
+        uint32_t crc = crc32c::value(encoded.data(), encoded.size());
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Stream& stream = streams[stream_id];
+            if (stream.has_pending) {
+                // Superseded before it started: only the newest frame is worth sending
+                stream.stats.frames_dropped++;
+            }
+
+            std::vector<uint8_t> previous = std::move(stream.pending.data);
+            stream.pending.data = std::move(encoded);
+            stream.pending.frame_id = frame_id;
+            stream.pending.capture_us = capture_us;
+            stream.pending.crc = crc;
+            stream.has_pending = true;
+
+            encoded = previous.capacity() > 0 ? std::move(previous) : frame_pool.acquire(stream.pending.data.size());
+            encoded.clear();
+        }
+        frame_ready.notify_one();
+    }
+
+    StreamStats Multiplexer::stats(uint32_t stream_id) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stream_id < streams.size() ? streams[stream_id].stats : StreamStats();
+    }
+
+    bool Multiplexer::take_pending(Stream& stream) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!stream.has_pending) {
+            return false;
+        }
+
+        frame_pool.release(std::move(stream.current.data));
+        std::swap(stream.current, stream.pending);
+        stream.has_pending = false;
+        stream.has_current = true;
+        stream.current.chunk_size = chunk_size;
+        stream.next_chunk = 0;
+        return true;
+    }
+
+    bool Multiplexer::pump(std::chrono::milliseconds budget) {
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        while (true) {
+            bool active = false;
+            for (uint32_t stream_id = 0; stream_id < streams.size(); stream_id++) {
+                Stream& stream = streams[stream_id];
+                if (!stream.has_current && !take_pending(stream)) {
+                    stream.deficit = 0;
+                    continue;
+                }
+                active = true;
+
+                // Deficit round robin: every round grants each busy stream one full datagram
+                stream.deficit += video_chunking::HEADER_SIZE + stream.current.chunk_size;
+                while (stream.has_current) {
+                    size_t frame_chunk_size = stream.current.chunk_size;
+                    size_t offset = stream.next_chunk * frame_chunk_size;
+                    size_t next_size = video_chunking::HEADER_SIZE +
+                        std::min(frame_chunk_size, stream.current.data.size() - offset);
+                    if (next_size > stream.deficit) {
+                        break;
+                    }
+
+                    SendResult result = send_chunk(stream_id, stream);
+                    if (result == SendResult::SENT) {
+                        stream.deficit -= next_size;
+                    }
+                    else if (result == SendResult::WOULD_BLOCK) {
+                        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            deadline - std::chrono::steady_clock::now());
+                        if (remaining.count() <= 0 || !wait_writable(remaining)) {
+                            return true;
+                        }
+                    }
+                    else if (result == SendResult::TOO_BIG) {
+                        // The path narrowed: this frame cannot be finished, and frames started from now on
+                        // are cut smaller. Other streams' frames in flight keep the layout they began
+                        // with, and are dropped the same way if their chunks no longer fit
+                        size_t mtu = path_mtu::after_too_big(destination, next_size);
+                        chunk_size = std::min(chunk_size, path_mtu::chunk_size(mtu, video_chunking::HEADER_SIZE));
+                        std::cout << "Path MTU dropped to " << mtu << " bytes\n";
+                        stream.has_current = false;
+                        std::lock_guard<std::mutex> lock(mutex);
+                        stream.stats.frames_dropped++;
+                    }
+                    else {
+                        return false;
+                    }
+                }
+                if (!stream.has_current) {
+                    stream.deficit = 0;
+                }
+            }
+
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return true;
+            }
+            if (!active) {
+                std::unique_lock<std::mutex> lock(mutex);
+                bool any_pending = frame_ready.wait_until(lock, deadline, [this] {
+                    return std::any_of(streams.begin(), streams.end(), [](const Stream& s) { return s.has_pending; });
+                });
+                if (!any_pending) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    Multiplexer::SendResult Multiplexer::send_chunk(uint32_t stream_id, Stream& stream) {
+        size_t datagram_size = video_chunking::build_chunk(stream.current.frame_id, stream.current.data.data(),
+            stream.current.data.size(), stream.next_chunk, stream.current.chunk_size, datagram.data(),
+            static_cast<uint16_t>(stream_id), 0, stream.current.capture_us, frame_trace::now_us(),
+            stream.current.crc);
+
+        int sent = sendto(sock, datagram.data(), static_cast<int>(datagram_size), 0,
+            reinterpret_cast<const sockaddr*>(&destination), sizeof(destination));
+        if (sent == SOCK_ERR) {
+#ifdef _WIN32
+            int error = WSAGetLastError();
+            if (error == WSAEWOULDBLOCK) {
+#else
+            int error = errno;
+            if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) {
+#endif
+                return SendResult::WOULD_BLOCK;
+            }
+            if (path_mtu::is_too_big(error)) {
+                return SendResult::TOO_BIG;
+            }
+            std::cerr << "send_chunk() failed\n";
+            return SendResult::FAILED;
+        }
+
+        stream.next_chunk++;
+        bool finished = stream.next_chunk == video_chunking::chunk_count(stream.current.data.size(), stream.current.chunk_size);
+        if (finished) {
+            stream.has_current = false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stream.stats.chunks_sent++;
+        stream.stats.bytes_sent += static_cast<uint64_t>(sent);
+        if (finished) {
+            stream.stats.frames_sent++;
+        }
+        return SendResult::SENT;
+    }
+
+    bool Multiplexer::wait_writable(std::chrono::milliseconds timeout) {
+        fd_set writefds;
+        FD_ZERO(&writefds);
+        FD_SET(sock, &writefds);
+
+        timeval tv;
+        tv.tv_sec = static_cast<long>(timeout.count() / 1000);
+        tv.tv_usec = static_cast<long>((timeout.count() % 1000) * 1000);
+
+        return select(static_cast<int>(sock) + 1, nullptr, &writefds, nullptr, &tv) > 0;
+    }
+}
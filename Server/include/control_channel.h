@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "stream_control.h"
+#include "tcp_server.h"
+
+// Server end of the stream control channel (see stream_control.h). Each session is served on
+// a thread of its own, which answers every request at once: stats from the last snapshot the
+// sender published, changes by queueing them. The sender takes the queued changes between
+// frames, so the capture loop never waits on a control client. Sessions idle for longer than
+// IDLE_TIMEOUT are closed, and at most MAX_SESSIONS are served at a time.
+//
+// The channel listens on loopback unless CONTROL_ADDRESS names another address to listen on
+// (e.g. 0.0.0.0). A client connecting from another host may only send the video to its own
+// address, so the channel cannot be used to aim the stream at a third party.
+namespace control_channel {
+    constexpr const char* DEFAULT_ADDRESS = "127.0.0.1";
+    constexpr size_t MAX_SESSIONS = 8;
+    constexpr auto IDLE_TIMEOUT = std::chrono::seconds(60);
+
+    // From the CONTROL_ADDRESS environment variable, DEFAULT_ADDRESS when unset
+    const char* address_from_environment();
+
+    // Everything requested since the sender last looked; the latest request of each kind wins
+    struct Changes {
+        bool refresh = false;
+        std::optional<std::pair<int, int>> resolution;    // 0x0: the camera's own
+        std::optional<double> fps;
+        std::optional<int> max_quality;
+        std::optional<sockaddr_in> destination;
+        std::optional<bool> paused;
+    };
+
+    struct Stats {
+        uint32_t frame_id = 0;
+        uint64_t frames_sent = 0;
+        uint64_t frames_dropped = 0;
+        uint64_t bytes_sent = 0;
+        double fps = 0;             // Measured
+        double target_fps = 0;
+        int quality = 0;
+        int width = 0;              // Of the frames sent
+        int height = 0;
+        bool paused = false;
+        std::string destination;    // IP:PORT, or shm:NAME for the shared-memory ring
+    };
+
+    class Channel {
+    public:
+        Channel() = default;
+        ~Channel();
+        Channel(const Channel&) = delete;
+        Channel& operator=(const Channel&) = delete;
+
+        // Winsock must already be initialized. `destination` is where the video goes now,
+        // for destination commands that only give an address.
+        bool start(const sockaddr_in& destination, uint16_t port = stream_control::PORT,
+                   const char* address = DEFAULT_ADDRESS);
+        void stop();
+
+        // Called by the sender between frames: move the queued changes into `changes`.
+        // Returns false when nothing was requested.
+        bool take(Changes& changes);
+        void publish(const Stats& stats);
+
+    private:
+        void serve_loop();
+        void serve(tcp_server::Connection& connection, const sockaddr_in& peer);
+        std::string handle(std::string_view request, const sockaddr_in& peer);
+
+        tcp_server::Listener listener;
+        std::thread worker;
+        std::atomic<bool> stopping{false};
+        tcp_server::Sessions sessions;
+
+        std::mutex mutex;           // Guards the members below
+        Changes pending;
+        bool has_pending = false;
+        Stats stats;
+        sockaddr_in destination{};
+    };
+}
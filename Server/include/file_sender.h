@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include "file_transfer.h"
+#include "tcp_server.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Serves one file over TCP (see file_transfer for the protocol). Ranges are sent with
+// sendfile() on Linux and TransmitFile() on Windows, so file data goes from the page
+// cache to the socket without passing through user memory. Every connection is served
+// on its own thread, so a receiver can pull several ranges in parallel.
+namespace file_sender {
+    // Read-only file opened for zero-copy sends.
+    class FileSource {
+    public:
+        FileSource() = default;
+        ~FileSource();
+        FileSource(const FileSource&) = delete;
+        FileSource& operator=(const FileSource&) = delete;
+
+        bool open(const std::string& path);
+        void close();
+        uint64_t size() const { return file_size; }
+
+        // Send bytes [offset, offset + length) to a blocking socket. `sent` is increased as
+        // data goes out; stops early (returning false) when `cancel` becomes true.
+        bool send_range(sock_t sock, uint64_t offset, uint64_t length,
+                        std::atomic<uint64_t>& sent, const std::atomic<bool>& cancel);
+
+    private:
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+#else
+        int file = -1;
+#endif
+        uint64_t file_size = 0;
+    };
+
+    struct Stats {
+        std::atomic<uint64_t> bytes_sent{0};
+        std::atomic<uint64_t> ranges_sent{0};
+        std::atomic<size_t> active_streams{0};
+    };
+
+    class Server {
+    public:
+        Server() = default;
+        ~Server();
+        Server(const Server&) = delete;
+        Server& operator=(const Server&) = delete;
+
+        bool start(uint16_t port, const std::string& path);
+        void stop();
+
+        const Stats& stats() const { return totals; }
+        uint64_t file_size() const { return offer.size; }
+
+    private:
+        void accept_loop();
+        void serve(tcp_server::Connection& connection);
+
+        std::string path;
+        file_transfer::Offer offer;
+        tcp_server::Listener listener;
+        std::thread acceptor;
+        std::atomic<bool> stopping{false};
+        tcp_server::Sessions sessions;
+        Stats totals;
+    };
+}
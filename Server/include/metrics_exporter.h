@@ -0,0 +1,31 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include "metrics.h"
+#include "tcp_server.h"
+
+// Minimal HTTP endpoint serving a metrics registry in the Prometheus text format.
+// GET /metrics (or /) returns the rendered registry; every response closes the connection.
+// Scrapes are served one at a time on the exporter's own thread.
+namespace metrics_exporter {
+    class Exporter {
+    public:
+        Exporter() = default;
+        ~Exporter();
+        Exporter(const Exporter&) = delete;
+        Exporter& operator=(const Exporter&) = delete;
+
+        bool start(uint16_t port, metrics::Registry& registry = metrics::default_registry());
+        void stop();
+
+    private:
+        void serve_loop();
+        void serve(tcp_server::Connection& connection);
+
+        metrics::Registry* registry = nullptr;
+        tcp_server::Listener listener;
+        std::thread worker;
+        std::atomic<bool> stopping{false};
+    };
+}
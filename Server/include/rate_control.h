@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <opencv2/opencv.hpp>
+
+// Per-frame JPEG rate control: picks the quality expected to hit a byte budget per frame,
+// instead of stepping the quality after the fact, so the bitrate stays near the budget
+// whatever the scene. Encoded size is modelled as
+//     ln(bytes) = a + b * quality + ln(complexity)
+// with complexity measured on each captured frame before encoding, and a and b fitted to
+// recent frames by least squares, weighted towards the newest. A leaky bucket carries over
+// what earlier frames spent above or below the budget, spread over the next few frames.
+namespace rate_control {
+    constexpr int MIN_QUALITY = 30;             // Default quality bounds
+    constexpr int MAX_QUALITY = 90;
+    constexpr size_t HISTORY = 32;              // Frames the model is fitted to
+    constexpr double DEFAULT_SLOPE = 0.035;     // b before there is enough spread in quality
+    constexpr double RE_ENCODE_OVERSHOOT = 1.5; // Re-encode frames this far above the target
+    constexpr double DEFAULT_BITRATE = 20e6;    // Bits per second
+
+    // From VIDEO_BITRATE, in bits per second with an optional k, M or G suffix ("8M");
+    // DEFAULT_BITRATE when unset or invalid
+    double bitrate_from_environment();
+
+    class Controller {
+    public:
+        Controller(double bits_per_second, double fps,
+                   int min_quality = MIN_QUALITY, int max_quality = MAX_QUALITY);
+
+        // Mean absolute difference between neighbouring pixels of a small grey copy of the
+        // frame: flat 720p scenes score near 1, detailed ones tens. Scaled by the frame's area
+        // relative to 720p, so a change of resolution moves the prediction at once.
+        double measure_complexity(const cv::Mat& frame);
+
+        // Quality expected to hit target_bytes() for a frame of this complexity
+        int choose_quality(double complexity) const;
+        // Learn from an encode. Returns true when the frame overshot so far that encoding it
+        // again at choose_quality() would send much less; callers re-encode at most once.
+        bool observe(int quality, double complexity, size_t bytes);
+        // Account for the bytes actually sent for a frame, re-encoded or not
+        void sent(size_t bytes);
+
+        // Shrink the budget while the network reports errors; it grows back by a small
+        // step with every frame sent
+        void congestion();
+
+        // Live changes, e.g. from the control channel; the fitted model carries over
+        void set_frame_rate(double fps);
+        void set_quality_range(int min_quality, int max_quality);
+        int highest_quality() const { return max_quality; }
+
+        size_t target_bytes() const;
+        double budget_bytes() const { return frame_budget * budget_scale; }
+        double predict_bytes(int quality, double complexity) const;
+
+    private:
+        struct Sample {
+            int quality;
+            double log_size;    // ln(bytes / complexity)
+        };
+
+        void fit();
+
+        double bitrate;             // Bits per second
+        double frame_budget;        // Bytes per frame at the full bitrate
+        int min_quality;
+        int max_quality;
+        double budget_scale = 1.0;  // Lowered by congestion()
+        double debt = 0.0;          // Bytes sent beyond the budget so far, negative when under
+        double intercept = 0.0;     // a
+        double slope = DEFAULT_SLOPE;   // b
+        bool fitted = false;
+        std::deque<Sample> history;
+        cv::Mat small;
+        cv::Mat grey;
+    };
+}
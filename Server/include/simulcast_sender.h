@@ -0,0 +1,105 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "simulcast.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+// Server side of simulcast (see simulcast.h): encoding each captured frame into every layer
+// someone is subscribed to, and tracking who is subscribed to what.
+namespace simulcast_sender {
+    // One encoding thread per layer, so the layers of a frame are encoded concurrently.
+    // Frames are scaled down to fit their layer, never up.
+    class LayerEncoder {
+    public:
+        explicit LayerEncoder(const std::vector<simulcast::Layer>& layers);
+        ~LayerEncoder();
+
+        LayerEncoder(const LayerEncoder&) = delete;
+        LayerEncoder& operator=(const LayerEncoder&) = delete;
+
+        // Encode `frame` into each layer with wanted[layer] set; blocks until all are done.
+        void encode(const cv::Mat& frame, const std::vector<bool>& wanted);
+        // The layer's JPEG from the last encode(), empty if it was not wanted
+        const std::vector<uchar>& encoded(size_t layer) const { return workers[layer].output; }
+
+        size_t layer_count() const { return workers.size(); }
+
+    private:
+        struct Worker {
+            simulcast::Layer layer;
+            std::vector<int> params;
+            cv::Mat scaled;
+            std::vector<uchar> output;
+            std::thread thread;
+        };
+
+        void run(size_t index);
+
+        std::vector<Worker> workers;
+        std::mutex mutex;
+        std::condition_variable work_ready;
+        std::condition_variable work_done;
+        const cv::Mat* source = nullptr;   // Guarded by mutex, like everything below
+        std::vector<bool> wanted;
+        uint64_t generation = 0;
+        size_t remaining = 0;
+        bool stopping = false;
+    };
+
+    struct Subscriber {
+        sockaddr_in address;
+        uint16_t layer;
+        size_t max_chunk_size;      // From the path MTU towards this receiver
+        std::chrono::steady_clock::time_point last_seen;
+    };
+
+    // Not thread-safe: owned by the sending loop, which applies subscribe datagrams between
+    // frames so that a receiver never gets half a frame from each of two layers.
+    // Cookies are a keyed hash (SipHash-2-4, with a key drawn at construction) of the
+    // receiver's address and the current COOKIE_PERIOD, so no per-address state is kept
+    // before a receiver proves it gets what is sent to it.
+    class Subscriptions {
+    public:
+        static constexpr size_t MAX_SUBSCRIBERS = 32;
+        static constexpr auto COOKIE_PERIOD = std::chrono::seconds(30);  // The previous one is accepted too
+
+        enum class Result {
+            IGNORED,        // Not a subscription, or one that cannot be granted
+            APPLIED,
+            CHALLENGE,      // Send `challenge` back to the sender
+        };
+
+        explicit Subscriptions(size_t layer_count);
+
+        // Apply one datagram received on the simulcast port. `challenge` must have room for
+        // simulcast::CHALLENGE_SIZE bytes.
+        Result handle(const char* data, size_t size, const sockaddr_in& from,
+                      std::chrono::steady_clock::time_point now, char* challenge);
+        // Forget receivers silent for longer than simulcast::SUBSCRIPTION_TIMEOUT
+        void expire(std::chrono::steady_clock::time_point now);
+
+        // Whether anyone is subscribed to each layer
+        std::vector<bool> wanted_layers() const;
+        std::vector<Subscriber>& subscribers() { return list; }
+
+    private:
+        uint64_t cookie_for(const sockaddr_in& address, int64_t period) const;
+
+        size_t layer_count;
+        uint64_t key[2];
+        std::vector<Subscriber> list;
+    };
+}
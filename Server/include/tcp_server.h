@@ -1,5 +1,13 @@
 #pragma once
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include "message_framing.h"
+#include "payload_codec.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -15,9 +23,110 @@ using sock_t = int;
 namespace tcp_server {
     bool initialize_winsock();
     void cleanup_winsock();
-    bool start_server(uint16_t port);
-    bool accept_client();
-    bool send_message(const std::string& message);
-    std::string receive_message();
-    void stop_server();
-} 
\ No newline at end of file
+
+    // An accepted client connection. Move-only; may be handed to a worker thread,
+    // but must only be used by one thread at a time.
+    class Connection {
+    public:
+        Connection();
+        ~Connection();
+        Connection(Connection&& other) noexcept;
+        Connection& operator=(Connection&& other) noexcept;
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+        bool send_message(const std::string& message);
+        std::string receive_message();
+
+        // Pipelined messaging: queued messages go out in one gathered write on flush.
+        // Queued payloads must stay alive until flush_messages() returns.
+        void queue_message(std::string_view message);
+        bool flush_messages();
+        // Zero-copy receive: the view is valid until the next receive call.
+        // A compression request from the client (see payload_codec) is answered here
+        // transparently, using the built-in dictionary.
+        bool receive_message(std::string_view& message);
+        // Like receive_message(), but only from what is already buffered: never waits on
+        // the socket. Sets received when a message was returned.
+        bool poll_message(std::string_view& message, bool& received);
+        // Read what the socket has into the buffer, once wait_readable() reported data.
+        // A partial message stays buffered for a later poll_message().
+        bool read_available();
+        // True if a complete message is buffered, so the socket may never become readable for it
+        bool has_frame() const { return reader.has_frame(); }
+        void disconnect();
+
+        bool compression_enabled() const { return compressing; }
+        const payload_codec::Encoder& compression_stats() const { return encoder; }
+
+        bool is_connected() const;
+        // Socket of the client, for transports layered on top (e.g. tcp_video_sender)
+        sock_t handle() const { return client_socket; }
+
+    private:
+        friend class Listener;
+
+        // Turns a received frame into a message, answering a compression request in place
+        bool accept_frame(std::string_view frame, std::string_view& message, bool& received);
+
+        sock_t client_socket;
+        message_framing::StreamReader reader;
+        message_framing::BatchWriter writer;
+        bool compressing = false;
+        payload_codec::Encoder encoder;
+        payload_codec::Decoder decoder;
+        std::deque<std::string> encoded_queue; // Compressed copies of queued messages
+    };
+
+    // Listening socket. Any number of listeners can run in one process.
+    class Listener {
+    public:
+        Listener();
+        ~Listener();
+        Listener(Listener&& other) noexcept;
+        Listener& operator=(Listener&& other) noexcept;
+        Listener(const Listener&) = delete;
+        Listener& operator=(const Listener&) = delete;
+
+        // Listen on `address`, a dotted IPv4 address, or on all interfaces when it is null
+        bool start_server(uint16_t port, const char* address = nullptr);
+        // Block until a client connects and hand it over in `client`, with its address in
+        // `peer` if given
+        bool accept_client(Connection& client, sockaddr_in* peer = nullptr);
+        void stop_server();
+
+        sock_t handle() const { return server_socket; }
+
+    private:
+        sock_t server_socket;
+    };
+
+    // Accepted connections served on a thread each. Finished threads are joined as new
+    // sessions start; stop() shuts down the sockets of the rest, so a thread blocked in
+    // recv() or send() on a stalled peer returns at once, and joins them.
+    class Sessions {
+    public:
+        Sessions() = default;
+        ~Sessions();
+        Sessions(const Sessions&) = delete;
+        Sessions& operator=(const Sessions&) = delete;
+
+        // Run `serve` on the connection on a new thread; the connection is closed after it returns
+        void start(Connection connection, std::function<void(Connection&)> serve);
+        // Sessions still running
+        size_t active();
+        void stop();
+
+    private:
+        struct Session {
+            std::thread thread;
+            sock_t sock;
+            bool done = false;
+        };
+
+        void join(bool all);
+
+        std::mutex mutex;           // Guards sessions' sock and done
+        std::list<Session> sessions;
+    };
+}
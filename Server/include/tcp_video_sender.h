@@ -0,0 +1,81 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "message_framing.h"
+#include "buffer_pool.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using sock_t = SOCKET;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+using sock_t = int;
+#endif
+
+// Video transport over an accepted TCP connection, for sites where UDP is blocked.
+// Each frame is one length-prefixed message (see message_framing) whose payload is
+// the 4-byte big-endian frame ID followed by the encoded JPEG data.
+namespace tcp_video_sender {
+    constexpr size_t FRAME_ID_SIZE = 4;
+
+    struct Stats {
+        size_t bytes_sent = 0;
+        size_t frames_sent = 0;
+        size_t frames_dropped = 0;
+    };
+
+    class FrameSender {
+    public:
+        FrameSender(sock_t sock, size_t max_queued_frames);
+
+        // Set TCP_NODELAY, non-blocking mode and the kernel send buffer size.
+        // With zero_copy, large sends use MSG_ZEROCOPY where the platform supports it.
+        bool configure(size_t send_buffer_size, bool zero_copy);
+
+        // Queue an encoded frame. The buffer is taken over without copying and replaced
+        // by a recycled one, so the encoder keeps reusing the same allocations.
+        // When more than max_queued_frames are waiting, the oldest unsent ones are dropped.
+        void submit(uint32_t frame_id, std::vector<unsigned char>& encoded);
+
+        // Send queued data until the queue is empty or the budget runs out.
+        // Returns false if the connection is lost.
+        bool pump(std::chrono::milliseconds budget);
+
+        size_t queued_frames() const { return queue.size(); }
+        bool zero_copy_enabled() const { return zero_copy; }
+        const Stats& stats() const { return totals; }
+
+    private:
+        enum class SendResult { PROGRESS, WOULD_BLOCK, FAILED };
+
+        struct PendingFrame {
+            // Moves with the entry, so never part of a MSG_ZEROCOPY send
+            unsigned char header[message_framing::PREFIX_SIZE + FRAME_ID_SIZE];
+            std::vector<unsigned char> data;
+            size_t sent = 0;          // Bytes of header + data already handed to the kernel
+            bool zero_copy = false;   // Kernel may still reference data (not header) after the send returns
+            uint32_t last_zc_id = 0;  // ID of the last MSG_ZEROCOPY send covering this frame
+
+            size_t total_size() const { return sizeof(header) + data.size(); }
+        };
+
+        SendResult send_some();
+        void reap_zero_copy_completions();
+        bool wait_writable(std::chrono::milliseconds timeout);
+
+        sock_t sock;
+        size_t max_queued_frames;
+        std::deque<PendingFrame> queue;
+        std::deque<PendingFrame> awaiting_completion;
+        buffer_pool::Pool frame_pool; // Sent frames, handed back to the encoder
+        bool zero_copy = false;
+        uint32_t next_zc_id = 0;      // The kernel numbers every successful MSG_ZEROCOPY send
+        uint32_t completed_zc_id = 0; // All sends below this ID have completed
+        Stats totals;
+    };
+}
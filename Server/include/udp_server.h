@@ -1,5 +1,8 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <unordered_set>
+#include "payload_codec.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -15,8 +18,31 @@ using sock_t = int;
 namespace udp_server {
     bool initialize_winsock();
     void cleanup_winsock();
-    bool start_server(uint16_t port);
-    bool send_message(const std::string& message, const sockaddr_in& client_addr);
-    std::pair<std::string, sockaddr_in> receive_message();
-    void stop_server();
-} 
\ No newline at end of file
+
+    // Bound UDP server socket. Move-only; may be handed to another thread,
+    // but must only be used by one thread at a time.
+    class Socket {
+    public:
+        Socket();
+        ~Socket();
+        Socket(Socket&& other) noexcept;
+        Socket& operator=(Socket&& other) noexcept;
+        Socket(const Socket&) = delete;
+        Socket& operator=(const Socket&) = delete;
+
+        bool start_server(uint16_t port);
+        bool send_message(const std::string& message, const sockaddr_in& client_addr);
+        // Compression requests (see payload_codec) are answered here; datagrams to and
+        // from clients that negotiated it are compressed transparently.
+        std::pair<std::string, sockaddr_in> receive_message();
+        void stop_server();
+
+        sock_t handle() const { return server_socket; }
+
+    private:
+        sock_t server_socket;
+        std::unordered_set<uint64_t> compressed_peers; // Address and port of each client
+        payload_codec::Encoder encoder;
+        payload_codec::Decoder decoder;
+    };
+}
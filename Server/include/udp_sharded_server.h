@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using sock_t = SOCKET;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+using sock_t = int;
+#endif
+
+// Multi-core UDP request/response server.
+// On Linux every shard owns its own SO_REUSEPORT socket on the same port, runs on a thread
+// pinned to one core and drains it with recvmmsg/sendmmsg, so throughput scales with cores.
+// Elsewhere the shards share one socket and use recvfrom/sendto.
+namespace udp_sharded_server {
+    // Build the reply to one request into `reply` (capacity bytes) and return its size;
+    // return 0 to send nothing. Called concurrently from all shard threads.
+    using Handler = std::function<size_t(const char* request, size_t size, const sockaddr_in& from,
+                                         char* reply, size_t capacity)>;
+
+    struct Options {
+        uint16_t port = 0;
+        size_t shards = 0;              // 0 = one per hardware thread
+        size_t batch_size = 32;         // Datagrams per recvmmsg/sendmmsg call
+        size_t max_datagram_size = 65536;
+        bool pin_threads = true;        // Pin shard i to core i
+        bool steer_by_flow_hash = false; // Attach a CBPF program that picks the shard from the flow hash
+        int receive_buffer_size = 4 * 1024 * 1024;
+    };
+
+    struct ShardStats {
+        std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> replies{0};
+        std::atomic<uint64_t> bytes_received{0};
+    };
+
+    class Server {
+    public:
+        Server() = default;
+        ~Server();
+        Server(const Server&) = delete;
+        Server& operator=(const Server&) = delete;
+
+        bool start(const Options& options, Handler handler);
+        void stop();
+
+        size_t shard_count() const { return stats.size(); }
+        const ShardStats& shard_stats(size_t shard) const { return *stats[shard]; }
+        uint64_t total_requests() const;
+        uint64_t total_replies() const;
+
+    private:
+        bool open_socket(bool reuse_port);
+        void run_shard(size_t shard, sock_t sock);
+        void close_sockets();
+
+        Options options;
+        Handler handler;
+        std::vector<sock_t> sockets;
+        std::vector<std::thread> workers;
+        std::vector<std::unique_ptr<ShardStats>> stats;
+        std::atomic<bool> running{false};
+    };
+}
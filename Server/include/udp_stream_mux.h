@@ -0,0 +1,83 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "buffer_pool.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using sock_t = SOCKET;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+using sock_t = int;
+#endif
+
+// Several video streams sent through one UDP socket, each chunk tagged with its stream ID
+// (see video_chunking). Encoder threads submit frames concurrently; a single sending thread
+// interleaves the streams chunk by chunk with deficit round robin over bytes, so a stream
+// with large frames cannot starve the others. Each stream keeps only its newest unsent
+// frame: a frame superseded before its first chunk went out is dropped.
+namespace udp_stream_mux {
+    struct StreamStats {
+        uint64_t frames_sent = 0;
+        uint64_t frames_dropped = 0;
+        uint64_t chunks_sent = 0;
+        uint64_t bytes_sent = 0;
+    };
+
+    class Multiplexer {
+    public:
+        Multiplexer(sock_t sock, const sockaddr_in& destination, size_t stream_count, size_t max_chunk_size);
+
+        // Thread-safe. The buffer is taken over and replaced by a recycled one. capture_us
+        // (frame_trace::now_us() when the frame was captured) goes into every chunk header.
+        void submit(uint32_t stream_id, uint32_t frame_id, std::vector<uint8_t>& encoded, int64_t capture_us = 0);
+
+        // Sending thread only. Send chunks until every stream is idle or the budget runs out,
+        // waiting for frames while idle. Returns false on a socket error.
+        bool pump(std::chrono::milliseconds budget);
+
+        size_t stream_count() const { return streams.size(); }
+        size_t max_chunk_size() const { return chunk_size; }
+        StreamStats stats(uint32_t stream_id) const;
+
+    private:
+        struct Frame {
+            uint32_t frame_id = 0;
+            int64_t capture_us = 0;
+            uint32_t crc = 0;
+            size_t chunk_size = 0;      // Fixed when sending starts; chunk IDs index this layout
+            std::vector<uint8_t> data;
+        };
+
+        struct Stream {
+            Frame pending;              // Newest submitted frame, guarded by mutex
+            bool has_pending = false;
+            Frame current;              // Being sent; sending thread only
+            bool has_current = false;
+            size_t next_chunk = 0;
+            size_t deficit = 0;         // Bytes this stream may still send this round
+            StreamStats stats;          // Guarded by mutex
+        };
+
+        enum class SendResult { SENT, WOULD_BLOCK, TOO_BIG, FAILED };
+
+        bool take_pending(Stream& stream);
+        SendResult send_chunk(uint32_t stream_id, Stream& stream);
+        bool wait_writable(std::chrono::milliseconds timeout);
+
+        sock_t sock;
+        sockaddr_in destination;
+        size_t chunk_size;              // For frames not started yet
+        std::vector<Stream> streams;
+        std::vector<char> datagram;
+        buffer_pool::Pool frame_pool;   // Guarded by mutex
+        mutable std::mutex mutex;
+        std::condition_variable frame_ready;
+    };
+}
@@ -0,0 +1,558 @@
+#include "async_io.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define CLOSESOCK(s) closesocket(s)
+#define SOCK_ERR   SOCKET_ERROR
+#define SOCK_INV   INVALID_SOCKET
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#define CLOSESOCK(s) ::close(s)
+#define SOCK_ERR   -1
+#define SOCK_INV   -1
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+#endif
+
+namespace async_io {
+    namespace {
+        // Root of a spawned coroutine: starts it, keeps the reactor's bookkeeping and frees
+        // its own frame when the task completes
+        struct Detached {
+            struct promise_type {
+                std::unordered_set<void*>* roots = nullptr;
+                std::atomic<size_t>* live_tasks = nullptr;
+
+                Detached get_return_object() {
+                    return { std::coroutine_handle<promise_type>::from_promise(*this) };
+                }
+                std::suspend_always initial_suspend() noexcept { return {}; }
+
+                struct FinalAwaiter {
+                    bool await_ready() noexcept { return false; }
+                    bool await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                        promise_type& promise = handle.promise();
+                        promise.roots->erase(handle.address());
+                        promise.live_tasks->fetch_sub(1, std::memory_order_relaxed);
+                        return false; // Do not suspend: the frame is destroyed right away
+                    }
+                    void await_resume() noexcept {}
+                };
+                FinalAwaiter final_suspend() noexcept { return {}; }
+
+                void return_void() {}
+                void unhandled_exception() {}
+            };
+
+            std::coroutine_handle<promise_type> handle;
+        };
+
+        Detached run_detached(Task<void> task) {
+            try {
+                co_await task;
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Unhandled exception in coroutine: " << e.what() << std::endl;
+            }
+        }
+
+        bool would_block() {
+#ifdef _WIN32
+            return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+        }
+
+        bool connect_in_progress() {
+#ifdef _WIN32
+            return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+            return errno == EINPROGRESS;
+#endif
+        }
+    }
+
+    bool set_non_blocking(sock_t sock) {
+#ifdef _WIN32
+        u_long mode = 1;
+        return ioctlsocket(sock, FIONBIO, &mode) != SOCK_ERR;
+#else
+        int flags = fcntl(sock, F_GETFL, 0);
+        return flags != -1 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) != -1;
+#endif
+    }
+
+    Reactor::Reactor() {
+#ifdef __linux__
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd == -1 || event_fd == -1) {
+            std::cerr << "Failed to create reactor\n";
+            return;
+        }
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr; // The wakeup descriptor is the only one without state
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event);
+#endif
+    }
+
+    Reactor::~Reactor() {
+        // Destroying a root frame destroys the coroutines it awaits and the sockets they own
+        std::vector<void*> remaining(roots.begin(), roots.end());
+        roots.clear();
+        for (void* root : remaining) {
+            std::coroutine_handle<>::from_address(root).destroy();
+        }
+        posted.clear();
+        retired.clear();
+#ifdef __linux__
+        if (event_fd != -1) close(event_fd);
+        if (epoll_fd != -1) close(epoll_fd);
+#endif
+    }
+
+    void Reactor::spawn(Task<void> task) {
+        live_tasks.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(posted_mutex);
+            posted.push_back(std::move(task));
+        }
+        wake();
+    }
+
+    void Reactor::run() {
+        while (!stopping.load(std::memory_order_relaxed)) {
+            start_posted();
+#ifdef __linux__
+            poll_events(-1);
+#else
+            // No cross-thread wakeup here, so poll with a short timeout to pick up spawned tasks
+            poll_events(10);
+#endif
+            retired.clear();
+        }
+    }
+
+    void Reactor::stop() {
+        stopping = true;
+        wake();
+    }
+
+    void Reactor::start_posted() {
+        std::vector<Task<void>> starting;
+        {
+            std::lock_guard<std::mutex> lock(posted_mutex);
+            starting.swap(posted);
+        }
+        for (auto& task : starting) {
+            Detached root = run_detached(std::move(task));
+            root.handle.promise().roots = &roots;
+            root.handle.promise().live_tasks = &live_tasks;
+            roots.insert(root.handle.address());
+            root.handle.resume();
+        }
+    }
+
+    void Reactor::wake() {
+#ifdef __linux__
+        uint64_t one = 1;
+        if (write(event_fd, &one, sizeof(one)) < 0) {
+            // Counter already non-zero: the reactor is going to wake up anyway
+        }
+#endif
+    }
+
+    std::unique_ptr<detail::IoState> Reactor::watch(sock_t sock) {
+        auto state = std::make_unique<detail::IoState>();
+        state->sock = sock;
+#ifdef __linux__
+        // Edge-triggered: awaiters always try the operation before waiting, so no edge is lost
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = state.get();
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &event) == -1) {
+            std::cerr << "epoll_ctl() failed\n";
+        }
+#else
+        watched.push_back(state.get());
+#endif
+        return state;
+    }
+
+    void Reactor::unwatch(std::unique_ptr<detail::IoState> state) {
+#ifdef __linux__
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, state->sock, nullptr);
+#else
+        for (size_t i = 0; i < watched.size(); i++) {
+            if (watched[i] == state.get()) {
+                watched[i] = watched.back();
+                watched.pop_back();
+                break;
+            }
+        }
+#endif
+        // Events for this socket may still be pending in the current batch
+        state->closed = true;
+        retired.push_back(std::move(state));
+    }
+
+    void Reactor::poll_events(int timeout_ms) {
+        std::vector<std::coroutine_handle<>> ready;
+
+#ifdef __linux__
+        epoll_event events[256];
+        int count = epoll_wait(epoll_fd, events, 256, timeout_ms);
+        for (int i = 0; i < count; i++) {
+            auto* state = static_cast<detail::IoState*>(events[i].data.ptr);
+            if (state == nullptr) {
+                uint64_t value;
+                if (read(event_fd, &value, sizeof(value)) < 0) {
+                    // Nothing to drain
+                }
+                continue;
+            }
+            if (state->closed) {
+                continue;
+            }
+            uint32_t flags = events[i].events;
+            if ((flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && state->reader) {
+                ready.push_back(std::exchange(state->reader, {}));
+            }
+            if ((flags & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && state->writer) {
+                ready.push_back(std::exchange(state->writer, {}));
+            }
+        }
+#else
+        std::vector<detail::IoState*> waiting;
+#ifdef _WIN32
+        std::vector<WSAPOLLFD> fds;
+#else
+        std::vector<pollfd> fds;
+#endif
+        for (detail::IoState* state : watched) {
+            short events = 0;
+            if (state->reader) events |= POLLIN;
+            if (state->writer) events |= POLLOUT;
+            if (events != 0) {
+                fds.push_back({ state->sock, events, 0 });
+                waiting.push_back(state);
+            }
+        }
+        if (fds.empty()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+            return;
+        }
+#ifdef _WIN32
+        int count = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), timeout_ms);
+#else
+        int count = poll(fds.data(), static_cast<nfds_t>(fds.size()), timeout_ms);
+#endif
+        for (size_t i = 0; count > 0 && i < fds.size(); i++) {
+            short flags = fds[i].revents;
+            if ((flags & (POLLIN | POLLHUP | POLLERR)) && waiting[i]->reader) {
+                ready.push_back(std::exchange(waiting[i]->reader, {}));
+            }
+            if ((flags & (POLLOUT | POLLHUP | POLLERR)) && waiting[i]->writer) {
+                ready.push_back(std::exchange(waiting[i]->writer, {}));
+            }
+        }
+#endif
+
+        for (auto handle : ready) {
+            handle.resume();
+        }
+    }
+
+    TcpConnection::TcpConnection(Reactor& reactor, sock_t sock)
+        : reactor(&reactor), reader(4096) {
+        set_non_blocking(sock);
+        state = reactor.watch(sock);
+    }
+
+    TcpConnection::TcpConnection(Reactor& reactor)
+        : reactor(&reactor), reader(4096) {
+    }
+
+    TcpConnection::~TcpConnection() {
+        close();
+    }
+
+    Task<bool> TcpConnection::connect(const char* server_ip, uint16_t server_port) {
+        close();
+
+        sock_t sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock == SOCK_INV) {
+            std::cerr << "socket() failed\n";
+            co_return false;
+        }
+
+        sockaddr_in server_addr{};
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_port = htons(server_port);
+        if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) != 1) {
+            std::cerr << "Invalid address: " << server_ip << "\n";
+            CLOSESOCK(sock);
+            co_return false;
+        }
+
+        set_non_blocking(sock);
+        state = reactor->watch(sock);
+        reader.reset();
+
+        if (::connect(sock, (sockaddr*)&server_addr, sizeof(server_addr)) == SOCK_ERR) {
+            if (!connect_in_progress()) {
+                std::cerr << "connect() failed\n";
+                close();
+                co_return false;
+            }
+
+            co_await reactor->writable(*state);
+
+            int error = 0;
+            socklen_t error_len = sizeof(error);
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &error_len);
+            if (error != 0) {
+                std::cerr << "connect() failed\n";
+                close();
+                co_return false;
+            }
+        }
+        co_return true;
+    }
+
+    Task<bool> TcpConnection::send(std::string_view message) {
+        uint32_t length_net = htonl(static_cast<uint32_t>(message.size()));
+        std::string_view parts[2] = {
+            std::string_view(reinterpret_cast<const char*>(&length_net), message_framing::PREFIX_SIZE),
+            message
+        };
+
+        size_t index = 0;
+        while (state && index < 2) {
+            size_t sent = 0;
+            bool blocked = false;
+            if (!message_framing::send_some(state->sock, parts + index, 2 - index, sent, blocked)) {
+                co_return false;
+            }
+            if (blocked) {
+                co_await reactor->writable(*state);
+                continue;
+            }
+
+            while (index < 2 && sent >= parts[index].size()) {
+                sent -= parts[index].size();
+                index++;
+            }
+            if (index < 2) {
+                parts[index].remove_prefix(sent);
+            }
+        }
+        co_return index == 2;
+    }
+
+    Task<bool> TcpConnection::receive(std::string_view& message) {
+        while (state) {
+            if (reader.poll_frame(message)) {
+                co_return true;
+            }
+            if (reader.corrupted()) {
+                co_return false;
+            }
+
+            bool blocked = false;
+            if (!reader.read_some(state->sock, blocked)) {
+                co_return false;
+            }
+            if (blocked) {
+                co_await reactor->readable(*state);
+            }
+        }
+        co_return false;
+    }
+
+    void TcpConnection::close() {
+        if (state) {
+            sock_t sock = state->sock;
+            reactor->unwatch(std::move(state));
+            CLOSESOCK(sock);
+        }
+    }
+
+    TcpListener::TcpListener(Reactor& reactor) : reactor(&reactor) {
+    }
+
+    TcpListener::~TcpListener() {
+        close();
+    }
+
+    bool TcpListener::listen(uint16_t port, int backlog) {
+        close();
+
+        sock_t sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock == SOCK_INV) {
+            std::cerr << "socket() failed\n";
+            return false;
+        }
+
+        // Allow address reuse
+        int opt = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char*>(&opt), sizeof(opt));
+
+        sockaddr_in server_addr{};
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        server_addr.sin_port = htons(port);
+
+        if (bind(sock, (sockaddr*)&server_addr, sizeof(server_addr)) == SOCK_ERR) {
+            std::cerr << "bind() failed\n";
+            CLOSESOCK(sock);
+            return false;
+        }
+        if (::listen(sock, backlog) == SOCK_ERR) {
+            std::cerr << "listen() failed\n";
+            CLOSESOCK(sock);
+            return false;
+        }
+
+        set_non_blocking(sock);
+        state = reactor->watch(sock);
+        std::cout << "Async TCP server listening on port " << port << "\n";
+        return true;
+    }
+
+    Task<sock_t> TcpListener::accept() {
+        while (state) {
+            sock_t client = ::accept(state->sock, nullptr, nullptr);
+            if (client != SOCK_INV) {
+                co_return client;
+            }
+            if (!would_block()) {
+#ifdef _WIN32
+                std::cerr << "accept() failed: " << WSAGetLastError() << "\n";
+#else
+                std::cerr << "accept() failed: " << strerror(errno) << "\n";
+#endif
+                co_return INVALID_SOCK;
+            }
+            co_await reactor->readable(*state);
+        }
+        co_return INVALID_SOCK;
+    }
+
+    void TcpListener::close() {
+        if (state) {
+            sock_t sock = state->sock;
+            reactor->unwatch(std::move(state));
+            CLOSESOCK(sock);
+        }
+    }
+
+    UdpSocket::UdpSocket(Reactor& reactor) : reactor(&reactor) {
+    }
+
+    UdpSocket::~UdpSocket() {
+        close();
+    }
+
+    bool UdpSocket::open(uint16_t port) {
+        close();
+
+        sock_t sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == SOCK_INV) {
+            std::cerr << "socket() failed\n";
+            return false;
+        }
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if (bind(sock, (sockaddr*)&addr, sizeof(addr)) == SOCK_ERR) {
+            std::cerr << "bind() failed\n";
+            CLOSESOCK(sock);
+            return false;
+        }
+
+        set_non_blocking(sock);
+        state = reactor->watch(sock);
+        return true;
+    }
+
+    Task<int> UdpSocket::recv_from(char* buffer, size_t capacity, sockaddr_in& from) {
+        while (state) {
+            socklen_t from_len = sizeof(from);
+            int recvd = recvfrom(state->sock, buffer, static_cast<int>(capacity), 0, (sockaddr*)&from, &from_len);
+            if (recvd != SOCK_ERR) {
+                co_return recvd;
+            }
+            if (!would_block()) {
+                std::cerr << "recvfrom() failed\n";
+                co_return -1;
+            }
+            co_await reactor->readable(*state);
+        }
+        co_return -1;
+    }
+
+    Task<bool> UdpSocket::send_to(std::string_view data, const sockaddr_in& to) {
+        while (state) {
+            int sent = sendto(state->sock, data.data(), static_cast<int>(data.size()), 0, (const sockaddr*)&to, sizeof(to));
+            if (sent != SOCK_ERR) {
+                co_return true;
+            }
+            if (!would_block()) {
+                std::cerr << "sendto() failed\n";
+                co_return false;
+            }
+            co_await reactor->writable(*state);
+        }
+        co_return false;
+    }
+
+    void UdpSocket::close() {
+        if (state) {
+            sock_t sock = state->sock;
+            reactor->unwatch(std::move(state));
+            CLOSESOCK(sock);
+        }
+    }
+
+    ReactorPool::~ReactorPool() {
+        stop();
+    }
+
+    void ReactorPool::start(size_t count) {
+        stop();
+        for (size_t i = 0; i < std::max<size_t>(1, count); i++) {
+            reactors.push_back(std::make_unique<Reactor>());
+        }
+        for (auto& reactor : reactors) {
+            threads.emplace_back(&Reactor::run, reactor.get());
+        }
+    }
+
+    void ReactorPool::stop() {
+        for (auto& reactor : reactors) {
+            reactor->stop();
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        threads.clear();
+        reactors.clear();
+    }
+
+    Reactor& ReactorPool::next() {
+        return *reactors[next_index.fetch_add(1, std::memory_order_relaxed) % reactors.size()];
+    }
+}
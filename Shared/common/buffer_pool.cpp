@@ -0,0 +1,52 @@
+#include "buffer_pool.h"
+#include <bit>
+
+namespace buffer_pool {
+    static size_t bucket_of(size_t capacity) {
+        return std::bit_width(capacity) - 1;
+    }
+
+    Pool::Pool(size_t max_free) : max_free(max_free) {
+    }
+
+    std::vector<uint8_t> Pool::acquire(size_t capacity) {
+        std::vector<uint8_t> buffer;
+        if (free_count > 0) {
+            // A buffer that fits, from the smallest bucket that has one, so small requests do
+            // not leave big frames without one; failing that the largest, to grow the least
+            size_t first = capacity > 0 ? bucket_of(capacity) : 0;
+            std::vector<std::vector<uint8_t>>* source = nullptr;
+            if (!free[first].empty() && free[first].back().capacity() >= capacity) {
+                source = &free[first];
+            }
+            for (size_t k = first + 1; !source && k < BUCKETS; k++) {
+                if (!free[k].empty()) {
+                    source = &free[k];
+                }
+            }
+            for (size_t k = first + 1; !source && k-- > 0;) {
+                if (!free[k].empty()) {
+                    source = &free[k];
+                }
+            }
+            buffer = std::move(source->back());
+            source->pop_back();
+            free_count--;
+        }
+
+        if (buffer.capacity() < capacity) {
+            buffer.reserve(capacity);
+            allocation_count++;
+        }
+        return buffer;
+    }
+
+    void Pool::release(std::vector<uint8_t>&& buffer) {
+        if (free_count >= max_free || buffer.capacity() == 0) {
+            return;
+        }
+        buffer.clear();
+        free[bucket_of(buffer.capacity())].push_back(std::move(buffer));
+        free_count++;
+    }
+}
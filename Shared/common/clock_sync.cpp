@@ -0,0 +1,223 @@
+#include "clock_sync.h"
+#include <algorithm>
+#include <iostream>
+#include "frame_trace.h"
+#include "message_framing.h"
+
+#ifdef _WIN32
+#define CLOSESOCK(s) closesocket(s)
+#define SOCK_ERR   SOCKET_ERROR
+#define INVALID_SOCK INVALID_SOCKET
+#else
+#include <unistd.h>
+#define CLOSESOCK(s) close(s)
+#define SOCK_ERR   -1
+#define INVALID_SOCK -1
+#endif
+
+namespace clock_sync {
+    static const uint32_t REQUEST_TAG = 0x4E544351;     // "NTCQ"
+    static const uint32_t RESPONSE_TAG = 0x4E544352;    // "NTCR"
+
+    Sample make_sample(int64_t t0, int64_t t1, int64_t t2, int64_t t3) {
+        Sample sample;
+        sample.offset_us = ((t1 - t0) + (t2 - t3)) / 2;
+        sample.delay_us = (t3 - t0) - (t2 - t1);
+        return sample;
+    }
+
+    void write_request(char* out, int64_t t0) {
+        packet_codec::MutableView<wire::Request> request(out);
+        request.set<wire::Tag>(REQUEST_TAG);
+        request.set<wire::T0>(t0);
+        request.set<wire::T1>(0);
+        request.set<wire::T2>(0);
+    }
+
+    bool read_request(const char* data, size_t size, int64_t& t0) {
+        packet_codec::View<wire::Request> request(data);
+        if (size != REQUEST_SIZE || request.get<wire::Tag>() != REQUEST_TAG) {
+            return false;
+        }
+        t0 = request.get<wire::T0>();
+        return true;
+    }
+
+    void write_response(char* out, int64_t t0, int64_t t1, int64_t t2) {
+        packet_codec::MutableView<wire::Response> response(out);
+        response.set<wire::Tag>(RESPONSE_TAG);
+        response.set<wire::T0>(t0);
+        response.set<wire::T1>(t1);
+        response.set<wire::T2>(t2);
+    }
+
+    bool read_response(const char* data, size_t size, int64_t& t0, int64_t& t1, int64_t& t2) {
+        packet_codec::View<wire::Response> response(data);
+        if (size != RESPONSE_SIZE || response.get<wire::Tag>() != RESPONSE_TAG) {
+            return false;
+        }
+        t0 = response.get<wire::T0>();
+        t1 = response.get<wire::T1>();
+        t2 = response.get<wire::T2>();
+        return true;
+    }
+
+    void Estimator::add(const Sample& sample) {
+        samples[next] = sample;
+        next = (next + 1) % FILTER_SIZE;
+        count = std::min(count + 1, FILTER_SIZE);
+    }
+
+    Sample Estimator::best() const {
+        return *std::min_element(samples, samples + count,
+            [](const Sample& a, const Sample& b) { return a.delay_us < b.delay_us; });
+    }
+
+    Responder::~Responder() {
+        stop();
+    }
+
+    bool Responder::start(uint16_t port) {
+        stop();
+
+        sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == INVALID_SOCK) {
+            std::cerr << "socket() failed\n";
+            return false;
+        }
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = INADDR_ANY;
+        if (bind(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == SOCK_ERR) {
+            std::cerr << "Clock sync: could not bind port " << port << "\n";
+            CLOSESOCK(sock);
+            return false;
+        }
+
+        stopping = false;
+        running = true;
+        worker = std::thread(&Responder::run, this);
+        return true;
+    }
+
+    void Responder::stop() {
+        if (!running) {
+            return;
+        }
+        stopping = true;
+        worker.join();
+        CLOSESOCK(sock);
+        running = false;
+    }
+
+    void Responder::run() {
+        char request[64];
+        char response[RESPONSE_SIZE];
+        while (!stopping.load()) {
+            if (!message_framing::wait_readable(sock, std::chrono::milliseconds(100))) {
+                continue;
+            }
+
+            sockaddr_in from{};
+            socklen_t from_len = sizeof(from);
+            int received = recvfrom(sock, request, static_cast<int>(sizeof(request)), 0,
+                reinterpret_cast<sockaddr*>(&from), &from_len);
+            int64_t t1 = frame_trace::now_us();
+
+            int64_t t0;
+            if (received <= 0 || !read_request(request, static_cast<size_t>(received), t0)) {
+                continue;
+            }
+            write_response(response, t0, t1, frame_trace::now_us());
+            sendto(sock, response, static_cast<int>(sizeof(response)), 0,
+                reinterpret_cast<sockaddr*>(&from), sizeof(from));
+        }
+    }
+
+    Tracker::~Tracker() {
+        stop();
+    }
+
+    bool Tracker::start(const char* sender_ip, uint16_t port) {
+        stop();
+
+        sender = {};
+        sender.sin_family = AF_INET;
+        sender.sin_port = htons(port);
+        if (inet_pton(AF_INET, sender_ip, &sender.sin_addr) != 1) {
+            std::cerr << "Invalid address: " << sender_ip << "\n";
+            return false;
+        }
+        sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == INVALID_SOCK) {
+            std::cerr << "socket() failed\n";
+            return false;
+        }
+
+        estimator = Estimator();
+        offset = 0;
+        round_trip = -1;
+        stopping = false;
+        running = true;
+        worker = std::thread(&Tracker::run, this);
+        return true;
+    }
+
+    void Tracker::stop() {
+        if (!running) {
+            return;
+        }
+        stopping = true;
+        worker.join();
+        CLOSESOCK(sock);
+        running = false;
+    }
+
+    void Tracker::run() {
+        auto next_request = std::chrono::steady_clock::now();
+        while (!stopping.load()) {
+            if (exchange()) {
+                Sample best = estimator.best();
+                offset.store(best.offset_us, std::memory_order_relaxed);
+                round_trip.store(best.delay_us, std::memory_order_relaxed);
+            }
+
+            // Quickly at first, to fill the filter, then slowly enough to cost nothing
+            next_request += estimator.size() < FILTER_SIZE ? std::chrono::steady_clock::duration(FAST_INTERVAL) :
+                                                             std::chrono::steady_clock::duration(INTERVAL);
+            while (!stopping.load() && std::chrono::steady_clock::now() < next_request) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        }
+    }
+
+    // One request and its answer; false if none came in time
+    bool Tracker::exchange() {
+        char request[REQUEST_SIZE];
+        int64_t t0 = frame_trace::now_us();
+        write_request(request, t0);
+        if (sendto(sock, request, static_cast<int>(sizeof(request)), 0,
+                reinterpret_cast<const sockaddr*>(&sender), sizeof(sender)) == SOCK_ERR) {
+            return false;
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + RESPONSE_TIMEOUT;
+        char response[64];
+        while (true) {
+            auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0 || !message_framing::wait_readable(sock, std::chrono::ceil<std::chrono::milliseconds>(remaining))) {
+                return false;
+            }
+            int received = recvfrom(sock, response, static_cast<int>(sizeof(response)), 0, nullptr, nullptr);
+            int64_t t3 = frame_trace::now_us();
+
+            // Late answers to earlier requests are skipped: their t3 would be wrong
+            int64_t echoed, t1, t2;
+            if (received > 0 && read_response(response, static_cast<size_t>(received), echoed, t1, t2) && echoed == t0) {
+                estimator.add(make_sample(t0, t1, t2, t3));
+                return true;
+            }
+        }
+    }
+}
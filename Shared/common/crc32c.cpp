@@ -0,0 +1,154 @@
+#include "crc32c.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32C_X64
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CRC32C_TARGET
+#else
+#define CRC32C_TARGET __attribute__((target("sse4.2,pclmul")))
+#endif
+#endif
+
+namespace crc32c {
+    static const uint32_t POLYNOMIAL = 0x82F63B78;  // Reflected
+
+    // table[0] is the classic byte-at-a-time table; table[k] advances a byte k more positions
+    struct Tables {
+        uint32_t table[8][256];
+
+        Tables() {
+            for (uint32_t byte = 0; byte < 256; byte++) {
+                uint32_t crc = byte;
+                for (int bit = 0; bit < 8; bit++) {
+                    crc = (crc >> 1) ^ ((crc & 1) ? POLYNOMIAL : 0);
+                }
+                table[0][byte] = crc;
+            }
+            for (uint32_t byte = 0; byte < 256; byte++) {
+                for (int k = 1; k < 8; k++) {
+                    table[k][byte] = (table[k - 1][byte] >> 8) ^ table[0][table[k - 1][byte] & 0xFF];
+                }
+            }
+        }
+    };
+
+    static const Tables& tables() {
+        static const Tables instance;
+        return instance;
+    }
+
+    uint32_t extend_portable(uint32_t crc, const uint8_t* data, size_t size) {
+        const auto& table = tables().table;
+        crc = ~crc;
+        while (size >= 8) {
+            uint32_t low = crc ^ (uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24);
+            crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+                  table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+            data += 8;
+            size -= 8;
+        }
+        while (size-- > 0) {
+            crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xFF];
+        }
+        return ~crc;
+    }
+
+#ifdef CRC32C_X64
+    // Bytes per stream of the three interleaved streams: long blocks for frames, short ones
+    // for chunks and frame tails
+    static const size_t LONG_BLOCK = 8192;
+    static const size_t SHORT_BLOCK = 256;
+
+    // x^power modulo the polynomial, in the reflected bit order of CRC registers
+    static uint32_t x_power(uint64_t power) {
+        uint32_t value = 0x80000000;
+        while (power-- > 0) {
+            value = (value >> 1) ^ ((value & 1) ? POLYNOMIAL : 0);
+        }
+        return value;
+    }
+
+    // A CRC register run over `bytes` zero bytes is it times x^(8 * bytes); with the
+    // crc32 instruction's own x^32 and the product's extra bit, the factor is x^(8 * bytes - 33)
+    static const uint32_t LONG_SHIFT = x_power(8 * LONG_BLOCK - 33);
+    static const uint32_t SHORT_SHIFT = x_power(8 * SHORT_BLOCK - 33);
+
+    CRC32C_TARGET static uint64_t shift(uint64_t crc, uint32_t factor) {
+        __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(static_cast<int>(crc)),
+                                               _mm_cvtsi32_si128(static_cast<int>(factor)), 0);
+        return _mm_crc32_u64(0, static_cast<uint64_t>(_mm_cvtsi128_si64(product)));
+    }
+
+    static uint64_t load_u64(const uint8_t* data) {
+        uint64_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    // Each crc32 takes three cycles but one can start every cycle, so three independent
+    // streams keep the unit busy; the second and third start from zero and are merged after
+    CRC32C_TARGET static const uint8_t* interleaved(uint64_t& crc, const uint8_t* data, size_t& size,
+                                                    size_t block, uint32_t factor) {
+        while (size >= 3 * block) {
+            uint64_t crc1 = 0;
+            uint64_t crc2 = 0;
+            for (size_t offset = 0; offset < block; offset += 8) {
+                crc = _mm_crc32_u64(crc, load_u64(data + offset));
+                crc1 = _mm_crc32_u64(crc1, load_u64(data + block + offset));
+                crc2 = _mm_crc32_u64(crc2, load_u64(data + 2 * block + offset));
+            }
+            crc = shift(shift(crc, factor) ^ crc1, factor) ^ crc2;
+            data += 3 * block;
+            size -= 3 * block;
+        }
+        return data;
+    }
+
+    CRC32C_TARGET static uint32_t extend_hardware(uint32_t crc, const uint8_t* data, size_t size) {
+        uint64_t state = ~crc;
+        data = interleaved(state, data, size, LONG_BLOCK, LONG_SHIFT);
+        data = interleaved(state, data, size, SHORT_BLOCK, SHORT_SHIFT);
+        while (size >= 8) {
+            state = _mm_crc32_u64(state, load_u64(data));
+            data += 8;
+            size -= 8;
+        }
+        while (size-- > 0) {
+            state = _mm_crc32_u8(static_cast<uint32_t>(state), *data++);
+        }
+        return ~static_cast<uint32_t>(state);
+    }
+
+    static bool detect_hardware() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0 && (info[2] & (1 << 1)) != 0;   // SSE4.2, PCLMULQDQ
+#else
+        return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul");
+#endif
+    }
+#endif
+
+    bool hardware_accelerated() {
+#ifdef CRC32C_X64
+        static const bool supported = detect_hardware();
+        return supported;
+#else
+        return false;
+#endif
+    }
+
+    uint32_t extend(uint32_t crc, const uint8_t* data, size_t size) {
+#ifdef CRC32C_X64
+        if (hardware_accelerated()) {
+            return extend_hardware(crc, data, size);
+        }
+#endif
+        return extend_portable(crc, data, size);
+    }
+}
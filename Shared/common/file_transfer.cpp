@@ -0,0 +1,82 @@
+#include "file_transfer.h"
+#include <algorithm>
+#include <iostream>
+
+namespace file_transfer {
+    namespace {
+        constexpr char MAGIC[] = { 'N', 'T', 'F', 'T' };
+        constexpr size_t MAGIC_SIZE = sizeof(MAGIC);
+        constexpr size_t REQUEST_SIZE = MAGIC_SIZE + 1 + 8 + 8;
+        constexpr size_t OFFER_HEADER_SIZE = MAGIC_SIZE + 8;
+
+        void put_u64(std::string& out, uint64_t value) {
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                out.push_back(static_cast<char>(value >> shift));
+            }
+        }
+
+        uint64_t get_u64(const char* in) {
+            uint64_t value = 0;
+            for (int i = 0; i < 8; i++) {
+                value = (value << 8) | static_cast<unsigned char>(in[i]);
+            }
+            return value;
+        }
+
+        bool has_magic(std::string_view message) {
+            return message.size() >= MAGIC_SIZE && message.substr(0, MAGIC_SIZE) == std::string_view(MAGIC, MAGIC_SIZE);
+        }
+    }
+
+    std::string encode_request(const Request& request) {
+        std::string message(MAGIC, MAGIC_SIZE);
+        message.push_back(static_cast<char>(request.type));
+        put_u64(message, request.offset);
+        put_u64(message, request.length);
+        return message;
+    }
+
+    bool decode_request(std::string_view message, Request& request) {
+        if (message.size() != REQUEST_SIZE || !has_magic(message)) {
+            std::cerr << "Invalid file transfer request\n";
+            return false;
+        }
+
+        request.type = static_cast<RequestType>(message[MAGIC_SIZE]);
+        request.offset = get_u64(message.data() + MAGIC_SIZE + 1);
+        request.length = get_u64(message.data() + MAGIC_SIZE + 9);
+        return request.type == RequestType::OFFER || request.type == RequestType::RANGE;
+    }
+
+    std::string encode_offer(const Offer& offer) {
+        std::string message(MAGIC, MAGIC_SIZE);
+        put_u64(message, offer.size);
+        message.append(offer.name);
+        return message;
+    }
+
+    bool decode_offer(std::string_view message, Offer& offer) {
+        if (message.size() < OFFER_HEADER_SIZE || !has_magic(message)) {
+            std::cerr << "Invalid file transfer offer\n";
+            return false;
+        }
+
+        offer.size = get_u64(message.data() + MAGIC_SIZE);
+        offer.name.assign(message.substr(OFFER_HEADER_SIZE));
+        return true;
+    }
+
+    std::vector<Range> split(uint64_t size, size_t count) {
+        std::vector<Range> ranges;
+        count = std::max<size_t>(1, count);
+
+        // Round the share of each stream up to the alignment, so small files use fewer ranges
+        uint64_t share = (size + count - 1) / count;
+        share = std::max<uint64_t>(RANGE_ALIGNMENT, (share + RANGE_ALIGNMENT - 1) / RANGE_ALIGNMENT * RANGE_ALIGNMENT);
+
+        for (uint64_t offset = 0; offset < size; offset += share) {
+            ranges.push_back({ offset, std::min(share, size - offset) });
+        }
+        return ranges;
+    }
+}
@@ -0,0 +1,186 @@
+#include "frame_trace.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#ifdef _WIN32
+#include <process.h>
+#define GETPID _getpid
+#else
+#include <unistd.h>
+#define GETPID getpid
+#endif
+
+namespace frame_trace {
+    struct Event {
+        int64_t start_us;
+        int64_t duration_us;
+        uint32_t frame_id;
+        Stage stage;
+    };
+
+    struct Ring {
+        std::vector<Event> events = std::vector<Event>(RING_CAPACITY);
+        std::atomic<uint64_t> written{0};
+        size_t thread_index = 0;
+        bool in_use = true;         // Guarded by mutex
+    };
+
+    static const char* STAGE_NAMES[] = { "capture", "encode", "send", "receive", "reassembly", "decode", "display" };
+
+    static std::atomic<bool> active{false};
+    static std::mutex mutex; // Guards everything below
+    static std::vector<std::unique_ptr<Ring>> rings;
+    static std::string output;
+    static std::string process;
+    static std::atomic<uint64_t> dropped{0};
+
+    // A thread's claim on a ring, given up when the thread exits. The ring stays registered,
+    // so flush() still sees its spans until the next thread to take it overwrites them.
+    struct RingClaim {
+        Ring* ring = nullptr;
+        bool refused = false;       // Every ring was taken when this thread first recorded
+
+        ~RingClaim() {
+            if (ring) {
+                std::lock_guard<std::mutex> lock(mutex);
+                ring->in_use = false;
+            }
+        }
+    };
+
+    static Ring* local_ring() {
+        thread_local RingClaim claim;
+        if (!claim.ring && !claim.refused) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& ring : rings) {
+                if (!ring->in_use) {
+                    claim.ring = ring.get();
+                    claim.ring->in_use = true;
+                    break;
+                }
+            }
+            if (!claim.ring && rings.size() < MAX_RINGS) {
+                rings.push_back(std::make_unique<Ring>());
+                claim.ring = rings.back().get();
+                claim.ring->thread_index = rings.size();
+            }
+            claim.refused = !claim.ring;
+        }
+        return claim.ring;
+    }
+
+    void start(const std::string& output_path, const std::string& process_name) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            output = output_path;
+            process = process_name;
+        }
+        active = true;
+        std::cout << "Frame tracing on, written to " << output_path << " at the end of each video demo\n";
+    }
+
+    bool start_from_environment(const std::string& process_name) {
+        const char* prefix = std::getenv("FRAME_TRACE");
+        if (!prefix || !*prefix) {
+            return false;
+        }
+        start(prefix + process_name + ".json", process_name);
+        return true;
+    }
+
+    bool enabled() {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    int64_t now_us() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    void record(Stage stage, uint32_t frame_id, int64_t start_us, int64_t end_us) {
+        if (!enabled()) {
+            return;
+        }
+
+        Ring* ring = local_ring();
+        if (!ring) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        uint64_t index = ring->written.load(std::memory_order_relaxed);
+        ring->events[index % RING_CAPACITY] = { start_us, end_us - start_us, frame_id, stage };
+        ring->written.store(index + 1, std::memory_order_release);
+    }
+
+    bool flush() {
+        if (!enabled()) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ofstream file(output, std::ios::trunc);
+        int pid = static_cast<int>(GETPID());
+
+        // One event per line, so merge() can combine files without a JSON parser
+        file << "{\"traceEvents\":[\n";
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":0,\"args\":{\"name\":\""
+             << process << "\"}}";
+        for (const auto& ring : rings) {
+            uint64_t written = ring->written.load(std::memory_order_acquire);
+            uint64_t first = written > RING_CAPACITY ? written - RING_CAPACITY : 0;
+            for (uint64_t i = first; i < written; i++) {
+                const Event& event = ring->events[i % RING_CAPACITY];
+                file << ",\n{\"name\":\"" << STAGE_NAMES[static_cast<int>(event.stage)]
+                     << "\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":" << event.start_us
+                     << ",\"dur\":" << event.duration_us << ",\"pid\":" << pid << ",\"tid\":" << ring->thread_index
+                     << ",\"args\":{\"frame_id\":" << event.frame_id << "}}";
+            }
+        }
+        file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+        if (uint64_t lost = dropped.load()) {
+            std::cerr << "Frame trace: " << lost << " spans dropped, more than " << MAX_RINGS
+                      << " threads were recording at once\n";
+        }
+        if (!file) {
+            std::cerr << "Could not write trace to " << output << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool merge(const std::vector<std::string>& input_paths, const std::string& output_path) {
+        std::ostringstream events;
+        bool first = true;
+        for (const auto& path : input_paths) {
+            std::ifstream input(path);
+            if (!input) {
+                std::cerr << "Could not read " << path << "\n";
+                return false;
+            }
+
+            // Event lines are the ones starting with an object, minus their separating comma
+            std::string line;
+            while (std::getline(input, line)) {
+                if (line.empty() || line[0] != '{' || line.rfind("{\"traceEvents\"", 0) == 0) {
+                    continue;
+                }
+                if (line.back() == ',') {
+                    line.pop_back();
+                }
+                events << (first ? "" : ",\n") << line;
+                first = false;
+            }
+        }
+
+        std::ofstream file(output_path, std::ios::trunc);
+        file << "{\"traceEvents\":[\n" << events.str() << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return static_cast<bool>(file);
+    }
+}
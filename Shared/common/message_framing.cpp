@@ -0,0 +1,289 @@
+#include "message_framing.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define SOCK_ERR   SOCKET_ERROR
+#else
+#include <cerrno>
+#include <poll.h>
+#include <sys/uio.h>
+#define SOCK_ERR   -1
+#endif
+
+namespace message_framing {
+    StreamReader::StreamReader(size_t initial_capacity)
+        : initial_capacity(initial_capacity < PREFIX_SIZE ? PREFIX_SIZE : initial_capacity) {
+    }
+
+    bool StreamReader::next_frame(sock_t sock, std::string_view& frame) {
+        while (!poll_frame(frame)) {
+            if (corrupt || !fill(sock)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool StreamReader::poll_frame(std::string_view& frame) {
+        if (tail - head < PREFIX_SIZE) {
+            return false;
+        }
+
+        uint32_t length_net;
+        memcpy(&length_net, buffer.data() + head, PREFIX_SIZE);
+        size_t length = ntohl(length_net);
+        if (length > MAX_MESSAGE_SIZE) {
+            if (!corrupt) {
+                std::cerr << "Invalid message length: " << length << " bytes\n";
+                corrupt = true;
+            }
+            return false;
+        }
+        if (tail - head - PREFIX_SIZE < length) {
+            return false;
+        }
+
+        frame = std::string_view(buffer.data() + head + PREFIX_SIZE, length);
+        head += PREFIX_SIZE + length;
+        return true;
+    }
+
+    bool StreamReader::has_frame() const {
+        if (tail - head < PREFIX_SIZE) {
+            return false;
+        }
+        uint32_t length_net;
+        memcpy(&length_net, buffer.data() + head, PREFIX_SIZE);
+        return tail - head - PREFIX_SIZE >= ntohl(length_net);
+    }
+
+    void StreamReader::reset() {
+        head = 0;
+        tail = 0;
+        peer_closed = false;
+        corrupt = false;
+    }
+
+    void StreamReader::make_room() {
+        if (buffer.empty()) {
+            buffer.resize(initial_capacity);
+        }
+
+        // Bytes needed to complete the frame at head (prefix only if the length is not known yet)
+        size_t needed = PREFIX_SIZE;
+        if (tail - head >= PREFIX_SIZE) {
+            uint32_t length_net;
+            memcpy(&length_net, buffer.data() + head, PREFIX_SIZE);
+            needed += ntohl(length_net);
+        }
+
+        // Slide the partial frame to the front once the free space at the end runs low,
+        // and grow the buffer only when a single frame does not fit at all
+        if (head > 0 && (head == tail || buffer.size() - tail < buffer.size() / 2 || buffer.size() - head < needed)) {
+            memmove(buffer.data(), buffer.data() + head, tail - head);
+            tail -= head;
+            head = 0;
+        }
+        if (buffer.size() - head < needed) {
+            buffer.resize(std::max(needed, buffer.size() * 2));
+        }
+        else if (tail == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+    }
+
+    bool StreamReader::fill(sock_t sock) {
+        bool would_block = false;
+        return read_some(sock, would_block) && !would_block;
+    }
+
+    bool StreamReader::read_some(sock_t sock, bool& would_block) {
+        would_block = false;
+        make_room();
+
+        int recvd = recv(sock, buffer.data() + tail, static_cast<int>(buffer.size() - tail), 0);
+        if (recvd == SOCK_ERR) {
+#ifdef _WIN32
+            if (WSAGetLastError() == WSAEWOULDBLOCK) {
+                would_block = true;
+                return true;
+            }
+#else
+            if (errno == EINTR) {
+                return true;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                would_block = true;
+                return true;
+            }
+#endif
+            std::cerr << "recv() failed\n";
+            return false;
+        }
+        else if (recvd == 0) {
+            peer_closed = true;
+            return false;
+        }
+        tail += static_cast<size_t>(recvd);
+        return true;
+    }
+
+    void BatchWriter::queue(std::string_view message) {
+        prefixes.push_back(htonl(static_cast<uint32_t>(message.size())));
+        payloads.push_back(message);
+    }
+
+    bool BatchWriter::flush(sock_t sock) {
+        if (payloads.empty()) {
+            return true;
+        }
+
+        // Interleave prefixes and payloads; prefixes no longer move once queuing is done
+        std::vector<std::string_view> buffers;
+        buffers.reserve(payloads.size() * 2);
+        for (size_t i = 0; i < payloads.size(); i++) {
+            buffers.emplace_back(reinterpret_cast<const char*>(&prefixes[i]), PREFIX_SIZE);
+            buffers.push_back(payloads[i]);
+        }
+
+        bool ok = send_buffers(sock, buffers.data(), buffers.size());
+        clear();
+        return ok;
+    }
+
+    void BatchWriter::clear() {
+        prefixes.clear();
+        payloads.clear();
+    }
+
+    bool send_some(sock_t sock, const std::string_view* buffers, size_t count, size_t& sent, bool& would_block) {
+        constexpr size_t MAX_BATCH = 64; // Well below IOV_MAX on every platform
+
+        sent = 0;
+        would_block = false;
+#ifdef _WIN32
+        WSABUF batch[MAX_BATCH];
+#else
+        iovec batch[MAX_BATCH];
+#endif
+        size_t batch_size = 0;
+        for (size_t i = 0; i < count && batch_size < MAX_BATCH; i++) {
+            if (buffers[i].empty()) {
+                continue;
+            }
+#ifdef _WIN32
+            batch[batch_size].buf = const_cast<char*>(buffers[i].data());
+            batch[batch_size].len = static_cast<ULONG>(buffers[i].size());
+#else
+            batch[batch_size].iov_base = const_cast<char*>(buffers[i].data());
+            batch[batch_size].iov_len = buffers[i].size();
+#endif
+            batch_size++;
+        }
+        if (batch_size == 0) {
+            return true;
+        }
+
+#ifdef _WIN32
+        DWORD bytes = 0;
+        if (WSASend(sock, batch, static_cast<DWORD>(batch_size), &bytes, 0, nullptr, nullptr) == SOCK_ERR) {
+            if (WSAGetLastError() == WSAEWOULDBLOCK) {
+                would_block = true;
+                return true;
+            }
+            std::cerr << "WSASend() failed\n";
+            return false;
+        }
+        sent = bytes;
+#else
+        msghdr msg{};
+        msg.msg_iov = batch;
+        msg.msg_iovlen = batch_size;
+#ifdef MSG_NOSIGNAL
+        ssize_t result = sendmsg(sock, &msg, MSG_NOSIGNAL);
+#else
+        ssize_t result = sendmsg(sock, &msg, 0);
+#endif
+        if (result < 0) {
+            if (errno == EINTR) {
+                return true;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                would_block = true;
+                return true;
+            }
+            std::cerr << "sendmsg() failed\n";
+            return false;
+        }
+        sent = static_cast<size_t>(result);
+#endif
+        return true;
+    }
+
+    // poll() on one socket: 1 when ready, 0 on timeout (-1 waits for good), -1 on error.
+    // Unlike select(), it takes descriptors past FD_SETSIZE.
+    static int poll_one(sock_t sock, short events, int timeout_ms) {
+#ifdef _WIN32
+        WSAPOLLFD entry{};
+#else
+        pollfd entry{};
+#endif
+        entry.fd = sock;
+        entry.events = events;
+#ifdef _WIN32
+        return WSAPoll(&entry, 1, timeout_ms);
+#else
+        return poll(&entry, 1, timeout_ms);
+#endif
+    }
+
+    bool wait_readable(sock_t sock, std::chrono::milliseconds timeout) {
+        return poll_one(sock, POLLIN, static_cast<int>(std::max<int64_t>(timeout.count(), 0))) > 0;
+    }
+
+    // Block until the socket can take more data; false if it failed instead
+    static bool wait_writable(sock_t sock) {
+        while (true) {
+            int ready = poll_one(sock, POLLOUT, -1);
+            if (ready > 0) {
+                return true;
+            }
+#ifndef _WIN32
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+#endif
+            std::cerr << "poll() failed\n";
+            return false;
+        }
+    }
+
+    bool send_buffers(sock_t sock, const std::string_view* buffers, size_t count) {
+        // Local copy of the views so that partially sent buffers can be trimmed
+        std::vector<std::string_view> pending(buffers, buffers + count);
+        size_t index = 0;  // First buffer not fully sent
+        while (index < pending.size()) {
+            size_t sent = 0;
+            bool would_block = false;
+            if (!send_some(sock, pending.data() + index, pending.size() - index, sent, would_block)) {
+                return false;
+            }
+            // A non-blocking socket with a full send buffer: sleep in poll() rather than spin
+            if (would_block && !wait_writable(sock)) {
+                return false;
+            }
+
+            // Advance past everything the kernel accepted
+            while (index < pending.size() && sent >= pending[index].size()) {
+                sent -= pending[index].size();
+                index++;
+            }
+            if (index < pending.size()) {
+                pending[index].remove_prefix(sent);
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,205 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace metrics {
+    Histogram::Histogram(std::vector<double> bounds)
+        : upper_bounds(std::move(bounds)), counts(new std::atomic<uint64_t>[upper_bounds.size() + 1]) {
+        std::sort(upper_bounds.begin(), upper_bounds.end());
+        for (size_t i = 0; i <= upper_bounds.size(); i++) {
+            counts[i] = 0;
+        }
+    }
+
+    void Histogram::observe(double value) {
+        size_t bucket = std::lower_bound(upper_bounds.begin(), upper_bounds.end(), value) - upper_bounds.begin();
+        counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint64_t Histogram::count() const {
+        uint64_t sum = 0;
+        for (size_t i = 0; i <= upper_bounds.size(); i++) {
+            sum += bucket_count(i);
+        }
+        return sum;
+    }
+
+    double Histogram::quantile(double q) const {
+        uint64_t observations = count();
+        if (observations == 0) {
+            return 0.0;
+        }
+        // Rank of the observation sought, from 1
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(observations))));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < upper_bounds.size(); i++) {
+            seen += bucket_count(i);
+            if (seen >= rank) {
+                return upper_bounds[i];
+            }
+        }
+        return std::numeric_limits<double>::infinity();
+    }
+
+    std::vector<double> latency_buckets() {
+        return { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+    }
+
+    std::vector<double> size_buckets() {
+        std::vector<double> bounds;
+        for (double size = 1024; size <= 16 * 1024 * 1024; size *= 2) {
+            bounds.push_back(size);
+        }
+        return bounds;
+    }
+
+    Registry::Entry* Registry::find(const std::string& name) {
+        for (auto& entry : entries) {
+            if (entry.name == name) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    Registry::Entry& Registry::add(const std::string& name, const std::string& help, Type type) {
+        Entry entry;
+        entry.name = name;
+        entry.help = help;
+        entry.type = type;
+        entries.push_back(std::move(entry));
+        return entries.back();
+    }
+
+    Counter& Registry::counter(const std::string& name, const std::string& help) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry* entry = find(name);
+        if (entry && entry->counter) {
+            return *entry->counter;
+        }
+        if (entry) {
+            std::cerr << "Metric " << name << " already registered with another type\n";
+        }
+
+        counters.emplace_back();
+        add(name, help, Type::COUNTER).counter = &counters.back();
+        return counters.back();
+    }
+
+    Gauge& Registry::gauge(const std::string& name, const std::string& help) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry* entry = find(name);
+        if (entry && entry->gauge) {
+            return *entry->gauge;
+        }
+        if (entry) {
+            std::cerr << "Metric " << name << " already registered with another type\n";
+        }
+
+        gauges.emplace_back();
+        add(name, help, Type::GAUGE).gauge = &gauges.back();
+        return gauges.back();
+    }
+
+    Histogram& Registry::histogram(const std::string& name, const std::string& help, std::vector<double> bounds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry* entry = find(name);
+        if (entry && entry->histogram) {
+            return *entry->histogram;
+        }
+        if (entry) {
+            std::cerr << "Metric " << name << " already registered with another type\n";
+        }
+
+        histograms.emplace_back(std::move(bounds));
+        add(name, help, Type::HISTOGRAM).histogram = &histograms.back();
+        return histograms.back();
+    }
+
+    void Registry::gauge_function(const std::string& name, const std::string& help, std::function<double()> read) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry* entry = find(name);
+        if (entry && entry->type == Type::FUNCTION) {
+            entry->read = std::move(read);
+            return;
+        }
+        if (entry) {
+            std::cerr << "Metric " << name << " already registered with another type\n";
+            return;
+        }
+        add(name, help, Type::FUNCTION).read = std::move(read);
+    }
+
+    void Registry::remove_function(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const Entry& entry) {
+            return entry.type == Type::FUNCTION && entry.name == name;
+        }), entries.end());
+    }
+
+    static void write_value(std::ostringstream& out, double value) {
+        if (value == std::numeric_limits<double>::infinity()) {
+            out << "+Inf";
+        }
+        else {
+            out << value;
+        }
+    }
+
+    std::string Registry::render() const {
+        std::ostringstream out;
+        out << std::setprecision(15);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : entries) {
+            static const char* TYPE_NAMES[] = { "counter", "gauge", "histogram", "gauge" };
+            out << "# HELP " << entry.name << " " << entry.help << "\n";
+            out << "# TYPE " << entry.name << " " << TYPE_NAMES[static_cast<int>(entry.type)] << "\n";
+
+            switch (entry.type) {
+                case Type::COUNTER:
+                    out << entry.name << " " << entry.counter->get() << "\n";
+                    break;
+                case Type::GAUGE:
+                    out << entry.name << " ";
+                    write_value(out, entry.gauge->get());
+                    out << "\n";
+                    break;
+                case Type::FUNCTION:
+                    out << entry.name << " ";
+                    write_value(out, entry.read());
+                    out << "\n";
+                    break;
+                case Type::HISTOGRAM: {
+                    // Buckets are exposed cumulatively. Under concurrent updates the sum may
+                    // lag the buckets by a few observations, which scrapers tolerate
+                    const Histogram& histogram = *entry.histogram;
+                    uint64_t cumulative = 0;
+                    for (size_t i = 0; i < histogram.bounds().size(); i++) {
+                        cumulative += histogram.bucket_count(i);
+                        out << entry.name << "_bucket{le=\"";
+                        write_value(out, histogram.bounds()[i]);
+                        out << "\"} " << cumulative << "\n";
+                    }
+                    cumulative += histogram.bucket_count(histogram.bounds().size());
+                    out << entry.name << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+                    out << entry.name << "_sum ";
+                    write_value(out, histogram.sum());
+                    out << "\n" << entry.name << "_count " << cumulative << "\n";
+                    break;
+                }
+            }
+        }
+        return out.str();
+    }
+
+    Registry& default_registry() {
+        static Registry registry;
+        return registry;
+    }
+}
@@ -0,0 +1,307 @@
+#include "mjpeg_file.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MJPEG_FILE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mjpeg_file {
+    static const uint8_t MARKER_PREFIX = 0xFF;
+    static const uint8_t SOI = 0xD8;
+    static const uint8_t EOI = 0xD9;
+    static const uint8_t SOS = 0xDA;
+    static const uint8_t RST0 = 0xD0;
+    static const uint8_t RST7 = 0xD7;
+    static const uint8_t TEM = 0x01;
+
+    // A marker at `offset` if data[offset] starts one, which data[offset + 1] must exist for
+    static void check_marker(const uint8_t* data, size_t offset, std::vector<Marker>& markers) {
+        if (data[offset] == MARKER_PREFIX && (data[offset + 1] == SOI || data[offset + 1] == EOI)) {
+            markers.push_back({ offset, data[offset + 1] == SOI });
+        }
+    }
+
+    std::vector<Marker> find_markers_scalar(const uint8_t* data, size_t size) {
+        std::vector<Marker> markers;
+        for (size_t offset = 0; offset + 1 < size; offset++) {
+            check_marker(data, offset, markers);
+        }
+        return markers;
+    }
+
+    std::vector<Marker> find_markers(const uint8_t* data, size_t size) {
+#ifdef MJPEG_FILE_SSE2
+        std::vector<Marker> markers;
+        const __m128i prefix = _mm_set1_epi8(static_cast<char>(MARKER_PREFIX));
+        // SOI and EOI differ only in the lowest bit: OR-ing it in matches both with one compare
+        const __m128i low_bit = _mm_set1_epi8(1);
+        const __m128i eoi = _mm_set1_epi8(static_cast<char>(EOI));
+
+        // 16 candidate positions per step, each compared with the byte after it too. Compressed
+        // data rarely contains 0xFF, so almost every step is two loads, three compares and a branch
+        size_t offset = 0;
+        for (; offset + 17 <= size; offset += 16) {
+            __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+            __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset + 1));
+            __m128i found = _mm_and_si128(_mm_cmpeq_epi8(first, prefix),
+                                          _mm_cmpeq_epi8(_mm_or_si128(second, low_bit), eoi));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(found));
+            while (mask != 0) {
+#ifdef _MSC_VER
+                unsigned long bit;
+                _BitScanForward(&bit, mask);
+#else
+                unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+                markers.push_back({ offset + bit, data[offset + bit + 1] == SOI });
+                mask &= mask - 1;
+            }
+        }
+        for (; offset + 1 < size; offset++) {
+            check_marker(data, offset, markers);
+        }
+        return markers;
+#else
+        return find_markers_scalar(data, size);
+#endif
+    }
+
+    // Follow the frame whose SOI is at `start` to its EOI. Marker segments are skipped by their
+    // lengths, so SOI and EOI bytes inside them (EXIF thumbnails, ICC profiles) are never seen.
+    // Sets `end` past the EOI, or, for a frame cut short, malformed or interrupted by another
+    // SOI, to where it stopped making sense: nothing before that starts a frame.
+    static bool parse_frame(const uint8_t* data, size_t size, size_t start, size_t& end) {
+        size_t offset = start + 2;
+        end = size;
+        while (offset + 1 < size) {
+            if (data[offset] != MARKER_PREFIX) {
+                end = offset;
+                return false;
+            }
+            uint8_t type = data[offset + 1];
+            if (type == MARKER_PREFIX) {
+                offset++;   // Fill byte
+                continue;
+            }
+            if (type == SOI || type == 0x00) {
+                end = offset;
+                return false;
+            }
+            offset += 2;
+            if (type == EOI) {
+                end = offset;
+                return true;
+            }
+            if (type == TEM || (type >= RST0 && type <= RST7)) {
+                continue;   // No length
+            }
+
+            if (offset + 2 > size) {
+                return false;
+            }
+            size_t length = (static_cast<size_t>(data[offset]) << 8) | data[offset + 1];
+            if (length < 2) {
+                end = offset;
+                return false;
+            }
+            offset += length;
+            if (type != SOS) {
+                continue;
+            }
+
+            // Entropy-coded data runs to the next marker; FF 00 is a stuffed data byte, and
+            // restart markers belong to the scan
+            while (true) {
+                const void* found = offset < size ? memchr(data + offset, MARKER_PREFIX, size - offset) : nullptr;
+                if (!found) {
+                    return false;
+                }
+                offset = static_cast<size_t>(static_cast<const uint8_t*>(found) - data);
+                if (offset + 1 >= size) {
+                    return false;
+                }
+                uint8_t next = data[offset + 1];
+                if (next == 0x00 || (next >= RST0 && next <= RST7)) {
+                    offset += 2;
+                }
+                else if (next == MARKER_PREFIX) {
+                    offset++;
+                }
+                else {
+                    break;
+                }
+            }
+        }
+        return false;
+    }
+
+    std::vector<Frame> build_index(const uint8_t* data, size_t size) {
+        std::vector<Frame> frames;
+        uint64_t resume = 0;    // Start markers before this are inside a frame already parsed
+        for (const Marker& marker : find_markers(data, size)) {
+            if (!marker.start || marker.offset < resume) {
+                continue;
+            }
+            // A frame that does not parse to its EOI is dropped, and the scan picks up where it
+            // broke off, e.g. at the SOI of the next frame, so one damaged frame costs only itself
+            size_t end = 0;
+            bool complete = parse_frame(data, size, static_cast<size_t>(marker.offset), end);
+            resume = end;
+            uint64_t frame_size = end - marker.offset;
+            if (complete && frame_size <= UINT32_MAX) {
+                frames.push_back({ marker.offset, static_cast<uint32_t>(frame_size), 0 });
+            }
+        }
+        return frames;
+    }
+
+    Recording::~Recording() {
+        close();
+    }
+
+    bool Recording::open(const std::string& path, double fps) {
+        close();
+
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER size;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+            std::cerr << "Could not open " << path << "\n";
+            if (file != INVALID_HANDLE_VALUE) {
+                CloseHandle(file);
+            }
+            return false;
+        }
+        file_size = static_cast<uint64_t>(size.QuadPart);
+        if (file_size > 0) {
+            // The mapping keeps the file open
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) {
+                base = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            }
+        }
+        CloseHandle(file);
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (file == -1 || fstat(file, &info) != 0) {
+            std::cerr << "Could not open " << path << "\n";
+            if (file != -1) {
+                ::close(file);
+            }
+            return false;
+        }
+        file_size = static_cast<uint64_t>(info.st_size);
+        if (file_size > 0) {
+            // The mapping keeps the file open
+            void* mapped = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, file, 0);
+            if (mapped != MAP_FAILED) {
+                base = static_cast<const uint8_t*>(mapped);
+                posix_madvise(mapped, file_size, POSIX_MADV_SEQUENTIAL);
+            }
+        }
+        ::close(file);
+#endif
+        if (!base) {
+            std::cerr << "Could not map " << path << "\n";
+            close();
+            return false;
+        }
+
+        index = build_index(base, file_size);
+        if (index.empty()) {
+            std::cerr << path << " contains no complete JPEG frame\n";
+            close();
+            return false;
+        }
+
+        frame_interval_us = static_cast<int64_t>(std::llround(1000000.0 / (fps > 0 ? fps : DEFAULT_FPS)));
+        if (!load_timestamps(path + ".timestamps")) {
+            for (size_t i = 0; i < index.size(); i++) {
+                index[i].timestamp_us = static_cast<int64_t>(i) * frame_interval_us;
+            }
+        }
+        return true;
+    }
+
+    void Recording::close() {
+        if (base) {
+#ifdef _WIN32
+            UnmapViewOfFile(base);
+#else
+            munmap(const_cast<uint8_t*>(base), file_size);
+#endif
+            base = nullptr;
+        }
+#ifdef _WIN32
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+#endif
+        mapping = nullptr;
+        file_size = 0;
+        index.clear();
+    }
+
+    bool Recording::load_timestamps(const std::string& path) {
+        std::ifstream sidecar(path);
+        if (!sidecar) {
+            return false;
+        }
+
+        // Rebased on the first frame; frames past the end of the list keep the last spacing
+        double first = 0.0;
+        size_t count = 0;
+        double seconds;
+        while (count < index.size() && sidecar >> seconds) {
+            if (count == 0) {
+                first = seconds;
+            }
+            int64_t timestamp_us = static_cast<int64_t>(std::llround((seconds - first) * 1000000.0));
+            // Presentation order only moves forward
+            index[count].timestamp_us = count > 0 ? std::max(timestamp_us, index[count - 1].timestamp_us) : 0;
+            count++;
+        }
+        if (count == 0) {
+            std::cerr << "No timestamps in " << path << ", using a constant frame rate\n";
+            return false;
+        }
+        if (count < index.size()) {
+            std::cerr << path << " has " << count << " timestamps for " << index.size() << " frames\n";
+        }
+        for (size_t i = count; i < index.size(); i++) {
+            index[i].timestamp_us = index[i - 1].timestamp_us + frame_interval_us;
+        }
+        return true;
+    }
+
+    int64_t Recording::duration_us() const {
+        return index.empty() ? 0 : index.back().timestamp_us + frame_interval_us;
+    }
+
+    size_t Recording::largest_frame() const {
+        size_t largest = 0;
+        for (const Frame& frame : index) {
+            largest = std::max<size_t>(largest, frame.size);
+        }
+        return largest;
+    }
+}
@@ -0,0 +1,85 @@
+#include "path_mtu.h"
+#include <algorithm>
+#include <iostream>
+
+#ifdef _WIN32
+#define CLOSESOCK(s) closesocket(s)
+#define SOCK_ERR   SOCKET_ERROR
+#define INVALID_SOCK INVALID_SOCKET
+#else
+#include <cerrno>
+#include <unistd.h>
+#define CLOSESOCK(s) close(s)
+#define SOCK_ERR   -1
+#define INVALID_SOCK -1
+#endif
+
+namespace path_mtu {
+    // Largest first
+    static const size_t PLATEAUS[] = { 32000, 17914, 9000, 8166, 4352, 2002, 1500, 1492, 1280, 1006 };
+
+    bool disable_fragmentation(sock_t sock) {
+#ifdef _WIN32
+        DWORD dont_fragment = 1;
+        if (setsockopt(sock, IPPROTO_IP, IP_DONTFRAGMENT, (char*)&dont_fragment, sizeof(dont_fragment)) == SOCK_ERR) {
+#else
+        // IP_PMTUDISC_DO: set DF and fail sends above the kernel's path MTU estimate
+        int discover_mode = IP_PMTUDISC_DO;
+        if (setsockopt(sock, IPPROTO_IP, IP_MTU_DISCOVER, &discover_mode, sizeof(discover_mode)) == SOCK_ERR) {
+#endif
+            std::cerr << "disable_fragmentation() failed\n";
+            return false;
+        }
+        return true;
+    }
+
+    size_t discover(const sockaddr_in& destination) {
+#ifdef IP_MTU
+        // IP_MTU is only defined on a connected socket; connecting a UDP socket sends nothing
+        sock_t sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == INVALID_SOCK) {
+            return DEFAULT_MTU;
+        }
+
+        size_t mtu = DEFAULT_MTU;
+        int value = 0;
+        socklen_t length = sizeof(value);
+        if (disable_fragmentation(sock) &&
+            connect(sock, reinterpret_cast<const sockaddr*>(&destination), sizeof(destination)) != SOCK_ERR &&
+            getsockopt(sock, IPPROTO_IP, IP_MTU, (char*)&value, &length) != SOCK_ERR && value > 0) {
+            mtu = std::clamp(static_cast<size_t>(value), MIN_MTU, MAX_MTU);
+        }
+        CLOSESOCK(sock);
+        return mtu;
+#else
+        (void)destination;
+        return DEFAULT_MTU;
+#endif
+    }
+
+    size_t after_too_big(const sockaddr_in& destination, size_t datagram_size) {
+        size_t packet_size = datagram_size + IPV4_UDP_OVERHEAD;
+        size_t mtu = discover(destination);
+        if (mtu < packet_size) {
+            return mtu;
+        }
+        for (size_t plateau : PLATEAUS) {
+            if (plateau < packet_size) {
+                return plateau;
+            }
+        }
+        return MIN_MTU;
+    }
+
+    size_t chunk_size(size_t mtu, size_t header_size) {
+        return std::max(MIN_MTU, mtu) - IPV4_UDP_OVERHEAD - header_size;
+    }
+
+    bool is_too_big(int error) {
+#ifdef _WIN32
+        return error == WSAEMSGSIZE;
+#else
+        return error == EMSGSIZE;
+#endif
+    }
+}
@@ -0,0 +1,329 @@
+#include "payload_codec.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "lz4.lib")
+#endif
+#endif
+
+namespace payload_codec {
+    namespace {
+        constexpr size_t HEADER_SIZE = 1;
+        constexpr size_t SIZE_FIELD = 4;
+        constexpr char HELLO_TAG[] = { '\0', 'N', 'T', 'Z', '?' };
+        constexpr char ACCEPT_TAG[] = { '\0', 'N', 'T', 'Z', '+' };
+        constexpr char DECLINE_TAG[] = { '\0', 'N', 'T', 'Z', '-' };
+        constexpr size_t TAG_SIZE = sizeof(HELLO_TAG);
+
+        void put_u32(char* out, uint32_t value) {
+            out[0] = static_cast<char>(value >> 24);
+            out[1] = static_cast<char>(value >> 16);
+            out[2] = static_cast<char>(value >> 8);
+            out[3] = static_cast<char>(value);
+        }
+
+        uint32_t get_u32(const char* in) {
+            const auto* bytes = reinterpret_cast<const unsigned char*>(in);
+            return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3];
+        }
+
+        // FNV-1a, to check that both peers prime their history with the same dictionary
+        uint32_t dictionary_id(std::string_view dictionary) {
+            uint32_t hash = 2166136261u;
+            for (unsigned char c : dictionary) {
+                hash = (hash ^ c) * 16777619u;
+            }
+            return hash;
+        }
+
+        // LZ4 only ever looks at the last 64 KB of a dictionary
+        std::string_view dictionary_tail(std::string_view dictionary) {
+            return dictionary.size() > HISTORY_SIZE ? dictionary.substr(dictionary.size() - HISTORY_SIZE) : dictionary;
+        }
+    }
+
+    bool available() {
+#ifdef HAVE_LZ4
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    std::string_view default_dictionary() {
+        static const char dictionary[] =
+            "{\"level\":\"DEBUG\",\"level\":\"WARNING\",\"level\":\"ERROR\",\"level\":\"INFO\","
+            "\"source\":\"server\",\"source\":\"client\",\"component\":\"udp_video\",\"component\":\"tcp_video\","
+            "\"metric\":\"frames_sent\",\"metric\":\"frames_dropped\",\"metric\":\"bytes_sent\",\"metric\":\"fps\","
+            "\"metric\":\"latency_ms\",\"metric\":\"jitter_ms\",\"metric\":\"packet_loss\",\"metric\":\"queue_depth\","
+            "\"unit\":\"ms\",\"unit\":\"bytes\",\"unit\":\"frames\",\"unit\":\"percent\",\"host\":\"127.0.0.1\","
+            "\"port\":8080,\"port\":12345,\"status\":\"ok\",\"status\":\"failed\",\"message\":\"Connection closed\","
+            "\"message\":\"Frame incomplete\",\"message\":\"Client disconnected\",\"message\":\"send() failed\","
+            "\"frame_id\":,\"chunk_id\":,\"total_chunks\":,\"width\":1920,\"height\":1080,\"quality\":,"
+            "\"timestamp\":\"2024-01-01T00:00:00.000Z\",\"value\":0.0,\"count\":0,\"id\":0}\n";
+        return std::string_view(dictionary, sizeof(dictionary) - 1);
+    }
+
+    std::string hello(std::string_view dictionary) {
+        std::string message(HELLO_TAG, TAG_SIZE);
+        message.resize(TAG_SIZE + SIZE_FIELD);
+        put_u32(&message[TAG_SIZE], dictionary_id(dictionary));
+        return message;
+    }
+
+    bool is_hello(std::string_view message) {
+        return message.size() == TAG_SIZE + SIZE_FIELD && message.substr(0, TAG_SIZE) == std::string_view(HELLO_TAG, TAG_SIZE);
+    }
+
+    std::string answer(std::string_view hello_message, std::string_view dictionary, bool& accepted) {
+        accepted = available() && is_hello(hello_message) &&
+                   get_u32(hello_message.data() + TAG_SIZE) == dictionary_id(dictionary);
+        return accepted ? std::string(ACCEPT_TAG, TAG_SIZE) : std::string(DECLINE_TAG, TAG_SIZE);
+    }
+
+    bool is_accepted(std::string_view answer_message) {
+        return answer_message == std::string_view(ACCEPT_TAG, TAG_SIZE);
+    }
+
+#ifdef HAVE_LZ4
+    struct Encoder::State {
+        LZ4_stream_t* stream = LZ4_createStream();
+        LZ4_stream_t* datagram_stream = nullptr;
+        std::vector<char> window; // History, followed by the message being compressed
+        size_t history = 0;
+
+        explicit State(std::string_view dictionary) {
+            dictionary = dictionary_tail(dictionary);
+            window.resize(HISTORY_SIZE + 64 * 1024);
+            memcpy(window.data(), dictionary.data(), dictionary.size());
+            history = dictionary.size();
+            LZ4_loadDict(stream, window.data(), static_cast<int>(history));
+        }
+
+        ~State() {
+            LZ4_freeStream(stream);
+            if (datagram_stream) LZ4_freeStream(datagram_stream);
+        }
+    };
+#else
+    struct Encoder::State {};
+#endif
+
+    Encoder::Encoder(std::string_view dictionary) : dictionary(dictionary) {
+    }
+
+    Encoder::~Encoder() = default;
+    Encoder::Encoder(Encoder&& other) noexcept = default;
+    Encoder& Encoder::operator=(Encoder&& other) noexcept = default;
+
+    std::string_view Encoder::encode(std::string_view message) {
+        total_in += message.size();
+        output.clear();
+
+#ifdef HAVE_LZ4
+        if (message.size() >= MIN_COMPRESS_SIZE && message.size() <= MAX_DECODED_SIZE) {
+            if (!state) {
+                state = std::make_unique<State>(dictionary);
+            }
+            State& s = *state;
+
+            // Copy the message right behind the history, so LZ4 sees one contiguous block
+            // and can match against both
+            if (s.window.size() < s.history + message.size()) {
+                s.window.resize(s.history + message.size());
+                LZ4_loadDict(s.stream, s.window.data(), static_cast<int>(s.history));
+            }
+            char* source = s.window.data() + s.history;
+            memcpy(source, message.data(), message.size());
+
+            int bound = LZ4_compressBound(static_cast<int>(message.size()));
+            output.resize(HEADER_SIZE + SIZE_FIELD + bound);
+            int compressed = LZ4_compress_fast_continue(s.stream, source, &output[HEADER_SIZE + SIZE_FIELD],
+                static_cast<int>(message.size()), bound, 1);
+
+            // Keep the last 64 KB as history for the next message; the decoder does the same
+            s.history = LZ4_saveDict(s.stream, s.window.data(), static_cast<int>(HISTORY_SIZE));
+
+            if (compressed > 0 && HEADER_SIZE + SIZE_FIELD + compressed < HEADER_SIZE + message.size()) {
+                output[0] = static_cast<char>(Kind::LZ4);
+                put_u32(&output[HEADER_SIZE], static_cast<uint32_t>(message.size()));
+                output.resize(HEADER_SIZE + SIZE_FIELD + compressed);
+            }
+            else {
+                // Incompressible, but already part of the history
+                output.assign(1, static_cast<char>(Kind::LZ4_STORED));
+                output.append(message);
+            }
+            total_out += output.size();
+            return output;
+        }
+#endif
+
+        output.assign(1, static_cast<char>(Kind::RAW));
+        output.append(message);
+        total_out += output.size();
+        return output;
+    }
+
+    std::string_view Encoder::encode_datagram(std::string_view message) {
+        total_in += message.size();
+        output.clear();
+
+#ifdef HAVE_LZ4
+        if (message.size() >= MIN_COMPRESS_SIZE && message.size() <= MAX_DECODED_SIZE) {
+            if (!state) {
+                state = std::make_unique<State>(dictionary);
+            }
+            if (!state->datagram_stream) {
+                state->datagram_stream = LZ4_createStream();
+            }
+
+            std::string_view dict = dictionary_tail(dictionary);
+            LZ4_loadDict(state->datagram_stream, dict.data(), static_cast<int>(dict.size()));
+
+            int bound = LZ4_compressBound(static_cast<int>(message.size()));
+            output.resize(HEADER_SIZE + SIZE_FIELD + bound);
+            int compressed = LZ4_compress_fast_continue(state->datagram_stream, message.data(),
+                &output[HEADER_SIZE + SIZE_FIELD], static_cast<int>(message.size()), bound, 1);
+
+            if (compressed > 0 && HEADER_SIZE + SIZE_FIELD + compressed < HEADER_SIZE + message.size()) {
+                output[0] = static_cast<char>(Kind::LZ4);
+                put_u32(&output[HEADER_SIZE], static_cast<uint32_t>(message.size()));
+                output.resize(HEADER_SIZE + SIZE_FIELD + compressed);
+                total_out += output.size();
+                return output;
+            }
+            output.clear();
+        }
+#endif
+
+        output.assign(1, static_cast<char>(Kind::RAW));
+        output.append(message);
+        total_out += output.size();
+        return output;
+    }
+
+    Decoder::Decoder(std::string_view dictionary) : dictionary(dictionary_tail(dictionary)) {
+        history = this->dictionary.size();
+        window.assign(this->dictionary.begin(), this->dictionary.end());
+    }
+
+    Decoder::~Decoder() = default;
+    Decoder::Decoder(Decoder&& other) noexcept = default;
+    Decoder& Decoder::operator=(Decoder&& other) noexcept = default;
+
+    bool Decoder::decode(std::string_view encoded, std::string_view& message) {
+        if (encoded.empty()) {
+            return false;
+        }
+
+        Kind kind = static_cast<Kind>(encoded[0]);
+        std::string_view payload = encoded.substr(HEADER_SIZE);
+        if (kind == Kind::RAW) {
+            message = payload;
+            return true;
+        }
+        if (kind == Kind::LZ4_STORED) {
+            return store(payload, message);
+        }
+        if (kind != Kind::LZ4 || payload.size() < SIZE_FIELD) {
+            std::cerr << "Invalid compressed message\n";
+            return false;
+        }
+
+#ifdef HAVE_LZ4
+        size_t size = get_u32(payload.data());
+        if (size > MAX_DECODED_SIZE) {
+            std::cerr << "Invalid compressed message size: " << size << " bytes\n";
+            return false;
+        }
+
+        keep_history();
+        if (window.size() < history + size) {
+            window.resize(history + size);
+        }
+        char* target = window.data() + history;
+        int decoded = LZ4_decompress_safe_usingDict(payload.data() + SIZE_FIELD, target,
+            static_cast<int>(payload.size() - SIZE_FIELD), static_cast<int>(size),
+            window.data(), static_cast<int>(history));
+        if (decoded < 0 || static_cast<size_t>(decoded) != size) {
+            std::cerr << "LZ4 decompression failed\n";
+            return false;
+        }
+
+        last = size;
+        message = std::string_view(target, size);
+        return true;
+#else
+        std::cerr << "Received LZ4 message, but compression is not built in\n";
+        return false;
+#endif
+    }
+
+    void Decoder::keep_history() {
+        // Same update as LZ4_saveDict on the encoder: the last 64 KB become the history
+        size_t kept = std::min(HISTORY_SIZE, history + last);
+        if (kept > 0) {
+            memmove(window.data(), window.data() + history + last - kept, kept);
+        }
+        history = kept;
+        last = 0;
+    }
+
+    bool Decoder::store(std::string_view payload, std::string_view& message) {
+        keep_history();
+        if (window.size() < history + payload.size()) {
+            window.resize(history + payload.size());
+        }
+        if (!payload.empty()) {
+            memcpy(window.data() + history, payload.data(), payload.size());
+        }
+        last = payload.size();
+        message = std::string_view(window.data() + history, last);
+        return true;
+    }
+
+    bool Decoder::decode_datagram(std::string_view encoded, std::string_view& message) {
+        if (encoded.empty()) {
+            return false;
+        }
+
+        Kind kind = static_cast<Kind>(encoded[0]);
+        std::string_view payload = encoded.substr(HEADER_SIZE);
+        if (kind == Kind::RAW) {
+            message = payload;
+            return true;
+        }
+        if (kind != Kind::LZ4 || payload.size() < SIZE_FIELD) {
+            std::cerr << "Invalid compressed datagram\n";
+            return false;
+        }
+
+#ifdef HAVE_LZ4
+        size_t size = get_u32(payload.data());
+        if (size > MAX_DECODED_SIZE) {
+            std::cerr << "Invalid compressed datagram size: " << size << " bytes\n";
+            return false;
+        }
+
+        scratch.resize(size);
+        int decoded = LZ4_decompress_safe_usingDict(payload.data() + SIZE_FIELD, scratch.data(),
+            static_cast<int>(payload.size() - SIZE_FIELD), static_cast<int>(size),
+            dictionary.data(), static_cast<int>(dictionary.size()));
+        if (decoded < 0 || static_cast<size_t>(decoded) != size) {
+            std::cerr << "LZ4 decompression failed\n";
+            return false;
+        }
+
+        message = std::string_view(scratch.data(), size);
+        return true;
+#else
+        std::cerr << "Received LZ4 datagram, but compression is not built in\n";
+        return false;
+#endif
+    }
+}
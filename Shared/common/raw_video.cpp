@@ -0,0 +1,162 @@
+#include "raw_video.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "lz4.lib")
+#endif
+#endif
+
+namespace raw_video {
+    static const uint32_t TAG = 0x4E545256;     // "NTRV"
+    static const uint8_t FORMAT_I420 = 1;
+    static const int MAX_DIMENSION = 8192;
+    static_assert(static_cast<long long>(MAX_DIMENSION) * MAX_DIMENSION * 3 / 2 <= INT_MAX,
+                  "plane sizes are passed to LZ4 as int");
+
+    static void write_header(uint8_t* out, int width, int height, Compression compression, size_t data_size) {
+        packet_codec::MutableView<wire::Header> header(out);
+        header.set<wire::Tag>(TAG);
+        header.set<wire::Width>(static_cast<uint16_t>(width));
+        header.set<wire::Height>(static_cast<uint16_t>(height));
+        header.set<wire::Format>(FORMAT_I420);
+        header.set<wire::Compression>(static_cast<uint8_t>(compression));
+        header.set<wire::Reserved>(0);
+        header.set<wire::DataSize>(static_cast<uint32_t>(data_size));
+    }
+
+    bool parse_mode(const std::string& text, Mode& mode) {
+        if (text == "jpeg") {
+            mode = Mode::JPEG;
+        }
+        else if (text == "raw") {
+            mode = Mode::RAW;
+        }
+        else if (text == "raw-lz4") {
+            mode = Mode::RAW_LZ4;
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+    const char* mode_name(Mode mode) {
+        switch (mode) {
+            case Mode::RAW:
+                return "raw";
+            case Mode::RAW_LZ4:
+                return "raw-lz4";
+            default:
+                return "jpeg";
+        }
+    }
+
+    Mode mode_from_environment() {
+        Mode mode = Mode::JPEG;
+        const char* payload = std::getenv("VIDEO_PAYLOAD");
+        if (payload && !parse_mode(payload, mode)) {
+            std::cerr << "Unknown VIDEO_PAYLOAD \"" << payload << "\", sending JPEG\n";
+        }
+        return mode;
+    }
+
+    bool is_raw(const uint8_t* data, size_t size) {
+        return size >= HEADER_SIZE && packet_codec::View<wire::Header>(data).get<wire::Tag>() == TAG;
+    }
+
+    void Encoder::encode(const cv::Mat& frame, Compression compression, std::vector<uint8_t>& payload) {
+        int width = std::min(frame.cols & ~1, MAX_DIMENSION);
+        int height = std::min(frame.rows & ~1, MAX_DIMENSION);
+        if (width == 0 || height == 0) {
+            payload.clear();
+            return;
+        }
+        cv::Mat source = frame(cv::Rect(0, 0, width, height));
+        size_t planes_size = static_cast<size_t>(width) * height * 3 / 2;
+
+#ifdef HAVE_LZ4
+        if (compression == Compression::LZ4) {
+            cv::cvtColor(source, yuv, cv::COLOR_BGR2YUV_I420);
+
+            int bound = LZ4_compressBound(static_cast<int>(planes_size));
+            payload.resize(HEADER_SIZE + bound);
+            int compressed = LZ4_compress_default(reinterpret_cast<const char*>(yuv.data),
+                reinterpret_cast<char*>(payload.data() + HEADER_SIZE), static_cast<int>(planes_size), bound);
+
+            // Noisy frames can come out larger; those are sent as they are
+            if (compressed > 0 && static_cast<size_t>(compressed) < planes_size) {
+                write_header(payload.data(), width, height, Compression::LZ4, compressed);
+                payload.resize(HEADER_SIZE + compressed);
+                return;
+            }
+            payload.resize(HEADER_SIZE + planes_size);
+            memcpy(payload.data() + HEADER_SIZE, yuv.data, planes_size);
+            write_header(payload.data(), width, height, Compression::NONE, planes_size);
+            return;
+        }
+#else
+        (void)compression;
+#endif
+
+        // Converted straight into the payload, behind the header
+        payload.resize(HEADER_SIZE + planes_size);
+        cv::Mat planes(height * 3 / 2, width, CV_8UC1, payload.data() + HEADER_SIZE);
+        cv::cvtColor(source, planes, cv::COLOR_BGR2YUV_I420);
+        write_header(payload.data(), width, height, Compression::NONE, planes_size);
+    }
+
+    bool Decoder::decode(const uint8_t* data, size_t size, cv::Mat& frame) {
+        if (!is_raw(data, size)) {
+            return false;
+        }
+        packet_codec::View<wire::Header> header(data);
+        if (header.get<wire::Format>() != FORMAT_I420) {
+            return false;
+        }
+        int width = header.get<wire::Width>();
+        int height = header.get<wire::Height>();
+        size_t data_size = header.get<wire::DataSize>();
+        size_t planes_size = static_cast<size_t>(width) * height * 3 / 2;
+        // Checked before anything is sized from them: the header comes off the network
+        if (width == 0 || height == 0 || width > MAX_DIMENSION || height > MAX_DIMENSION ||
+            ((width | height) & 1) || data_size != size - HEADER_SIZE || data_size > INT_MAX) {
+            return false;
+        }
+
+        const uint8_t* yuv = data + HEADER_SIZE;
+        switch (static_cast<Compression>(header.get<wire::Compression>())) {
+            case Compression::NONE:
+                if (data_size != planes_size) {
+                    return false;
+                }
+                break;
+
+            case Compression::LZ4:
+#ifdef HAVE_LZ4
+                planes.resize(planes_size);
+                if (LZ4_decompress_safe(reinterpret_cast<const char*>(yuv), reinterpret_cast<char*>(planes.data()),
+                        static_cast<int>(data_size), static_cast<int>(planes_size)) != static_cast<int>(planes_size)) {
+                    return false;
+                }
+                yuv = planes.data();
+                break;
+#else
+                std::cerr << "Received an LZ4 frame, but this build has no LZ4\n";
+                return false;
+#endif
+
+            default:
+                return false;
+        }
+
+        cv::Mat source(height * 3 / 2, width, CV_8UC1, const_cast<uint8_t*>(yuv));
+        cv::cvtColor(source, frame, cv::COLOR_YUV2BGR_I420);
+        return true;
+    }
+}
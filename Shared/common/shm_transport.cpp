@@ -0,0 +1,645 @@
+#include "shm_transport.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace shm_transport {
+    static const uint32_t MAGIC = 0x4D53544E;     // "NTSM"
+    static const uint32_t INDEX_MAGIC = 0x4953544E; // "NTSI"
+    static const uint32_t VERSION = 2;
+    static const uint32_t EMPTY = 0;              // Slot states besides published sequence numbers
+    static const uint32_t WRITING = 0xFFFFFFFF;
+    static const uint32_t NO_SLOT = 0xFFFFFFFF;   // Lease of a consumer reading nothing
+    static const uint32_t MAX_CONSUMERS = 16;
+    static const int MAX_GENERATION_ATTEMPTS = 16;
+    static const size_t CACHE_LINE = 64;
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring counters are shared between processes");
+
+    // The fixed-name segment telling consumers which ring is current. Each producer creates
+    // its ring under a new generation, "<name>_<generation>", so that a ring still mapped by
+    // consumers of an earlier producer never stands in the way (on Windows a mapping cannot be
+    // removed while anyone holds it, and its size is fixed).
+    struct alignas(CACHE_LINE) IndexHeader {
+        std::atomic<uint32_t> magic;
+        std::atomic<uint32_t> generation;           // 0 until a ring is ready
+    };
+
+    // One per open consumer, holding the slot it reads. The owner's process ID lets the
+    // producer take back the lease of a consumer that died holding it.
+    struct alignas(CACHE_LINE) LeaseRecord {
+        std::atomic<uint32_t> owner;                // Process ID, 0 when free
+        std::atomic<uint32_t> slot;                 // Leased slot or NO_SLOT
+    };
+
+    // Cache-line aligned, so that the producer's counters and each slot's leases do not share lines
+    struct alignas(CACHE_LINE) RingHeader {
+        std::atomic<uint32_t> magic;                // Stored last, once the rest is valid
+        uint32_t version;
+        uint32_t slot_count;
+        uint64_t slot_size;
+        uint64_t slot_stride;                       // SlotHeader plus data, in whole cache lines
+        alignas(CACHE_LINE) std::atomic<uint32_t> sequence; // Frames published; the futex word
+        std::atomic<uint32_t> latest;               // Slot of the newest frame
+        std::atomic<uint32_t> waiters;              // Consumers asleep, or about to be
+        std::atomic<uint32_t> closed;
+        LeaseRecord leases[MAX_CONSUMERS];
+    };
+
+    struct alignas(CACHE_LINE) SlotHeader {
+        std::atomic<uint32_t> state;                // EMPTY, WRITING or the sequence it was published as
+        uint64_t size;
+        FrameInfo info;
+    };
+
+    static RingHeader* ring(const Segment& segment) {
+        return reinterpret_cast<RingHeader*>(segment.base);
+    }
+
+    static SlotHeader* slot_at(const Segment& segment, uint32_t index) {
+        return reinterpret_cast<SlotHeader*>(segment.base + sizeof(RingHeader) + index * ring(segment)->slot_stride);
+    }
+
+    static uint8_t* slot_data(SlotHeader* slot) {
+        return reinterpret_cast<uint8_t*>(slot + 1);
+    }
+
+    static std::string ring_name(const std::string& name, uint32_t generation) {
+        return name + "_" + std::to_string(generation);
+    }
+
+    static uint32_t current_process() {
+#ifdef _WIN32
+        return static_cast<uint32_t>(GetCurrentProcessId());
+#else
+        return static_cast<uint32_t>(getpid());
+#endif
+    }
+
+    // A process ID can be reused, but only after the process it named is gone, by which time
+    // its leases have normally been reclaimed already
+    static bool process_alive(uint32_t pid) {
+#ifdef _WIN32
+        HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(pid));
+        if (!process) {
+            return GetLastError() == ERROR_ACCESS_DENIED;
+        }
+        bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+        CloseHandle(process);
+        return alive;
+#else
+        return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#endif
+    }
+
+    // Free the lease records of consumers whose process has exited. Returns how many.
+    static size_t reclaim_stale_leases(const Segment& segment) {
+        size_t reclaimed = 0;
+        for (LeaseRecord& lease : ring(segment)->leases) {
+            uint32_t owner = lease.owner.load();
+            if (owner == 0 || process_alive(owner)) {
+                continue;
+            }
+            // The slot first: once the owner is 0, another consumer may claim the record
+            lease.slot.store(NO_SLOT);
+            if (lease.owner.compare_exchange_strong(owner, 0)) {
+                reclaimed++;
+            }
+        }
+        return reclaimed;
+    }
+
+    static bool slot_leased(const Segment& segment, uint32_t index) {
+        for (const LeaseRecord& lease : ring(segment)->leases) {
+            if (lease.slot.load() == index) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Create the named memory with `size` bytes, or open it at whatever size it has. `in_use`
+    // is set when creating fails only because the name is still mapped (Windows).
+    static bool map_segment(Segment& segment, const std::string& name, size_t size, bool create, bool& in_use) {
+        in_use = false;
+#ifdef _WIN32
+        std::string path = "Local\\" + name;
+        HANDLE mapping;
+        if (create) {
+            mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size & 0xFFFFFFFF), path.c_str());
+            if (mapping && GetLastError() == ERROR_ALREADY_EXISTS) {
+                CloseHandle(mapping);
+                in_use = true;
+                return false;
+            }
+        }
+        else {
+            mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, path.c_str());
+        }
+        if (!mapping) {
+            if (create) {
+                std::cerr << "CreateFileMapping() failed\n";
+            }
+            return false;
+        }
+
+        void* base = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, create ? size : 0);
+        if (!base) {
+            std::cerr << "MapViewOfFile() failed\n";
+            CloseHandle(mapping);
+            return false;
+        }
+        if (!create) {
+            MEMORY_BASIC_INFORMATION info;
+            size = VirtualQuery(base, &info, sizeof(info)) ? info.RegionSize : 0;
+        }
+
+        std::string wake_path = path + "_wake";
+        HANDLE wake = create ? CreateSemaphoreA(nullptr, 0, LONG_MAX, wake_path.c_str())
+                             : OpenSemaphoreA(SEMAPHORE_MODIFY_STATE | SYNCHRONIZE, FALSE, wake_path.c_str());
+        if (!wake) {
+            std::cerr << "Could not " << (create ? "create" : "open") << " the wakeup semaphore\n";
+            UnmapViewOfFile(base);
+            CloseHandle(mapping);
+            return false;
+        }
+        segment.mapping = mapping;
+        segment.wake = wake;
+#else
+        std::string path = "/" + name;
+        int fd;
+        if (create) {
+            shm_unlink(path.c_str()); // Left over by a producer that crashed
+            fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0) {
+                std::cerr << "shm_open() failed\n";
+                return false;
+            }
+            if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                std::cerr << "ftruncate() failed\n";
+                close(fd);
+                shm_unlink(path.c_str());
+                return false;
+            }
+        }
+        else {
+            fd = shm_open(path.c_str(), O_RDWR, 0);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat status;
+            size = fstat(fd, &status) == 0 ? static_cast<size_t>(status.st_size) : 0;
+            if (size == 0) {
+                close(fd);
+                return false;
+            }
+        }
+
+        void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            std::cerr << "mmap() failed\n";
+            if (create) {
+                shm_unlink(path.c_str());
+            }
+            return false;
+        }
+#endif
+        segment.base = static_cast<uint8_t*>(base);
+        segment.size = size;
+        segment.name = name;
+        return true;
+    }
+
+    // The index is opened whether or not it exists already, and has no wakeup semaphore
+    static bool map_index(Segment& segment, const std::string& name, bool create) {
+        size_t size = sizeof(IndexHeader);
+#ifdef _WIN32
+        std::string path = "Local\\" + name;
+        HANDLE mapping = create ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+                                                     static_cast<DWORD>(size), path.c_str())
+                                : OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, path.c_str());
+        if (!mapping) {
+            return false;
+        }
+        void* base = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (!base) {
+            CloseHandle(mapping);
+            return false;
+        }
+        segment.mapping = mapping;
+#else
+        std::string path = "/" + name;
+        int fd = shm_open(path.c_str(), create ? O_CREAT | O_RDWR : O_RDWR, 0600);
+        if (fd < 0) {
+            return false;
+        }
+        // A new one is zero-filled, which reads as no ring yet
+        struct stat status;
+        bool sized = create ? ftruncate(fd, static_cast<off_t>(size)) == 0
+                            : fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= size;
+        void* base = sized ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (base == MAP_FAILED) {
+            return false;
+        }
+#endif
+        segment.base = static_cast<uint8_t*>(base);
+        segment.size = size;
+        segment.name = name;
+        return true;
+    }
+
+    static void unmap_segment(Segment& segment, bool remove) {
+        if (!segment.base) {
+            return;
+        }
+#ifdef _WIN32
+        // The mapping goes away with its last handle
+        (void)remove;
+        UnmapViewOfFile(segment.base);
+        CloseHandle(segment.mapping);
+        if (segment.wake) {
+            CloseHandle(segment.wake);
+        }
+#else
+        munmap(segment.base, segment.size);
+        if (remove) {
+            shm_unlink(("/" + segment.name).c_str());
+        }
+#endif
+        segment = Segment();
+    }
+
+    // Sleep until the frame counter moves from `seen`, a wakeup or the timeout
+    static void wait_for_change(const Segment& segment, uint32_t seen, std::chrono::milliseconds timeout) {
+        RingHeader* header = ring(segment);
+        header->waiters.fetch_add(1);
+        // Counted as a waiter before the last look, so a publish in between still wakes us
+        if (header->sequence.load() == seen) {
+#if defined(_WIN32)
+            WaitForSingleObject(segment.wake, static_cast<DWORD>(timeout.count()));
+#elif defined(__linux__)
+            timespec relative;
+            relative.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+            relative.tv_nsec = static_cast<long>(timeout.count() % 1000) * 1000000;
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header->sequence), FUTEX_WAIT, seen, &relative, nullptr, 0);
+#else
+            std::this_thread::sleep_for(std::min(timeout, std::chrono::milliseconds(1)));
+#endif
+        }
+        header->waiters.fetch_sub(1);
+    }
+
+    static void wake_all(const Segment& segment, uint32_t waiters) {
+#if defined(_WIN32)
+        ReleaseSemaphore(segment.wake, static_cast<LONG>(waiters), nullptr);
+#elif defined(__linux__)
+        (void)waiters;
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&ring(segment)->sequence), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+        (void)segment;
+        (void)waiters;
+#endif
+    }
+
+    Producer::~Producer() {
+        close();
+    }
+
+    bool Producer::create(const std::string& name, size_t slot_size, uint32_t slot_count) {
+        close();
+        slot_count = std::max<uint32_t>(slot_count, 2);
+        size_t slot_stride = (sizeof(SlotHeader) + slot_size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+        if (!map_index(index, name, true)) {
+            std::cerr << "Could not create the shared memory index " << name << "\n";
+            return false;
+        }
+
+        // The generation after the last one published, or a later one while that is still mapped
+        IndexHeader* directory = reinterpret_cast<IndexHeader*>(index.base);
+        uint32_t generation = directory->magic.load() == INDEX_MAGIC ? directory->generation.load() : 0;
+        bool in_use = true;
+        for (int attempt = 0; attempt < MAX_GENERATION_ATTEMPTS && in_use; attempt++) {
+            generation++;
+            if (map_segment(segment, ring_name(name, generation), sizeof(RingHeader) + slot_count * slot_stride,
+                            true, in_use)) {
+                break;
+            }
+        }
+        if (!segment.base) {
+            if (in_use) {
+                std::cerr << "Shared memory " << name << " is still in use by earlier producers\n";
+            }
+            unmap_segment(index, false);
+            return false;
+        }
+
+        RingHeader* header = new (segment.base) RingHeader();
+        header->version = VERSION;
+        header->slot_count = slot_count;
+        header->slot_size = slot_size;
+        header->slot_stride = slot_stride;
+        for (LeaseRecord& lease : header->leases) {
+            lease.slot.store(NO_SLOT);
+        }
+        for (uint32_t i = 0; i < slot_count; i++) {
+            new (slot_at(segment, i)) SlotHeader();
+        }
+        header->magic.store(MAGIC, std::memory_order_release);
+        directory->magic.store(INDEX_MAGIC);
+        directory->generation.store(generation, std::memory_order_release);
+
+        write_pending = false;
+        next_slot = 0;
+        dropped_frames = 0;
+        return true;
+    }
+
+    void Producer::close() {
+        if (!segment.base) {
+            return;
+        }
+        RingHeader* header = ring(segment);
+        header->closed.store(1);
+        wake_all(segment, header->waiters.load());
+        unmap_segment(segment, true);
+        unmap_segment(index, true);
+    }
+
+    size_t Producer::slot_size() const {
+        return segment.base ? static_cast<size_t>(ring(segment)->slot_size) : 0;
+    }
+
+    uint8_t* Producer::begin_write(size_t size) {
+        if (!segment.base || size > ring(segment)->slot_size) {
+            dropped_frames++;
+            return nullptr;
+        }
+
+        RingHeader* header = ring(segment);
+        bool published = header->sequence.load(std::memory_order_relaxed) != 0;
+        uint32_t latest = header->latest.load(std::memory_order_relaxed);
+        // With every slot leased, a consumer may have died holding one: look again once the
+        // leases of exited processes are taken back
+        for (int pass = 0; pass < 2; pass++) {
+            for (uint32_t i = 0; i < header->slot_count; i++) {
+                uint32_t index = (next_slot + i) % header->slot_count;
+                if (published && index == latest) {
+                    continue; // Consumers arriving now still need the newest frame
+                }
+
+                // Mark the slot before checking its leases; consumers lease before checking the
+                // mark, so at least one side sees the other and backs off
+                SlotHeader* slot = slot_at(segment, index);
+                uint32_t previous = slot->state.load(std::memory_order_relaxed);
+                slot->state.store(WRITING);
+                if (slot_leased(segment, index)) {
+                    slot->state.store(previous);
+                    continue;
+                }
+
+                write_pending = true;
+                writing = index;
+                writing_size = size;
+                next_slot = (index + 1) % header->slot_count;
+                return slot_data(slot);
+            }
+            if (reclaim_stale_leases(segment) == 0) {
+                break;
+            }
+        }
+
+        dropped_frames++;
+        return nullptr;
+    }
+
+    void Producer::publish(const FrameInfo& info) {
+        if (!write_pending) {
+            return;
+        }
+        write_pending = false;
+
+        RingHeader* header = ring(segment);
+        SlotHeader* slot = slot_at(segment, writing);
+        slot->info = info;
+        slot->size = writing_size;
+
+        // Sequence numbers skip the two reserved slot states when they wrap
+        uint32_t sequence = header->sequence.load(std::memory_order_relaxed);
+        do {
+            sequence++;
+        } while (sequence == EMPTY || sequence == WRITING);
+
+        slot->state.store(sequence, std::memory_order_release);
+        header->latest.store(writing, std::memory_order_release);
+        header->sequence.store(sequence);
+        uint32_t waiters = header->waiters.load();
+        if (waiters > 0) {
+            wake_all(segment, waiters);
+        }
+    }
+
+    bool Producer::publish(const FrameInfo& info, const uint8_t* data, size_t size) {
+        uint8_t* slot = begin_write(size);
+        if (!slot) {
+            return false;
+        }
+        memcpy(slot, data, size);
+        publish(info);
+        return true;
+    }
+
+    Consumer::~Consumer() {
+        close();
+    }
+
+    static int64_t claim_lease(const Segment& segment) {
+        uint32_t pid = current_process();
+        LeaseRecord* leases = ring(segment)->leases;
+        for (uint32_t i = 0; i < MAX_CONSUMERS; i++) {
+            uint32_t expected = 0;
+            if (leases[i].owner.compare_exchange_strong(expected, pid)) {
+                leases[i].slot.store(NO_SLOT);
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    bool Consumer::open(const std::string& name) {
+        close();
+
+        // The index names the current ring
+        Segment index;
+        if (!map_index(index, name, false)) {
+            return false;
+        }
+        IndexHeader* directory = reinterpret_cast<IndexHeader*>(index.base);
+        uint32_t generation = directory->magic.load() == INDEX_MAGIC ?
+            directory->generation.load(std::memory_order_acquire) : 0;
+        unmap_segment(index, false);
+        bool in_use;
+        if (generation == 0 || !map_segment(segment, ring_name(name, generation), 0, false, in_use)) {
+            return false;
+        }
+
+        // A ring still being set up, or one from another version, is not usable yet
+        RingHeader* header = ring(segment);
+        bool valid = segment.size >= sizeof(RingHeader) &&
+                     header->magic.load(std::memory_order_acquire) == MAGIC && header->version == VERSION &&
+                     segment.size >= sizeof(RingHeader) + header->slot_count * header->slot_stride;
+        if (!valid) {
+            unmap_segment(segment, false);
+            return false;
+        }
+
+        lease = claim_lease(segment);
+        if (lease < 0 && reclaim_stale_leases(segment) > 0) {
+            lease = claim_lease(segment);
+        }
+        if (lease < 0) {
+            std::cerr << "Shared memory " << name << " already has " << MAX_CONSUMERS << " consumers\n";
+            unmap_segment(segment, false);
+            return false;
+        }
+
+        last_sequence = 0;
+        skipped_frames = 0;
+        return true;
+    }
+
+    void Consumer::close() {
+        release();
+        if (lease >= 0 && segment.base) {
+            ring(segment)->leases[lease].owner.store(0);
+        }
+        lease = -1;
+        unmap_segment(segment, false);
+    }
+
+    void Consumer::release() {
+        if (held >= 0 && segment.base) {
+            ring(segment)->leases[lease].slot.store(NO_SLOT);
+        }
+        held = -1;
+    }
+
+    bool Consumer::producer_closed() const {
+        return segment.base && ring(segment)->closed.load() != 0;
+    }
+
+    bool Consumer::next(FrameView& view, std::chrono::milliseconds timeout) {
+        release();
+        if (!segment.base) {
+            return false;
+        }
+
+        RingHeader* header = ring(segment);
+        LeaseRecord& record = header->leases[lease];
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (true) {
+            uint32_t sequence = header->sequence.load(std::memory_order_acquire);
+            if (sequence != last_sequence) {
+                uint32_t index = header->latest.load(std::memory_order_acquire);
+                SlotHeader* slot = slot_at(segment, index);
+                record.slot.store(index);
+                uint32_t state = slot->state.load();
+                if (state != EMPTY && state != WRITING && static_cast<int32_t>(state - last_sequence) > 0) {
+                    if (last_sequence != 0) {
+                        skipped_frames += state - last_sequence - 1;
+                    }
+                    last_sequence = state;
+                    held = index;
+                    view.info = slot->info;
+                    view.data = slot_data(slot);
+                    view.size = static_cast<size_t>(slot->size);
+                    return true;
+                }
+
+                // The producer moved on while we looked: read `latest` again
+                record.slot.store(NO_SLOT);
+                std::this_thread::yield();
+                continue;
+            }
+
+            if (header->closed.load() != 0) {
+                return false;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                return false;
+            }
+            wait_for_change(segment, sequence,
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + std::chrono::milliseconds(1));
+        }
+    }
+
+    bool is_local(const char* address) {
+        in_addr target;
+        if (inet_pton(AF_INET, address, &target) != 1) {
+            return false;
+        }
+        if ((ntohl(target.s_addr) >> 24) == 127) {
+            return true;
+        }
+
+        // Otherwise, one of the addresses this host's name resolves to
+#ifdef _WIN32
+        WSADATA wsa;
+        if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+            return false;
+        }
+#endif
+        bool local = false;
+        char host[256];
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        addrinfo* results = nullptr;
+        if (gethostname(host, sizeof(host)) == 0 && getaddrinfo(host, nullptr, &hints, &results) == 0) {
+            for (addrinfo* result = results; result; result = result->ai_next) {
+                if (reinterpret_cast<sockaddr_in*>(result->ai_addr)->sin_addr.s_addr == target.s_addr) {
+                    local = true;
+                }
+            }
+            freeaddrinfo(results);
+        }
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return local;
+    }
+
+    bool use_for_peer(const char* address) {
+        const char* transport = std::getenv("VIDEO_TRANSPORT");
+        if (transport && std::string(transport) == "udp") {
+            return false;
+        }
+        return is_local(address);
+    }
+}
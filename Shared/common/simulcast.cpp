@@ -0,0 +1,104 @@
+#include "simulcast.h"
+#include <algorithm>
+
+namespace simulcast {
+    static const uint32_t SUBSCRIBE_TAG = 0x53435354;   // "SCST"
+    static const uint32_t CHALLENGE_TAG = 0x5343434B;   // "SCCK"
+
+    void write_subscribe(char* out, uint16_t layer, uint64_t cookie) {
+        packet_codec::MutableView<wire::Subscribe> subscribe(out);
+        subscribe.set<wire::Tag>(SUBSCRIBE_TAG);
+        subscribe.set<wire::Layer>(layer);
+        subscribe.set<wire::LayerReserved>(0);
+        subscribe.set<wire::Cookie>(cookie);
+    }
+
+    bool read_subscribe(const char* data, size_t size, uint16_t& layer, uint64_t& cookie) {
+        packet_codec::View<wire::Subscribe> subscribe(data);
+        if (size != SUBSCRIBE_SIZE || subscribe.get<wire::Tag>() != SUBSCRIBE_TAG) {
+            return false;
+        }
+        layer = subscribe.get<wire::Layer>();
+        cookie = subscribe.get<wire::Cookie>();
+        return true;
+    }
+
+    void write_challenge(char* out, uint64_t cookie) {
+        packet_codec::MutableView<wire::Challenge> challenge(out);
+        challenge.set<wire::Tag>(CHALLENGE_TAG);
+        challenge.set<wire::ChallengeReserved>(0);
+        challenge.set<wire::Cookie>(cookie);
+    }
+
+    bool read_challenge(const char* data, size_t size, uint64_t& cookie) {
+        packet_codec::View<wire::Challenge> challenge(data);
+        if (size != CHALLENGE_SIZE || challenge.get<wire::Tag>() != CHALLENGE_TAG) {
+            return false;
+        }
+        cookie = challenge.get<wire::Cookie>();
+        return true;
+    }
+
+    LayerSelector::LayerSelector(size_t layer_count, uint16_t start_layer)
+        : layer_count(std::max<size_t>(layer_count, 1)),
+          current(static_cast<uint16_t>(std::min<size_t>(start_layer, this->layer_count - 1))) {
+    }
+
+    void LayerSelector::reset_period() {
+        seen = false;
+        completed = 0;
+    }
+
+    void LayerSelector::chunk_received(uint16_t layer, uint32_t frame_id) {
+        if (layer != current) {
+            return;
+        }
+
+        if (!seen) {
+            first_frame = last_frame = frame_id;
+            seen = true;
+        }
+        first_frame = std::min(first_frame, frame_id);
+        last_frame = std::max(last_frame, frame_id);
+    }
+
+    void LayerSelector::frame_completed(uint16_t layer) {
+        if (layer == current) {
+            completed++;
+        }
+    }
+
+    bool LayerSelector::update() {
+        // Nothing arrived at all: the server is not sending, which says nothing about the link
+        if (!seen) {
+            return false;
+        }
+
+        // Frame IDs count captured frames, so a frame lost entirely still leaves a gap
+        size_t expected = static_cast<size_t>(last_frame - first_frame) + 1;
+        last_completion = std::min(1.0, static_cast<double>(completed) / expected);
+        // The newest frame may still be in flight when the period closes
+        bool clean = completed + 1 >= expected;
+        reset_period();
+
+        if (last_completion < STEP_DOWN_RATIO) {
+            clean_periods = 0;
+            if (current + 1u < layer_count) {
+                current++;
+                return true;
+            }
+            return false;
+        }
+
+        if (!clean) {
+            clean_periods = 0;
+            return false;
+        }
+        if (++clean_periods >= STEP_UP_PERIODS && current > 0) {
+            clean_periods = 0;
+            current--;
+            return true;
+        }
+        return false;
+    }
+}
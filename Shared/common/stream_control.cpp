@@ -0,0 +1,103 @@
+#include "stream_control.h"
+#include <cstdlib>
+#include <sstream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#endif
+
+namespace stream_control {
+    static bool parse_int(const std::string& text, int minimum, int maximum, int& value) {
+        char* end = nullptr;
+        long number = std::strtol(text.c_str(), &end, 10);
+        if (text.empty() || *end != '\0' || number < minimum || number > maximum) {
+            return false;
+        }
+        value = static_cast<int>(number);
+        return true;
+    }
+
+    bool parse_command(std::string_view text, Command& command, std::string& error) {
+        std::istringstream input{std::string(text)};
+        std::string name;
+        std::string argument;
+        std::string extra;
+        input >> name >> argument >> extra;
+        if (!extra.empty()) {
+            error = "too many arguments";
+            return false;
+        }
+
+        command = Command();
+        bool takes_argument = true;
+        if (name == "refresh" || name == "pause" || name == "resume" || name == "stats") {
+            command.type = name == "refresh" ? Type::REFRESH : name == "pause" ? Type::PAUSE :
+                           name == "resume" ? Type::RESUME : Type::STATS;
+            takes_argument = false;
+        }
+        else if (name == "resolution") {
+            command.type = Type::RESOLUTION;
+            size_t x = argument.find('x');
+            if (x == std::string::npos ||
+                !parse_int(argument.substr(0, x), 0, MAX_DIMENSION, command.width) ||
+                !parse_int(argument.substr(x + 1), 0, MAX_DIMENSION, command.height) ||
+                (command.width == 0) != (command.height == 0)) {
+                error = "expected WxH, up to " + std::to_string(MAX_DIMENSION) + " each, or 0x0";
+                return false;
+            }
+        }
+        else if (name == "fps") {
+            command.type = Type::FPS;
+            char* end = nullptr;
+            command.fps = std::strtod(argument.c_str(), &end);
+            if (argument.empty() || *end != '\0' || !(command.fps > 0) || command.fps > MAX_FPS) {
+                error = "expected a frame rate above 0, up to " + std::to_string(static_cast<int>(MAX_FPS));
+                return false;
+            }
+        }
+        else if (name == "quality") {
+            command.type = Type::QUALITY;
+            if (!parse_int(argument, 1, 100, command.quality)) {
+                error = "expected a JPEG quality from 1 to 100";
+                return false;
+            }
+        }
+        else if (name == "destination") {
+            command.type = Type::DESTINATION;
+            size_t colon = argument.find(':');
+            command.address = argument.substr(0, colon);
+            int port = 0;
+            in_addr address;
+            if (inet_pton(AF_INET, command.address.c_str(), &address) != 1 ||
+                (colon != std::string::npos && !parse_int(argument.substr(colon + 1), 1, 65535, port))) {
+                error = "expected IP or IP:PORT";
+                return false;
+            }
+            command.port = static_cast<uint16_t>(port);
+        }
+        else {
+            error = name.empty() ? "empty command" : "unknown command \"" + name + "\"";
+            return false;
+        }
+
+        if (!takes_argument && !argument.empty()) {
+            error = name + " takes no argument";
+            return false;
+        }
+        return true;
+    }
+
+    const char* usage() {
+        return "  refresh                  next frame at the top quality\n"
+               "  resolution WxH           scale frames before encoding (0x0: camera's own)\n"
+               "  fps F                    frames per second\n"
+               "  quality Q                highest JPEG quality (1-100)\n"
+               "  destination IP[:PORT]    send the video elsewhere\n"
+               "  pause / resume           stop and restart sending\n"
+               "  stats                    counters of the stream\n";
+    }
+}
@@ -0,0 +1,276 @@
+#include "video_chunking.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include "crc32c.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/uio.h>
+#endif
+
+namespace video_chunking {
+    void write_header(char* out, const ChunkHeader& header) {
+        packet_codec::MutableView<wire::Header> view(out);
+        view.set<wire::Version>(VERSION);
+        view.set<wire::Type>(static_cast<uint8_t>(PacketType::VIDEO_CHUNK));
+        view.set<wire::Flags>(header.flags);
+        view.set<wire::FrameId>(header.frame_id);
+        view.set<wire::ChunkId>(header.chunk_id);
+        view.set<wire::TotalChunks>(header.total_chunks);
+        view.set<wire::StreamId>(header.stream_id);
+        view.set<wire::Layer>(header.layer);
+        view.set<wire::CaptureUs>(header.capture_us);
+        view.set<wire::SendUs>(header.send_us);
+        view.set<wire::FrameCrc>(header.frame_crc);
+    }
+
+    bool read_header(const char* datagram, size_t size, ChunkHeader& header) {
+        if (size <= HEADER_SIZE || size - HEADER_SIZE > MAX_CHUNK_SIZE) {
+            return false;
+        }
+
+        packet_codec::View<wire::Header> view(datagram);
+        if (view.get<wire::Version>() != VERSION ||
+            view.get<wire::Type>() != static_cast<uint8_t>(PacketType::VIDEO_CHUNK)) {
+            return false;
+        }
+        header.flags = view.get<wire::Flags>();
+        header.frame_id = view.get<wire::FrameId>();
+        header.chunk_id = view.get<wire::ChunkId>();
+        header.total_chunks = view.get<wire::TotalChunks>();
+        header.stream_id = view.get<wire::StreamId>();
+        header.layer = view.get<wire::Layer>();
+        header.capture_us = view.get<wire::CaptureUs>();
+        header.send_us = view.get<wire::SendUs>();
+        header.frame_crc = view.get<wire::FrameCrc>();
+
+        return header.total_chunks > 0 && header.total_chunks <= MAX_CHUNKS &&
+               header.stream_id < MAX_STREAMS && header.layer < MAX_LAYERS;
+    }
+
+    // CRC of the header up to the chunk CRC, then of the chunk's bytes wherever they are
+    static uint32_t chunk_crc(const char* header_bytes, const uint8_t* chunk, size_t chunk_size) {
+        uint32_t crc = crc32c::value(reinterpret_cast<const uint8_t*>(header_bytes), wire::ChunkCrc::offset);
+        return crc32c::extend(crc, chunk, chunk_size);
+    }
+
+    bool verify_chunk(const char* datagram, size_t size) {
+        if (size < HEADER_SIZE) {
+            return false;
+        }
+        packet_codec::View<wire::Header> view(datagram);
+        return view.get<wire::ChunkCrc>() == chunk_crc(datagram, view.payload(), size - HEADER_SIZE);
+    }
+
+    bool verify_frame(const ChunkHeader& header, const uint8_t* frame, size_t size) {
+        return !(header.flags & FLAG_FRAME_CRC) || crc32c::value(frame, size) == header.frame_crc;
+    }
+
+    size_t chunk_count(size_t frame_size, size_t max_chunk_size) {
+        return (frame_size + max_chunk_size - 1) / max_chunk_size;
+    }
+
+    // Header of one chunk, with its CRC; returns the chunk's size
+    static size_t prepare_chunk(char* header_bytes, uint32_t frame_id, const uint8_t* frame, size_t frame_size,
+                                size_t chunk_id, size_t max_chunk_size, uint16_t stream_id, uint16_t layer,
+                                int64_t capture_us, int64_t send_us, std::optional<uint32_t> frame_crc) {
+        size_t offset = chunk_id * max_chunk_size;
+        size_t chunk_size = std::min(max_chunk_size, frame_size - offset);
+
+        ChunkHeader header;
+        header.frame_id = frame_id;
+        header.chunk_id = static_cast<uint32_t>(chunk_id);
+        header.total_chunks = static_cast<uint32_t>(chunk_count(frame_size, max_chunk_size));
+        header.stream_id = stream_id;
+        header.layer = layer;
+        header.capture_us = capture_us;
+        header.send_us = send_us;
+        if (frame_crc) {
+            header.flags |= FLAG_FRAME_CRC;
+            header.frame_crc = *frame_crc;
+        }
+        write_header(header_bytes, header);
+        packet_codec::MutableView<wire::Header>(header_bytes).set<wire::ChunkCrc>(
+            chunk_crc(header_bytes, frame + offset, chunk_size));
+        return chunk_size;
+    }
+
+    size_t build_chunk(uint32_t frame_id, const uint8_t* frame, size_t frame_size,
+                       size_t chunk_id, size_t max_chunk_size, char* out,
+                       uint16_t stream_id, uint16_t layer, int64_t capture_us, int64_t send_us,
+                       std::optional<uint32_t> frame_crc) {
+        size_t chunk_size = prepare_chunk(out, frame_id, frame, frame_size, chunk_id, max_chunk_size,
+            stream_id, layer, capture_us, send_us, frame_crc);
+        memcpy(out + HEADER_SIZE, frame + chunk_id * max_chunk_size, chunk_size);
+
+        return HEADER_SIZE + chunk_size;
+    }
+
+    int send_chunk(sock_t sock, const sockaddr_in& destination, uint32_t frame_id, const uint8_t* frame,
+                   size_t frame_size, size_t chunk_id, size_t max_chunk_size, uint16_t stream_id, uint16_t layer,
+                   int64_t capture_us, int64_t send_us, std::optional<uint32_t> frame_crc) {
+        size_t offset = chunk_id * max_chunk_size;
+        char header_bytes[HEADER_SIZE];
+        size_t chunk_size = prepare_chunk(header_bytes, frame_id, frame, frame_size, chunk_id, max_chunk_size,
+            stream_id, layer, capture_us, send_us, frame_crc);
+
+#ifdef _WIN32
+        WSABUF buffers[2];
+        buffers[0].buf = header_bytes;
+        buffers[0].len = static_cast<ULONG>(HEADER_SIZE);
+        buffers[1].buf = reinterpret_cast<char*>(const_cast<uint8_t*>(frame + offset));
+        buffers[1].len = static_cast<ULONG>(chunk_size);
+        DWORD bytes = 0;
+        if (WSASendTo(sock, buffers, 2, &bytes, 0, reinterpret_cast<const sockaddr*>(&destination),
+                      sizeof(destination), nullptr, nullptr) == SOCKET_ERROR) {
+            return -1;
+        }
+        return static_cast<int>(bytes);
+#else
+        iovec buffers[2];
+        buffers[0].iov_base = header_bytes;
+        buffers[0].iov_len = HEADER_SIZE;
+        buffers[1].iov_base = const_cast<uint8_t*>(frame + offset);
+        buffers[1].iov_len = chunk_size;
+        msghdr message{};
+        message.msg_name = const_cast<sockaddr_in*>(&destination);
+        message.msg_namelen = sizeof(destination);
+        message.msg_iov = buffers;
+        message.msg_iovlen = 2;
+        return static_cast<int>(sendmsg(sock, &message, 0));
+#endif
+    }
+
+    // The pool holds up to a full frame of released chunks, for the largest frame allowed
+    Reassembler::Reassembler(size_t max_frames)
+        : slots(std::max<size_t>(1, max_frames)), chunk_pool(MAX_CHUNKS) {
+    }
+
+    Reassembler::Slot* Reassembler::find(uint32_t frame_id) {
+        for (auto& slot : slots) {
+            if (slot.used && slot.frame_id == frame_id) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    void Reassembler::clear(Slot& slot) {
+        for (auto& chunk : slot.chunks) {
+            chunk_pool.release(std::move(chunk));
+        }
+        slot.chunks.clear();
+        slot.used = false;
+    }
+
+    size_t Reassembler::pending_frames() const {
+        return std::count_if(slots.begin(), slots.end(), [](const Slot& slot) { return slot.used; });
+    }
+
+    Reassembler::Status Reassembler::add(const ChunkHeader& header, const uint8_t* data, size_t size) {
+        if (size == 0) {
+            return Status::REJECTED;
+        }
+
+        Slot* slot = find(header.frame_id);
+        if (!slot) {
+            if (header.chunk_id != 0 || header.total_chunks == 0 || header.total_chunks > MAX_CHUNKS) {
+                return Status::REJECTED;
+            }
+
+            // Take a free slot, or drop the oldest frame when all are in use
+            Slot* oldest = nullptr;
+            for (auto& candidate : slots) {
+                if (!candidate.used) {
+                    slot = &candidate;
+                    break;
+                }
+                if (!oldest || candidate.frame_id < oldest->frame_id) {
+                    oldest = &candidate;
+                }
+            }
+            if (!slot) {
+                // The new frame may itself be older than every pending one
+                if (header.frame_id < oldest->frame_id) {
+                    return Status::REJECTED;
+                }
+                clear(*oldest);
+                slot = oldest;
+            }
+
+            // Grow every slot at once, so a new largest frame allocates here once, not per slot
+            if (slot->chunks.capacity() < header.total_chunks) {
+                for (auto& other : slots) {
+                    other.chunks.reserve(header.total_chunks);
+                }
+            }
+
+            slot->used = true;
+            slot->frame_id = header.frame_id;
+            slot->total_chunks = header.total_chunks;
+            slot->received = 0;
+            slot->chunks.resize(header.total_chunks);
+        }
+
+        if (header.chunk_id >= slot->total_chunks) {
+            return Status::REJECTED;
+        }
+        std::vector<uint8_t>& chunk = slot->chunks[header.chunk_id];
+        if (chunk.empty()) {
+            chunk = chunk_pool.acquire(size);
+            slot->received++;
+        }
+        chunk.assign(data, data + size);
+
+        return slot->received == slot->total_chunks ? Status::COMPLETE : Status::STORED;
+    }
+
+    bool Reassembler::take(uint32_t frame_id, std::vector<uint8_t>& frame) {
+        Slot* slot = find(frame_id);
+        if (!slot || slot->received != slot->total_chunks) {
+            return false;
+        }
+
+        size_t total_size = 0;
+        for (const auto& chunk : slot->chunks) {
+            total_size += chunk.size();
+        }
+
+        frame.clear();
+        frame.reserve(total_size);
+        for (const auto& chunk : slot->chunks) {
+            frame.insert(frame.end(), chunk.begin(), chunk.end());
+        }
+        clear(*slot);
+        return true;
+    }
+
+    static const auto PACING_STEP = std::chrono::milliseconds(1);
+
+    void Pacer::wait() {
+        if (rate > 0 && next - std::chrono::steady_clock::now() >= PACING_STEP) {
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+    void Pacer::sent(size_t bytes) {
+        if (rate <= 0) {
+            return;
+        }
+        // Time spent idle earns no burst
+        auto now = std::chrono::steady_clock::now();
+        next = std::max(next, now) + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(bytes * 8.0 / rate));
+    }
+
+    bool has_jpeg_end_marker(const uint8_t* data, size_t size) {
+        for (size_t i = size; i >= 2; i--) {
+            if (data[i - 2] == 0xFF && data[i - 1] == 0xD9) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
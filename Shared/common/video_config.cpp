@@ -0,0 +1,252 @@
+#include "video_config.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "video_chunking.h"
+
+namespace video_config {
+    static const size_t MAX_UDP_PAYLOAD = 65507;
+    static const size_t MIN_CHUNK_SIZE = 256;
+    static const size_t MIN_SOCKET_BUFFER = 4096;
+
+    static std::string trim(const std::string& text) {
+        size_t begin = 0;
+        size_t end = text.size();
+        while (begin < end && std::isspace(static_cast<unsigned char>(text[begin]))) {
+            begin++;
+        }
+        while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1]))) {
+            end--;
+        }
+        return text.substr(begin, end - begin);
+    }
+
+    bool parse_rate(const std::string& text, double& value) {
+        const char* begin = text.c_str();
+        char* end = nullptr;
+        double number = std::strtod(begin, &end);
+        if (end == begin) {
+            return false;
+        }
+        switch (*end) {
+            case 'k': case 'K': number *= 1e3; end++; break;
+            case 'm': case 'M': number *= 1e6; end++; break;
+            case 'g': case 'G': number *= 1e9; end++; break;
+        }
+        if (*end != '\0' || !std::isfinite(number) || number < 0) {
+            return false;
+        }
+        value = number;
+        return true;
+    }
+
+    bool parse_size(const std::string& text, size_t& value) {
+        if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) {
+            return false;
+        }
+        char* end = nullptr;
+        unsigned long long number = std::strtoull(text.c_str(), &end, 10);
+        unsigned long long scale = 1;
+        switch (*end) {
+            case 'k': case 'K': scale = 1ull << 10; end++; break;
+            case 'm': case 'M': scale = 1ull << 20; end++; break;
+            case 'g': case 'G': scale = 1ull << 30; end++; break;
+        }
+        if (*end != '\0' || number > SIZE_MAX / scale) {
+            return false;
+        }
+        value = static_cast<size_t>(number * scale);
+        return true;
+    }
+
+    static bool parse_int(const std::string& text, int minimum, int maximum, int& value) {
+        size_t number = 0;
+        if (!parse_size(text, number) || number < static_cast<size_t>(minimum) || number > static_cast<size_t>(maximum)) {
+            return false;
+        }
+        value = static_cast<int>(number);
+        return true;
+    }
+
+    bool set(Settings& settings, const std::string& key, const std::string& value) {
+        std::string name = key;
+        std::replace(name.begin(), name.end(), '-', '_');
+
+        if (name == "video_port") {
+            int port = 0;
+            if (!parse_int(value, 1, 65535, port)) {
+                return false;
+            }
+            settings.video_port = static_cast<uint16_t>(port);
+            return true;
+        }
+        if (name == "client_ip" || name == "server_ip") {
+            if (value.empty()) {
+                return false;
+            }
+            (name == "client_ip" ? settings.client_ip : settings.server_ip) = value;
+            return true;
+        }
+        if (name == "target_fps") {
+            double fps = 0;
+            if (!parse_rate(value, fps) || fps <= 0 || fps > 1000) {
+                return false;
+            }
+            settings.target_fps = fps;
+            return true;
+        }
+        if (name == "max_chunk_size") {
+            size_t size = 0;
+            if (!parse_size(value, size) ||
+                (size != 0 && (size < MIN_CHUNK_SIZE || size > MAX_UDP_PAYLOAD - video_chunking::HEADER_SIZE))) {
+                return false;
+            }
+            settings.max_chunk_size = size;
+            return true;
+        }
+        if (name == "buffer_size") {
+            // Room for the largest datagram, so none is ever truncated
+            size_t size = 0;
+            if (!parse_size(value, size) || size < MAX_UDP_PAYLOAD) {
+                return false;
+            }
+            settings.buffer_size = size;
+            return true;
+        }
+        if (name == "send_buffer" || name == "receive_buffer") {
+            int size = 0;
+            if (!parse_int(value, static_cast<int>(MIN_SOCKET_BUFFER), INT_MAX, size)) {
+                return false;
+            }
+            (name == "send_buffer" ? settings.send_buffer : settings.receive_buffer) = size;
+            return true;
+        }
+        if (name == "min_quality" || name == "max_quality") {
+            int quality = 0;
+            if (!parse_int(value, 1, 100, quality)) {
+                return false;
+            }
+            (name == "min_quality" ? settings.min_quality : settings.max_quality) = quality;
+            return true;
+        }
+        if (name == "pacing_rate") {
+            return parse_rate(value, settings.pacing_rate);
+        }
+        return false;
+    }
+
+    bool validate(const Settings& settings) {
+        if (settings.min_quality > settings.max_quality) {
+            std::cerr << "min_quality (" << settings.min_quality << ") is above max_quality ("
+                      << settings.max_quality << ")\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool load(const std::string& path, Settings& settings) {
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "Could not open " << path << "\n";
+            return false;
+        }
+
+        std::string line;
+        for (size_t number = 1; std::getline(file, line); number++) {
+            line = trim(line.substr(0, line.find('#')));
+            if (line.empty()) {
+                continue;
+            }
+            size_t equals = line.find('=');
+            if (equals == std::string::npos ||
+                !set(settings, trim(line.substr(0, equals)), trim(line.substr(equals + 1)))) {
+                std::cerr << path << ":" << number << ": invalid setting \"" << line << "\"\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void write(std::ostream& out, const Settings& settings) {
+        // Default formatting, whatever the caller left set on `out`, with every digit of a rate
+        std::ostringstream text;
+        text << std::setprecision(12);
+        text << "video_port = " << settings.video_port << "\n"
+             << "client_ip = " << settings.client_ip << "\n"
+             << "server_ip = " << settings.server_ip << "\n"
+             << "target_fps = " << settings.target_fps << "\n"
+             << "max_chunk_size = " << settings.max_chunk_size << "\n"
+             << "buffer_size = " << settings.buffer_size << "\n"
+             << "send_buffer = " << settings.send_buffer << "\n"
+             << "receive_buffer = " << settings.receive_buffer << "\n"
+             << "min_quality = " << settings.min_quality << "\n"
+             << "max_quality = " << settings.max_quality << "\n"
+             << "pacing_rate = " << settings.pacing_rate << "\n";
+        out << text.str();
+    }
+
+    bool save(const std::string& path, const Settings& settings) {
+        std::ofstream file(path, std::ios::trunc);
+        file << "# Video demo settings (see video_config.h)\n";
+        write(file, settings);
+        if (!file) {
+            std::cerr << "Could not write " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool from_command_line(int argc, char* argv[], Settings& settings, std::vector<std::string>& positional) {
+        // The file first, wherever --config appears, so options override it
+        std::string path;
+        for (int i = 1; i + 1 < argc; i++) {
+            if (std::string(argv[i]) == "--config") {
+                path = argv[i + 1];
+            }
+        }
+        if (!path.empty()) {
+            if (!load(path, settings)) {
+                return false;
+            }
+        }
+        else if (std::ifstream(DEFAULT_FILE)) {
+            if (!load(DEFAULT_FILE, settings)) {
+                return false;
+            }
+            std::cout << "Settings from " << DEFAULT_FILE << "\n";
+        }
+
+        positional.clear();
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg.rfind("--", 0) != 0) {
+                positional.push_back(arg);
+                continue;
+            }
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << "\n";
+                print_usage(argv[0]);
+                return false;
+            }
+            std::string value = argv[++i];
+            if (arg != "--config" && !set(settings, arg.substr(2), value)) {
+                std::cerr << "Invalid option: " << arg << " " << value << "\n";
+                print_usage(argv[0]);
+                return false;
+            }
+        }
+        return validate(settings);
+    }
+
+    void print_usage(const char* program) {
+        std::cout << "Usage: " << program << " [--config FILE] [--KEY VALUE]...\n"
+                  << "KEY and its default, as in a config file:\n";
+        write(std::cout, Settings());
+    }
+}
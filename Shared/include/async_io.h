@@ -0,0 +1,287 @@
+#pragma once
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "message_framing.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using sock_t = SOCKET;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+using sock_t = int;
+#endif
+
+// C++20 coroutine API over non-blocking sockets.
+// A Reactor runs many coroutines on one thread and resumes them when their socket is ready
+// (epoll on Linux, poll/WSAPoll elsewhere), so thousands of connections need neither a
+// thread nor a stack each:
+//
+//     async_io::Task<void> echo(async_io::Reactor& reactor, sock_t sock) {
+//         async_io::TcpConnection conn(reactor, sock);
+//         std::string_view message;
+//         while (co_await conn.receive(message)) {
+//             if (!co_await conn.send(message)) break;
+//         }
+//     }
+namespace async_io {
+#ifdef _WIN32
+    constexpr sock_t INVALID_SOCK = INVALID_SOCKET;
+#else
+    constexpr sock_t INVALID_SOCK = -1;
+#endif
+
+    class Reactor;
+
+    // Lazily started coroutine whose result is obtained with co_await.
+    template <typename T>
+    class Task;
+
+    namespace detail {
+        struct PromiseBase {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr exception;
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+                template <typename Promise>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                    auto next = handle.promise().continuation;
+                    return next ? next : std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+            FinalAwaiter final_suspend() noexcept { return {}; }
+
+            void unhandled_exception() { exception = std::current_exception(); }
+        };
+
+        template <typename T>
+        struct Promise : PromiseBase {
+            std::optional<T> value;
+
+            Task<T> get_return_object();
+            void return_value(T result) { value = std::move(result); }
+            T take() {
+                if (exception) std::rethrow_exception(exception);
+                return std::move(*value);
+            }
+        };
+
+        template <>
+        struct Promise<void> : PromiseBase {
+            Task<void> get_return_object();
+            void return_void() {}
+            void take() {
+                if (exception) std::rethrow_exception(exception);
+            }
+        };
+    }
+
+    template <typename T>
+    class Task {
+    public:
+        using promise_type = detail::Promise<T>;
+        using handle_type = std::coroutine_handle<promise_type>;
+
+        Task() = default;
+        explicit Task(handle_type handle) : handle(handle) {}
+        Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+        Task& operator=(Task&& other) noexcept {
+            if (this != &other) {
+                if (handle) handle.destroy();
+                handle = std::exchange(other.handle, {});
+            }
+            return *this;
+        }
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+        ~Task() {
+            if (handle) handle.destroy();
+        }
+
+        bool await_ready() const noexcept { return !handle || handle.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+        T await_resume() { return handle.promise().take(); }
+
+    private:
+        handle_type handle;
+    };
+
+    namespace detail {
+        template <typename T>
+        Task<T> Promise<T>::get_return_object() {
+            return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+        }
+
+        inline Task<void> Promise<void>::get_return_object() {
+            return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+        }
+
+        // Per-socket registration with a reactor: the coroutines waiting on it, if any.
+        struct IoState {
+            sock_t sock;
+            std::coroutine_handle<> reader;
+            std::coroutine_handle<> writer;
+            bool closed = false;
+        };
+
+        struct IoAwaiter {
+            IoState& state;
+            bool write;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) noexcept {
+                (write ? state.writer : state.reader) = handle;
+            }
+            void await_resume() const noexcept {}
+        };
+    }
+
+    // Single-threaded event loop. spawn() and stop() may be called from any thread;
+    // everything else belongs to the thread running run().
+    class Reactor {
+    public:
+        Reactor();
+        ~Reactor();
+        Reactor(const Reactor&) = delete;
+        Reactor& operator=(const Reactor&) = delete;
+
+        // Start a detached coroutine on this reactor; it is destroyed when it finishes.
+        void spawn(Task<void> task);
+        // Run until stop() is called.
+        void run();
+        void stop();
+
+        size_t active_tasks() const { return live_tasks.load(std::memory_order_relaxed); }
+
+        // Used by the socket types below
+        std::unique_ptr<detail::IoState> watch(sock_t sock);
+        void unwatch(std::unique_ptr<detail::IoState> state);
+        detail::IoAwaiter readable(detail::IoState& state) { return { state, false }; }
+        detail::IoAwaiter writable(detail::IoState& state) { return { state, true }; }
+
+    private:
+        void start_posted();
+        void poll_events(int timeout_ms);
+        void wake();
+
+#ifdef __linux__
+        int epoll_fd = -1;
+        int event_fd = -1;
+#else
+        std::vector<detail::IoState*> watched;
+#endif
+        std::vector<std::unique_ptr<detail::IoState>> retired; // Freed after the current batch of events
+        std::unordered_set<void*> roots; // Frames of running detached coroutines
+        std::mutex posted_mutex;
+        std::vector<Task<void>> posted;
+        std::atomic<bool> stopping{false};
+        std::atomic<size_t> live_tasks{0};
+    };
+
+    // Framed TCP connection (see message_framing) driven by a reactor.
+    class TcpConnection {
+    public:
+        TcpConnection(Reactor& reactor, sock_t sock);
+        explicit TcpConnection(Reactor& reactor);
+        ~TcpConnection();
+        TcpConnection(TcpConnection&& other) noexcept = default;
+        TcpConnection(const TcpConnection&) = delete;
+        TcpConnection& operator=(const TcpConnection&) = delete;
+
+        Task<bool> connect(const char* server_ip, uint16_t server_port);
+        // Send one length-prefixed message.
+        Task<bool> send(std::string_view message);
+        // Receive one message; the view is valid until the next receive.
+        Task<bool> receive(std::string_view& message);
+        void close();
+
+        bool is_open() const { return state != nullptr; }
+
+    private:
+        Reactor* reactor;
+        std::unique_ptr<detail::IoState> state;
+        message_framing::StreamReader reader;
+    };
+
+    class TcpListener {
+    public:
+        explicit TcpListener(Reactor& reactor);
+        ~TcpListener();
+        TcpListener(const TcpListener&) = delete;
+        TcpListener& operator=(const TcpListener&) = delete;
+
+        bool listen(uint16_t port, int backlog = 1024);
+        // Wait for the next client and return its socket, or INVALID_SOCK on error.
+        // Wrap it in a TcpConnection on whichever reactor should serve it. Errors such as
+        // running out of descriptors pass; while is_open(), accepting again can succeed.
+        Task<sock_t> accept();
+        void close();
+
+        bool is_open() const { return state != nullptr; }
+
+    private:
+        Reactor* reactor;
+        std::unique_ptr<detail::IoState> state;
+    };
+
+    class UdpSocket {
+    public:
+        explicit UdpSocket(Reactor& reactor);
+        ~UdpSocket();
+        UdpSocket(const UdpSocket&) = delete;
+        UdpSocket& operator=(const UdpSocket&) = delete;
+
+        // Bind to the given port (0 = any free port).
+        bool open(uint16_t port);
+        // Receive one datagram; returns its size, or -1 on error.
+        Task<int> recv_from(char* buffer, size_t capacity, sockaddr_in& from);
+        Task<bool> send_to(std::string_view data, const sockaddr_in& to);
+        void close();
+
+    private:
+        Reactor* reactor;
+        std::unique_ptr<detail::IoState> state;
+    };
+
+    // Several reactors on their own threads; new work is handed out round-robin.
+    class ReactorPool {
+    public:
+        ReactorPool() = default;
+        ~ReactorPool();
+        ReactorPool(const ReactorPool&) = delete;
+        ReactorPool& operator=(const ReactorPool&) = delete;
+
+        void start(size_t threads);
+        void stop();
+        Reactor& next();
+        size_t size() const { return reactors.size(); }
+        Reactor& at(size_t index) { return *reactors[index]; }
+
+    private:
+        std::vector<std::unique_ptr<Reactor>> reactors;
+        std::vector<std::thread> threads;
+        std::atomic<size_t> next_index{0};
+    };
+
+    // Sockets created outside a reactor must be switched to non-blocking mode first.
+    bool set_non_blocking(sock_t sock);
+}
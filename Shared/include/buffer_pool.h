@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Recycles byte buffers between frames, so that once every buffer has grown to the
+// largest frame or chunk seen, streaming no longer touches the heap.
+// Free buffers are kept in buckets by power-of-two capacity, so acquire() and release()
+// take constant time however many buffers are free (a reassembler keeps thousands).
+// Not thread-safe: each pipeline keeps its own pool.
+namespace buffer_pool {
+    class Pool {
+    public:
+        // At most max_free released buffers are kept; extra ones are freed.
+        explicit Pool(size_t max_free = 64);
+
+        // An empty buffer with room for at least `capacity` bytes, recycled when possible.
+        std::vector<uint8_t> acquire(size_t capacity);
+        void release(std::vector<uint8_t>&& buffer);
+
+        size_t free_buffers() const { return free_count; }
+        // Buffers acquire() had to allocate or grow, for spotting a pool that never warms up
+        uint64_t allocations() const { return allocation_count; }
+
+    private:
+        static constexpr size_t BUCKETS = 64;
+
+        std::vector<std::vector<uint8_t>> free[BUCKETS];   // Bucket k: capacities in [2^k, 2^(k+1))
+        size_t free_count = 0;
+        size_t max_free;
+        uint64_t allocation_count = 0;
+    };
+}
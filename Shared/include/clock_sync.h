@@ -0,0 +1,133 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include "packet_codec.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using sock_t = SOCKET;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+using sock_t = int;
+#endif
+
+// NTP-style estimate of the offset between a video sender's clock and a receiver's, so the
+// timestamps in chunk headers (see video_chunking) can be compared across hosts.
+// The receiver sends a request stamped with its clock (t0); the sender stamps when it got
+// it (t1) and when it answers (t2); the receiver notes the answer's arrival (t3). Then
+//     offset = ((t1 - t0) + (t2 - t3)) / 2     sender clock minus receiver clock
+//     delay  = (t3 - t0) - (t2 - t1)           time spent on the network, both ways
+// assuming the path takes as long each way. Queueing only ever adds delay, and skews the
+// offset by up to half of what it adds, so as in NTP's clock filter the estimate comes
+// from the recent sample with the lowest delay.
+//
+// Requests are 28 bytes, "NTCQ", t0 and 16 zero bytes; answers are 28, "NTCR", t0, t1 and
+// t2. Times are frame_trace::now_us(), as 8-byte big-endian integers. Requests are padded to
+// the size of an answer, and shorter ones ignored, so that a forged source address gets the
+// responder to send no more than it was sent.
+namespace clock_sync {
+    constexpr uint16_t PORT = 12347;
+    namespace wire {
+        using Tag = packet_codec::Field<uint32_t, 0>;
+        using T0 = packet_codec::Field<int64_t, 4>;
+        using T1 = packet_codec::Field<int64_t, 12>;
+        using T2 = packet_codec::Field<int64_t, 20>;
+        using Request = packet_codec::Layout<Tag, T0, T1, T2>;     // T1 and T2 zero: padding
+        using Response = packet_codec::Layout<Tag, T0, T1, T2>;
+    }
+
+    constexpr size_t REQUEST_SIZE = wire::Request::size;
+    constexpr size_t RESPONSE_SIZE = wire::Response::size;
+    static_assert(REQUEST_SIZE == RESPONSE_SIZE && RESPONSE_SIZE == 28, "the sizes are part of the wire format");
+    constexpr size_t FILTER_SIZE = 8;                   // Recent samples the estimate is chosen from
+    constexpr auto FAST_INTERVAL = std::chrono::milliseconds(100);     // Until the filter is full
+    constexpr auto INTERVAL = std::chrono::seconds(1);
+    constexpr auto RESPONSE_TIMEOUT = std::chrono::milliseconds(250);
+
+    struct Sample {
+        int64_t offset_us = 0;
+        int64_t delay_us = 0;
+    };
+
+    Sample make_sample(int64_t t0, int64_t t1, int64_t t2, int64_t t3);
+
+    void write_request(char* out, int64_t t0);
+    bool read_request(const char* data, size_t size, int64_t& t0);
+    void write_response(char* out, int64_t t0, int64_t t1, int64_t t2);
+    bool read_response(const char* data, size_t size, int64_t& t0, int64_t& t1, int64_t& t2);
+
+    // The lowest-delay sample of the last FILTER_SIZE
+    class Estimator {
+    public:
+        void add(const Sample& sample);
+        size_t size() const { return count; }
+        Sample best() const;
+
+    private:
+        Sample samples[FILTER_SIZE];
+        size_t count = 0;
+        size_t next = 0;
+    };
+
+    // Sender side: answers requests on its own thread, so the answer times are not held
+    // up by whatever the sender is doing.
+    class Responder {
+    public:
+        Responder() = default;
+        ~Responder();
+        Responder(const Responder&) = delete;
+        Responder& operator=(const Responder&) = delete;
+
+        // Winsock must already be initialized.
+        bool start(uint16_t port = PORT);
+        void stop();
+
+    private:
+        void run();
+
+        sock_t sock{};
+        bool running = false;
+        std::thread worker;
+        std::atomic<bool> stopping{false};
+    };
+
+    // Receiver side: polls the sender on its own thread and keeps the current estimate.
+    class Tracker {
+    public:
+        Tracker() = default;
+        ~Tracker();
+        Tracker(const Tracker&) = delete;
+        Tracker& operator=(const Tracker&) = delete;
+
+        // Winsock must already be initialized.
+        bool start(const char* sender_ip, uint16_t port = PORT);
+        void stop();
+
+        // Whether the sender has answered yet; until then the offset is 0, which is right
+        // only on the same host
+        bool synchronized() const { return round_trip.load(std::memory_order_relaxed) >= 0; }
+        int64_t offset_us() const { return offset.load(std::memory_order_relaxed); }
+        int64_t round_trip_us() const { return round_trip.load(std::memory_order_relaxed); }
+        // A sender timestamp on this host's clock
+        int64_t to_local(int64_t sender_us) const { return sender_us - offset_us(); }
+
+    private:
+        void run();
+        bool exchange();
+
+        sock_t sock{};
+        sockaddr_in sender{};
+        bool running = false;
+        std::thread worker;
+        std::atomic<bool> stopping{false};
+        std::atomic<int64_t> offset{0};
+        std::atomic<int64_t> round_trip{-1};
+        Estimator estimator;    // Worker thread only
+    };
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32C (Castagnoli), the checksum of iSCSI and SCTP, for catching corrupt or misassembled
+// video data before it is decoded. On x86-64 CPUs with SSE4.2 and PCLMULQDQ it runs on the
+// crc32 instruction over three interleaved streams, whose CRCs are merged with a carry-less
+// multiply; elsewhere it falls back to slicing-by-8 tables.
+namespace crc32c {
+    // CRC of `size` more bytes, continuing from the CRC of what came before (0 to start)
+    uint32_t extend(uint32_t crc, const uint8_t* data, size_t size);
+
+    inline uint32_t value(const uint8_t* data, size_t size) {
+        return extend(0, data, size);
+    }
+
+    // The table-driven version, whatever the CPU supports
+    uint32_t extend_portable(uint32_t crc, const uint8_t* data, size_t size);
+
+    // Whether extend() uses the crc32 instruction on this CPU
+    bool hardware_accelerated();
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Wire protocol for bulk file transfer (file_sender on the server, file_receiver on the client).
+// Every connection starts with one framed Request (see message_framing):
+//   OFFER  the server answers with one framed Offer (file size and name) and closes
+//   RANGE  the server streams bytes [offset, offset + length) of the file, unframed,
+//          straight from the page cache, then closes
+// The receiver splits the file into ranges and fetches them over parallel connections;
+// resuming a transfer is just requesting what is still missing of each range.
+namespace file_transfer {
+    constexpr uint64_t RANGE_ALIGNMENT = 1024 * 1024; // Range starts, so receiver writes stay aligned
+
+    enum class RequestType : uint8_t {
+        OFFER = 1,
+        RANGE = 2
+    };
+
+    struct Request {
+        RequestType type = RequestType::OFFER;
+        uint64_t offset = 0;
+        uint64_t length = 0;
+    };
+
+    struct Offer {
+        uint64_t size = 0;
+        std::string name;
+    };
+
+    struct Range {
+        uint64_t offset = 0;
+        uint64_t length = 0;
+    };
+
+    std::string encode_request(const Request& request);
+    bool decode_request(std::string_view message, Request& request);
+    std::string encode_offer(const Offer& offer);
+    bool decode_offer(std::string_view message, Offer& offer);
+
+    // Split a file into at most `count` contiguous ranges starting on RANGE_ALIGNMENT boundaries.
+    std::vector<Range> split(uint64_t size, size_t count);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Per-frame pipeline tracing in the Chrome Trace Event format (chrome://tracing, Perfetto).
+// Each pipeline stage of a frame is recorded as a span tagged with its frame_id, into a
+// ring buffer owned by the recording thread, so recording takes no lock. Timestamps come
+// from the system clock, so traces written by the server and the client on one machine
+// line up once merged. While tracing is off a span costs one relaxed atomic load.
+namespace frame_trace {
+    enum class Stage : uint8_t { CAPTURE, ENCODE, SEND, RECEIVE, REASSEMBLY, DECODE, DISPLAY };
+
+    constexpr size_t RING_CAPACITY = 65536; // Spans kept per thread; the oldest are overwritten
+    // Rings at most, 1.5 MB each. A thread that exits hands its ring to the next thread that
+    // records; threads beyond this many recording at once have their spans dropped.
+    constexpr size_t MAX_RINGS = 32;
+
+    // Start tracing into `output_path` (written by flush()).
+    void start(const std::string& output_path, const std::string& process_name);
+    // Start tracing if the FRAME_TRACE environment variable is set: the trace goes to
+    // "<FRAME_TRACE><process_name>.json", e.g. FRAME_TRACE=/tmp/trace- gives /tmp/trace-server.json.
+    bool start_from_environment(const std::string& process_name);
+    bool enabled();
+
+    int64_t now_us();
+    void record(Stage stage, uint32_t frame_id, int64_t start_us, int64_t end_us);
+
+    // Write every span recorded so far. Spans recorded while this runs may be missing or
+    // torn, so call it once the pipeline has stopped.
+    bool flush();
+
+    // Combine trace files from several processes into one.
+    bool merge(const std::vector<std::string>& input_paths, const std::string& output_path);
+
+    // Records the time between construction and end() (or destruction) as one span.
+    class Span {
+    public:
+        Span(Stage stage, uint32_t frame_id) : stage(stage), frame_id(frame_id), start_us(enabled() ? now_us() : -1) {}
+        ~Span() { end(); }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        // For stages that only learn their frame ID while running
+        void set_frame(uint32_t id) { frame_id = id; }
+        void end() {
+            if (start_us >= 0) {
+                record(stage, frame_id, start_us, now_us());
+                start_us = -1;
+            }
+        }
+
+    private:
+        Stage stage;
+        uint32_t frame_id;
+        int64_t start_us;
+    };
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using sock_t = SOCKET;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+using sock_t = int;
+#endif
+
+// Length-prefixed message framing for TCP streams.
+// Every message goes on the wire as a 4-byte big-endian length followed by the payload.
+namespace message_framing {
+    constexpr size_t PREFIX_SIZE = 4;
+    constexpr size_t MAX_MESSAGE_SIZE = 16 * 1024 * 1024; // Reject anything larger as corrupt
+
+    // Buffered reader that turns a byte stream back into messages.
+    // Data is read in large recv() calls into a growable buffer; complete frames are
+    // returned as views into that buffer, so no copy or allocation is made per message.
+    // The buffer is only allocated on the first read, so idle readers cost no memory.
+    class StreamReader {
+    public:
+        explicit StreamReader(size_t initial_capacity = 64 * 1024);
+
+        // Return the next complete message, reading from the socket as needed.
+        // The view stays valid until the next call on this reader.
+        // Returns false when the peer closed the connection or on error.
+        bool next_frame(sock_t sock, std::string_view& frame);
+
+        // Return the next message already buffered, without touching the socket.
+        bool poll_frame(std::string_view& frame);
+
+        // Non-blocking sockets: read whatever the socket has available into the buffer.
+        // Sets would_block when nothing was available; returns false when the peer
+        // closed the connection or on error.
+        bool read_some(sock_t sock, bool& would_block);
+
+        // Drop any buffered data (e.g. when the socket is reconnected).
+        void reset();
+
+        // True if a complete message is buffered and poll_frame() will return it.
+        bool has_frame() const;
+
+        size_t buffered_bytes() const { return tail - head; }
+        bool closed() const { return peer_closed; }
+        bool corrupted() const { return corrupt; }
+
+    private:
+        bool fill(sock_t sock);
+        void make_room();
+
+        std::vector<char> buffer;
+        size_t initial_capacity;
+        size_t head = 0; // Start of unconsumed data
+        size_t tail = 0; // End of received data
+        bool peer_closed = false;
+        bool corrupt = false;
+    };
+
+    // Collects outgoing messages and sends them in a single gathered write (writev / WSASend).
+    // Payloads are not copied: the caller keeps them alive until flush() returns.
+    class BatchWriter {
+    public:
+        void queue(std::string_view message);
+        bool flush(sock_t sock);
+        void clear();
+
+        size_t pending_messages() const { return payloads.size(); }
+
+    private:
+        std::vector<uint32_t> prefixes;
+        std::vector<std::string_view> payloads;
+    };
+
+    // Send the given buffers with as few system calls as possible, handling partial writes.
+    // On a non-blocking socket it waits for room whenever the send buffer is full.
+    bool send_buffers(sock_t sock, const std::string_view* buffers, size_t count);
+
+    // Wait up to `timeout` for `sock` to have data, a pending connection or an error to
+    // report. Built on poll(), so it takes descriptors past FD_SETSIZE.
+    bool wait_readable(sock_t sock, std::chrono::milliseconds timeout);
+
+    // One gathered send without retrying, for non-blocking sockets. `sent` receives the number
+    // of bytes the kernel accepted (may be partial); would_block is set when it accepted none.
+    bool send_some(sock_t sock, const std::string_view* buffers, size_t count, size_t& sent, bool& would_block);
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Process-wide metrics: cumulative counters, gauges and histograms, rendered in the
+// Prometheus text exposition format. Updating a metric is a relaxed atomic operation
+// and never takes a lock; only registration and rendering lock the registry.
+// Metrics live as long as their registry, so references can be kept in hot paths.
+namespace metrics {
+    class Counter {
+    public:
+        void add(uint64_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+        uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> value{0};
+    };
+
+    class Gauge {
+    public:
+        void set(double amount) { value.store(amount, std::memory_order_relaxed); }
+        void add(double amount) { value.fetch_add(amount, std::memory_order_relaxed); }
+        double get() const { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<double> value{0};
+    };
+
+    // Fixed buckets, given as sorted upper bounds; an implicit +Inf bucket follows.
+    class Histogram {
+    public:
+        explicit Histogram(std::vector<double> bounds);
+
+        void observe(double value);
+
+        const std::vector<double>& bounds() const { return upper_bounds; }
+        uint64_t bucket_count(size_t bucket) const { return counts[bucket].load(std::memory_order_relaxed); }
+        uint64_t count() const;
+        double sum() const { return total.load(std::memory_order_relaxed); }
+        // Upper bound of the bucket the q-quantile (0 to 1) falls in, as precise as the buckets
+        // allow; infinity if it is in the +Inf bucket, 0 while empty
+        double quantile(double q) const;
+
+    private:
+        std::vector<double> upper_bounds;
+        std::unique_ptr<std::atomic<uint64_t>[]> counts; // Per bucket, not cumulative
+        std::atomic<double> total{0};
+    };
+
+    // Bucket bounds for durations in seconds, 100 us to 10 s
+    std::vector<double> latency_buckets();
+    // Bucket bounds for sizes in bytes, 1 KB to 16 MB
+    std::vector<double> size_buckets();
+
+    class Registry {
+    public:
+        // Registering an existing name returns the metric already there.
+        Counter& counter(const std::string& name, const std::string& help);
+        Gauge& gauge(const std::string& name, const std::string& help);
+        Histogram& histogram(const std::string& name, const std::string& help, std::vector<double> bounds);
+
+        // Gauge read from `read` at every scrape, for values already kept elsewhere.
+        // Replaces any previous function of that name; remove it before what it reads goes away.
+        void gauge_function(const std::string& name, const std::string& help, std::function<double()> read);
+        void remove_function(const std::string& name);
+
+        std::string render() const;
+
+    private:
+        enum class Type { COUNTER, GAUGE, HISTOGRAM, FUNCTION };
+
+        struct Entry {
+            std::string name;
+            std::string help;
+            Type type = Type::COUNTER;
+            Counter* counter = nullptr;
+            Gauge* gauge = nullptr;
+            Histogram* histogram = nullptr;
+            std::function<double()> read;
+        };
+
+        Entry* find(const std::string& name);
+        Entry& add(const std::string& name, const std::string& help, Type type);
+
+        mutable std::mutex mutex;
+        std::vector<Entry> entries;
+        std::deque<Counter> counters;   // Deques: growing them never moves existing metrics
+        std::deque<Gauge> gauges;
+        std::deque<Histogram> histograms;
+    };
+
+    // The registry the demos and the exporter use unless told otherwise.
+    Registry& default_registry();
+}
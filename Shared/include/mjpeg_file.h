@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Pre-encoded MJPEG recordings (concatenated JPEG frames, as written by
+// `ffmpeg -i input -c:v mjpeg -f mjpeg out.mjpeg`), for streaming video on demand without
+// decoding or encoding anything. The file is memory-mapped read-only and indexed once by
+// scanning for JPEG start markers (FF D8) and following each frame's marker segments to its
+// end marker (FF D9); frames are then sent straight from the mapping.
+//
+// Frame timestamps come from an optional sidecar file, `<recording>.timestamps`, holding one
+// presentation time in seconds per line, e.g. from
+// `ffprobe -select_streams v -show_entries frame=pts_time -of csv=p=0 input`.
+// Without it, frames are spaced evenly at the given frame rate.
+namespace mjpeg_file {
+    constexpr double DEFAULT_FPS = 30.0;
+
+    struct Frame {
+        uint64_t offset;            // Of the SOI marker in the file
+        uint32_t size;              // SOI to EOI, both included
+        int64_t timestamp_us;       // Since the first frame
+    };
+
+    struct Marker {
+        uint64_t offset;
+        bool start;                 // SOI, otherwise EOI
+    };
+
+    // Every SOI and EOI marker in `data`, in file order. Uses SSE2 where available.
+    std::vector<Marker> find_markers(const uint8_t* data, size_t size);
+    // Same result, one byte at a time
+    std::vector<Marker> find_markers_scalar(const uint8_t* data, size_t size);
+
+    // Frames from each SOI to its EOI, found by following the marker segments by their lengths,
+    // so markers nested in a frame (EXIF thumbnails) are skipped. A frame cut short or
+    // malformed is dropped and the index resumes at the next SOI; bytes outside a complete
+    // frame are skipped too. Timestamps are left at 0.
+    std::vector<Frame> build_index(const uint8_t* data, size_t size);
+
+    class Recording {
+    public:
+        Recording() = default;
+        ~Recording();
+
+        Recording(const Recording&) = delete;
+        Recording& operator=(const Recording&) = delete;
+
+        // Map and index `path`. `fps` spaces the frames when there is no timestamp sidecar.
+        bool open(const std::string& path, double fps = DEFAULT_FPS);
+        void close();
+        bool is_open() const { return base != nullptr; }
+
+        const std::vector<Frame>& frames() const { return index; }
+        // The frame's bytes inside the mapping, valid until close()
+        const uint8_t* frame_data(const Frame& frame) const { return base + frame.offset; }
+        // First frame to one frame interval past the last, the offset to add when looping
+        int64_t duration_us() const;
+        size_t largest_frame() const;
+
+    private:
+        bool load_timestamps(const std::string& path);
+
+        const uint8_t* base = nullptr;
+        uint64_t file_size = 0;
+        void* mapping = nullptr;    // Windows only: file mapping handle
+        std::vector<Frame> index;
+        int64_t frame_interval_us = 0;
+    };
+}
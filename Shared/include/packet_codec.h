@@ -0,0 +1,180 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
+
+// Compile-time packet layouts: each field is an integer type at a fixed byte offset, stored
+// big-endian, and a layout lists its fields in offset order. Views read and write fields in
+// place in a datagram buffer, with no copy into a struct and no alignment requirement: an
+// access is one unaligned load or store and a byte swap (a byte loop in constant evaluation).
+//
+//     using Id = packet_codec::Field<uint32_t, 0>;
+//     using Size = packet_codec::Field<uint16_t, 4>;
+//     using Header = packet_codec::Layout<Id, Size>;          // Header::size == 6
+//     packet_codec::View<Header> view(datagram);              // Caller checks fits()
+//     uint32_t id = view.get<Id>();
+//
+// Overlapping or out-of-order fields, and fields of another layout, fail to compile.
+namespace packet_codec {
+    namespace detail {
+        template <typename U>
+        constexpr U byte_swap(U value) {
+            if (!std::is_constant_evaluated()) {
+                if constexpr (sizeof(U) == 2) {
+#ifdef _MSC_VER
+                    return static_cast<U>(_byteswap_ushort(value));
+#else
+                    return static_cast<U>(__builtin_bswap16(value));
+#endif
+                }
+                else if constexpr (sizeof(U) == 4) {
+#ifdef _MSC_VER
+                    return static_cast<U>(_byteswap_ulong(value));
+#else
+                    return static_cast<U>(__builtin_bswap32(value));
+#endif
+                }
+                else if constexpr (sizeof(U) == 8) {
+#ifdef _MSC_VER
+                    return static_cast<U>(_byteswap_uint64(value));
+#else
+                    return static_cast<U>(__builtin_bswap64(value));
+#endif
+                }
+            }
+            U swapped = 0;
+            for (size_t i = 0; i < sizeof(U); i++) {
+                swapped = static_cast<U>((swapped << 8) | ((value >> (8 * i)) & 0xFF));
+            }
+            return swapped;
+        }
+
+        // Host order from and to the wire's big-endian order
+        template <typename U>
+        constexpr U to_host(U value) {
+            if constexpr (std::endian::native == std::endian::big || sizeof(U) == 1) {
+                return value;
+            }
+            else {
+                return byte_swap(value);
+            }
+        }
+    }
+
+    template <typename T>
+    constexpr T load_be(const uint8_t* in) {
+        static_assert(std::is_integral_v<T>, "fields are integers");
+        using Bits = std::make_unsigned_t<T>;
+        Bits bits = 0;
+        if (std::is_constant_evaluated()) {
+            for (size_t i = 0; i < sizeof(T); i++) {
+                bits = static_cast<Bits>((bits << 8) | in[i]);
+            }
+            return static_cast<T>(bits);
+        }
+        // One unaligned load and a byte swap
+        memcpy(&bits, in, sizeof(bits));
+        return static_cast<T>(detail::to_host(bits));
+    }
+
+    template <typename T>
+    constexpr void store_be(uint8_t* out, T value) {
+        static_assert(std::is_integral_v<T>, "fields are integers");
+        using Bits = std::make_unsigned_t<T>;
+        Bits bits = static_cast<Bits>(value);
+        if (std::is_constant_evaluated()) {
+            for (size_t i = sizeof(T); i-- > 0;) {
+                out[i] = static_cast<uint8_t>(bits & 0xFF);
+                bits = static_cast<Bits>(bits >> 8);
+            }
+            return;
+        }
+        bits = detail::to_host(bits);
+        memcpy(out, &bits, sizeof(bits));
+    }
+
+    template <typename T, size_t Offset>
+    struct Field {
+        static_assert(std::is_integral_v<T> && !std::is_same_v<T, bool>, "fields are integers");
+        using type = T;
+        static constexpr size_t offset = Offset;
+        static constexpr size_t end = Offset + sizeof(T);
+    };
+
+    namespace detail {
+        template <typename... Fields>
+        constexpr bool in_order() {
+            size_t offsets[] = { Fields::offset..., 0 };
+            size_t ends[] = { Fields::end..., 0 };
+            for (size_t i = 1; i < sizeof...(Fields); i++) {
+                if (offsets[i] < ends[i - 1]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    template <typename... Fields>
+    struct Layout {
+        static_assert(detail::in_order<Fields...>(), "fields must be in offset order and must not overlap");
+
+        static constexpr size_t size = std::max({ size_t(0), Fields::end... });
+
+        template <typename F>
+        static constexpr bool contains = (std::is_same_v<F, Fields> || ...);
+    };
+
+    // Read-only view of a packet starting at `data`, which must hold at least L::size bytes
+    template <typename L>
+    class View {
+    public:
+        constexpr explicit View(const uint8_t* data) : bytes(data) {}
+        explicit View(const char* data) : bytes(reinterpret_cast<const uint8_t*>(data)) {}
+
+        static constexpr bool fits(size_t size) { return size >= L::size; }
+
+        template <typename F>
+        constexpr typename F::type get() const {
+            static_assert(L::template contains<F>, "field is not part of this layout");
+            return load_be<typename F::type>(bytes + F::offset);
+        }
+
+        // What follows the header
+        constexpr const uint8_t* payload() const { return bytes + L::size; }
+
+    private:
+        const uint8_t* bytes;
+    };
+
+    // Writable view, for building a packet in its send buffer
+    template <typename L>
+    class MutableView {
+    public:
+        constexpr explicit MutableView(uint8_t* data) : bytes(data) {}
+        explicit MutableView(char* data) : bytes(reinterpret_cast<uint8_t*>(data)) {}
+
+        template <typename F>
+        constexpr typename F::type get() const {
+            static_assert(L::template contains<F>, "field is not part of this layout");
+            return load_be<typename F::type>(bytes + F::offset);
+        }
+
+        template <typename F>
+        constexpr void set(typename F::type value) {
+            static_assert(L::template contains<F>, "field is not part of this layout");
+            store_be<typename F::type>(bytes + F::offset, value);
+        }
+
+        constexpr uint8_t* payload() const { return bytes + L::size; }
+
+    private:
+        uint8_t* bytes;
+    };
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using sock_t = SOCKET;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+using sock_t = int;
+#endif
+
+// Path MTU discovery for UDP senders. Datagrams larger than the path MTU are split into
+// IP fragments, and losing any fragment loses the whole datagram, so senders size their
+// datagrams to fit one packet and set the don't-fragment bit. Routers on a narrower path
+// then answer with ICMP "fragmentation needed", the kernel lowers its path MTU estimate,
+// and the next oversized send fails with EMSGSIZE (WSAEMSGSIZE), prompting a re-query.
+namespace path_mtu {
+    constexpr size_t DEFAULT_MTU = 1500;         // Ethernet, when the kernel cannot tell
+    constexpr size_t MIN_MTU = 576;              // Every IPv4 host must accept this
+    constexpr size_t MAX_MTU = 65535;            // Loopback reports more than an IPv4 packet holds
+    constexpr size_t IPV4_UDP_OVERHEAD = 28;     // 20-byte IPv4 header + 8-byte UDP header
+
+    // Set the don't-fragment bit on outgoing datagrams.
+    bool disable_fragmentation(sock_t sock);
+
+    // The kernel's path MTU estimate towards `destination`, clamped to [MIN_MTU, MAX_MTU].
+    // Returns DEFAULT_MTU where the platform does not expose it.
+    size_t discover(const sockaddr_in& destination);
+
+    // MTU to use after a `datagram_size`-byte UDP payload failed with EMSGSIZE: the kernel's
+    // estimate if it has dropped below that packet, else the next common MTU below it (the
+    // RFC 1191 plateaus, plus 1500 and 1280), down to MIN_MTU. Without the fallback a platform
+    // that cannot report the path MTU would answer DEFAULT_MTU forever and every frame would fail.
+    size_t after_too_big(const sockaddr_in& destination, size_t datagram_size);
+
+    // Largest payload after a `header_size`-byte application header that still fits
+    // one IP packet of `mtu` bytes.
+    size_t chunk_size(size_t mtu, size_t header_size);
+
+    // Whether a send error means the datagram exceeds the path MTU.
+    bool is_too_big(int error);
+}
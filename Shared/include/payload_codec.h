@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Optional LZ4 compression of text payloads (telemetry, logs), negotiated per connection.
+// Build with HAVE_LZ4 defined and liblz4 linked to enable it; without it every peer
+// declines the negotiation and messages go out unchanged.
+//
+// Once both sides agree, every message carries a 1-byte header:
+//     RAW         payload follows as-is (small or incompressible payloads)
+//     LZ4         4-byte big-endian original size, then an LZ4 block
+//     LZ4_STORED  payload follows as-is, but it still enters the compression history
+// Streams keep the last 64 KB of data as history, so repetitive messages compress far
+// better than they would one by one. A preset dictionary primes that history.
+namespace payload_codec {
+    enum class Kind : uint8_t {
+        RAW = 0,
+        LZ4 = 1,
+        LZ4_STORED = 2
+    };
+
+    constexpr size_t MIN_COMPRESS_SIZE = 256; // Smaller payloads are never worth compressing
+    constexpr size_t HISTORY_SIZE = 64 * 1024;  // LZ4 match window
+    constexpr size_t MAX_DECODED_SIZE = 16 * 1024 * 1024;
+
+    // True if this build can compress.
+    bool available();
+
+    // Built-in dictionary of tokens common in our telemetry and log messages.
+    std::string_view default_dictionary();
+
+    // Negotiation: the initiating side sends hello(), the other answers with answer().
+    // Compression is only accepted when both sides have LZ4 and the same dictionary.
+    std::string hello(std::string_view dictionary);
+    bool is_hello(std::string_view message);
+    std::string answer(std::string_view hello_message, std::string_view dictionary, bool& accepted);
+    bool is_accepted(std::string_view answer_message);
+
+    // Compressing side of one stream. Move-only; the LZ4 state is only allocated on
+    // the first payload large enough to compress.
+    class Encoder {
+    public:
+        explicit Encoder(std::string_view dictionary = {});
+        ~Encoder();
+        Encoder(Encoder&& other) noexcept;
+        Encoder& operator=(Encoder&& other) noexcept;
+
+        // Encode one message; the view is valid until the next call.
+        std::string_view encode(std::string_view message);
+
+        // Stateless variant for datagrams, which may be lost or reordered: only the
+        // dictionary is used as history.
+        std::string_view encode_datagram(std::string_view message);
+
+        uint64_t bytes_in() const { return total_in; }
+        uint64_t bytes_out() const { return total_out; }
+
+    private:
+        struct State;
+
+        std::unique_ptr<State> state;
+        std::string dictionary;
+        std::string output;
+        uint64_t total_in = 0;
+        uint64_t total_out = 0;
+    };
+
+    // Decompressing side of one stream. Move-only.
+    class Decoder {
+    public:
+        explicit Decoder(std::string_view dictionary = {});
+        ~Decoder();
+        Decoder(Decoder&& other) noexcept;
+        Decoder& operator=(Decoder&& other) noexcept;
+
+        // Decode one message. The view is valid until the next call, and for uncompressed
+        // messages only as long as `encoded` is. Returns false on malformed input.
+        bool decode(std::string_view encoded, std::string_view& message);
+        bool decode_datagram(std::string_view encoded, std::string_view& message);
+
+    private:
+        void keep_history();
+        bool store(std::string_view payload, std::string_view& message);
+
+        std::string dictionary;
+        std::vector<char> window; // History followed by the last decoded message
+        size_t history = 0;       // Bytes of history at the front of window
+        size_t last = 0;          // Size of the last message stored after the history
+        std::string scratch;
+    };
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "packet_codec.h"
+
+// Uncompressed video payloads, for links fast enough that JPEG encode and decode cost more
+// time than the bandwidth they save (a 1080p frame is 3 MB in YUV420, about 0.75 Gbit/s at
+// 30 fps). Frames are converted to planar YUV420 (I420) with OpenCV's vectorized cvtColor,
+// optionally LZ4-compressed, and sent as the frame payload in the usual chunked format.
+//
+// A payload starts with a 16-byte header, big-endian: "NTRV", width and height (2 bytes
+// each), format (1 = I420), compression (0 = none, 1 = LZ4), 2 reserved bytes and the size
+// of the data that follows. JPEG payloads start with FF D8, so receivers tell them apart.
+namespace raw_video {
+    namespace wire {
+        using Tag = packet_codec::Field<uint32_t, 0>;
+        using Width = packet_codec::Field<uint16_t, 4>;
+        using Height = packet_codec::Field<uint16_t, 6>;
+        using Format = packet_codec::Field<uint8_t, 8>;
+        using Compression = packet_codec::Field<uint8_t, 9>;
+        using Reserved = packet_codec::Field<uint16_t, 10>;
+        using DataSize = packet_codec::Field<uint32_t, 12>;
+        using Header = packet_codec::Layout<Tag, Width, Height, Format, Compression, Reserved, DataSize>;
+    }
+
+    constexpr size_t HEADER_SIZE = wire::Header::size;
+    static_assert(HEADER_SIZE == 16, "the header size is part of the wire format");
+
+    enum class Compression : uint8_t {
+        NONE = 0,
+        LZ4 = 1,        // Falls back to NONE in builds without HAVE_LZ4, or when it does not help
+    };
+
+    // What the UDP video senders put in a frame
+    enum class Mode {
+        JPEG,
+        RAW,
+        RAW_LZ4,
+    };
+
+    // "jpeg", "raw" or "raw-lz4"
+    bool parse_mode(const std::string& text, Mode& mode);
+    const char* mode_name(Mode mode);
+    // From the VIDEO_PAYLOAD environment variable, JPEG when unset or invalid
+    Mode mode_from_environment();
+
+    // Whether an assembled frame holds a raw payload rather than a JPEG
+    bool is_raw(const uint8_t* data, size_t size);
+
+    class Encoder {
+    public:
+        // Convert a BGR frame into `payload`, reusing its capacity. An odd last row or column
+        // is dropped, since YUV420 shares chroma between pairs of both.
+        void encode(const cv::Mat& frame, Compression compression, std::vector<uint8_t>& payload);
+
+    private:
+        cv::Mat yuv;    // Only used when compressing; otherwise cvtColor writes into the payload
+    };
+
+    class Decoder {
+    public:
+        // Convert a payload back into a BGR frame. Returns false if it is malformed.
+        bool decode(const uint8_t* data, size_t size, cv::Mat& frame);
+
+    private:
+        std::vector<uint8_t> planes;    // Decompressed YUV420
+    };
+}
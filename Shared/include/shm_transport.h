@@ -0,0 +1,124 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Same-host video transport. The server writes each frame into one slot of a ring in named
+// shared memory (shm_open on POSIX, a pagefile-backed file mapping on Windows) and any number
+// of local receivers read it in place, with no encoding, sockets or copies on their side.
+//
+// One producer, many consumers, lock-free: a consumer holds a lease on the slot it is reading
+// so the producer writes around it, and always takes the newest frame, skipping any it was
+// too slow for. Leases are recorded with the consumer's process ID, so those of a consumer
+// that died holding one are taken back when they would stall the producer. Waiting consumers
+// sleep on the ring's frame counter (a futex on Linux, a named semaphore on Windows) and are
+// woken by each publish. Every producer creates a ring of its own, named after a generation
+// kept in a small segment under `name`, so it can start while an earlier ring is still mapped.
+namespace shm_transport {
+    constexpr const char* DEFAULT_NAME = "networktools_video";
+    constexpr uint32_t DEFAULT_SLOTS = 4;   // Newest frame, one being written, and room for leases
+
+    enum class Format : uint32_t {
+        BGR24 = 0,      // Raw OpenCV CV_8UC3 pixels, `stride` bytes per row
+        JPEG = 1,
+    };
+
+    struct FrameInfo {
+        uint32_t frame_id = 0;
+        Format format = Format::BGR24;
+        int32_t width = 0;
+        int32_t height = 0;
+        uint32_t stride = 0;
+        int64_t capture_us = 0;     // frame_trace::now_us() when captured, for latency on the same host
+    };
+
+    struct FrameView {
+        FrameInfo info;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+
+    // The mapping and its platform handles
+    struct Segment {
+        uint8_t* base = nullptr;
+        size_t size = 0;
+        std::string name;
+        void* mapping = nullptr;    // Windows only: file mapping handle
+        void* wake = nullptr;       // Windows only: semaphore standing in for a futex
+    };
+
+    class Producer {
+    public:
+        Producer() = default;
+        ~Producer();
+
+        Producer(const Producer&) = delete;
+        Producer& operator=(const Producer&) = delete;
+
+        // Create a ring with slot_count slots of slot_size bytes and make it the current one under
+        // `name`. Consumers of an earlier ring see it closed and reopen.
+        bool create(const std::string& name, size_t slot_size, uint32_t slot_count = DEFAULT_SLOTS);
+        // Tells consumers the stream ended, then unmaps and removes the ring.
+        void close();
+
+        // A slot no consumer is reading, to write a frame of `size` bytes into; nullptr if the
+        // frame does not fit or every slot is leased. Valid until publish().
+        uint8_t* begin_write(size_t size);
+        // Make the frame written since begin_write() the newest one and wake the consumers.
+        void publish(const FrameInfo& info);
+        // begin_write(), copy and publish(). Returns false if the frame was dropped.
+        bool publish(const FrameInfo& info, const uint8_t* data, size_t size);
+
+        size_t slot_size() const;
+        // Frames begin_write() had no slot for
+        uint64_t dropped() const { return dropped_frames; }
+
+    private:
+        Segment segment;
+        Segment index;
+        bool write_pending = false;
+        uint32_t writing = 0;       // Slot handed out by begin_write()
+        size_t writing_size = 0;
+        uint32_t next_slot = 0;
+        uint64_t dropped_frames = 0;
+    };
+
+    class Consumer {
+    public:
+        Consumer() = default;
+        ~Consumer();
+
+        Consumer(const Consumer&) = delete;
+        Consumer& operator=(const Consumer&) = delete;
+
+        // Map the current ring under `name`. Fails until a producer has created it, or when
+        // it already has its maximum of consumers.
+        bool open(const std::string& name);
+        void close();
+        bool is_open() const { return segment.base != nullptr; }
+
+        // Wait up to `timeout` for a frame newer than the last one returned. The frame's slot
+        // stays leased, so `view` stays valid, until the next call, release() or close().
+        bool next(FrameView& view, std::chrono::milliseconds timeout);
+        void release();
+
+        // Whether the producer has closed the ring; reopen to follow a restarted producer
+        bool producer_closed() const;
+        // Frames published but never returned because a newer one was already there
+        uint64_t skipped() const { return skipped_frames; }
+
+    private:
+        Segment segment;
+        int64_t lease = -1;         // This consumer's lease record in the ring
+        uint32_t last_sequence = 0;
+        int64_t held = -1;          // Leased slot, if any
+        uint64_t skipped_frames = 0;
+    };
+
+    // Whether `address` (dotted IPv4) is this host: loopback or one of its own addresses.
+    bool is_local(const char* address);
+    // Whether video to or from `address` should use this transport: the peer is local and
+    // the VIDEO_TRANSPORT environment variable does not ask for "udp".
+    bool use_for_peer(const char* address);
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "packet_codec.h"
+
+// Simulcast: the server encodes every captured frame once per quality layer, under the same
+// frame ID, and each receiver subscribes to the one layer its link can carry. Receivers send
+// a subscribe datagram to PORT from the socket they receive video on, and repeat it at least
+// every RESUBSCRIBE_INTERVAL; the server stops sending to a receiver it has not heard from
+// for SUBSCRIPTION_TIMEOUT. A changed subscription takes effect from the next captured frame,
+// and since frame IDs are shared by all layers, a receiver can switch without a gap.
+//
+// Subscriptions carry a cookie, so that a forged source address cannot turn the server
+// into a video cannon aimed at someone else: the server answers a subscribe without a valid
+// cookie with a challenge of the same size holding one, sent to the claimed address, and
+// only a receiver that got it can subscribe. Receivers repeat the cookie in every later
+// subscribe; it changes every few tens of seconds, and each change costs one more challenge.
+namespace simulcast {
+    struct Layer {
+        int width;
+        int height;
+        int quality;    // JPEG quality
+    };
+
+    // Best first: the layer index in chunk headers and subscriptions refers to this table
+    constexpr Layer LAYERS[] = {
+        { 1920, 1080, 85 },
+        { 1280, 720, 75 },
+        { 640, 360, 60 },
+    };
+    constexpr size_t LAYER_COUNT = sizeof(LAYERS) / sizeof(LAYERS[0]);
+
+    constexpr uint16_t PORT = 12346;
+    constexpr uint16_t UNSUBSCRIBE = 0xFFFF;     // Layer value to stop receiving at once
+    constexpr auto RESUBSCRIBE_INTERVAL = std::chrono::seconds(1);
+    constexpr auto SUBSCRIPTION_TIMEOUT = std::chrono::seconds(5);
+
+    // "SCST", then the layer as 2 bytes big-endian, 2 reserved bytes and the cookie (8 bytes, 0
+    // before the first challenge); challenges are "SCCK", 4 reserved bytes and the cookie
+    namespace wire {
+        using Tag = packet_codec::Field<uint32_t, 0>;
+        using Layer = packet_codec::Field<uint16_t, 4>;
+        using LayerReserved = packet_codec::Field<uint16_t, 6>;
+        using ChallengeReserved = packet_codec::Field<uint32_t, 4>;
+        using Cookie = packet_codec::Field<uint64_t, 8>;
+        using Subscribe = packet_codec::Layout<Tag, Layer, LayerReserved, Cookie>;
+        using Challenge = packet_codec::Layout<Tag, ChallengeReserved, Cookie>;
+    }
+
+    constexpr size_t SUBSCRIBE_SIZE = wire::Subscribe::size;
+    constexpr size_t CHALLENGE_SIZE = wire::Challenge::size;
+    static_assert(SUBSCRIBE_SIZE == 16 && CHALLENGE_SIZE == 16, "the sizes are part of the wire format");
+
+    void write_subscribe(char* out, uint16_t layer, uint64_t cookie);
+    // Returns false for anything that is not a subscribe datagram.
+    bool read_subscribe(const char* data, size_t size, uint16_t& layer, uint64_t& cookie);
+
+    void write_challenge(char* out, uint64_t cookie);
+    bool read_challenge(const char* data, size_t size, uint64_t& cookie);
+
+    // Receiver-side layer choice from the share of frames that arrive complete. A second
+    // with under STEP_DOWN_RATIO of the frames complete moves one layer down at once;
+    // STEP_UP_PERIODS clean seconds in a row move one layer up again.
+    class LayerSelector {
+    public:
+        static constexpr double STEP_DOWN_RATIO = 0.9;
+        static constexpr size_t STEP_UP_PERIODS = 5;
+
+        explicit LayerSelector(size_t layer_count = LAYER_COUNT, uint16_t start_layer = 0);
+
+        // Chunks and frames of other layers, still in flight after a switch, are ignored
+        void chunk_received(uint16_t layer, uint32_t frame_id);
+        void frame_completed(uint16_t layer);
+
+        // Close the current period, normally once a second. Returns true when the layer changed.
+        bool update();
+
+        uint16_t layer() const { return current; }
+        // Completed share of the frames sent during the last closed period
+        double completion() const { return last_completion; }
+
+    private:
+        void reset_period();
+
+        size_t layer_count;
+        uint16_t current;
+        bool seen = false;
+        uint32_t first_frame = 0;
+        uint32_t last_frame = 0;
+        size_t completed = 0;
+        size_t clean_periods = 0;
+        double last_completion = 1.0;
+    };
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Control channel for a live video stream: a TCP session next to the UDP video, over which a
+// client asks the server to change the stream while it runs. Each request is one message
+// (see message_framing) holding a text command, and gets one text reply starting with "OK"
+// or "ERROR". Changes are queued and applied by the sender between two frames, with the same
+// camera and socket, so they show from the next frame on.
+//
+//     refresh                  next frame at the top quality, e.g. after heavy loss
+//     resolution WxH           scale frames to WxH before encoding; 0x0 for the camera's own
+//     fps F                    capture and send F frames per second
+//     quality Q                highest JPEG quality the rate controller may pick
+//     destination IP[:PORT]    send the video elsewhere (the port stays when omitted)
+//     pause / resume           stop and restart sending; capture goes on
+//     stats                    reply with a snapshot of the stream's counters
+namespace stream_control {
+    constexpr uint16_t PORT = 12348;
+    constexpr int MAX_DIMENSION = 4096;
+    constexpr double MAX_FPS = 240.0;
+
+    enum class Type {
+        REFRESH,
+        RESOLUTION,
+        FPS,
+        QUALITY,
+        DESTINATION,
+        PAUSE,
+        RESUME,
+        STATS,
+    };
+
+    struct Command {
+        Type type = Type::STATS;
+        int width = 0;              // RESOLUTION
+        int height = 0;
+        double fps = 0;             // FPS
+        int quality = 0;            // QUALITY
+        std::string address;        // DESTINATION, a dotted IPv4 address
+        uint16_t port = 0;          // DESTINATION; 0 to keep the current one
+    };
+
+    // Returns false, with the reason in `error`, for anything that is not a valid command.
+    bool parse_command(std::string_view text, Command& command, std::string& error);
+
+    // The command list above, for help text
+    const char* usage();
+}
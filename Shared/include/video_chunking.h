@@ -0,0 +1,163 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "buffer_pool.h"
+#include "packet_codec.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using sock_t = SOCKET;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+using sock_t = int;
+#endif
+
+// Splitting of encoded video frames into UDP datagrams, and reassembly on the receiver.
+// Every datagram starts with a 44-byte header, big-endian (see wire below): version, packet
+// type and flags, frame ID, chunk ID and total chunk count (4 bytes each), stream ID and
+// layer (2 bytes each), the frame's capture time and this chunk's send time (8 bytes each,
+// frame_trace::now_us() on the sender's clock), then the CRC-32C of the whole frame and of
+// this datagram (4 bytes each), followed by up to max_chunk_size bytes of the frame. Frame
+// IDs are per stream, so several streams can share one socket; the layers of a simulcast
+// stream share frame IDs, so receivers can switch between them at any frame.
+//
+// The chunk CRC covers the header up to it and the chunk's bytes, so a corrupt chunk is
+// dropped on arrival rather than misplacing or spoiling a frame; the frame CRC catches
+// what is left, such as chunks of two senders reusing a frame ID, before a decode is tried.
+namespace video_chunking {
+    // Header layout, also for reading fields in place with packet_codec::View<wire::Header>
+    namespace wire {
+        using Version = packet_codec::Field<uint8_t, 0>;
+        using Type = packet_codec::Field<uint8_t, 1>;
+        using Flags = packet_codec::Field<uint16_t, 2>;
+        using FrameId = packet_codec::Field<uint32_t, 4>;
+        using ChunkId = packet_codec::Field<uint32_t, 8>;
+        using TotalChunks = packet_codec::Field<uint32_t, 12>;
+        using StreamId = packet_codec::Field<uint16_t, 16>;
+        using Layer = packet_codec::Field<uint16_t, 18>;
+        using CaptureUs = packet_codec::Field<int64_t, 20>;
+        using SendUs = packet_codec::Field<int64_t, 28>;
+        using FrameCrc = packet_codec::Field<uint32_t, 36>;
+        using ChunkCrc = packet_codec::Field<uint32_t, 40>;     // Last: covers everything before it
+        using Header = packet_codec::Layout<Version, Type, Flags, FrameId, ChunkId, TotalChunks,
+                                            StreamId, Layer, CaptureUs, SendUs, FrameCrc, ChunkCrc>;
+    }
+
+    // Bumped for changes older receivers cannot read; they drop such datagrams. Additions
+    // they can ignore go in the flags instead, which receivers pass through untouched.
+    constexpr uint8_t VERSION = 2;
+    enum class PacketType : uint8_t {
+        VIDEO_CHUNK = 1,
+    };
+    constexpr uint16_t FLAG_FRAME_CRC = 0x0001;     // The frame CRC field is set
+
+    constexpr size_t HEADER_SIZE = wire::Header::size;
+    static_assert(HEADER_SIZE == 44, "the header size is part of the wire format");
+    constexpr uint32_t MAX_CHUNKS = 4096;           // Receiver sanity bounds: a raw 1080p frame in MTU-sized chunks
+    constexpr size_t MAX_CHUNK_SIZE = 1024 * 1024;
+    constexpr uint32_t MAX_STREAMS = 16;
+    constexpr uint32_t MAX_LAYERS = 8;
+
+    struct ChunkHeader {
+        uint32_t frame_id = 0;
+        uint32_t chunk_id = 0;
+        uint32_t total_chunks = 0;
+        uint16_t stream_id = 0;
+        uint16_t layer = 0;
+        int64_t capture_us = 0;     // 0 when the sender does not record it
+        int64_t send_us = 0;
+        uint16_t flags = 0;         // FLAG_*
+        uint32_t frame_crc = 0;     // With FLAG_FRAME_CRC
+    };
+
+    // The chunk CRC is left to build_chunk() and send_chunk().
+    void write_header(char* out, const ChunkHeader& header);
+    // Returns false for datagrams too short, of another version or type, or outside the
+    // sanity bounds.
+    bool read_header(const char* datagram, size_t size, ChunkHeader& header);
+
+    // Whether a datagram's chunk CRC matches its header and bytes
+    bool verify_chunk(const char* datagram, size_t size);
+    // Whether a reassembled frame matches the frame CRC in its chunks' header; true for
+    // frames sent without one
+    bool verify_frame(const ChunkHeader& header, const uint8_t* frame, size_t size);
+
+    size_t chunk_count(size_t frame_size, size_t max_chunk_size);
+
+    // Write the datagram for one chunk of `frame` into `out`, which must hold
+    // HEADER_SIZE + max_chunk_size bytes. Returns the datagram size. `frame_crc` is
+    // crc32c::value() of the whole frame, computed once per frame by the caller.
+    size_t build_chunk(uint32_t frame_id, const uint8_t* frame, size_t frame_size,
+                       size_t chunk_id, size_t max_chunk_size, char* out,
+                       uint16_t stream_id = 0, uint16_t layer = 0,
+                       int64_t capture_us = 0, int64_t send_us = 0,
+                       std::optional<uint32_t> frame_crc = std::nullopt);
+
+    // Send the same datagram as build_chunk() with one gathered write of the header and the
+    // chunk's bytes in place (WSASendTo / sendmsg), so a frame that is already in memory, such
+    // as a mapped file, is never copied into a datagram buffer. Returns the datagram size, or
+    // -1 with the error in WSAGetLastError() / errno.
+    int send_chunk(sock_t sock, const sockaddr_in& destination, uint32_t frame_id, const uint8_t* frame,
+                   size_t frame_size, size_t chunk_id, size_t max_chunk_size,
+                   uint16_t stream_id = 0, uint16_t layer = 0,
+                   int64_t capture_us = 0, int64_t send_us = 0,
+                   std::optional<uint32_t> frame_crc = std::nullopt);
+
+    // Collects chunks per frame of one stream until a frame is complete.
+    // A frame is only started by its chunk 0; at most max_frames incomplete frames are
+    // kept, the oldest are dropped first. Frame slots and chunk buffers are recycled, so
+    // once warmed up, reassembly does not allocate.
+    class Reassembler {
+    public:
+        enum class Status { STORED, COMPLETE, REJECTED };
+
+        explicit Reassembler(size_t max_frames = 30);
+
+        Status add(const ChunkHeader& header, const uint8_t* data, size_t size);
+        // Concatenate a complete frame into `frame` and forget it. Reusing `frame`
+        // across calls keeps its allocation.
+        bool take(uint32_t frame_id, std::vector<uint8_t>& frame);
+
+        size_t pending_frames() const;
+
+    private:
+        struct Slot {
+            bool used = false;
+            uint32_t frame_id = 0;
+            uint32_t total_chunks = 0;
+            uint32_t received = 0;
+            std::vector<std::vector<uint8_t>> chunks; // Empty until received
+        };
+
+        Slot* find(uint32_t frame_id);
+        void clear(Slot& slot);
+
+        std::vector<Slot> slots;
+        buffer_pool::Pool chunk_pool;
+    };
+
+    // Spreads datagrams out at a bit rate, so that a frame's chunks do not leave as one burst
+    // that overflows the receiver's socket buffer or a router queue on the way. Sleeps come
+    // in steps of a millisecond or more, about the resolution of system timers, with the
+    // datagrams in between sent back to back. A rate of 0 never waits.
+    class Pacer {
+    public:
+        explicit Pacer(double bits_per_second = 0) : rate(bits_per_second) {}
+
+        // Wait until the next datagram may go
+        void wait();
+        void sent(size_t bytes);
+
+    private:
+        double rate;
+        std::chrono::steady_clock::time_point next{};
+    };
+
+    // Look for the JPEG end-of-image marker (FF D9), scanning back from the end.
+    bool has_jpeg_end_marker(const uint8_t* data, size_t size);
+}
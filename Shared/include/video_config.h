@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Settings of the video demos, read at startup instead of being compiled in. A config file
+// holds one "key = value" per line, with # starting a comment:
+//     client_ip = 192.168.1.20
+//     receive_buffer = 8M
+// The command line takes the same keys as options ("--client_ip 192.168.1.20", dashes or
+// underscores), applied over the file named by --config, or over video.conf in the working
+// directory when there is one. Bench autotune writes its best settings in this format.
+namespace video_config {
+    constexpr const char* DEFAULT_FILE = "video.conf";
+
+    struct Settings {
+        uint16_t video_port = 12345;
+        std::string client_ip = "127.0.0.1";    // Where the server sends UDP video
+        std::string server_ip = "127.0.0.1";    // Where the client connects and subscribes
+        double target_fps = 30.0;
+        size_t max_chunk_size = 0;              // Frame bytes per datagram; 0 for the largest one packet of the path carries
+        size_t buffer_size = 262144;            // Client datagram buffer
+        int send_buffer = 262144;               // SO_SNDBUF of the server's video socket; raw payloads get at least 8 MB
+        int receive_buffer = 8 * 1024 * 1024;   // SO_RCVBUF of the client's video socket
+        int min_quality = 30;                   // JPEG quality bounds of the rate controller
+        int max_quality = 90;
+        double pacing_rate = 0;                 // Bits per second chunks are spread at; 0 sends each frame at once
+    };
+
+    // Parse "8M"-style numbers: rates with decimal k/M/G suffixes, sizes with binary ones.
+    bool parse_rate(const std::string& text, double& value);
+    bool parse_size(const std::string& text, size_t& value);
+
+    // One setting, by its key in a config file. Returns false for unknown keys and invalid values.
+    bool set(Settings& settings, const std::string& key, const std::string& value);
+    // Whether the settings are consistent with each other, reporting the first problem
+    bool validate(const Settings& settings);
+
+    bool load(const std::string& path, Settings& settings);
+    bool save(const std::string& path, const Settings& settings);
+    void write(std::ostream& out, const Settings& settings);
+
+    // Apply the config file, then the --key value options. Arguments that are not options go
+    // to `positional`, in order. Returns false, after printing the problem and the keys, on
+    // anything it cannot apply.
+    bool from_command_line(int argc, char* argv[], Settings& settings, std::vector<std::string>& positional);
+    void print_usage(const char* program);
+}